@@ -0,0 +1,225 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file crash_log_upload.c
+ * @brief Publish the records kept from a crashed boot to <thing name>/crashlog,
+ * then release them so the crash log ring can be reused.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#include "logging.h"
+
+/* Standard includes. */
+#include <stdio.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "kvstore.h"
+
+#include "mqtt_agent_task.h"
+#include "mqtt_publish_queue.h"
+#include "crash_log.h"
+
+#define CRASH_LOG_UPLOAD_TOPIC_LEN        ( 160 )
+#define CRASH_LOG_UPLOAD_MAX_PAYLOAD      ( 1024 )
+#define CRASH_LOG_UPLOAD_QOS              ( MQTTQoS1 )
+#define CRASH_LOG_UPLOAD_TIMEOUT_MS       ( 10000 )
+#define CRASH_LOG_UPLOAD_RETRY_DELAY_MS   ( 30000 )
+
+/* Fixed part of a line: seq, boot, ms, type and separators */
+#define CRASH_LOG_UPLOAD_LINE_MAX         ( 40 + CRASH_LOG_DATA_LEN )
+
+/*-----------------------------------------------------------*/
+
+/* Fill pcPayload with as many records as fit, starting at *pulSeq */
+static size_t prvFillPayload( char * pcPayload,
+                              uint32_t * pulSeq,
+                              uint32_t ulEndSeq )
+{
+    CrashLogRecord_t xRecord;
+    size_t uxLen = 0;
+
+    while( ( *pulSeq != ulEndSeq ) &&
+           ( ( uxLen + CRASH_LOG_UPLOAD_LINE_MAX ) <= CRASH_LOG_UPLOAD_MAX_PAYLOAD ) )
+    {
+        if( CrashLog_ReadRecord( *pulSeq, &xRecord ) == pdTRUE )
+        {
+            int lLen = snprintf( &pcPayload[ uxLen ], CRASH_LOG_UPLOAD_MAX_PAYLOAD - uxLen,
+                                 "%lu %u %lu %s %.*s\n",
+                                 ( unsigned long ) xRecord.ulSeq,
+                                 ( unsigned int ) xRecord.usBoot,
+                                 ( unsigned long ) ( xRecord.ulTick * portTICK_PERIOD_MS ),
+                                 CrashLog_TypeToString( xRecord.ucType ),
+                                 ( int ) xRecord.ucLen,
+                                 xRecord.pcData );
+
+            if( lLen > 0 )
+            {
+                uxLen += ( size_t ) lLen;
+            }
+        }
+
+        ( *pulSeq )++;
+    }
+
+    return uxLen;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvUploadCrash( MQTTAgentPublishQueueHandle_t xPublishQueue,
+                                  const char * pcTopic,
+                                  char * pcPayload )
+{
+    BaseType_t xSuccess = pdTRUE;
+    CrashLogInfo_t xInfo;
+    MQTTAgentPublishStats_t xStats;
+    uint32_t ulFailedBefore = 0;
+    uint32_t ulSeq = 0;
+
+    CrashLog_GetInfo( &xInfo );
+
+    /* Released from the CLI in the meantime */
+    if( xInfo.ulPinnedSeq == CRASH_LOG_SEQ_NONE )
+    {
+        return pdTRUE;
+    }
+
+    MqttAgent_PublishQueueGetStats( xPublishQueue, &xStats );
+    ulFailedBefore = xStats.ulFailed;
+
+    ulSeq = xInfo.ulPinnedSeq;
+
+    while( ( xSuccess == pdTRUE ) && ( ulSeq != xInfo.ulBootFirstSeq ) )
+    {
+        size_t uxLen = prvFillPayload( pcPayload, &ulSeq, xInfo.ulBootFirstSeq );
+
+        if( uxLen > 0 )
+        {
+            MQTTStatus_t xStatus = MqttAgent_PublishAsync( xPublishQueue, pcTopic, CRASH_LOG_UPLOAD_QOS,
+                                                           pcPayload, uxLen,
+                                                           pdMS_TO_TICKS( CRASH_LOG_UPLOAD_TIMEOUT_MS ) );
+
+            if( xStatus != MQTTSuccess )
+            {
+                LogError( "Failed to publish crash log, status: %d.", xStatus );
+                xSuccess = pdFALSE;
+            }
+        }
+    }
+
+    /* Wait for every publish to be acknowledged before releasing the records */
+    do
+    {
+        MqttAgent_PublishQueueGetStats( xPublishQueue, &xStats );
+    }
+    while( ( xStats.uxOutstanding > 0 ) &&
+           ( MqttAgent_PublishQueueReap( xPublishQueue, pdMS_TO_TICKS( CRASH_LOG_UPLOAD_TIMEOUT_MS ) ) > 0 ) );
+
+    MqttAgent_PublishQueueGetStats( xPublishQueue, &xStats );
+
+    if( ( xStats.uxOutstanding > 0 ) || ( xStats.ulFailed != ulFailedBefore ) )
+    {
+        xSuccess = pdFALSE;
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+void vCrashLogUploadTask( void * pvParameters )
+{
+    MQTTAgentPublishQueueHandle_t xPublishQueue = NULL;
+    char pcTopic[ CRASH_LOG_UPLOAD_TOPIC_LEN ] = { 0 };
+    char * pcPayload = NULL;
+    char * pcThingName = NULL;
+    CrashLogInfo_t xInfo;
+    int lTopicLen = 0;
+
+    ( void ) pvParameters;
+
+    CrashLog_GetInfo( &xInfo );
+
+    if( xInfo.ulPinnedSeq == CRASH_LOG_SEQ_NONE )
+    {
+        LogDebug( "No crash to upload." );
+        vTaskDelete( NULL );
+    }
+
+    pcThingName = KVStore_getStringHeap( CS_CORE_THING_NAME, NULL );
+
+    if( pcThingName != NULL )
+    {
+        lTopicLen = snprintf( pcTopic, sizeof( pcTopic ), "%s/crashlog", pcThingName );
+        vPortFree( pcThingName );
+    }
+
+    pcPayload = pvPortMalloc( CRASH_LOG_UPLOAD_MAX_PAYLOAD );
+
+    vSleepUntilMQTTAgentReady();
+
+    xPublishQueue = MqttAgent_PublishQueueCreate( xGetMqttAgentHandle(), 2, CRASH_LOG_UPLOAD_MAX_PAYLOAD );
+
+    if( ( lTopicLen <= 0 ) || ( lTopicLen >= ( int ) sizeof( pcTopic ) ) )
+    {
+        LogError( "Failed to construct the crash log topic." );
+    }
+    else if( ( pcPayload == NULL ) || ( xPublishQueue == NULL ) )
+    {
+        LogError( "Failed to allocate crash log upload buffers." );
+    }
+    else
+    {
+        for( ; ; )
+        {
+            vSleepUntilMQTTAgentConnected();
+
+            if( prvUploadCrash( xPublishQueue, pcTopic, pcPayload ) == pdTRUE )
+            {
+                CrashLog_Release();
+                LogInfo( "Crash log uploaded to %s.", pcTopic );
+                break;
+            }
+
+            vTaskDelay( pdMS_TO_TICKS( CRASH_LOG_UPLOAD_RETRY_DELAY_MS ) );
+        }
+    }
+
+    if( xPublishQueue != NULL )
+    {
+        MqttAgent_PublishQueueDelete( xPublishQueue );
+    }
+
+    vPortFree( pcPayload );
+
+    vTaskDelete( NULL );
+}
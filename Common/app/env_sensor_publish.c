@@ -50,6 +50,8 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "mqtt_publish_queue.h"
+#include "mqtt_publish_spool.h"
 
 /* Sensor includes */
 #include "hts221.h"
@@ -67,23 +69,12 @@ static LPS22HH_Object_t LPS22HH_Obj;
 #define MQTT_PUBLISH_TOPIC                   "env_sensor_data"
 #define MQTT_PUBLICH_TOPIC_STR_LEN           ( 256 )
 #define MQTT_PUBLISH_BLOCK_TIME_MS           ( 1000 )
-#define MQTT_PUBLISH_NOTIFICATION_WAIT_MS    ( 1000 )
+#define MQTT_PUBLISH_QUEUE_DEPTH             ( 4 )
 
-#define MQTT_NOTIFY_IDX                      ( 1 )
 #define MQTT_PUBLISH_QOS                     ( MQTTQoS0 )
 
 /*-----------------------------------------------------------*/
 
-/**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
- */
-struct MQTTAgentCommandContext
-{
-  MQTTStatus_t xReturnStatus;
-  TaskHandle_t xTaskToNotify;
-};
-
 typedef struct
 {
   float_t fTemperature0;
@@ -94,70 +85,6 @@ typedef struct
 
 /*-----------------------------------------------------------*/
 
-static void prvPublishCommandCallback(MQTTAgentCommandContext_t *pxCommandContext, MQTTAgentReturnInfo_t *pxReturnInfo)
-{
-  configASSERT(pxCommandContext != NULL);
-  configASSERT(pxReturnInfo != NULL);
-
-  pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
-
-  if (pxCommandContext->xTaskToNotify != NULL)
-  {
-    /* Send the context's ulNotificationValue as the notification value so
-     * the receiving task can check the value it set in the context matches
-     * the value it receives in the notification. */
-    (void) xTaskNotifyGiveIndexed(pxCommandContext->xTaskToNotify, MQTT_NOTIFY_IDX);
-  }
-}
-
-/*-----------------------------------------------------------*/
-
-static BaseType_t prvPublishAndWaitForAck(MQTTAgentHandle_t xAgentHandle, const char *pcTopic, const void *pvPublishData, size_t xPublishDataLen)
-{
-  BaseType_t xResult = pdFALSE;
-  MQTTStatus_t xStatus;
-
-  configASSERT(pcTopic != NULL);
-  configASSERT(pvPublishData != NULL);
-  configASSERT(xPublishDataLen > 0);
-
-  MQTTPublishInfo_t xPublishInfo =
-  { .qos = MQTT_PUBLISH_QOS, .retain = 0, .dup = 0, .pTopicName = pcTopic, .topicNameLength = strlen(pcTopic), .pPayload = pvPublishData, .payloadLength = xPublishDataLen };
-
-  MQTTAgentCommandContext_t xCommandContext =
-  { .xTaskToNotify = xTaskGetCurrentTaskHandle(), .xReturnStatus = MQTTIllegalState, };
-
-  MQTTAgentCommandInfo_t xCommandParams =
-  { .blockTimeMs = MQTT_PUBLISH_BLOCK_TIME_MS, .cmdCompleteCallback = prvPublishCommandCallback, .pCmdCompleteCallbackContext = &xCommandContext, };
-
-  /* Clear the notification index */
-  xTaskNotifyStateClearIndexed(NULL, MQTT_NOTIFY_IDX);
-
-  xStatus = MQTTAgent_Publish(xAgentHandle, &xPublishInfo, &xCommandParams);
-
-  if (xStatus == MQTTSuccess)
-  {
-    xResult = ulTaskNotifyTakeIndexed(MQTT_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ));
-
-    if (xResult == 0)
-    {
-      LogError("Timed out while waiting for publish ACK or Sent event. xTimeout = %d", pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ));
-      xResult = pdFALSE;
-    }
-    else if (xCommandContext.xReturnStatus != MQTTSuccess)
-    {
-      LogError("MQTT Agent returned error code: %d during publish operation.", xCommandContext.xReturnStatus);
-      xResult = pdFALSE;
-    }
-  }
-  else
-  {
-    LogError("MQTTAgent_Publish returned error code: %d.", xStatus);
-  }
-
-  return xResult;
-}
-
 static BaseType_t xIsMqttConnected(void)
 {
   /* Wait for MQTT to be connected */
@@ -283,7 +210,7 @@ void vEnvironmentSensorPublishTask(void *pvParameters)
   BaseType_t xResult = pdFALSE;
   BaseType_t xExitFlag = pdFALSE;
   char payloadBuf[MQTT_PUBLISH_MAX_LEN];
-  MQTTAgentHandle_t xAgentHandle = NULL;
+  MQTTAgentPublishQueueHandle_t xPublishQueue = NULL;
   char pcTopicString[MQTT_PUBLICH_TOPIC_STR_LEN] =  { 0 };
   char * pcDeviceId = NULL;
   size_t uxTopicLen = 0;
@@ -317,7 +244,13 @@ void vEnvironmentSensorPublishTask(void *pvParameters)
 
   vSleepUntilMQTTAgentReady();
 
-  xAgentHandle = xGetMqttAgentHandle();
+  xPublishQueue = MqttAgent_PublishQueueCreate(xGetMqttAgentHandle(), MQTT_PUBLISH_QUEUE_DEPTH, MQTT_PUBLISH_MAX_LEN);
+
+  if (xPublishQueue == NULL)
+  {
+    LogError("Failed to allocate publish queue.");
+    xExitFlag = pdTRUE;
+  }
 
   while (xExitFlag == pdFALSE)
   {
@@ -326,6 +259,9 @@ void vEnvironmentSensorPublishTask(void *pvParameters)
 
     vTaskSetTimeOutState(&xTimeOut);
 
+    /* Collect the publishes completed since the previous period */
+    (void) MqttAgent_PublishQueueReap(xPublishQueue, 0);
+
     EnvironmentalSensorData_t xEnvData;
     xResult = xUpdateSensorData(&xEnvData);
 
@@ -333,7 +269,7 @@ void vEnvironmentSensorPublishTask(void *pvParameters)
     {
       LogError("Error while reading sensor data.");
     }
-    else if (xIsMqttConnected() == pdTRUE)
+    else
     {
       int bytesWritten = 0;
 
@@ -341,9 +277,38 @@ void vEnvironmentSensorPublishTask(void *pvParameters)
       bytesWritten = snprintf(payloadBuf,
       MQTT_PUBLISH_MAX_LEN, "{ \"temp_0_c\": %f, \"rh_pct\": %f, \"temp_1_c\": %f, \"baro_mbar\": %f }", xEnvData.fTemperature0, xEnvData.fHumidity, xEnvData.fTemperature1, xEnvData.fBarometricPressure);
 
-      if (bytesWritten < MQTT_PUBLISH_MAX_LEN)
+      if ((bytesWritten > 0) && (bytesWritten < MQTT_PUBLISH_MAX_LEN))
       {
-        xResult = prvPublishAndWaitForAck(xAgentHandle, pcTopicString, payloadBuf, bytesWritten);
+        MQTTStatus_t xStatus = MQTTNotConnected;
+
+#if DEMO_PUBLISH_SPOOL
+        /* Publish live only once older spooled readings have been sent */
+        if ((xIsMqttConnected() == pdTRUE) && MqttSpool_IsEmpty())
+#else
+        if (xIsMqttConnected() == pdTRUE)
+#endif
+        {
+          xStatus = MqttAgent_PublishAsync(xPublishQueue, pcTopicString, MQTT_PUBLISH_QOS, payloadBuf, bytesWritten, pdMS_TO_TICKS( MQTT_PUBLISH_BLOCK_TIME_MS ));
+
+          if (xStatus != MQTTSuccess)
+          {
+            LogError("MqttAgent_PublishAsync returned error code: %d.", xStatus);
+          }
+        }
+
+        if (xStatus == MQTTSuccess)
+        {
+          xResult = pdTRUE;
+        }
+        else
+        {
+#if DEMO_PUBLISH_SPOOL
+          xResult = MqttSpool_Enqueue(pcTopicString, MQTT_PUBLISH_QOS, payloadBuf, bytesWritten) ? pdTRUE : pdFALSE;
+#else
+          /* Without the spool, readings taken while offline are dropped */
+          xResult = pdFALSE;
+#endif
+        }
       }
       else if (bytesWritten > 0)
       {
@@ -57,6 +57,8 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "mqtt_publish_queue.h"
+#include "mqtt_publish_spool.h"
 
 /* Sensor includes */
 #include "ism330dhcx.h"
@@ -80,130 +82,12 @@ static IIS2MDC_Axes_t    xMagnetoAxes;
 #define MQTT_PUBLISH_PERIOD_MS               ( 500 )
 #define MQTT_PUBLICH_TOPIC_STR_LEN           ( 256 )
 #define MQTT_PUBLISH_BLOCK_TIME_MS           ( 200 )
-#define MQTT_PUBLISH_NOTIFICATION_WAIT_MS    ( 1000 )
-#define MQTT_NOTIFY_IDX                      ( 1 )
-#define MQTT_PUBLISH_QOS                     ( MQTTQoS0 )
-
-/*-----------------------------------------------------------*/
-
-/**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
- */
-struct MQTTAgentCommandContext
-{
-    MQTTStatus_t xReturnStatus;
-    TaskHandle_t xTaskToNotify;
-    uint32_t ulNotificationValue;
-};
+#define MQTT_PUBLISH_QUEUE_DEPTH             ( 4 )
 
-/*-----------------------------------------------------------*/
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo )
-{
-    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pxCommandContext;
-
-    configASSERT( pxReturnInfo != NULL );
-
-    uint32_t ulNotifyValue = pxReturnInfo->returnCode;
-
-    if( xTaskHandle != NULL )
-    {
-        /* Send the context's ulNotificationValue as the notification value so
-         * the receiving task can check the value it set in the context matches
-         * the value it receives in the notification. */
-        ( void ) xTaskNotifyIndexed( xTaskHandle,
-                                     MQTT_NOTIFY_IDX,
-                                     ulNotifyValue,
-                                     eSetValueWithOverwrite );
-    }
-}
+#define MQTT_PUBLISH_QOS                     ( MQTTQoS0 )
 
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvPublishAndWaitForAck( MQTTAgentHandle_t xAgentHandle,
-                                           const char * pcTopic,
-                                           const void * pvPublishData,
-                                           size_t xPublishDataLen )
-{
-    MQTTStatus_t xStatus;
-    size_t uxTopicLen = 0;
-
-    configASSERT( pcTopic != NULL );
-    configASSERT( pvPublishData != NULL );
-    configASSERT( xPublishDataLen > 0 );
-
-    uxTopicLen = strnlen( pcTopic, UINT16_MAX );
-
-    MQTTPublishInfo_t xPublishInfo =
-    {
-        .qos             = MQTT_PUBLISH_QOS,
-        .retain          = 0,
-        .dup             = 0,
-        .pTopicName      = pcTopic,
-        .topicNameLength = ( uint16_t ) uxTopicLen,
-        .pPayload        = pvPublishData,
-        .payloadLength   = xPublishDataLen
-    };
-
-    MQTTAgentCommandInfo_t xCommandParams =
-    {
-        .blockTimeMs                 = MQTT_PUBLISH_BLOCK_TIME_MS,
-        .cmdCompleteCallback         = prvPublishCommandCallback,
-        .pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle(),
-    };
-
-    if( xPublishInfo.qos > MQTTQoS0 )
-    {
-        xCommandParams.pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle();
-    }
-
-    /* Clear the notification index */
-    xTaskNotifyStateClearIndexed( NULL, MQTT_NOTIFY_IDX );
-
-
-    xStatus = MQTTAgent_Publish( xAgentHandle,
-                                 &xPublishInfo,
-                                 &xCommandParams );
-
-    if( xStatus == MQTTSuccess )
-    {
-        uint32_t ulNotifyValue = 0;
-        BaseType_t xResult = pdFALSE;
-
-        xResult = xTaskNotifyWaitIndexed( MQTT_NOTIFY_IDX,
-                                          0xFFFFFFFF,
-                                          0xFFFFFFFF,
-                                          &ulNotifyValue,
-                                          pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-
-        if( xResult )
-        {
-            xStatus = ( MQTTStatus_t ) ulNotifyValue;
-
-            if( xStatus != MQTTSuccess )
-            {
-                LogError( "MQTT Agent returned error code: %d during publish operation.",
-                          xStatus );
-                xResult = pdFALSE;
-            }
-        }
-        else
-        {
-            LogError( "Timed out while waiting for publish ACK or Sent event. xTimeout = %d",
-                      pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-            xResult = pdFALSE;
-        }
-    }
-    else
-    {
-        LogError( "MQTTAgent_Publish returned error code: %d.", xStatus );
-    }
-
-    return( xStatus == MQTTSuccess );
-}
-
-/*-----------------------------------------------------------*/
 static BaseType_t xInitSensors(void)
 {
 #if USE_SENSORS
@@ -286,7 +170,7 @@ void vMotionSensorsPublish( void * pvParameters )
     BaseType_t xResult = pdFALSE;
     BaseType_t xExitFlag = pdFALSE;
 
-    MQTTAgentHandle_t xAgentHandle = NULL;
+    MQTTAgentPublishQueueHandle_t xPublishQueue = NULL;
     char pcPayloadBuf[ MQTT_PUBLISH_MAX_LEN ];
     char pcTopicString[ MQTT_PUBLICH_TOPIC_STR_LEN ] = { 0 };
     char * pcDeviceId = NULL;
@@ -319,10 +203,21 @@ void vMotionSensorsPublish( void * pvParameters )
 
     vSleepUntilMQTTAgentReady();
 
-    xAgentHandle = xGetMqttAgentHandle();
+    xPublishQueue = MqttAgent_PublishQueueCreate( xGetMqttAgentHandle(),
+                                                  MQTT_PUBLISH_QUEUE_DEPTH,
+                                                  MQTT_PUBLISH_MAX_LEN );
+
+    if( xPublishQueue == NULL )
+    {
+        LogError( "Failed to allocate publish queue." );
+        xExitFlag = pdTRUE;
+    }
 
     while( xExitFlag == pdFALSE )
     {
+        /* Collect the publishes completed since the previous period */
+        ( void ) MqttAgent_PublishQueueReap( xPublishQueue, 0 );
+
 #if USE_SENSORS
       /* Interpret sensor data */
         int32_t lBspError = BSP_ERROR_NONE;
@@ -360,23 +255,45 @@ void vMotionSensorsPublish( void * pvParameters )
                                           xGyroAxes.x, xGyroAxes.y, xGyroAxes.z,
                                           xMagnetoAxes.x, xMagnetoAxes.y, xMagnetoAxes.z );
 
-            if( ( lbytesWritten < MQTT_PUBLISH_MAX_LEN ) &&
-                ( xIsMqttAgentConnected() == pdTRUE ) )
+            if( ( lbytesWritten > 0 ) && ( lbytesWritten < MQTT_PUBLISH_MAX_LEN ) )
             {
-                xResult = prvPublishAndWaitForAck( xAgentHandle,
-                                                   pcTopicString,
-                                                   pcPayloadBuf,
-                                                   ( size_t ) lbytesWritten );
+                MQTTStatus_t xStatus = MQTTNotConnected;
 
-                if( xResult != pdPASS )
+#if DEMO_PUBLISH_SPOOL
+                /* Publish live only once older spooled readings have been sent */
+                if( ( xIsMqttAgentConnected() == pdTRUE ) && MqttSpool_IsEmpty() )
+#else
+                if( xIsMqttAgentConnected() == pdTRUE )
+#endif
                 {
-                    LogError( "Failed to publish motion sensor data" );
+                    xStatus = MqttAgent_PublishAsync( xPublishQueue,
+                                                      pcTopicString,
+                                                      MQTT_PUBLISH_QOS,
+                                                      pcPayloadBuf,
+                                                      ( size_t ) lbytesWritten,
+                                                      pdMS_TO_TICKS( MQTT_PUBLISH_BLOCK_TIME_MS ) );
+
+                    if( xStatus != MQTTSuccess )
+                    {
+                        LogError( "Failed to publish motion sensor data, xStatus=%s.",
+                                  MQTT_Status_strerror( xStatus ) );
+                    }
                 }
+
+#if DEMO_PUBLISH_SPOOL
+                if( ( xStatus != MQTTSuccess ) &&
+                    !MqttSpool_Enqueue( pcTopicString, MQTT_PUBLISH_QOS, pcPayloadBuf, ( size_t ) lbytesWritten ) )
+                {
+                    LogError( "Failed to spool motion sensor data." );
+                }
+#endif
             }
         }
 
         vTaskDelay( pdMS_TO_TICKS( MQTT_PUBLISH_PERIOD_MS ) );
     }
 
+    MqttAgent_PublishQueueDelete( xPublishQueue );
+
     vPortFree( pcDeviceId );
 }
@@ -39,14 +39,37 @@
 /* Standard includes. */
 #include <string.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <assert.h>
 
 /* Kernel includes. */
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 
 /* Header include. */
 #include "freertos_command_pool.h"
 
+/*
+ * The free list is a singly linked list of pool indexes threaded through
+ * pusNextFree. Its head packs the index of the first free structure in the low
+ * 16 bits and a modification tag in the high 16 bits. The tag is incremented on
+ * every update of the head so that a compare-and-swap based on a stale head
+ * fails even if the same index was released and re-acquired in the meantime
+ * (ABA). On Cortex-M33 these atomics compile to LDREX/STREX sequences, so
+ * acquiring or releasing a command never enters a critical section.
+ *
+ * A task that finds the list empty registers in ulWaiters and blocks on
+ * xFreeSignal. Agent_ReleaseCommand only gives the semaphore while a waiter
+ * is registered, so the fast paths never call into the kernel.
+ */
+#define POOL_INDEX_NONE         ( 0xFFFFU )
+#define POOL_HEAD_INDEX( x )    ( ( uint16_t ) ( ( x ) & 0xFFFFU ) )
+#define POOL_HEAD_TAG( x )      ( ( uint16_t ) ( ( x ) >> 16 ) )
+#define POOL_HEAD( tag, idx )   ( ( ( uint32_t ) ( tag ) << 16 ) | ( uint32_t ) ( idx ) )
+
+static_assert( MQTT_COMMAND_CONTEXTS_POOL_SIZE < POOL_INDEX_NONE, "Command pool index must fit in 16 bits." );
+
 /**
  * @brief The pool of command structures used to hold information on commands (such
  * as PUBLISH or SUBSCRIBE) between the command being created by an API call and
@@ -54,23 +77,98 @@
  */
 static MQTTAgentCommand_t commandStructurePool[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
 
-static QueueHandle_t xCommandPoolQueue = NULL;
+static atomic_uint_least16_t pusNextFree[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+static atomic_bool pxInUse[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+static atomic_uint_least32_t ulFreeHead = POOL_HEAD( 0, POOL_INDEX_NONE );
+static atomic_bool xPoolInitialized = false;
+
+static atomic_uint_least32_t ulWaiters = 0;
+static SemaphoreHandle_t xFreeSignal = NULL;
+static StaticSemaphore_t xFreeSignalStorage;
+
+static atomic_uint_least32_t ulInUse = 0;
+static atomic_uint_least32_t ulHighWaterMark = 0;
+static atomic_uint_least32_t ulAllocFailures = 0;
+static atomic_uint_least32_t ulTotalWaitMs = 0;
+static atomic_uint_least32_t ulMaxWaitMs = 0;
 
 /*-----------------------------------------------------------*/
 
-void Agent_InitializePool( void )
+static inline void prvAtomicMax( atomic_uint_least32_t * pulTarget,
+                                 uint32_t ulValue )
+{
+    uint32_t ulCurrent = atomic_load_explicit( pulTarget, memory_order_relaxed );
+
+    while( ( ulValue > ulCurrent ) &&
+           !atomic_compare_exchange_weak_explicit( pulTarget, &ulCurrent, ulValue,
+                                                   memory_order_relaxed,
+                                                   memory_order_relaxed ) )
+    {
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTAgentCommand_t * prvPoolPop( void )
 {
-    if( xCommandPoolQueue == NULL )
+    uint32_t ulHead = atomic_load_explicit( &ulFreeHead, memory_order_acquire );
+    uint32_t ulNewHead = 0;
+    uint16_t usIdx = POOL_INDEX_NONE;
+
+    do
     {
-        xCommandPoolQueue = xQueueCreate( MQTT_COMMAND_CONTEXTS_POOL_SIZE, sizeof( MQTTAgentCommand_t * ) );
+        usIdx = POOL_HEAD_INDEX( ulHead );
 
-        /* Populate the queue with pointers to each command structure. */
-        for( uint32_t ulIdx = 0; ulIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE; ulIdx++ )
+        if( usIdx == POOL_INDEX_NONE )
         {
-            MQTTAgentCommand_t * pCommand = &commandStructurePool[ ulIdx ];
+            break;
+        }
+
+        ulNewHead = POOL_HEAD( POOL_HEAD_TAG( ulHead ) + 1U,
+                               atomic_load_explicit( &( pusNextFree[ usIdx ] ), memory_order_relaxed ) );
+    } while( !atomic_compare_exchange_weak_explicit( &ulFreeHead, &ulHead, ulNewHead,
+                                                     memory_order_acquire,
+                                                     memory_order_acquire ) );
 
-            ( void ) xQueueSend( xCommandPoolQueue, &pCommand, 0U );
+    return ( usIdx == POOL_INDEX_NONE ) ? NULL : &( commandStructurePool[ usIdx ] );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPoolPush( uint16_t usIdx )
+{
+    uint32_t ulHead = atomic_load_explicit( &ulFreeHead, memory_order_relaxed );
+    uint32_t ulNewHead = 0;
+
+    do
+    {
+        atomic_store_explicit( &( pusNextFree[ usIdx ] ), POOL_HEAD_INDEX( ulHead ), memory_order_relaxed );
+        ulNewHead = POOL_HEAD( POOL_HEAD_TAG( ulHead ) + 1U, usIdx );
+    } while( !atomic_compare_exchange_weak_explicit( &ulFreeHead, &ulHead, ulNewHead,
+                                                     memory_order_release,
+                                                     memory_order_relaxed ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_InitializePool( void )
+{
+    if( !atomic_load( &xPoolInitialized ) )
+    {
+        /* Chain every command structure into the free list. */
+        for( uint32_t ulIdx = 0; ulIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE; ulIdx++ )
+        {
+            atomic_store( &( pusNextFree[ ulIdx ] ),
+                          ( ulIdx + 1 < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ? ( uint16_t ) ( ulIdx + 1 ) : POOL_INDEX_NONE );
+            atomic_store( &( pxInUse[ ulIdx ] ), false );
         }
+
+        atomic_store( &ulFreeHead, POOL_HEAD( 0, 0 ) );
+
+        xFreeSignal = xSemaphoreCreateCountingStatic( MQTT_COMMAND_CONTEXTS_POOL_SIZE, 0, &xFreeSignalStorage );
+        configASSERT( xFreeSignal != NULL );
+
+        atomic_store( &xPoolInitialized, true );
     }
 }
 
@@ -80,10 +178,52 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t ulBlockTimeMs )
 {
     MQTTAgentCommand_t * pxCommandStruct = NULL;
 
-    if( xCommandPoolQueue )
+    if( atomic_load_explicit( &xPoolInitialized, memory_order_acquire ) )
     {
-        if( !xQueueReceive( xCommandPoolQueue, &pxCommandStruct, pdMS_TO_TICKS( ulBlockTimeMs ) ) )
+        pxCommandStruct = prvPoolPop();
+
+        /* Slow path: block until a structure is released or the block time expires. */
+        if( ( pxCommandStruct == NULL ) && ( ulBlockTimeMs > 0 ) )
+        {
+            TickType_t xTicksToWait = pdMS_TO_TICKS( ulBlockTimeMs );
+            TickType_t xStartTime = xTaskGetTickCount();
+            TimeOut_t xTimeOut;
+            uint32_t ulWaitMs = 0;
+
+            vTaskSetTimeOutState( &xTimeOut );
+
+            /* Register before checking the list again, so that a release in between is signaled */
+            ( void ) atomic_fetch_add( &ulWaiters, 1 );
+
+            pxCommandStruct = prvPoolPop();
+
+            /* A give may be left over from a waiter that timed out, so check the list after every wake up. */
+            while( ( pxCommandStruct == NULL ) &&
+                   ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE ) &&
+                   ( xSemaphoreTake( xFreeSignal, xTicksToWait ) == pdTRUE ) )
+            {
+                pxCommandStruct = prvPoolPop();
+            }
+
+            ( void ) atomic_fetch_sub( &ulWaiters, 1 );
+
+            ulWaitMs = ( uint32_t ) ( ( xTaskGetTickCount() - xStartTime ) * portTICK_PERIOD_MS );
+
+            ( void ) atomic_fetch_add_explicit( &ulTotalWaitMs, ulWaitMs, memory_order_relaxed );
+            prvAtomicMax( &ulMaxWaitMs, ulWaitMs );
+        }
+
+        if( pxCommandStruct != NULL )
         {
+            uint32_t ulCount = atomic_fetch_add_explicit( &ulInUse, 1, memory_order_relaxed ) + 1;
+
+            prvAtomicMax( &ulHighWaterMark, ulCount );
+
+            atomic_store_explicit( &( pxInUse[ pxCommandStruct - commandStructurePool ] ), true, memory_order_relaxed );
+        }
+        else
+        {
+            ( void ) atomic_fetch_add_explicit( &ulAllocFailures, 1, memory_order_relaxed );
             LogError( ( "No command structure available." ) );
         }
     }
@@ -99,25 +239,58 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t ulBlockTimeMs )
 
 bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
 {
-    BaseType_t xStructReturned = pdFALSE;
+    bool xStructReturned = false;
 
-    if( !xCommandPoolQueue )
+    if( !atomic_load_explicit( &xPoolInitialized, memory_order_acquire ) )
     {
         LogError( ( "Command pool not initialized." ) );
     }
     /* See if the structure being returned is actually from the pool. */
     else if( ( pCommandToRelease < commandStructurePool ) ||
-             ( pCommandToRelease > ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
+             ( pCommandToRelease >= ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
     {
         LogError( ( "Provided pointer: %p does not belong to the command pool.", pCommandToRelease ) );
     }
+    /* Guard the free list against a double release. */
+    else if( !atomic_exchange_explicit( &( pxInUse[ pCommandToRelease - commandStructurePool ] ), false, memory_order_relaxed ) )
+    {
+        LogError( ( "Command Context %d was already returned to the pool.",
+                    ( int ) ( pCommandToRelease - commandStructurePool ) ) );
+    }
     else
     {
-        xStructReturned = xQueueSend( xCommandPoolQueue, &pCommandToRelease, 0U );
+        ( void ) atomic_fetch_sub_explicit( &ulInUse, 1, memory_order_relaxed );
+
+        prvPoolPush( ( uint16_t ) ( pCommandToRelease - commandStructurePool ) );
+
+        /* Order the push before the check for waiters, see Agent_GetCommand */
+        atomic_thread_fence( memory_order_seq_cst );
+
+        if( atomic_load( &ulWaiters ) > 0 )
+        {
+            ( void ) xSemaphoreGive( xFreeSignal );
+        }
+
+        xStructReturned = true;
 
         LogDebug( ( "Returned Command Context %d to pool",
                     ( int ) ( pCommandToRelease - commandStructurePool ) ) );
     }
 
-    return ( bool ) xStructReturned;
+    return xStructReturned;
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_GetPoolStats( AgentCommandPoolStats_t * pxStats )
+{
+    if( pxStats != NULL )
+    {
+        pxStats->ulPoolSize = MQTT_COMMAND_CONTEXTS_POOL_SIZE;
+        pxStats->ulInUse = atomic_load_explicit( &ulInUse, memory_order_relaxed );
+        pxStats->ulHighWaterMark = atomic_load_explicit( &ulHighWaterMark, memory_order_relaxed );
+        pxStats->ulAllocFailures = atomic_load_explicit( &ulAllocFailures, memory_order_relaxed );
+        pxStats->ulTotalWaitMs = atomic_load_explicit( &ulTotalWaitMs, memory_order_relaxed );
+        pxStats->ulMaxWaitMs = atomic_load_explicit( &ulMaxWaitMs, memory_order_relaxed );
+    }
 }
@@ -34,6 +34,19 @@
 /* MQTT agent includes. */
 #include "core_mqtt_agent.h"
 
+/**
+ * @brief Usage statistics of the command structure pool.
+ */
+typedef struct
+{
+    uint32_t ulPoolSize;      /**< Number of structures in the pool. */
+    uint32_t ulInUse;         /**< Structures currently held by callers. */
+    uint32_t ulHighWaterMark; /**< Maximum value reached by ulInUse. */
+    uint32_t ulAllocFailures; /**< Calls to Agent_GetCommand that returned NULL. */
+    uint32_t ulTotalWaitMs;   /**< Total time spent waiting for a structure to be released. */
+    uint32_t ulMaxWaitMs;     /**< Longest single wait for a structure to be released. */
+} AgentCommandPoolStats_t;
+
 /**
  * @brief Initialize the common task pool. Not thread safe.
  */
@@ -80,4 +93,11 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs );
  */
 bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease );
 
+/**
+ * @brief Copy the current pool usage statistics into pxStats.
+ *
+ * @param[out] pxStats Location to write the statistics to.
+ */
+void Agent_GetPoolStats( AgentCommandPoolStats_t * pxStats );
+
 #endif /* FREERTOS_COMMAND_POOL_H */
@@ -28,6 +28,7 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE   mqtt_agent
 #include "logging.h"
 
 /* Standard includes. */
@@ -62,6 +63,9 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "topic_trie.h"
+#include "mqtt_dispatch_pool.h"
+#include "run_time_counter.h"
 
 #include "mbedtls_transport.h"
 #include "sys_evt.h"
@@ -118,6 +122,11 @@ static_assert( ( ( uint64_t ) RETRY_BACKOFF_MULTIPLIER * ( uint64_t ) RETRY_MAX_
 
 #define AGENT_READY_EVT_MASK                  ( 1U )
 
+/**
+ * @brief Inline callbacks running longer than this are reported as blocking the agent.
+ */
+#define SLOW_CALLBACK_WARN_MS                 ( 50U )
+
 #define MUTEX_IS_OWNED( xHandle )    ( xTaskGetCurrentTaskHandle() == xSemaphoreGetMutexHolder( xHandle ) )
 
 struct MQTTAgentMessageContext
@@ -133,6 +142,13 @@ typedef struct MQTTAgentSubscriptionManagerCtx
     uint32_t pulSubCbCount[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
     SubCallbackElement_t pxCallbacks[ MQTT_AGENT_MAX_CALLBACKS ];
 
+    /* Index of subscribed topic filters, values point into pxSubscriptions */
+    TopicTrie_t xTopicTrie;
+
+    /* Per-subscription chains of indexes into pxCallbacks, terminated by MQTT_AGENT_MAX_CALLBACKS */
+    size_t puxSubCbHead[ MQTT_AGENT_MAX_SUBSCRIPTIONS ];
+    size_t puxCbNext[ MQTT_AGENT_MAX_CALLBACKS ];
+
     size_t uxSubscriptionCount;
     size_t uxCallbackCount;
     MQTTAgentSubscribeArgs_t xInitialSubscribeArgs;
@@ -140,6 +156,15 @@ typedef struct MQTTAgentSubscriptionManagerCtx
     SemaphoreHandle_t xMutex;
 } SubMgrCtx_t;
 
+typedef struct PublishDispatchCtx
+{
+    SubMgrCtx_t * pxCtx;
+    MQTTPublishInfo_t * pxPublishInfo;
+    size_t uxCallbackCount;
+
+    /* Copy of the publish shared by deferred callbacks, created on first use */
+    MQTTDispatchBuffer_t * pxBuffer;
+} PublishDispatchCtx_t;
 
 typedef struct MQTTAgentTaskCtx
 {
@@ -347,6 +372,7 @@ static inline void prvUpdateCallbackRefs( SubCallbackElement_t * pxCallbacksList
 
 static inline void prvCompressSubscriptionList( MQTTSubscribeInfo_t * pxSubList,
                                                 SubCallbackElement_t * pxCallbacksList,
+                                                TopicTrie_t * pxTopicTrie,
                                                 size_t * puxSubCount )
 {
     size_t uxLastOccupiedIndex = 0;
@@ -354,6 +380,7 @@ static inline void prvCompressSubscriptionList( MQTTSubscribeInfo_t * pxSubList,
 
     configASSERT( pxSubList );
     configASSERT( pxCallbacksList );
+    configASSERT( pxTopicTrie );
 
     for( size_t uxIdx = 0U; uxIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxIdx++ )
     {
@@ -379,6 +406,12 @@ static inline void prvCompressSubscriptionList( MQTTSubscribeInfo_t * pxSubList,
 
                     prvUpdateCallbackRefs( pxCallbacksList, pxSubList, uxLastOccupiedIndex, uxIdx );
 
+                    /* Point the existing topic trie entry at the new location */
+                    ( void ) TopicTrie_Insert( pxTopicTrie,
+                                               pxSubList[ uxIdx ].pTopicFilter,
+                                               pxSubList[ uxIdx ].topicFilterLength,
+                                               &( pxSubList[ uxIdx ] ) );
+
                     /* Increment count of active subscriptions */
                     uxSubCount++;
 
@@ -469,6 +502,38 @@ static inline void prvCompressCallbackList( SubCallbackElement_t * pxCallbackLis
 
 /*-----------------------------------------------------------*/
 
+/* Rebuild the per-subscription callback chains after pxCallbacks or pxSubscriptions change. */
+static void prvIndexCallbacks( SubMgrCtx_t * pxCtx )
+{
+    configASSERT( pxCtx );
+
+    for( size_t uxSubIdx = 0U; uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxSubIdx++ )
+    {
+        pxCtx->puxSubCbHead[ uxSubIdx ] = MQTT_AGENT_MAX_CALLBACKS;
+    }
+
+    /* Walk backwards so that each chain preserves registration order */
+    for( size_t uxIdx = MQTT_AGENT_MAX_CALLBACKS; uxIdx > 0U; uxIdx-- )
+    {
+        size_t uxCbIdx = uxIdx - 1U;
+        MQTTSubscribeInfo_t * pxSubInfo = pxCtx->pxCallbacks[ uxCbIdx ].pxSubInfo;
+
+        pxCtx->puxCbNext[ uxCbIdx ] = MQTT_AGENT_MAX_CALLBACKS;
+
+        if( pxSubInfo != NULL )
+        {
+            size_t uxSubIdx = ( size_t ) ( pxSubInfo - pxCtx->pxSubscriptions );
+
+            configASSERT( uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS );
+
+            pxCtx->puxCbNext[ uxCbIdx ] = pxCtx->puxSubCbHead[ uxSubIdx ];
+            pxCtx->puxSubCbHead[ uxSubIdx ] = uxCbIdx;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvSocketRecvReadyCallback( void * pvCtx )
 {
     MQTTAgentMessageContext_t * pxMsgCtx = ( MQTTAgentMessageContext_t * ) pvCtx;
@@ -596,8 +661,11 @@ static MQTTStatus_t prvHandleResubscribe( MQTTAgentContext_t * pxMqttAgentCtx,
 
     prvCompressSubscriptionList( pxCtx->pxSubscriptions,
                                  pxCtx->pxCallbacks,
+                                 &( pxCtx->xTopicTrie ),
                                  &( pxCtx->uxSubscriptionCount ) );
 
+    prvIndexCallbacks( pxCtx );
+
     if( pxCtx->uxSubscriptionCount > 0U )
     {
         MQTTAgentCommandInfo_t xCommandParams =
@@ -636,23 +704,6 @@ static MQTTStatus_t prvHandleResubscribe( MQTTAgentContext_t * pxMqttAgentCtx,
 
 /*-----------------------------------------------------------*/
 
-static inline bool prvMatchTopic( MQTTSubscribeInfo_t * pxSubscribeInfo,
-                                  const char * pcTopicName,
-                                  const uint16_t usTopicLen )
-{
-    MQTTStatus_t xStatus = MQTTSuccess;
-    bool isMatched = false;
-
-    xStatus = MQTT_MatchTopic( pcTopicName,
-                               usTopicLen,
-                               pxSubscribeInfo->pTopicFilter,
-                               pxSubscribeInfo->topicFilterLength,
-                               &isMatched );
-    return ( xStatus == MQTTSuccess ) && isMatched;
-}
-
-/*-----------------------------------------------------------*/
-
 static inline bool prvMatchCbCtx( SubCallbackElement_t * pxCbCtx,
                                   MQTTSubscribeInfo_t * pxSubInfo,
                                   IncomingPubCallback_t pxCallback,
@@ -666,6 +717,111 @@ static inline bool prvMatchCbCtx( SubCallbackElement_t * pxCbCtx,
 
 /*-----------------------------------------------------------*/
 
+static void prvUpdateCallbackStats( MQTTAgentCallbackStats_t * pxStats,
+                                    uint32_t ulRunTime )
+{
+    pxStats->ulInvocations++;
+    pxStats->ulTotalRunTime += ulRunTime;
+
+    if( ulRunTime > pxStats->ulMaxRunTime )
+    {
+        pxStats->ulMaxRunTime = ulRunTime;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDispatchToSubscription( void * pvCtx,
+                                       void * pvValue )
+{
+    PublishDispatchCtx_t * pxDispatchCtx = ( PublishDispatchCtx_t * ) pvCtx;
+    SubMgrCtx_t * pxCtx = pxDispatchCtx->pxCtx;
+    MQTTSubscribeInfo_t * const pxSubInfo = ( MQTTSubscribeInfo_t * ) pvValue;
+    size_t uxSubIdx = ( size_t ) ( pxSubInfo - pxCtx->pxSubscriptions );
+
+    configASSERT( uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS );
+
+    for( size_t uxCbIdx = pxCtx->puxSubCbHead[ uxSubIdx ];
+         uxCbIdx < MQTT_AGENT_MAX_CALLBACKS;
+         uxCbIdx = pxCtx->puxCbNext[ uxCbIdx ] )
+    {
+        SubCallbackElement_t * const pxCallback = &( pxCtx->pxCallbacks[ uxCbIdx ] );
+
+        configASSERT( pxCallback->pxSubInfo == pxSubInfo );
+
+        LogDebug( "Handling callback for task=%s, topic=\"%.*s\", filter=\"%.*s\".",
+                  pcTaskGetName( pxCallback->xTaskHandle ),
+                  pxDispatchCtx->pxPublishInfo->topicNameLength,
+                  pxDispatchCtx->pxPublishInfo->pTopicName,
+                  pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+
+        if( pxCallback->xDispatchMode == MQTTAgentDispatchDeferred )
+        {
+            if( pxDispatchCtx->pxBuffer == NULL )
+            {
+                pxDispatchCtx->pxBuffer = MqttDispatch_BufferCreate( pxDispatchCtx->pxPublishInfo );
+            }
+
+            if( ( pxDispatchCtx->pxBuffer == NULL ) ||
+                !MqttDispatch_Post( pxDispatchCtx->pxBuffer,
+                                    pxCallback->pxIncomingPublishCallback,
+                                    pxCallback->pvIncomingPublishCallbackContext,
+                                    uxCbIdx ) )
+            {
+                LogWarn( "Dropped deferred callback for task=%s, filter=\"%.*s\".",
+                         pcTaskGetName( pxCallback->xTaskHandle ),
+                         pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+                pxCallback->xStats.ulDropped++;
+            }
+        }
+        else
+        {
+            uint32_t ulStartTime = ulGetRunTimeCounter();
+
+            pxCallback->pxIncomingPublishCallback( pxCallback->pvIncomingPublishCallbackContext,
+                                                   pxDispatchCtx->pxPublishInfo );
+
+            prvUpdateCallbackStats( &( pxCallback->xStats ),
+                                    ulGetRunTimeCounter() - ulStartTime );
+        }
+
+        pxDispatchCtx->uxCallbackCount++;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called by the dispatch workers once a deferred callback has returned. */
+static void prvDeferredCallbackDone( void * pvDoneCtx,
+                                     IncomingPubCallback_t pxCallback,
+                                     void * pvCallbackCtx,
+                                     size_t uxCallbackIdx,
+                                     uint32_t ulRunTime )
+{
+    SubMgrCtx_t * pxCtx = ( SubMgrCtx_t * ) pvDoneCtx;
+
+    configASSERT( pxCtx );
+    configASSERT( uxCallbackIdx < MQTT_AGENT_MAX_CALLBACKS );
+
+    if( xLockSubCtx( pxCtx ) )
+    {
+        SubCallbackElement_t * const pxCbCtx = &( pxCtx->pxCallbacks[ uxCallbackIdx ] );
+
+        /* The slot may have been released or reused while the job was queued */
+        if( ( pxCbCtx->pxSubInfo != NULL ) &&
+            ( pxCbCtx->xDispatchMode == MQTTAgentDispatchDeferred ) &&
+            ( pxCbCtx->pxIncomingPublishCallback == pxCallback ) &&
+            ( pxCbCtx->pvIncomingPublishCallbackContext == pvCallbackCtx ) )
+        {
+            prvUpdateCallbackStats( &( pxCbCtx->xStats ), ulRunTime );
+        }
+
+        ( void ) xUnlockSubCtx( pxCtx );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
                                         uint16_t packetId,
                                         MQTTPublishInfo_t * pxPublishInfo )
@@ -683,36 +839,37 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
 
     if( xLockSubCtx( pxCtx ) )
     {
-        /* Iterate over pxCtx->pxCallbacks list */
-        for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
+        PublishDispatchCtx_t xDispatchCtx =
         {
-            SubCallbackElement_t * const pxCallback = &( pxCtx->pxCallbacks[ ulCbIdx ] );
-            MQTTSubscribeInfo_t * const pxSubInfo = pxCallback->pxSubInfo;
+            .pxCtx           = pxCtx,
+            .pxPublishInfo   = pxPublishInfo,
+            .uxCallbackCount = 0,
+            .pxBuffer        = NULL,
+        };
+        TickType_t xStartTime = xTaskGetTickCount();
 
-            if( ( pxSubInfo != NULL ) &&
-                prvMatchTopic( pxSubInfo,
-                               pxPublishInfo->pTopicName,
-                               pxPublishInfo->topicNameLength ) )
-            {
-                char * pcTaskName = pcTaskGetName( pxCallback->xTaskHandle );
+        /* Visit only the subscriptions whose filter matches the topic name */
+        ( void ) TopicTrie_Match( &( pxCtx->xTopicTrie ),
+                                  pxPublishInfo->pTopicName,
+                                  pxPublishInfo->topicNameLength,
+                                  prvDispatchToSubscription,
+                                  &xDispatchCtx );
 
-                if( !pcTaskName )
-                {
-                    pcTaskName = "Unknown";
-                }
+        xPublishHandled = ( xDispatchCtx.uxCallbackCount > 0 );
 
-                LogInfo( "Handling callback for task=%s, topic=\"%.*s\", filter=\"%.*s\".",
-                         pcTaskName,
-                         pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName,
-                         pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+        ( void ) xUnlockSubCtx( pxCtx );
 
-                pxCallback->pxIncomingPublishCallback( pxCallback->pvIncomingPublishCallbackContext,
-                                                       pxPublishInfo );
-                xPublishHandled = true;
-            }
-        }
+        /* Drop the agent's reference, the workers hold the remaining ones */
+        MqttDispatch_BufferRelease( xDispatchCtx.pxBuffer );
 
-        ( void ) xUnlockSubCtx( pxCtx );
+        TickType_t xElapsed = xTaskGetTickCount() - xStartTime;
+
+        if( xElapsed > pdMS_TO_TICKS( SLOW_CALLBACK_WARN_MS ) )
+        {
+            LogWarn( "Inline callbacks for topic=\"%.*s\" blocked the agent for %lu ms.",
+                     pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName,
+                     ( unsigned long ) ( xElapsed * portTICK_PERIOD_MS ) );
+        }
     }
 
     if( !xPublishHandled )
@@ -733,6 +890,8 @@ static void prvSubscriptionManagerCtxFree( SubMgrCtx_t * pxSubMgrCtx )
         configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
         vSemaphoreDelete( pxSubMgrCtx->xMutex );
     }
+
+    TopicTrie_Clear( &( pxSubMgrCtx->xTopicTrie ) );
 }
 
 /*-----------------------------------------------------------*/
@@ -761,8 +920,13 @@ static void prvSubscriptionManagerCtxReset( SubMgrCtx_t * pxSubMgrCtx )
         pxSubMgrCtx->pxCallbacks[ uxIdx ].pxIncomingPublishCallback = NULL;
         pxSubMgrCtx->pxCallbacks[ uxIdx ].pxSubInfo = NULL;
         pxSubMgrCtx->pxCallbacks[ uxIdx ].xTaskHandle = NULL;
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].xDispatchMode = MQTTAgentDispatchInline;
+        memset( &( pxSubMgrCtx->pxCallbacks[ uxIdx ].xStats ), 0, sizeof( MQTTAgentCallbackStats_t ) );
     }
 
+    TopicTrie_Clear( &( pxSubMgrCtx->xTopicTrie ) );
+    prvIndexCallbacks( pxSubMgrCtx );
+
     pxSubMgrCtx->xInitialSubscribeArgs.numSubscriptions = 0;
     pxSubMgrCtx->xInitialSubscribeArgs.pSubscribeInfo = NULL;
 }
@@ -777,6 +941,8 @@ static MQTTStatus_t prvSubscriptionManagerCtxInit( SubMgrCtx_t * pxSubMgrCtx )
 
     pxSubMgrCtx->xMutex = xSemaphoreCreateMutex();
 
+    TopicTrie_Init( &( pxSubMgrCtx->xTopicTrie ) );
+
     if( pxSubMgrCtx->xMutex )
     {
         LogDebug( "Creating MqttAgent Mutex." );
@@ -860,6 +1026,7 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
         pxCtx->xTransport.pNetworkContext = pxNetworkContext;
         pxCtx->xTransport.send = mbedtls_transport_send;
         pxCtx->xTransport.recv = mbedtls_transport_recv;
+        pxCtx->xTransport.writev = mbedtls_transport_writev;
 
         /* MQTTConnectInfo_t */
         /* Always start the initial connection with a clean session */
@@ -1031,6 +1198,14 @@ void vMQTTAgentTask( void * pvParameters )
         }
     }
 
+    #if !defined( __USE_STSAFE__ ) && ( KV_STORE_PERSIST_TLS_SESSION == 1 )
+        if( xMQTTStatus == MQTTSuccess )
+        {
+            /* Also resume the previous TLS session after a reboot. Reconnects resume from RAM regardless. */
+            ( void ) mbedtls_transport_setsessionstore( pxNetworkContext, CS_TLS_SESSION );
+        }
+    #endif /* !defined( __USE_STSAFE__ ) && ( KV_STORE_PERSIST_TLS_SESSION == 1 ) */
+
     if( xMQTTStatus == MQTTSuccess )
     {
         pxCtx = pvPortMalloc( sizeof( MQTTAgentTaskCtx_t ) );
@@ -1051,6 +1226,12 @@ void vMQTTAgentTask( void * pvParameters )
     if( xMQTTStatus == MQTTSuccess )
     {
         Agent_InitializePool();
+
+        if( !MqttDispatch_Init( prvDeferredCallbackDone, &( pxCtx->xSubMgrCtx ) ) )
+        {
+            LogError( "Failed to start the publish dispatch workers." );
+            xMQTTStatus = MQTTNoMemory;
+        }
     }
 
     if( xMQTTStatus == MQTTSuccess )
@@ -1124,7 +1305,7 @@ void vMQTTAgentTask( void * pvParameters )
             xTlsStatus = mbedtls_transport_connect( pxNetworkContext,
                                                     pxCtx->pcMqttEndpoint,
                                                     ( uint16_t ) pxCtx->ulMqttPort,
-                                                    0, 0 );
+                                                    0, SEND_TIMEOUT_MS );
 
             if( xTlsStatus != TLS_TRANSPORT_SUCCESS )
             {
@@ -1427,6 +1608,23 @@ MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
                                       MQTTQoS_t xRequestedQoS,
                                       IncomingPubCallback_t pxCallback,
                                       void * pvCallbackCtx )
+{
+    return MqttAgent_SubscribeSyncEx( xHandle,
+                                      pcTopicFilter,
+                                      xRequestedQoS,
+                                      pxCallback,
+                                      pvCallbackCtx,
+                                      MQTTAgentDispatchInline );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_SubscribeSyncEx( MQTTAgentHandle_t xHandle,
+                                        const char * pcTopicFilter,
+                                        MQTTQoS_t xRequestedQoS,
+                                        IncomingPubCallback_t pxCallback,
+                                        void * pvCallbackCtx,
+                                        MQTTAgentDispatchMode_t xDispatchMode )
 {
     MQTTStatus_t xStatus = MQTTSuccess;
     size_t xTopicFilterLen = 0;
@@ -1436,7 +1634,9 @@ MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
     if( ( xHandle == NULL ) ||
         ( pcTopicFilter == NULL ) ||
         ( pxCallback == NULL ) ||
-        !prvValidateQoS( xRequestedQoS ) )
+        !prvValidateQoS( xRequestedQoS ) ||
+        ( ( xDispatchMode != MQTTAgentDispatchInline ) &&
+          ( xDispatchMode != MQTTAgentDispatchDeferred ) ) )
     {
         xStatus = MQTTBadParameter;
     }
@@ -1543,7 +1743,20 @@ MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
 
                     /* Ensure null terminated */
                     pcDupTopicFilter[ xTopicFilterLen ] = '\00';
+                }
 
+                if( ( pcDupTopicFilter != NULL ) &&
+                    !TopicTrie_Insert( &( pxCtx->xTopicTrie ),
+                                       pcDupTopicFilter,
+                                       ( uint16_t ) xTopicFilterLen,
+                                       &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] ) ) )
+                {
+                    LogError( "Failed to index topic filter=\"%.*s\".", xTopicFilterLen, pcTopicFilter );
+                    vPortFree( pcDupTopicFilter );
+                    xStatus = MQTTNoMemory;
+                }
+                else if( pcDupTopicFilter != NULL )
+                {
                     pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter = pcDupTopicFilter;
                     pxCtx->pxSubscriptions[ uxTargetSubIdx ].topicFilterLength = ( uint16_t ) xTopicFilterLen;
 
@@ -1564,15 +1777,23 @@ MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
             pxCtx->pxCallbacks[ uxTargetCbIdx ].xTaskHandle = xTaskGetCurrentTaskHandle();
             pxCtx->pxCallbacks[ uxTargetCbIdx ].pxIncomingPublishCallback = pxCallback;
             pxCtx->pxCallbacks[ uxTargetCbIdx ].pvIncomingPublishCallbackContext = pvCallbackCtx;
+            memset( &( pxCtx->pxCallbacks[ uxTargetCbIdx ].xStats ), 0, sizeof( MQTTAgentCallbackStats_t ) );
 
             /* Increment subscription reference count. */
             pxCtx->pulSubCbCount[ uxTargetSubIdx ]++;
 
             pxCtx->uxCallbackCount++;
 
+            prvIndexCallbacks( pxCtx );
+
             LogInfo( "Callback registered with filter=\"%.*s\".", xTopicFilterLen, pcTopicFilter );
         }
 
+        if( xStatus == MQTTSuccess )
+        {
+            pxCtx->pxCallbacks[ uxTargetCbIdx ].xDispatchMode = xDispatchMode;
+        }
+
         ( void ) xUnlockSubCtx( pxCtx );
 
         if( ( xStatus == MQTTSuccess ) &&
@@ -1681,6 +1902,7 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
     MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) xHandle;
     SubMgrCtx_t * pxCtx = &( pxTaskCtx->xSubMgrCtx );
     uint32_t ulCallbackCount = 0;
+    bool xWasDeferred = false;
 
     if( ( xHandle == NULL ) ||
         ( pcTopicFilter == NULL ) ||
@@ -1779,6 +2001,7 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
                     if( prvMatchCbCtx( pxCbCtx, pxSubInfo, pxCallback, pvCallbackCtx ) )
                     {
                         xStatus = MQTTSuccess;
+                        xWasDeferred = ( pxCbCtx->xDispatchMode == MQTTAgentDispatchDeferred );
                         pxCbCtx->pvIncomingPublishCallbackContext = NULL;
                         pxCbCtx->pxIncomingPublishCallback = NULL;
                         pxCbCtx->pxSubInfo = NULL;
@@ -1799,6 +2022,10 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
                     ( ulCallbackCount == 1 ) &&
                     ( pxCtx->pulSubCbCount[ uxSubInfoIdx ] == 0 ) )
                 {
+                    ( void ) TopicTrie_Remove( &( pxCtx->xTopicTrie ),
+                                               pxSubInfo->pTopicFilter,
+                                               pxSubInfo->topicFilterLength );
+
                     /* Free heap allocated topic filter */
                     vPortFree( ( void * ) pxSubInfo->pTopicFilter );
 
@@ -1814,6 +2041,8 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
                         pxCtx->uxSubscriptionCount--;
                     }
                 }
+
+                prvIndexCallbacks( pxCtx );
             }
 
             ( void ) xUnlockSubCtx( pxCtx );
@@ -1823,7 +2052,54 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
             xStatus = MQTTIllegalState;
             LogError( "Failed to acquire MQTTAgent mutex." );
         }
+
+        /* The callback context must remain valid until queued invocations have run */
+        if( xWasDeferred )
+        {
+            MqttDispatch_WaitIdle( pxCallback, pvCallbackCtx );
+        }
     }
 
     return xStatus;
 }
+
+/*-----------------------------------------------------------*/
+
+size_t MqttAgent_GetCallbackStats( MQTTAgentHandle_t xHandle,
+                                   MQTTAgentCallbackInfo_t * pxInfo,
+                                   size_t uxMaxEntries )
+{
+    MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) xHandle;
+    size_t uxCount = 0;
+
+    if( ( xHandle != NULL ) &&
+        ( pxInfo != NULL ) &&
+        xLockSubCtx( &( pxTaskCtx->xSubMgrCtx ) ) )
+    {
+        SubMgrCtx_t * pxCtx = &( pxTaskCtx->xSubMgrCtx );
+
+        for( size_t uxCbIdx = 0U; ( uxCbIdx < MQTT_AGENT_MAX_CALLBACKS ) && ( uxCount < uxMaxEntries ); uxCbIdx++ )
+        {
+            SubCallbackElement_t * const pxCbCtx = &( pxCtx->pxCallbacks[ uxCbIdx ] );
+
+            if( pxCbCtx->pxSubInfo != NULL )
+            {
+                pxInfo[ uxCount ].pxCallback = pxCbCtx->pxIncomingPublishCallback;
+                pxInfo[ uxCount ].pvCallbackCtx = pxCbCtx->pvIncomingPublishCallbackContext;
+                pxInfo[ uxCount ].xDispatchMode = pxCbCtx->xDispatchMode;
+                pxInfo[ uxCount ].xStats = pxCbCtx->xStats;
+
+                ( void ) strncpy( pxInfo[ uxCount ].pcTaskName,
+                                  pcTaskGetName( pxCbCtx->xTaskHandle ),
+                                  configMAX_TASK_NAME_LEN - 1 );
+                pxInfo[ uxCount ].pcTaskName[ configMAX_TASK_NAME_LEN - 1 ] = '\0';
+
+                uxCount++;
+            }
+        }
+
+        ( void ) xUnlockSubCtx( pxCtx );
+    }
+
+    return uxCount;
+}
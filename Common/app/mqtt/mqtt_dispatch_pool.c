@@ -0,0 +1,301 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_dispatch_pool.c
+ * @brief Worker tasks running incoming publish callbacks off the MQTT agent task.
+ *
+ * The agent task copies an incoming publish once into a reference counted
+ * buffer and posts one job per deferred callback. Each job carries its own
+ * MQTTPublishInfo_t pointing into the shared buffer, which is freed by whichever
+ * task drops the last reference.
+ *
+ * Every worker owns a job queue and all callbacks sharing a context are posted
+ * to the same worker, so they never run concurrently with each other and are
+ * executed in the order the publishes were received.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_ERROR
+#include "logging.h"
+
+/* Standard includes. */
+#include <stdatomic.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+
+#include "run_time_counter.h"
+#include "mqtt_dispatch_pool.h"
+
+struct MQTTDispatchBuffer
+{
+    atomic_uint_least32_t ulRefCount;
+    MQTTPublishInfo_t xPublishInfo;
+    uint8_t pucData[];
+};
+
+/* A job without a buffer is a marker posted by MqttDispatch_WaitIdle, pvCallbackCtx is then the semaphore to give */
+typedef struct
+{
+    MQTTDispatchBuffer_t * pxBuffer;
+    IncomingPubCallback_t pxCallback;
+    void * pvCallbackCtx;
+    size_t uxCallbackIdx;
+} DispatchJob_t;
+
+typedef struct
+{
+    QueueHandle_t pxJobQueues[ MQTT_DISPATCH_WORKER_COUNT ];
+    TaskHandle_t pxWorkers[ MQTT_DISPATCH_WORKER_COUNT ];
+    bool xInitialized;
+    MQTTDispatchDoneCallback_t pxDoneCallback;
+    void * pvDoneCtx;
+} DispatchPool_t;
+
+static DispatchPool_t xDispatchPool = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static void prvDispatchWorkerTask( void * pvParameters )
+{
+    QueueHandle_t xJobQueue = ( QueueHandle_t ) pvParameters;
+    DispatchJob_t xJob = { 0 };
+
+    for( ; ; )
+    {
+        if( xQueueReceive( xJobQueue, &xJob, portMAX_DELAY ) != pdTRUE )
+        {
+            /* Nothing received */
+        }
+        else if( xJob.pxBuffer == NULL )
+        {
+            /* Every job posted to this worker before the marker has run */
+            ( void ) xSemaphoreGive( ( SemaphoreHandle_t ) xJob.pvCallbackCtx );
+        }
+        else
+        {
+            /* Give every callback its own copy of the publish info */
+            MQTTPublishInfo_t xPublishInfo = xJob.pxBuffer->xPublishInfo;
+            uint32_t ulStartTime = ulGetRunTimeCounter();
+
+            xJob.pxCallback( xJob.pvCallbackCtx, &xPublishInfo );
+
+            if( xDispatchPool.pxDoneCallback != NULL )
+            {
+                xDispatchPool.pxDoneCallback( xDispatchPool.pvDoneCtx,
+                                              xJob.pxCallback,
+                                              xJob.pvCallbackCtx,
+                                              xJob.uxCallbackIdx,
+                                              ulGetRunTimeCounter() - ulStartTime );
+            }
+
+            MqttDispatch_BufferRelease( xJob.pxBuffer );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Pin each callback context to one worker to preserve ordering */
+static size_t prvGetWorkerIndex( IncomingPubCallback_t pxCallback,
+                                 void * pvCallbackCtx )
+{
+    uintptr_t uxHash = ( ( pvCallbackCtx != NULL ) ? ( uintptr_t ) pvCallbackCtx : ( uintptr_t ) pxCallback ) >> 2;
+
+    return ( size_t ) ( uxHash % MQTT_DISPATCH_WORKER_COUNT );
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttDispatch_Init( MQTTDispatchDoneCallback_t pxDoneCallback,
+                        void * pvDoneCtx )
+{
+    bool xSuccess = true;
+
+    if( !xDispatchPool.xInitialized )
+    {
+        xDispatchPool.pxDoneCallback = pxDoneCallback;
+        xDispatchPool.pvDoneCtx = pvDoneCtx;
+
+        for( size_t uxIdx = 0; xSuccess && ( uxIdx < MQTT_DISPATCH_WORKER_COUNT ); uxIdx++ )
+        {
+            char pcTaskName[ configMAX_TASK_NAME_LEN ] = "MQTTDisp0";
+
+            pcTaskName[ sizeof( "MQTTDisp" ) - 1 ] += ( char ) uxIdx;
+
+            xDispatchPool.pxJobQueues[ uxIdx ] = xQueueCreate( MQTT_DISPATCH_QUEUE_LENGTH, sizeof( DispatchJob_t ) );
+
+            if( xDispatchPool.pxJobQueues[ uxIdx ] == NULL )
+            {
+                LogError( "Failed to allocate the dispatch queue." );
+                xSuccess = false;
+            }
+            else if( xTaskCreate( prvDispatchWorkerTask,
+                                  pcTaskName,
+                                  MQTT_DISPATCH_WORKER_STACK_SIZE,
+                                  ( void * ) xDispatchPool.pxJobQueues[ uxIdx ],
+                                  MQTT_DISPATCH_WORKER_PRIORITY,
+                                  &( xDispatchPool.pxWorkers[ uxIdx ] ) ) != pdPASS )
+            {
+                LogError( "Failed to create dispatch worker %u.", ( unsigned int ) uxIdx );
+                xSuccess = false;
+            }
+            else
+            {
+                /* Worker started */
+            }
+        }
+
+        xDispatchPool.xInitialized = xSuccess;
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTDispatchBuffer_t * MqttDispatch_BufferCreate( const MQTTPublishInfo_t * pxPublishInfo )
+{
+    MQTTDispatchBuffer_t * pxBuffer = NULL;
+
+    configASSERT( pxPublishInfo != NULL );
+
+    pxBuffer = pvPortMalloc( sizeof( MQTTDispatchBuffer_t ) +
+                             pxPublishInfo->topicNameLength +
+                             pxPublishInfo->payloadLength );
+
+    if( pxBuffer != NULL )
+    {
+        uint8_t * pucTopic = pxBuffer->pucData;
+        uint8_t * pucPayload = &( pxBuffer->pucData[ pxPublishInfo->topicNameLength ] );
+
+        atomic_init( &( pxBuffer->ulRefCount ), 1 );
+
+        ( void ) memcpy( pucTopic, pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength );
+
+        if( pxPublishInfo->payloadLength > 0 )
+        {
+            ( void ) memcpy( pucPayload, pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
+        }
+
+        pxBuffer->xPublishInfo = *pxPublishInfo;
+        pxBuffer->xPublishInfo.pTopicName = ( const char * ) pucTopic;
+        pxBuffer->xPublishInfo.pPayload = pucPayload;
+    }
+    else
+    {
+        LogError( "Failed to allocate a %lu byte dispatch buffer.",
+                  ( unsigned long ) ( pxPublishInfo->topicNameLength + pxPublishInfo->payloadLength ) );
+    }
+
+    return pxBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttDispatch_BufferRelease( MQTTDispatchBuffer_t * pxBuffer )
+{
+    if( ( pxBuffer != NULL ) &&
+        ( atomic_fetch_sub( &( pxBuffer->ulRefCount ), 1 ) == 1 ) )
+    {
+        vPortFree( pxBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttDispatch_Post( MQTTDispatchBuffer_t * pxBuffer,
+                        IncomingPubCallback_t pxCallback,
+                        void * pvCallbackCtx,
+                        size_t uxCallbackIdx )
+{
+    bool xSuccess = false;
+    DispatchJob_t xJob =
+    {
+        .pxBuffer      = pxBuffer,
+        .pxCallback    = pxCallback,
+        .pvCallbackCtx = pvCallbackCtx,
+        .uxCallbackIdx = uxCallbackIdx,
+    };
+
+    configASSERT( pxBuffer != NULL );
+    configASSERT( pxCallback != NULL );
+
+    if( xDispatchPool.xInitialized )
+    {
+        QueueHandle_t xJobQueue = xDispatchPool.pxJobQueues[ prvGetWorkerIndex( pxCallback, pvCallbackCtx ) ];
+
+        ( void ) atomic_fetch_add( &( pxBuffer->ulRefCount ), 1 );
+
+        xSuccess = ( xQueueSendToBack( xJobQueue, &xJob, 0 ) == pdTRUE );
+
+        if( !xSuccess )
+        {
+            ( void ) atomic_fetch_sub( &( pxBuffer->ulRefCount ), 1 );
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttDispatch_WaitIdle( IncomingPubCallback_t pxCallback,
+                            void * pvCallbackCtx )
+{
+    TaskHandle_t xCurrentTask = xTaskGetCurrentTaskHandle();
+    bool xIsWorker = false;
+
+    for( size_t uxIdx = 0; uxIdx < MQTT_DISPATCH_WORKER_COUNT; uxIdx++ )
+    {
+        xIsWorker |= ( xDispatchPool.pxWorkers[ uxIdx ] == xCurrentTask );
+    }
+
+    /* A worker waiting on itself would never return */
+    if( xDispatchPool.xInitialized && !xIsWorker )
+    {
+        StaticSemaphore_t xDoneStorage;
+        SemaphoreHandle_t xDone = xSemaphoreCreateBinaryStatic( &xDoneStorage );
+        DispatchJob_t xMarker =
+        {
+            .pxBuffer      = NULL,
+            .pxCallback    = NULL,
+            .pvCallbackCtx = ( void * ) xDone,
+        };
+
+        /* Jobs of one context run in order on one worker, so the marker runs after all of them */
+        ( void ) xQueueSendToBack( xDispatchPool.pxJobQueues[ prvGetWorkerIndex( pxCallback, pvCallbackCtx ) ],
+                                   &xMarker,
+                                   portMAX_DELAY );
+
+        ( void ) xSemaphoreTake( xDone, portMAX_DELAY );
+    }
+}
@@ -0,0 +1,134 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_dispatch_pool.h
+ * @brief Worker tasks running incoming publish callbacks off the MQTT agent task.
+ */
+#ifndef MQTT_DISPATCH_POOL_H
+#define MQTT_DISPATCH_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/* MQTT library includes. */
+#include "core_mqtt.h"
+
+#include "subscription_manager.h"
+
+/**
+ * @brief Number of worker tasks running deferred callbacks.
+ */
+#ifndef MQTT_DISPATCH_WORKER_COUNT
+    #define MQTT_DISPATCH_WORKER_COUNT       ( 2 )
+#endif
+
+#ifndef MQTT_DISPATCH_WORKER_STACK_SIZE
+    #define MQTT_DISPATCH_WORKER_STACK_SIZE  ( 2048 )
+#endif
+
+/**
+ * @brief Priority of the worker tasks, below that of the MQTT agent task.
+ */
+#ifndef MQTT_DISPATCH_WORKER_PRIORITY
+    #define MQTT_DISPATCH_WORKER_PRIORITY    ( 8 )
+#endif
+
+/**
+ * @brief Maximum number of deferred callbacks waiting for each worker.
+ */
+#ifndef MQTT_DISPATCH_QUEUE_LENGTH
+    #define MQTT_DISPATCH_QUEUE_LENGTH       ( 8 )
+#endif
+
+/**
+ * @brief Reference counted copy of an incoming publish shared by every deferred
+ * callback it is dispatched to.
+ */
+typedef struct MQTTDispatchBuffer MQTTDispatchBuffer_t;
+
+/**
+ * @brief Called from the worker task after each deferred callback returns.
+ *
+ * @param[in] pvDoneCtx Context passed to MqttDispatch_Init.
+ * @param[in] pxCallback Callback that was run.
+ * @param[in] pvCallbackCtx Context the callback was run with.
+ * @param[in] uxCallbackIdx Index given to MqttDispatch_Post.
+ * @param[in] ulRunTime Execution time in run time counter units.
+ */
+typedef void (* MQTTDispatchDoneCallback_t )( void * pvDoneCtx,
+                                              IncomingPubCallback_t pxCallback,
+                                              void * pvCallbackCtx,
+                                              size_t uxCallbackIdx,
+                                              uint32_t ulRunTime );
+
+/**
+ * @brief Create the worker tasks. Subsequent calls have no effect.
+ *
+ * @return true if the worker pool is running.
+ */
+bool MqttDispatch_Init( MQTTDispatchDoneCallback_t pxDoneCallback,
+                        void * pvDoneCtx );
+
+/**
+ * @brief Copy an incoming publish into a new buffer holding a single reference.
+ *
+ * @return The buffer, or NULL if memory could not be allocated.
+ */
+MQTTDispatchBuffer_t * MqttDispatch_BufferCreate( const MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief Drop a reference to a buffer, freeing it when none are left.
+ */
+void MqttDispatch_BufferRelease( MQTTDispatchBuffer_t * pxBuffer );
+
+/**
+ * @brief Queue a callback for execution by a worker task without blocking.
+ *
+ * A reference to pxBuffer is taken on success and dropped once the callback returns.
+ * Callbacks sharing the same context run in order on a single worker.
+ * uxCallbackIdx is handed back unchanged to the done callback.
+ *
+ * @return false if the dispatch queue is full.
+ */
+bool MqttDispatch_Post( MQTTDispatchBuffer_t * pxBuffer,
+                        IncomingPubCallback_t pxCallback,
+                        void * pvCallbackCtx,
+                        size_t uxCallbackIdx );
+
+/**
+ * @brief Block until every callback posted so far with the given callback and context has returned.
+ *
+ * Jobs of other contexts posted in the meantime are not waited for.
+ * Returns immediately when called from a worker task.
+ */
+void MqttDispatch_WaitIdle( IncomingPubCallback_t pxCallback,
+                            void * pvCallbackCtx );
+
+#endif /* MQTT_DISPATCH_POOL_H */
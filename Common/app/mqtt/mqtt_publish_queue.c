@@ -0,0 +1,409 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_publish_queue.c
+ * @brief Non-blocking publish API built on MQTTAgent_Publish.
+ *
+ * Each queue owns uxDepth publish slots holding a copy of the payload and the
+ * MQTTPublishInfo_t referenced by the agent until the publish completes. The
+ * agent's completion callback posts the slot to a FreeRTOS queue, from which the
+ * owning task collects completions in batches and recycles the slots.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_ERROR
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+
+#include "mqtt_publish_queue.h"
+
+/*-----------------------------------------------------------*/
+
+typedef struct MQTTAgentPublishSlot
+{
+    MQTTPublishInfo_t xPublishInfo;
+    struct MQTTAgentPublishQueue * pxQueue;
+    MQTTStatus_t xStatus;
+    uint8_t * pucPayload;
+} PublishSlot_t;
+
+struct MQTTAgentPublishQueue
+{
+    MQTTAgentHandle_t xAgentHandle;
+    QueueHandle_t xCompletionQueue;
+    size_t uxDepth;
+    size_t uxMaxPayloadLen;
+
+    /* Stack of slots not currently owned by the agent, only accessed by the owning task */
+    PublishSlot_t ** ppxFreeSlots;
+    size_t uxFreeCount;
+
+    MQTTAgentPublishStats_t xStats;
+
+    /* Set by MqttAgent_PublishQueueDelete, the last abandoned completion frees the queue */
+    bool xAbandoned;
+    size_t uxAbandonedCount;
+
+    PublishSlot_t pxSlots[];
+};
+
+/*-----------------------------------------------------------*/
+
+/* Called from the MQTT agent task once a publish has been sent (QoS0) or acknowledged (QoS1/2). */
+static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                        MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    PublishSlot_t * pxSlot = ( PublishSlot_t * ) pxCommandContext;
+    struct MQTTAgentPublishQueue * pxQueue = NULL;
+    bool xAbandoned = false;
+    bool xFreeQueue = false;
+
+    configASSERT( pxSlot != NULL );
+    configASSERT( pxReturnInfo != NULL );
+
+    pxQueue = pxSlot->pxQueue;
+    pxSlot->xStatus = pxReturnInfo->returnCode;
+
+    /* Both tasks only touch the abandon state with the scheduler suspended */
+    vTaskSuspendAll();
+    {
+        xAbandoned = pxQueue->xAbandoned;
+
+        if( xAbandoned )
+        {
+            pxQueue->uxAbandonedCount--;
+            xFreeQueue = ( pxQueue->uxAbandonedCount == 0 );
+        }
+        else
+        {
+            /* The completion queue is sized to hold every slot so this never blocks */
+            ( void ) xQueueSendToBack( pxQueue->xCompletionQueue, &pxSlot, 0 );
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+    if( xFreeQueue )
+    {
+        LogDebug( "Freeing abandoned publish queue %p.", pxQueue );
+        vQueueDelete( pxQueue->xCompletionQueue );
+        vPortFree( pxQueue );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTAgentPublishQueueHandle_t MqttAgent_PublishQueueCreate( MQTTAgentHandle_t xHandle,
+                                                            size_t uxDepth,
+                                                            size_t uxMaxPayloadLen )
+{
+    struct MQTTAgentPublishQueue * pxQueue = NULL;
+    size_t uxAllocLen = 0;
+
+    if( ( xHandle == NULL ) ||
+        ( uxDepth == 0 ) ||
+        ( uxMaxPayloadLen == 0 ) )
+    {
+        LogError( "Invalid parameter." );
+    }
+    else
+    {
+        uxAllocLen = sizeof( struct MQTTAgentPublishQueue ) +
+                     ( uxDepth * sizeof( PublishSlot_t ) ) +
+                     ( uxDepth * sizeof( PublishSlot_t * ) ) +
+                     ( uxDepth * uxMaxPayloadLen );
+
+        pxQueue = pvPortMalloc( uxAllocLen );
+
+        if( pxQueue == NULL )
+        {
+            LogError( "Failed to allocate %d bytes for publish queue.", uxAllocLen );
+        }
+    }
+
+    if( pxQueue != NULL )
+    {
+        uint8_t * pucPayloads = NULL;
+
+        memset( pxQueue, 0, sizeof( struct MQTTAgentPublishQueue ) );
+
+        pxQueue->xAgentHandle = xHandle;
+        pxQueue->uxDepth = uxDepth;
+        pxQueue->uxMaxPayloadLen = uxMaxPayloadLen;
+        pxQueue->ppxFreeSlots = ( PublishSlot_t ** ) &( pxQueue->pxSlots[ uxDepth ] );
+        pxQueue->xStats.xLastError = MQTTSuccess;
+
+        pucPayloads = ( uint8_t * ) &( pxQueue->ppxFreeSlots[ uxDepth ] );
+
+        for( size_t uxIdx = 0; uxIdx < uxDepth; uxIdx++ )
+        {
+            PublishSlot_t * pxSlot = &( pxQueue->pxSlots[ uxIdx ] );
+
+            memset( pxSlot, 0, sizeof( PublishSlot_t ) );
+            pxSlot->pxQueue = pxQueue;
+            pxSlot->pucPayload = &( pucPayloads[ uxIdx * uxMaxPayloadLen ] );
+
+            pxQueue->ppxFreeSlots[ uxIdx ] = pxSlot;
+        }
+
+        pxQueue->uxFreeCount = uxDepth;
+
+        pxQueue->xCompletionQueue = xQueueCreate( uxDepth, sizeof( PublishSlot_t * ) );
+
+        if( pxQueue->xCompletionQueue == NULL )
+        {
+            LogError( "Failed to allocate publish completion queue." );
+            vPortFree( pxQueue );
+            pxQueue = NULL;
+        }
+    }
+
+    return pxQueue;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_PublishQueueDelete( MQTTAgentPublishQueueHandle_t xQueue )
+{
+    if( xQueue != NULL )
+    {
+        TickType_t xTicksToWait = pdMS_TO_TICKS( MQTT_PUBLISH_QUEUE_DELETE_TIMEOUT_MS );
+        TimeOut_t xTimeOut;
+        bool xFreeQueue = true;
+
+        vTaskSetTimeOutState( &xTimeOut );
+
+        /* The agent still references the slots of outstanding publishes */
+        while( ( xQueue->xStats.uxOutstanding > 0 ) &&
+               ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE ) )
+        {
+            ( void ) MqttAgent_PublishQueueReap( xQueue, xTicksToWait );
+        }
+
+        if( xQueue->xStats.uxOutstanding > 0 )
+        {
+            size_t uxAbandonedCount = 0;
+
+            vTaskSuspendAll();
+            {
+                /* Completions already queued no longer need the agent */
+                uxAbandonedCount = xQueue->xStats.uxOutstanding -
+                                   ( size_t ) uxQueueMessagesWaiting( xQueue->xCompletionQueue );
+                xQueue->uxAbandonedCount = uxAbandonedCount;
+                xQueue->xAbandoned = true;
+            }
+            ( void ) xTaskResumeAll();
+
+            /* Past this point the agent may free the queue at any time */
+            xFreeQueue = ( uxAbandonedCount == 0 );
+
+            if( !xFreeQueue )
+            {
+                LogWarn( "Abandoning %lu outstanding publish(es), the queue is freed once they complete.",
+                         ( unsigned long ) uxAbandonedCount );
+            }
+        }
+
+        if( xFreeQueue )
+        {
+            vQueueDelete( xQueue->xCompletionQueue );
+            vPortFree( xQueue );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+size_t MqttAgent_PublishQueueReap( MQTTAgentPublishQueueHandle_t xQueue,
+                                   TickType_t xTicksToWait )
+{
+    size_t uxCount = 0;
+    PublishSlot_t * pxSlot = NULL;
+
+    if( xQueue == NULL )
+    {
+        LogError( "Invalid parameter." );
+    }
+    else
+    {
+        while( ( xQueue->xStats.uxOutstanding > 0 ) &&
+               ( xQueueReceive( xQueue->xCompletionQueue,
+                                &pxSlot,
+                                ( uxCount == 0 ) ? xTicksToWait : 0 ) == pdTRUE ) )
+        {
+            configASSERT( pxSlot->pxQueue == xQueue );
+
+            if( pxSlot->xStatus == MQTTSuccess )
+            {
+                xQueue->xStats.ulCompleted++;
+            }
+            else
+            {
+                LogDebug( "Publish to topic=\"%.*s\" failed with status=%s.",
+                          pxSlot->xPublishInfo.topicNameLength,
+                          pxSlot->xPublishInfo.pTopicName,
+                          MQTT_Status_strerror( pxSlot->xStatus ) );
+
+                xQueue->xStats.ulFailed++;
+                xQueue->xStats.xLastError = pxSlot->xStatus;
+            }
+
+            xQueue->xStats.uxOutstanding--;
+            xQueue->ppxFreeSlots[ xQueue->uxFreeCount ] = pxSlot;
+            xQueue->uxFreeCount++;
+            uxCount++;
+        }
+    }
+
+    return uxCount;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_PublishAsync( MQTTAgentPublishQueueHandle_t xQueue,
+                                     const char * pcTopic,
+                                     MQTTQoS_t xQoS,
+                                     const void * pvPayload,
+                                     size_t uxPayloadLen,
+                                     TickType_t xTicksToWait )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    size_t uxTopicLen = 0;
+    TimeOut_t xTimeOut;
+
+    vTaskSetTimeOutState( &xTimeOut );
+
+    if( ( xQueue == NULL ) ||
+        ( pcTopic == NULL ) ||
+        ( pvPayload == NULL ) ||
+        ( uxPayloadLen == 0 ) ||
+        ( xQoS > MQTTQoS2 ) )
+    {
+        xStatus = MQTTBadParameter;
+    }
+    else if( uxPayloadLen > xQueue->uxMaxPayloadLen )
+    {
+        LogError( "Payload length %d exceeds the queue's limit of %d bytes.",
+                  uxPayloadLen, xQueue->uxMaxPayloadLen );
+        xStatus = MQTTBadParameter;
+    }
+    else
+    {
+        uxTopicLen = strnlen( pcTopic, UINT16_MAX );
+
+        if( ( uxTopicLen == 0 ) || ( uxTopicLen >= UINT16_MAX ) )
+        {
+            xStatus = MQTTBadParameter;
+        }
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        /* Recycle completed slots, waiting only if every slot is outstanding */
+        ( void ) MqttAgent_PublishQueueReap( xQueue, ( xQueue->uxFreeCount == 0 ) ? xTicksToWait : 0 );
+
+        if( xQueue->uxFreeCount == 0 )
+        {
+            xStatus = MQTTNoMemory;
+        }
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        PublishSlot_t * pxSlot = NULL;
+
+        xQueue->uxFreeCount--;
+        pxSlot = xQueue->ppxFreeSlots[ xQueue->uxFreeCount ];
+
+        ( void ) memcpy( pxSlot->pucPayload, pvPayload, uxPayloadLen );
+
+        pxSlot->xStatus = MQTTIllegalState;
+        pxSlot->xPublishInfo.qos = xQoS;
+        pxSlot->xPublishInfo.retain = false;
+        pxSlot->xPublishInfo.dup = false;
+        pxSlot->xPublishInfo.pTopicName = pcTopic;
+        pxSlot->xPublishInfo.topicNameLength = ( uint16_t ) uxTopicLen;
+        pxSlot->xPublishInfo.pPayload = pxSlot->pucPayload;
+        pxSlot->xPublishInfo.payloadLength = uxPayloadLen;
+
+        /* Spend whatever is left of xTicksToWait enqueueing the command */
+        ( void ) xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait );
+
+        MQTTAgentCommandInfo_t xCommandParams =
+        {
+            .blockTimeMs                 = ( uint32_t ) ( xTicksToWait * portTICK_PERIOD_MS ),
+            .cmdCompleteCallback         = prvPublishCompleteCallback,
+            .pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) pxSlot,
+        };
+
+        xStatus = MQTTAgent_Publish( xQueue->xAgentHandle,
+                                     &( pxSlot->xPublishInfo ),
+                                     &xCommandParams );
+
+        if( xStatus == MQTTSuccess )
+        {
+            xQueue->xStats.ulSubmitted++;
+            xQueue->xStats.uxOutstanding++;
+
+            if( xQueue->xStats.uxOutstanding > xQueue->xStats.uxMaxOutstanding )
+            {
+                xQueue->xStats.uxMaxOutstanding = xQueue->xStats.uxOutstanding;
+            }
+        }
+        else
+        {
+            /* The agent did not take ownership of the slot */
+            xQueue->ppxFreeSlots[ xQueue->uxFreeCount ] = pxSlot;
+            xQueue->uxFreeCount++;
+        }
+    }
+
+    if( ( xStatus != MQTTSuccess ) && ( xQueue != NULL ) )
+    {
+        xQueue->xStats.ulFailed++;
+        xQueue->xStats.xLastError = xStatus;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_PublishQueueGetStats( MQTTAgentPublishQueueHandle_t xQueue,
+                                     MQTTAgentPublishStats_t * pxStats )
+{
+    if( ( xQueue != NULL ) && ( pxStats != NULL ) )
+    {
+        *pxStats = xQueue->xStats;
+    }
+}
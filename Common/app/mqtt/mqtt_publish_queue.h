@@ -0,0 +1,134 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_publish_queue.h
+ * @brief Non-blocking publish API allowing several publishes to be outstanding
+ * at once, with completions collected in batches by the publishing task.
+ */
+#ifndef MQTT_PUBLISH_QUEUE_H
+#define MQTT_PUBLISH_QUEUE_H
+
+#include "FreeRTOS.h"
+
+/* MQTT agent includes. */
+#include "core_mqtt_agent.h"
+#include "mqtt_agent_task.h"
+
+/**
+ * @brief Time MqttAgent_PublishQueueDelete waits for outstanding publishes to
+ * complete before abandoning them.
+ */
+#ifndef MQTT_PUBLISH_QUEUE_DELETE_TIMEOUT_MS
+    #define MQTT_PUBLISH_QUEUE_DELETE_TIMEOUT_MS    ( 10000 )
+#endif
+
+/**
+ * @brief Handle for a publish queue owned by a single publishing task.
+ */
+typedef struct MQTTAgentPublishQueue * MQTTAgentPublishQueueHandle_t;
+
+/**
+ * @brief Counters describing the activity of a publish queue.
+ */
+typedef struct
+{
+    uint32_t ulSubmitted;      /**< Publishes accepted by the MQTT agent. */
+    uint32_t ulCompleted;      /**< Publishes completed successfully. */
+    uint32_t ulFailed;         /**< Publishes rejected by the agent or completed with an error. */
+    size_t uxOutstanding;      /**< Publishes currently awaiting completion. */
+    size_t uxMaxOutstanding;   /**< High-water mark of uxOutstanding. */
+    MQTTStatus_t xLastError;   /**< Status of the most recent failed publish. */
+} MQTTAgentPublishStats_t;
+
+/**
+ * @brief Create a publish queue.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] uxDepth Maximum number of publishes that may be outstanding at once.
+ * @param[in] uxMaxPayloadLen Size of the payload buffer reserved for each outstanding publish.
+ * @return Handle to the new queue, or NULL if memory could not be allocated.
+ */
+MQTTAgentPublishQueueHandle_t MqttAgent_PublishQueueCreate( MQTTAgentHandle_t xHandle,
+                                                            size_t uxDepth,
+                                                            size_t uxMaxPayloadLen );
+
+/**
+ * @brief Wait for outstanding publishes to complete and free the queue.
+ *
+ * Publishes still outstanding after MQTT_PUBLISH_QUEUE_DELETE_TIMEOUT_MS, for
+ * instance because the connection dropped before their acknowledgment arrived,
+ * are abandoned. Their slots remain allocated until the MQTT agent completes or
+ * cancels them, which it does at the latest on disconnect, and the queue is
+ * freed by the last of these completions. Their topic strings must remain valid
+ * until then.
+ */
+void MqttAgent_PublishQueueDelete( MQTTAgentPublishQueueHandle_t xQueue );
+
+/**
+ * @brief Copy a payload into the queue and hand it to the MQTT agent without
+ * waiting for the publish to complete.
+ *
+ * When all uxDepth slots are outstanding, completions are collected until a slot
+ * becomes free or xTicksToWait expires.
+ *
+ * @note The topic string is not copied and must remain valid until the publish
+ * has completed, i.e. until a later call to MqttAgent_PublishQueueReap returns it.
+ *
+ * @param[in] xQueue Publish queue handle.
+ * @param[in] pcTopic Topic to publish to.
+ * @param[in] xQoS QoS of the publish.
+ * @param[in] pvPayload Payload to publish, copied into the queue.
+ * @param[in] uxPayloadLen Length of the payload. Must not exceed the queue's uxMaxPayloadLen.
+ * @param[in] xTicksToWait Time to wait for a free slot.
+ * @return `MQTTSuccess` if the publish was handed to the agent, `MQTTNoMemory` if
+ * no slot became available, or the error returned by MQTTAgent_Publish.
+ */
+MQTTStatus_t MqttAgent_PublishAsync( MQTTAgentPublishQueueHandle_t xQueue,
+                                     const char * pcTopic,
+                                     MQTTQoS_t xQoS,
+                                     const void * pvPayload,
+                                     size_t uxPayloadLen,
+                                     TickType_t xTicksToWait );
+
+/**
+ * @brief Collect the publishes completed since the last call.
+ *
+ * Blocks for up to xTicksToWait for the first completion, then returns every
+ * completion already available without blocking further.
+ *
+ * @return The number of publishes collected.
+ */
+size_t MqttAgent_PublishQueueReap( MQTTAgentPublishQueueHandle_t xQueue,
+                                   TickType_t xTicksToWait );
+
+/**
+ * @brief Copy the queue's counters into pxStats.
+ */
+void MqttAgent_PublishQueueGetStats( MQTTAgentPublishQueueHandle_t xQueue,
+                                     MQTTAgentPublishStats_t * pxStats );
+
+#endif /* MQTT_PUBLISH_QUEUE_H */
@@ -0,0 +1,785 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_publish_spool.c
+ * @brief Persistent store-and-forward spool for publishes made while offline.
+ *
+ * Records are appended to numbered segment files in SPOOL_DIR. Each record
+ * carries a CRC over its header, topic and payload. Records are collected in a
+ * RAM buffer and written with a single open / append / close sequence, so that
+ * littlefs commits them atomically and copies the partially filled last block
+ * of the segment once per batch rather than once per record. Segments are
+ * consumed in FIFO order: the oldest segment is removed once fully drained, or
+ * evicted when the spool reaches MQTT_SPOOL_MAX_SEGMENTS.
+ *
+ * The read position within the oldest segment is only kept in RAM, so records
+ * drained from a partially consumed segment may be published again after a reset.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_ERROR
+#include "logging.h"
+
+/* Standard includes. */
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#include "lfs.h"
+#include "lfs_port.h"
+
+#include "mqtt_agent_task.h"
+#include "mqtt_publish_queue.h"
+#include "mqtt_publish_spool.h"
+
+#define SPOOL_DIR                    "/spool"
+#define SPOOL_SEGMENT_NAME_LEN       ( 8 )
+#define SPOOL_PATH_MAX_LEN           ( sizeof( SPOOL_DIR "/" ) + SPOOL_SEGMENT_NAME_LEN )
+#define SPOOL_RECORD_MAGIC           ( 0x5053U )
+#define SPOOL_IDLE_POLL_MS           ( 5000 )
+#define SPOOL_PUBLISH_BLOCK_TIME_MS  ( 1000 )
+#define SPOOL_REAP_TIMEOUT_MS        ( 10000 )
+
+typedef struct
+{
+    uint16_t usMagic;
+    uint16_t usTopicLen;
+    uint16_t usPayloadLen;
+    uint8_t ucQoS;
+    uint8_t ucReserved;
+    uint32_t ulCrc;
+} SpoolRecordHeader_t;
+
+static_assert( ( sizeof( SpoolRecordHeader_t ) + MQTT_SPOOL_MAX_TOPIC_LEN + MQTT_SPOOL_MAX_PAYLOAD_LEN ) <= MQTT_SPOOL_SEGMENT_SIZE,
+               "A record of maximum size must fit in a single segment." );
+
+static_assert( ( sizeof( SpoolRecordHeader_t ) + MQTT_SPOOL_MAX_TOPIC_LEN + MQTT_SPOOL_MAX_PAYLOAD_LEN ) <= MQTT_SPOOL_WRITE_BUFFER_SIZE,
+               "A record of maximum size must fit in the write buffer." );
+
+typedef struct
+{
+    MQTTQoS_t xQoS;
+    size_t uxPayloadLen;
+    char pcTopic[ MQTT_SPOOL_MAX_TOPIC_LEN + 1 ];
+    uint8_t pucPayload[ MQTT_SPOOL_MAX_PAYLOAD_LEN ];
+} SpoolRecord_t;
+
+/* Position after the last record of a batch, committed once the batch is published. */
+typedef struct
+{
+    uint32_t ulSeq;
+    uint32_t ulOffset;
+} SpoolCursor_t;
+
+typedef struct
+{
+    SemaphoreHandle_t xMutex;
+    StaticSemaphore_t xMutexStorage;
+    lfs_t * pxLfsCtx;
+    TaskHandle_t xDrainTask;
+    bool xInitialized;
+
+    /* Segment files are numbered ulHeadSeq to ulTailSeq inclusive. */
+    uint32_t ulHeadSeq;
+    uint32_t ulHeadOffset;
+    uint32_t ulTailSeq;
+    uint32_t ulTailSize;
+
+    /* Records not yet written, they follow the ulTailSize bytes of the tail segment. */
+    uint32_t ulBufferedLen;
+    uint32_t ulBufferedRecords;
+    TickType_t xBufferedSince;
+    uint8_t pucWriteBuffer[ MQTT_SPOOL_WRITE_BUFFER_SIZE ];
+
+    MqttSpoolStats_t xStats;
+} SpoolCtx_t;
+
+static SpoolCtx_t xSpoolCtx = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static inline void prvSegmentPath( char * pcPath,
+                                   uint32_t ulSeq )
+{
+    ( void ) snprintf( pcPath, SPOOL_PATH_MAX_LEN, SPOOL_DIR "/%08lx", ( unsigned long ) ulSeq );
+}
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t prvRecordCrc( const SpoolRecordHeader_t * pxHeader,
+                                     const void * pvTopic,
+                                     const void * pvPayload )
+{
+    uint32_t ulCrc = 0xFFFFFFFFUL;
+
+    ulCrc = lfs_crc( ulCrc, pxHeader, offsetof( SpoolRecordHeader_t, ulCrc ) );
+    ulCrc = lfs_crc( ulCrc, pvTopic, pxHeader->usTopicLen );
+    ulCrc = lfs_crc( ulCrc, pvPayload, pxHeader->usPayloadLen );
+
+    return ulCrc;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline bool prvIsEmptyLocked( void )
+{
+    return( ( xSpoolCtx.ulHeadSeq == xSpoolCtx.ulTailSeq ) &&
+            ( xSpoolCtx.ulHeadOffset >= xSpoolCtx.ulTailSize ) &&
+            ( xSpoolCtx.ulBufferedLen == 0 ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static inline void prvUpdateSegmentCount( void )
+{
+    xSpoolCtx.xStats.ulSegments = ( ( xSpoolCtx.ulTailSize + xSpoolCtx.ulBufferedLen ) > 0 ) ?
+                                  ( xSpoolCtx.ulTailSeq - xSpoolCtx.ulHeadSeq + 1 ) :
+                                  ( xSpoolCtx.ulTailSeq - xSpoolCtx.ulHeadSeq );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Remove the oldest segment. Must be called with the mutex held and ulHeadSeq != ulTailSeq. */
+static void prvRemoveHeadSegment( void )
+{
+    char pcPath[ SPOOL_PATH_MAX_LEN ];
+    int lError;
+
+    configASSERT( xSpoolCtx.ulHeadSeq != xSpoolCtx.ulTailSeq );
+
+    prvSegmentPath( pcPath, xSpoolCtx.ulHeadSeq );
+
+    lError = lfs_remove( xSpoolCtx.pxLfsCtx, pcPath );
+
+    if( ( lError != LFS_ERR_OK ) && ( lError != LFS_ERR_NOENT ) )
+    {
+        LogError( "Failed to remove spool segment %s, lError: %d.", pcPath, lError );
+    }
+
+    xSpoolCtx.ulHeadSeq++;
+    xSpoolCtx.ulHeadOffset = 0;
+    prvUpdateSegmentCount();
+}
+
+/*-----------------------------------------------------------*/
+
+/* Discard the remaining records when the only segment has been fully drained. */
+static void prvResetIfDrained( void )
+{
+    if( ( xSpoolCtx.ulTailSize > 0 ) && prvIsEmptyLocked() )
+    {
+        xSpoolCtx.ulTailSeq++;
+        xSpoolCtx.ulTailSize = 0;
+        prvRemoveHeadSegment();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Find the existing segments left over from a previous boot. */
+static bool prvScanSegments( void )
+{
+    struct lfs_info xInfo = { 0 };
+    lfs_dir_t xDir = { 0 };
+    bool xFound = false;
+    int lError;
+
+    xSpoolCtx.pxLfsCtx = pxGetDefaultFsCtx();
+
+    lError = lfs_stat( xSpoolCtx.pxLfsCtx, SPOOL_DIR, &xInfo );
+
+    if( lError == LFS_ERR_NOENT )
+    {
+        lError = lfs_mkdir( xSpoolCtx.pxLfsCtx, SPOOL_DIR );
+    }
+
+    if( lError == LFS_ERR_OK )
+    {
+        lError = lfs_dir_open( xSpoolCtx.pxLfsCtx, &xDir, SPOOL_DIR );
+    }
+
+    if( lError != LFS_ERR_OK )
+    {
+        LogError( "Failed to open spool directory, lError: %d.", lError );
+    }
+    else
+    {
+        while( lfs_dir_read( xSpoolCtx.pxLfsCtx, &xDir, &xInfo ) > 0 )
+        {
+            char * pcEnd = NULL;
+            uint32_t ulSeq = 0;
+
+            if( ( xInfo.type != LFS_TYPE_REG ) ||
+                ( strlen( xInfo.name ) != SPOOL_SEGMENT_NAME_LEN ) )
+            {
+                continue;
+            }
+
+            ulSeq = ( uint32_t ) strtoul( xInfo.name, &pcEnd, 16 );
+
+            if( *pcEnd != '\0' )
+            {
+                continue;
+            }
+
+            if( !xFound || ( ulSeq < xSpoolCtx.ulHeadSeq ) )
+            {
+                xSpoolCtx.ulHeadSeq = ulSeq;
+            }
+
+            if( !xFound || ( ulSeq >= xSpoolCtx.ulTailSeq ) )
+            {
+                xSpoolCtx.ulTailSeq = ulSeq;
+                xSpoolCtx.ulTailSize = xInfo.size;
+            }
+
+            xFound = true;
+        }
+
+        ( void ) lfs_dir_close( xSpoolCtx.pxLfsCtx, &xDir );
+
+        xSpoolCtx.ulHeadOffset = 0;
+
+        /* An empty tail segment is reused by the next append. */
+        if( xSpoolCtx.ulTailSize == 0 )
+        {
+            xSpoolCtx.ulHeadSeq = xSpoolCtx.ulTailSeq;
+        }
+
+        prvUpdateSegmentCount();
+
+        LogInfo( "Spool holds %lu segment(s).", xSpoolCtx.xStats.ulSegments );
+    }
+
+    return( lError == LFS_ERR_OK );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Append the buffered records to the tail segment. Must be called with the mutex held. */
+static bool prvFlushBuffer( void )
+{
+    bool xSuccess = true;
+
+    if( xSpoolCtx.ulBufferedLen > 0 )
+    {
+        char pcPath[ SPOOL_PATH_MAX_LEN ];
+        lfs_file_t xFile = { 0 };
+        lfs_ssize_t lResult;
+
+        prvSegmentPath( pcPath, xSpoolCtx.ulTailSeq );
+
+        lResult = lfs_file_open( xSpoolCtx.pxLfsCtx, &xFile, pcPath, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND );
+
+        if( lResult == LFS_ERR_OK )
+        {
+            lResult = lfs_file_write( xSpoolCtx.pxLfsCtx, &xFile, xSpoolCtx.pucWriteBuffer, xSpoolCtx.ulBufferedLen );
+
+            xSuccess = ( lResult == ( lfs_ssize_t ) xSpoolCtx.ulBufferedLen );
+
+            /* Drop a partially written batch so that it is never committed */
+            if( !xSuccess )
+            {
+                ( void ) lfs_file_truncate( xSpoolCtx.pxLfsCtx, &xFile, xSpoolCtx.ulTailSize );
+            }
+
+            lResult = lfs_file_close( xSpoolCtx.pxLfsCtx, &xFile );
+
+            xSuccess = xSuccess && ( lResult == LFS_ERR_OK );
+        }
+        else
+        {
+            xSuccess = false;
+        }
+
+        if( xSuccess )
+        {
+            xSpoolCtx.ulTailSize += xSpoolCtx.ulBufferedLen;
+            xSpoolCtx.xStats.ulFlashWrites++;
+        }
+        else
+        {
+            LogError( "Failed to append %lu record(s) to spool segment %s, lResult: %ld.",
+                      ( unsigned long ) xSpoolCtx.ulBufferedRecords, pcPath, ( long ) lResult );
+            xSpoolCtx.xStats.ulEnqueueErrors += xSpoolCtx.ulBufferedRecords;
+        }
+
+        xSpoolCtx.ulBufferedLen = 0;
+        xSpoolCtx.ulBufferedRecords = 0;
+        prvUpdateSegmentCount();
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvLock( void )
+{
+    if( xSpoolCtx.xMutex == NULL )
+    {
+        vTaskSuspendAll();
+
+        if( xSpoolCtx.xMutex == NULL )
+        {
+            xSpoolCtx.xMutex = xSemaphoreCreateMutexStatic( &( xSpoolCtx.xMutexStorage ) );
+        }
+
+        ( void ) xTaskResumeAll();
+    }
+
+    ( void ) xSemaphoreTake( xSpoolCtx.xMutex, portMAX_DELAY );
+
+    if( !xSpoolCtx.xInitialized )
+    {
+        xSpoolCtx.xInitialized = prvScanSegments();
+    }
+
+    if( !xSpoolCtx.xInitialized )
+    {
+        ( void ) xSemaphoreGive( xSpoolCtx.xMutex );
+    }
+
+    return xSpoolCtx.xInitialized;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline void prvUnlock( void )
+{
+    ( void ) xSemaphoreGive( xSpoolCtx.xMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSpool_Enqueue( const char * pcTopic,
+                        MQTTQoS_t xQoS,
+                        const void * pvPayload,
+                        size_t uxPayloadLen )
+{
+    bool xSuccess = false;
+    size_t uxTopicLen = ( pcTopic != NULL ) ? strnlen( pcTopic, MQTT_SPOOL_MAX_TOPIC_LEN + 1 ) : 0;
+
+    if( ( uxTopicLen == 0 ) || ( uxTopicLen > MQTT_SPOOL_MAX_TOPIC_LEN ) ||
+        ( pvPayload == NULL ) || ( uxPayloadLen > MQTT_SPOOL_MAX_PAYLOAD_LEN ) )
+    {
+        LogError( "Invalid spool record, topic length: %lu, payload length: %lu.",
+                  ( unsigned long ) uxTopicLen, ( unsigned long ) uxPayloadLen );
+    }
+    else if( prvLock() )
+    {
+        TickType_t xStartTime = xTaskGetTickCount();
+        uint32_t ulElapsedMs = 0;
+        uint8_t * pucRecord = NULL;
+        SpoolRecordHeader_t xHeader =
+        {
+            .usMagic      = SPOOL_RECORD_MAGIC,
+            .usTopicLen   = ( uint16_t ) uxTopicLen,
+            .usPayloadLen = ( uint16_t ) uxPayloadLen,
+            .ucQoS        = ( uint8_t ) xQoS,
+            .ucReserved   = 0,
+            .ulCrc        = 0
+        };
+        const uint32_t ulRecordLen = sizeof( xHeader ) + uxTopicLen + uxPayloadLen;
+
+        xHeader.ulCrc = prvRecordCrc( &xHeader, pcTopic, pvPayload );
+
+        /* Start a new segment when the current one is full */
+        if( ( xSpoolCtx.ulTailSize + xSpoolCtx.ulBufferedLen + ulRecordLen ) > MQTT_SPOOL_SEGMENT_SIZE )
+        {
+            ( void ) prvFlushBuffer();
+            prvResetIfDrained();
+
+            if( xSpoolCtx.ulTailSize > 0 )
+            {
+                xSpoolCtx.ulTailSeq++;
+                xSpoolCtx.ulTailSize = 0;
+            }
+        }
+        else if( ( xSpoolCtx.ulBufferedLen + ulRecordLen ) > MQTT_SPOOL_WRITE_BUFFER_SIZE )
+        {
+            ( void ) prvFlushBuffer();
+        }
+
+        /* Evict the oldest data to stay within the flash budget */
+        while( ( xSpoolCtx.ulTailSeq - xSpoolCtx.ulHeadSeq ) >= MQTT_SPOOL_MAX_SEGMENTS )
+        {
+            LogWarn( "Spool full, evicting segment %08lx.", ( unsigned long ) xSpoolCtx.ulHeadSeq );
+            xSpoolCtx.xStats.ulEvictedSegments++;
+            prvRemoveHeadSegment();
+        }
+
+        if( xSpoolCtx.ulBufferedLen == 0 )
+        {
+            xSpoolCtx.xBufferedSince = xStartTime;
+        }
+
+        pucRecord = &( xSpoolCtx.pucWriteBuffer[ xSpoolCtx.ulBufferedLen ] );
+        ( void ) memcpy( pucRecord, &xHeader, sizeof( xHeader ) );
+        ( void ) memcpy( &( pucRecord[ sizeof( xHeader ) ] ), pcTopic, uxTopicLen );
+        ( void ) memcpy( &( pucRecord[ sizeof( xHeader ) + uxTopicLen ] ), pvPayload, uxPayloadLen );
+
+        xSpoolCtx.ulBufferedLen += ulRecordLen;
+        xSpoolCtx.ulBufferedRecords++;
+        xSpoolCtx.xStats.ulEnqueued++;
+        xSuccess = true;
+
+        if( ( xTaskGetTickCount() - xSpoolCtx.xBufferedSince ) >= pdMS_TO_TICKS( MQTT_SPOOL_FLUSH_INTERVAL_MS ) )
+        {
+            ( void ) prvFlushBuffer();
+        }
+
+        ulElapsedMs = ( uint32_t ) ( ( xTaskGetTickCount() - xStartTime ) * portTICK_PERIOD_MS );
+
+        if( ulElapsedMs > xSpoolCtx.xStats.ulMaxEnqueueMs )
+        {
+            xSpoolCtx.xStats.ulMaxEnqueueMs = ulElapsedMs;
+        }
+
+        prvUpdateSegmentCount();
+
+        prvUnlock();
+
+        if( xSuccess && ( xSpoolCtx.xDrainTask != NULL ) )
+        {
+            ( void ) xTaskNotifyGive( xSpoolCtx.xDrainTask );
+        }
+    }
+    else
+    {
+        xSpoolCtx.xStats.ulEnqueueErrors++;
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+bool MqttSpool_IsEmpty( void )
+{
+    bool xEmpty = true;
+
+    if( prvLock() )
+    {
+        xEmpty = prvIsEmptyLocked();
+        prvUnlock();
+    }
+
+    return xEmpty;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttSpool_GetStats( MqttSpoolStats_t * pxStats )
+{
+    if( ( pxStats != NULL ) && prvLock() )
+    {
+        *pxStats = xSpoolCtx.xStats;
+        prvUnlock();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Read one record at the current file position. Returns false at the end of the
+ * segment or if the record is invalid, in which case *pxCorrupt is set. */
+static bool prvReadRecord( lfs_file_t * pxFile,
+                           SpoolRecord_t * pxRecord,
+                           uint32_t * pulRecordLen,
+                           bool * pxCorrupt )
+{
+    SpoolRecordHeader_t xHeader = { 0 };
+    lfs_ssize_t lResult;
+    bool xValid = false;
+
+    *pxCorrupt = false;
+
+    lResult = lfs_file_read( xSpoolCtx.pxLfsCtx, pxFile, &xHeader, sizeof( xHeader ) );
+
+    if( lResult == 0 )
+    {
+        /* End of segment */
+    }
+    else if( ( lResult != ( lfs_ssize_t ) sizeof( xHeader ) ) ||
+             ( xHeader.usMagic != SPOOL_RECORD_MAGIC ) ||
+             ( xHeader.usTopicLen == 0 ) ||
+             ( xHeader.usTopicLen > MQTT_SPOOL_MAX_TOPIC_LEN ) ||
+             ( xHeader.usPayloadLen > MQTT_SPOOL_MAX_PAYLOAD_LEN ) ||
+             ( xHeader.ucQoS > ( uint8_t ) MQTTQoS2 ) )
+    {
+        *pxCorrupt = true;
+    }
+    else if( ( lfs_file_read( xSpoolCtx.pxLfsCtx, pxFile, pxRecord->pcTopic, xHeader.usTopicLen ) != xHeader.usTopicLen ) ||
+             ( lfs_file_read( xSpoolCtx.pxLfsCtx, pxFile, pxRecord->pucPayload, xHeader.usPayloadLen ) != xHeader.usPayloadLen ) ||
+             ( prvRecordCrc( &xHeader, pxRecord->pcTopic, pxRecord->pucPayload ) != xHeader.ulCrc ) )
+    {
+        *pxCorrupt = true;
+    }
+    else
+    {
+        pxRecord->pcTopic[ xHeader.usTopicLen ] = '\0';
+        pxRecord->xQoS = ( MQTTQoS_t ) xHeader.ucQoS;
+        pxRecord->uxPayloadLen = xHeader.usPayloadLen;
+        *pulRecordLen = sizeof( xHeader ) + xHeader.usTopicLen + xHeader.usPayloadLen;
+        xValid = true;
+    }
+
+    return xValid;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Read up to uxMaxRecords from the oldest segment without consuming them. */
+static size_t prvReadBatch( SpoolRecord_t * pxRecords,
+                            size_t uxMaxRecords,
+                            SpoolCursor_t * pxCursor )
+{
+    size_t uxCount = 0;
+
+    if( prvLock() )
+    {
+        bool xDone = false;
+
+        while( !xDone && !prvIsEmptyLocked() )
+        {
+            char pcPath[ SPOOL_PATH_MAX_LEN ];
+            lfs_file_t xFile = { 0 };
+            uint32_t ulOffset = xSpoolCtx.ulHeadOffset;
+            bool xCorrupt = false;
+            int lError;
+
+            /* Only buffered records are left, write them out to read them back */
+            if( ( xSpoolCtx.ulHeadSeq == xSpoolCtx.ulTailSeq ) &&
+                ( ulOffset >= xSpoolCtx.ulTailSize ) &&
+                !prvFlushBuffer() )
+            {
+                break;
+            }
+
+            prvSegmentPath( pcPath, xSpoolCtx.ulHeadSeq );
+
+            lError = lfs_file_open( xSpoolCtx.pxLfsCtx, &xFile, pcPath, LFS_O_RDONLY );
+
+            if( lError == LFS_ERR_OK )
+            {
+                if( lfs_file_seek( xSpoolCtx.pxLfsCtx, &xFile, ( lfs_soff_t ) ulOffset, LFS_SEEK_SET ) < 0 )
+                {
+                    xCorrupt = true;
+                }
+
+                while( !xCorrupt && ( uxCount < uxMaxRecords ) )
+                {
+                    uint32_t ulRecordLen = 0;
+
+                    if( !prvReadRecord( &xFile, &( pxRecords[ uxCount ] ), &ulRecordLen, &xCorrupt ) )
+                    {
+                        break;
+                    }
+
+                    ulOffset += ulRecordLen;
+                    uxCount++;
+                }
+
+                ( void ) lfs_file_close( xSpoolCtx.pxLfsCtx, &xFile );
+            }
+            else
+            {
+                LogError( "Failed to open spool segment %s, lError: %d.", pcPath, lError );
+                xCorrupt = true;
+            }
+
+            if( uxCount > 0 )
+            {
+                /* Records preceding a corrupt one are published first, the
+                 * corrupt record is hit again by the next batch. */
+                pxCursor->ulSeq = xSpoolCtx.ulHeadSeq;
+                pxCursor->ulOffset = ulOffset;
+                xDone = true;
+            }
+            else
+            {
+                if( xCorrupt )
+                {
+                    LogWarn( "Discarding corrupt spool segment %s from offset %lu.",
+                             pcPath, ( unsigned long ) ulOffset );
+                    xSpoolCtx.xStats.ulCorruptRecords++;
+                }
+
+                if( xSpoolCtx.ulHeadSeq != xSpoolCtx.ulTailSeq )
+                {
+                    prvRemoveHeadSegment();
+                }
+                else
+                {
+                    /* Nothing left in the segment currently being appended to */
+                    xSpoolCtx.ulHeadOffset = xSpoolCtx.ulTailSize;
+                    prvResetIfDrained();
+                    xDone = true;
+                }
+            }
+        }
+
+        prvUnlock();
+    }
+
+    return uxCount;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCommitBatch( const SpoolCursor_t * pxCursor,
+                            size_t uxCount )
+{
+    if( prvLock() )
+    {
+        xSpoolCtx.xStats.ulDrained += uxCount;
+
+        /* The segment may have been evicted while the batch was in flight */
+        if( pxCursor->ulSeq == xSpoolCtx.ulHeadSeq )
+        {
+            xSpoolCtx.ulHeadOffset = pxCursor->ulOffset;
+            prvResetIfDrained();
+        }
+
+        prvUnlock();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Publish a batch and wait for every publish to complete. */
+static bool prvPublishBatch( MQTTAgentPublishQueueHandle_t xPublishQueue,
+                             SpoolRecord_t * pxRecords,
+                             size_t uxCount )
+{
+    MQTTAgentPublishStats_t xStatsBefore = { 0 };
+    MQTTAgentPublishStats_t xStatsAfter = { 0 };
+
+    MqttAgent_PublishQueueGetStats( xPublishQueue, &xStatsBefore );
+
+    for( size_t uxIdx = 0; uxIdx < uxCount; uxIdx++ )
+    {
+        MQTTStatus_t xStatus = MqttAgent_PublishAsync( xPublishQueue,
+                                                       pxRecords[ uxIdx ].pcTopic,
+                                                       pxRecords[ uxIdx ].xQoS,
+                                                       pxRecords[ uxIdx ].pucPayload,
+                                                       pxRecords[ uxIdx ].uxPayloadLen,
+                                                       pdMS_TO_TICKS( SPOOL_PUBLISH_BLOCK_TIME_MS ) );
+
+        if( xStatus != MQTTSuccess )
+        {
+            LogError( "Failed to publish spooled record, xStatus: %s.", MQTT_Status_strerror( xStatus ) );
+            break;
+        }
+    }
+
+    /* Topic buffers are referenced by the agent until each publish completes */
+    MqttAgent_PublishQueueGetStats( xPublishQueue, &xStatsAfter );
+
+    while( xStatsAfter.uxOutstanding > 0 )
+    {
+        if( MqttAgent_PublishQueueReap( xPublishQueue, pdMS_TO_TICKS( SPOOL_REAP_TIMEOUT_MS ) ) == 0 )
+        {
+            LogWarn( "Waiting for %lu spooled publish(es) to complete.",
+                     ( unsigned long ) xStatsAfter.uxOutstanding );
+        }
+
+        MqttAgent_PublishQueueGetStats( xPublishQueue, &xStatsAfter );
+    }
+
+    return( ( xStatsAfter.ulCompleted - xStatsBefore.ulCompleted ) == uxCount );
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttSpoolDrainTask( void * pvParameters )
+{
+    MQTTAgentPublishQueueHandle_t xPublishQueue = NULL;
+    SpoolRecord_t * pxRecords = NULL;
+
+    ( void ) pvParameters;
+
+    xSpoolCtx.xDrainTask = xTaskGetCurrentTaskHandle();
+
+    pxRecords = pvPortMalloc( MQTT_SPOOL_DRAIN_BATCH * sizeof( SpoolRecord_t ) );
+
+    vSleepUntilMQTTAgentReady();
+
+    xPublishQueue = MqttAgent_PublishQueueCreate( xGetMqttAgentHandle(),
+                                                  MQTT_SPOOL_DRAIN_BATCH,
+                                                  MQTT_SPOOL_MAX_PAYLOAD_LEN );
+
+    if( ( pxRecords == NULL ) || ( xPublishQueue == NULL ) )
+    {
+        LogError( "Failed to allocate spool drain buffers." );
+    }
+    else
+    {
+        for( ; ; )
+        {
+            SpoolCursor_t xCursor = { 0 };
+            size_t uxCount = 0;
+
+            vSleepUntilMQTTAgentConnected();
+
+            uxCount = prvReadBatch( pxRecords, MQTT_SPOOL_DRAIN_BATCH, &xCursor );
+
+            if( uxCount == 0 )
+            {
+                /* Wait for the next record to be spooled */
+                ( void ) ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( SPOOL_IDLE_POLL_MS ) );
+            }
+            else
+            {
+                if( prvPublishBatch( xPublishQueue, pxRecords, uxCount ) )
+                {
+                    prvCommitBatch( &xCursor, uxCount );
+                    LogDebug( "Drained %lu spooled record(s).", ( unsigned long ) uxCount );
+                }
+
+                vTaskDelay( pdMS_TO_TICKS( MQTT_SPOOL_DRAIN_INTERVAL_MS ) );
+            }
+        }
+    }
+
+    if( xPublishQueue != NULL )
+    {
+        MqttAgent_PublishQueueDelete( xPublishQueue );
+    }
+
+    vPortFree( pxRecords );
+
+    xSpoolCtx.xDrainTask = NULL;
+    vTaskDelete( NULL );
+}
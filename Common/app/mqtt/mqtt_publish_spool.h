@@ -0,0 +1,150 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_publish_spool.h
+ * @brief Persistent store-and-forward spool for publishes made while offline.
+ */
+#ifndef MQTT_PUBLISH_SPOOL_H
+#define MQTT_PUBLISH_SPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/* MQTT library includes. */
+#include "core_mqtt.h"
+
+/**
+ * @brief Maximum size of a single spool segment file in bytes.
+ */
+#ifndef MQTT_SPOOL_SEGMENT_SIZE
+    #define MQTT_SPOOL_SEGMENT_SIZE         ( 4096 )
+#endif
+
+/**
+ * @brief Maximum number of segment files. The oldest segment is evicted when
+ * appending a record would exceed this limit.
+ */
+#ifndef MQTT_SPOOL_MAX_SEGMENTS
+    #define MQTT_SPOOL_MAX_SEGMENTS         ( 16 )
+#endif
+
+#ifndef MQTT_SPOOL_MAX_TOPIC_LEN
+    #define MQTT_SPOOL_MAX_TOPIC_LEN        ( 192 )
+#endif
+
+#ifndef MQTT_SPOOL_MAX_PAYLOAD_LEN
+    #define MQTT_SPOOL_MAX_PAYLOAD_LEN      ( 512 )
+#endif
+
+/**
+ * @brief Size of the RAM buffer collecting records before they are appended to
+ * flash with a single write. Must hold a record of maximum size.
+ */
+#ifndef MQTT_SPOOL_WRITE_BUFFER_SIZE
+    #define MQTT_SPOOL_WRITE_BUFFER_SIZE    ( 1024 )
+#endif
+
+/**
+ * @brief Age at which buffered records are written out by the next enqueue,
+ * bounding what a reset can lose.
+ */
+#ifndef MQTT_SPOOL_FLUSH_INTERVAL_MS
+    #define MQTT_SPOOL_FLUSH_INTERVAL_MS    ( 30000 )
+#endif
+
+/**
+ * @brief Number of spooled records published per drain batch.
+ */
+#ifndef MQTT_SPOOL_DRAIN_BATCH
+    #define MQTT_SPOOL_DRAIN_BATCH          ( 4 )
+#endif
+
+/**
+ * @brief Delay between two drain batches, bounding the replay rate.
+ */
+#ifndef MQTT_SPOOL_DRAIN_INTERVAL_MS
+    #define MQTT_SPOOL_DRAIN_INTERVAL_MS    ( 250 )
+#endif
+
+/**
+ * @brief Counters describing the activity of the spool.
+ */
+typedef struct
+{
+    uint32_t ulEnqueued;         /**< Records appended to the spool. */
+    uint32_t ulEnqueueErrors;    /**< Records rejected or not written. */
+    uint32_t ulFlashWrites;      /**< Batches of buffered records appended to flash. */
+    uint32_t ulDrained;          /**< Records published and removed from the spool. */
+    uint32_t ulEvictedSegments;  /**< Segments discarded to make room for new records. */
+    uint32_t ulCorruptRecords;   /**< Records failing validation, discarded with the rest of their segment. */
+    uint32_t ulMaxEnqueueMs;     /**< Longest time spent appending a single record. */
+    uint32_t ulSegments;         /**< Segment files currently in use. */
+} MqttSpoolStats_t;
+
+/**
+ * @brief Append a publish to the spool.
+ *
+ * The record is buffered in RAM and appended to flash together with the
+ * following ones, once the buffer is full, MQTT_SPOOL_FLUSH_INTERVAL_MS after
+ * the first buffered record or when the drain task reaches it. Buffered records
+ * are lost on reset. vMqttSpoolDrainTask publishes the records once the MQTT
+ * agent is connected.
+ *
+ * @param[in] pcTopic NULL terminated topic to publish to.
+ * @param[in] xQoS QoS of the publish.
+ * @param[in] pvPayload Payload to publish.
+ * @param[in] uxPayloadLen Length of the payload.
+ * @return true if the record was written to the spool.
+ */
+bool MqttSpool_Enqueue( const char * pcTopic,
+                        MQTTQoS_t xQoS,
+                        const void * pvPayload,
+                        size_t uxPayloadLen );
+
+/**
+ * @brief Check whether any spooled records are waiting to be published.
+ *
+ * Publishers should route new data through MqttSpool_Enqueue while this returns
+ * false so that live data is not published ahead of older spooled data.
+ */
+bool MqttSpool_IsEmpty( void );
+
+/**
+ * @brief Copy the spool counters into pxStats.
+ */
+void MqttSpool_GetStats( MqttSpoolStats_t * pxStats );
+
+/**
+ * @brief Task publishing spooled records in rate limited batches whenever the
+ * MQTT agent is connected.
+ */
+void vMqttSpoolDrainTask( void * pvParameters );
+
+#endif /* MQTT_PUBLISH_SPOOL_H */
@@ -58,6 +58,28 @@
 typedef void (* IncomingPubCallback_t )( void * pvIncomingPublishCallbackContext,
                                          MQTTPublishInfo_t * pxPublishInfo );
 
+/**
+ * @brief Where a subscription callback is executed.
+ */
+typedef enum
+{
+    MQTTAgentDispatchInline = 0, /**< On the MQTT agent task, while the subscription list is locked. */
+    MQTTAgentDispatchDeferred    /**< On a dispatch worker task, with a private copy of the publish. */
+} MQTTAgentDispatchMode_t;
+
+/**
+ * @brief Execution statistics of a subscription callback.
+ *
+ * Times are expressed in run time stats counter units.
+ */
+typedef struct
+{
+    uint32_t ulInvocations;  /**< Number of times the callback returned. */
+    uint32_t ulDropped;      /**< Deferred invocations dropped because no worker was available. */
+    uint32_t ulTotalRunTime; /**< Total execution time. */
+    uint32_t ulMaxRunTime;   /**< Longest single execution time. */
+} MQTTAgentCallbackStats_t;
+
 /**
  * @brief An element in the list of subscriptions.
  *
@@ -76,8 +98,22 @@ typedef struct
     void * pvIncomingPublishCallbackContext;
     TaskHandle_t xTaskHandle;
     MQTTSubscribeInfo_t * pxSubInfo;
+    MQTTAgentDispatchMode_t xDispatchMode;
+    MQTTAgentCallbackStats_t xStats;
 } SubCallbackElement_t;
 
+/**
+ * @brief Snapshot of a registered callback returned by MqttAgent_GetCallbackStats.
+ */
+typedef struct
+{
+    IncomingPubCallback_t pxCallback;
+    void * pvCallbackCtx;
+    char pcTaskName[ configMAX_TASK_NAME_LEN ];
+    MQTTAgentDispatchMode_t xDispatchMode;
+    MQTTAgentCallbackStats_t xStats;
+} MQTTAgentCallbackInfo_t;
+
 
 /* @brief Add a callback for a given topic filter. Subscribe if not already subscribed.
  *
@@ -94,6 +130,27 @@ MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
                                       IncomingPubCallback_t pxCallback,
                                       void * pvCallbackCtx );
 
+/* @brief Add a callback for a given topic filter, selecting where the callback is executed.
+ *
+ * Callbacks which may take a long time, such as parsing a large document or
+ * writing to flash, should use MQTTAgentDispatchDeferred so that they do not
+ * delay keep-alives and other traffic handled by the MQTT agent task.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] pcTopicFilter Topic filter string to subscribe to.
+ * @param[in] xRequestedQoS Requested QoS for this subscription.
+ * @param[in] pxIncomingPublishCallback Callback function for the subscription.
+ * @param[in] pvIncomingPublishCallbackContext Context for the subscription callback.
+ * @param[in] xDispatchMode Task on which the callback is executed.
+ * @return `MQTTSuccess` if the subscription was added successfully.
+ **/
+MQTTStatus_t MqttAgent_SubscribeSyncEx( MQTTAgentHandle_t xHandle,
+                                        const char * pcTopicFilter,
+                                        MQTTQoS_t xRequestedQoS,
+                                        IncomingPubCallback_t pxCallback,
+                                        void * pvCallbackCtx,
+                                        MQTTAgentDispatchMode_t xDispatchMode );
+
 /* @brief Remove the specified callback from the given topic filter.
  * Unsubscribe from the specified topic is no other callback exist for the same filter.
  *
@@ -108,4 +165,15 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
                                         IncomingPubCallback_t pxCallback,
                                         void * pvCallbackCtx );
 
+/* @brief Copy the execution statistics of the registered callbacks.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[out] pxInfo Array to write the callback information to.
+ * @param[in] uxMaxEntries Number of elements in pxInfo.
+ * @return The number of entries written.
+ **/
+size_t MqttAgent_GetCallbackStats( MQTTAgentHandle_t xHandle,
+                                   MQTTAgentCallbackInfo_t * pxInfo,
+                                   size_t uxMaxEntries );
+
 #endif /* SUBSCRIPTION_MANAGER_H */
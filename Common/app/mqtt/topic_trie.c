@@ -0,0 +1,436 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file topic_trie.c
+ * @brief Prefix tree of MQTT topic filters, split on the '/' level separator.
+ *
+ * Looking up the filters matching a topic name costs roughly one node visit per
+ * topic level (plus one per wildcard branch), rather than one MQTT_MatchTopic call
+ * per registered filter.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_ERROR
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+
+#include "topic_trie.h"
+
+#define TOPIC_LEVEL_SEPARATOR       '/'
+#define TOPIC_SINGLE_LEVEL_WILDCARD "+"
+#define TOPIC_MULTI_LEVEL_WILDCARD  "#"
+
+/*-----------------------------------------------------------*/
+
+static inline size_t prvLevelEnd( const char * pcTopic,
+                                  size_t uxTopicLen,
+                                  size_t uxLevelStart )
+{
+    size_t uxLevelEnd = uxLevelStart;
+
+    while( ( uxLevelEnd < uxTopicLen ) &&
+           ( pcTopic[ uxLevelEnd ] != TOPIC_LEVEL_SEPARATOR ) )
+    {
+        uxLevelEnd++;
+    }
+
+    return uxLevelEnd;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline bool prvLevelIs( const char * pcLevel,
+                               size_t uxLevelLen,
+                               const char * pcWildcard )
+{
+    return( ( uxLevelLen == 1 ) && ( pcLevel[ 0 ] == pcWildcard[ 0 ] ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static TopicTrieNode_t * prvFindLiteralChild( const TopicTrieNode_t * pxNode,
+                                              const char * pcLevel,
+                                              size_t uxLevelLen )
+{
+    TopicTrieNode_t * pxChild = pxNode->pxChildren;
+
+    while( ( pxChild != NULL ) &&
+           ( ( pxChild->usLevelLen != uxLevelLen ) ||
+             ( memcmp( pxChild->pcLevel, pcLevel, uxLevelLen ) != 0 ) ) )
+    {
+        pxChild = pxChild->pxNext;
+    }
+
+    return pxChild;
+}
+
+/*-----------------------------------------------------------*/
+
+static TopicTrieNode_t * prvNodeCreate( TopicTrie_t * pxTrie,
+                                        TopicTrieNode_t * pxParent,
+                                        const char * pcLevel,
+                                        size_t uxLevelLen )
+{
+    TopicTrieNode_t * pxNode = pvPortMalloc( sizeof( TopicTrieNode_t ) + uxLevelLen );
+
+    if( pxNode == NULL )
+    {
+        LogError( "Failed to allocate %d bytes for a topic trie node.",
+                  sizeof( TopicTrieNode_t ) + uxLevelLen );
+    }
+    else
+    {
+        memset( pxNode, 0, sizeof( TopicTrieNode_t ) );
+        ( void ) memcpy( pxNode->pcLevel, pcLevel, uxLevelLen );
+
+        pxNode->usLevelLen = ( uint16_t ) uxLevelLen;
+        pxNode->pxParent = pxParent;
+
+        if( prvLevelIs( pcLevel, uxLevelLen, TOPIC_SINGLE_LEVEL_WILDCARD ) )
+        {
+            pxParent->pxSingleLevel = pxNode;
+        }
+        else if( prvLevelIs( pcLevel, uxLevelLen, TOPIC_MULTI_LEVEL_WILDCARD ) )
+        {
+            pxParent->pxMultiLevel = pxNode;
+        }
+        else
+        {
+            pxNode->pxNext = pxParent->pxChildren;
+            pxParent->pxChildren = pxNode;
+        }
+
+        pxTrie->uxNodeCount++;
+    }
+
+    return pxNode;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvNodeUnlink( TopicTrieNode_t * pxNode )
+{
+    TopicTrieNode_t * pxParent = pxNode->pxParent;
+
+    if( pxParent->pxSingleLevel == pxNode )
+    {
+        pxParent->pxSingleLevel = NULL;
+    }
+    else if( pxParent->pxMultiLevel == pxNode )
+    {
+        pxParent->pxMultiLevel = NULL;
+    }
+    else
+    {
+        TopicTrieNode_t ** ppxLink = &( pxParent->pxChildren );
+
+        while( ( *ppxLink != NULL ) && ( *ppxLink != pxNode ) )
+        {
+            ppxLink = &( ( *ppxLink )->pxNext );
+        }
+
+        configASSERT( *ppxLink == pxNode );
+
+        *ppxLink = pxNode->pxNext;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Free pxNode and any ancestors left without a value or children. */
+static void prvPrune( TopicTrie_t * pxTrie,
+                      TopicTrieNode_t * pxNode )
+{
+    while( ( pxNode != &( pxTrie->xRoot ) ) &&
+           ( pxNode->pvValue == NULL ) &&
+           ( pxNode->pxChildren == NULL ) &&
+           ( pxNode->pxSingleLevel == NULL ) &&
+           ( pxNode->pxMultiLevel == NULL ) )
+    {
+        TopicTrieNode_t * pxParent = pxNode->pxParent;
+
+        prvNodeUnlink( pxNode );
+        vPortFree( pxNode );
+
+        configASSERT( pxTrie->uxNodeCount > 0 );
+        pxTrie->uxNodeCount--;
+
+        pxNode = pxParent;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Walk the trie along pcTopicFilter, optionally creating missing levels. */
+static TopicTrieNode_t * prvFindFilter( TopicTrie_t * pxTrie,
+                                        const char * pcTopicFilter,
+                                        size_t uxTopicFilterLen,
+                                        bool xCreate )
+{
+    TopicTrieNode_t * pxNode = &( pxTrie->xRoot );
+    size_t uxLevelStart = 0;
+    bool xDone = false;
+
+    while( ( pxNode != NULL ) && !xDone )
+    {
+        size_t uxLevelEnd = prvLevelEnd( pcTopicFilter, uxTopicFilterLen, uxLevelStart );
+        const char * pcLevel = &( pcTopicFilter[ uxLevelStart ] );
+        size_t uxLevelLen = uxLevelEnd - uxLevelStart;
+        TopicTrieNode_t * pxChild = NULL;
+
+        xDone = ( uxLevelEnd == uxTopicFilterLen );
+
+        if( prvLevelIs( pcLevel, uxLevelLen, TOPIC_SINGLE_LEVEL_WILDCARD ) )
+        {
+            pxChild = pxNode->pxSingleLevel;
+        }
+        else if( prvLevelIs( pcLevel, uxLevelLen, TOPIC_MULTI_LEVEL_WILDCARD ) )
+        {
+            /* '#' is only valid as the last level of a topic filter. */
+            if( !xDone )
+            {
+                LogError( "Multi level wildcard is not the last level in filter=\"%.*s\".",
+                          uxTopicFilterLen, pcTopicFilter );
+
+                if( xCreate )
+                {
+                    /* Release the levels created so far for this filter. */
+                    prvPrune( pxTrie, pxNode );
+                    xCreate = false;
+                }
+            }
+            else
+            {
+                pxChild = pxNode->pxMultiLevel;
+            }
+        }
+        else
+        {
+            pxChild = prvFindLiteralChild( pxNode, pcLevel, uxLevelLen );
+        }
+
+        if( ( pxChild == NULL ) && xCreate )
+        {
+            pxChild = prvNodeCreate( pxTrie, pxNode, pcLevel, uxLevelLen );
+
+            if( pxChild == NULL )
+            {
+                /* Release the levels created so far for this filter. */
+                prvPrune( pxTrie, pxNode );
+            }
+        }
+
+        pxNode = pxChild;
+        uxLevelStart = uxLevelEnd + 1;
+    }
+
+    return pxNode;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvFreeSubtree( TopicTrieNode_t * pxNode )
+{
+    while( pxNode != NULL )
+    {
+        TopicTrieNode_t * pxNext = pxNode->pxNext;
+
+        prvFreeSubtree( pxNode->pxChildren );
+        prvFreeSubtree( pxNode->pxSingleLevel );
+        prvFreeSubtree( pxNode->pxMultiLevel );
+
+        vPortFree( pxNode );
+
+        pxNode = pxNext;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Match the topic levels starting at uxLevelStart against the children of pxNode.
+ * A uxLevelStart past the end of the topic name means all levels have been consumed.
+ */
+static size_t prvMatchLevel( const TopicTrieNode_t * pxNode,
+                             const char * pcTopicName,
+                             size_t uxTopicNameLen,
+                             size_t uxLevelStart,
+                             bool xAllowWildcards,
+                             TopicTrieMatchCallback_t pxCallback,
+                             void * pvCtx )
+{
+    size_t uxMatches = 0;
+
+    /* '#' matches the parent level and any number of child levels. */
+    if( xAllowWildcards &&
+        ( pxNode->pxMultiLevel != NULL ) &&
+        ( pxNode->pxMultiLevel->pvValue != NULL ) )
+    {
+        pxCallback( pvCtx, pxNode->pxMultiLevel->pvValue );
+        uxMatches++;
+    }
+
+    if( uxLevelStart > uxTopicNameLen )
+    {
+        if( pxNode->pvValue != NULL )
+        {
+            pxCallback( pvCtx, pxNode->pvValue );
+            uxMatches++;
+        }
+    }
+    else
+    {
+        size_t uxLevelEnd = prvLevelEnd( pcTopicName, uxTopicNameLen, uxLevelStart );
+        const TopicTrieNode_t * pxChild = prvFindLiteralChild( pxNode,
+                                                               &( pcTopicName[ uxLevelStart ] ),
+                                                               uxLevelEnd - uxLevelStart );
+
+        if( pxChild != NULL )
+        {
+            uxMatches += prvMatchLevel( pxChild, pcTopicName, uxTopicNameLen,
+                                        uxLevelEnd + 1, true, pxCallback, pvCtx );
+        }
+
+        if( xAllowWildcards && ( pxNode->pxSingleLevel != NULL ) )
+        {
+            uxMatches += prvMatchLevel( pxNode->pxSingleLevel, pcTopicName, uxTopicNameLen,
+                                        uxLevelEnd + 1, true, pxCallback, pvCtx );
+        }
+    }
+
+    return uxMatches;
+}
+
+/*-----------------------------------------------------------*/
+
+void TopicTrie_Init( TopicTrie_t * pxTrie )
+{
+    configASSERT( pxTrie );
+
+    memset( pxTrie, 0, sizeof( TopicTrie_t ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void TopicTrie_Clear( TopicTrie_t * pxTrie )
+{
+    configASSERT( pxTrie );
+
+    prvFreeSubtree( pxTrie->xRoot.pxChildren );
+    prvFreeSubtree( pxTrie->xRoot.pxSingleLevel );
+    prvFreeSubtree( pxTrie->xRoot.pxMultiLevel );
+
+    TopicTrie_Init( pxTrie );
+}
+
+/*-----------------------------------------------------------*/
+
+bool TopicTrie_Insert( TopicTrie_t * pxTrie,
+                       const char * pcTopicFilter,
+                       uint16_t usTopicFilterLen,
+                       void * pvValue )
+{
+    TopicTrieNode_t * pxNode = NULL;
+
+    if( ( pxTrie != NULL ) &&
+        ( pcTopicFilter != NULL ) &&
+        ( usTopicFilterLen > 0 ) &&
+        ( pvValue != NULL ) )
+    {
+        pxNode = prvFindFilter( pxTrie, pcTopicFilter, usTopicFilterLen, true );
+    }
+
+    if( pxNode != NULL )
+    {
+        if( pxNode->pvValue == NULL )
+        {
+            pxTrie->uxFilterCount++;
+        }
+
+        pxNode->pvValue = pvValue;
+    }
+
+    return( pxNode != NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+void * TopicTrie_Remove( TopicTrie_t * pxTrie,
+                         const char * pcTopicFilter,
+                         uint16_t usTopicFilterLen )
+{
+    TopicTrieNode_t * pxNode = NULL;
+    void * pvValue = NULL;
+
+    if( ( pxTrie != NULL ) &&
+        ( pcTopicFilter != NULL ) &&
+        ( usTopicFilterLen > 0 ) )
+    {
+        pxNode = prvFindFilter( pxTrie, pcTopicFilter, usTopicFilterLen, false );
+    }
+
+    if( ( pxNode != NULL ) && ( pxNode->pvValue != NULL ) )
+    {
+        pvValue = pxNode->pvValue;
+        pxNode->pvValue = NULL;
+
+        configASSERT( pxTrie->uxFilterCount > 0 );
+        pxTrie->uxFilterCount--;
+
+        prvPrune( pxTrie, pxNode );
+    }
+
+    return pvValue;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t TopicTrie_Match( const TopicTrie_t * pxTrie,
+                        const char * pcTopicName,
+                        uint16_t usTopicNameLen,
+                        TopicTrieMatchCallback_t pxCallback,
+                        void * pvCtx )
+{
+    size_t uxMatches = 0;
+
+    if( ( pxTrie != NULL ) &&
+        ( pcTopicName != NULL ) &&
+        ( usTopicNameLen > 0 ) &&
+        ( pxCallback != NULL ) )
+    {
+        /* Topic names starting with '$' cannot be matched by a leading wildcard. */
+        uxMatches = prvMatchLevel( &( pxTrie->xRoot ), pcTopicName, usTopicNameLen, 0,
+                                   ( pcTopicName[ 0 ] != '$' ), pxCallback, pvCtx );
+    }
+
+    return uxMatches;
+}
@@ -0,0 +1,120 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file topic_trie.h
+ * @brief Prefix tree of MQTT topic filters used to dispatch incoming publishes.
+ */
+#ifndef TOPIC_TRIE_H
+#define TOPIC_TRIE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A single level of a topic filter.
+ *
+ * Literal levels are linked through pxNext under their parent's pxChildren list.
+ * The single level ('+') and multi level ('#') wildcards are kept in dedicated
+ * slots so that a lookup never has to compare against them.
+ */
+typedef struct TopicTrieNode
+{
+    struct TopicTrieNode * pxParent;
+    struct TopicTrieNode * pxNext;
+    struct TopicTrieNode * pxChildren;
+    struct TopicTrieNode * pxSingleLevel;
+    struct TopicTrieNode * pxMultiLevel;
+    void * pvValue;
+    uint16_t usLevelLen;
+    char pcLevel[];
+} TopicTrieNode_t;
+
+typedef struct
+{
+    TopicTrieNode_t xRoot;
+    size_t uxNodeCount;
+    size_t uxFilterCount;
+} TopicTrie_t;
+
+/**
+ * @brief Callback invoked once for each topic filter matching a topic name.
+ *
+ * @param[in] pvCtx Context passed to TopicTrie_Match.
+ * @param[in] pvValue Value associated with the matching topic filter.
+ */
+typedef void (* TopicTrieMatchCallback_t )( void * pvCtx,
+                                            void * pvValue );
+
+/**
+ * @brief Initialize an empty trie.
+ */
+void TopicTrie_Init( TopicTrie_t * pxTrie );
+
+/**
+ * @brief Free every node held by the trie, leaving it empty.
+ */
+void TopicTrie_Clear( TopicTrie_t * pxTrie );
+
+/**
+ * @brief Associate pvValue with the given topic filter.
+ *
+ * If the topic filter is already present its value is replaced without allocating.
+ *
+ * @return true on success, false if the filter is invalid or memory is exhausted.
+ */
+bool TopicTrie_Insert( TopicTrie_t * pxTrie,
+                       const char * pcTopicFilter,
+                       uint16_t usTopicFilterLen,
+                       void * pvValue );
+
+/**
+ * @brief Remove a topic filter from the trie and free any nodes left unused.
+ *
+ * @return The value previously associated with the topic filter or NULL if not present.
+ */
+void * TopicTrie_Remove( TopicTrie_t * pxTrie,
+                         const char * pcTopicFilter,
+                         uint16_t usTopicFilterLen );
+
+/**
+ * @brief Call pxCallback for the value of every topic filter matching pcTopicName.
+ *
+ * Matching follows the MQTT 3.1.1 rules, including the exclusion of topic names
+ * starting with '$' from leading wildcards. Unlike MQTT_MatchTopic, a '+' level
+ * may match an empty last level and a trailing "/#" also matches its parent level
+ * when it follows a '+' (e.g. "+/#" matches "sport").
+ *
+ * @return The number of matching topic filters.
+ */
+size_t TopicTrie_Match( const TopicTrie_t * pxTrie,
+                        const char * pcTopicName,
+                        uint16_t usTopicNameLen,
+                        TopicTrieMatchCallback_t pxCallback,
+                        void * pvCtx );
+
+#endif /* TOPIC_TRIE_H */
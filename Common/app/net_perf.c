@@ -0,0 +1,614 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE   net_perf
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include "errno.h"
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* lwIP includes. */
+#include "lwip/sockets.h"
+
+#include "net_perf.h"
+
+#define NET_PERF_TASK_STACK_SIZE    1024
+#define NET_PERF_TASK_PRIORITY      5
+
+/* Blocking socket calls return at this interval so that a stop request is noticed */
+#define NET_PERF_POLL_TIMEOUT_MS    1000
+
+/* A progress line is logged at this interval */
+#define NET_PERF_REPORT_INTERVAL_MS 1000
+
+/* Number of copies of the final UDP datagram sent to the server */
+#define NET_PERF_UDP_FIN_COUNT      3
+
+/*
+ * Header of each UDP datagram, laid out as in iperf 2 so that an iperf 2
+ * server can be used as the peer. A negative lId marks the last datagram.
+ * All fields are in network byte order.
+ */
+typedef struct
+{
+    int32_t lId;
+    uint32_t ulSec;
+    uint32_t ulUsec;
+} NetPerfUdpHeader_t;
+
+static NetPerfResult_t xResult = { 0 };
+static volatile BaseType_t xStopRequested = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t ulElapsedMs( TickType_t xStart )
+{
+    return ( uint32_t ) ( ( xTaskGetTickCount() - xStart ) * portTICK_PERIOD_MS );
+}
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t ulKbps( uint32_t ulBytes,
+                               uint32_t ulMs )
+{
+    /* bits per millisecond is kbit/s */
+    return ( ulMs > 0 ) ? ( uint32_t ) ( ( ( uint64_t ) ulBytes * 8 ) / ulMs ) : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Returns pdTRUE when the test should end. */
+static BaseType_t xTestDone( TickType_t xStart,
+                             BaseType_t xStarted )
+{
+    BaseType_t xDone = xStopRequested;
+
+    if( ( xStarted == pdTRUE ) &&
+        ( xResult.xConfig.ulDurationS > 0 ) &&
+        ( ulElapsedMs( xStart ) >= ( xResult.xConfig.ulDurationS * 1000 ) ) )
+    {
+        xDone = pdTRUE;
+    }
+
+    return xDone;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Update the elapsed time and log the throughput of the last interval when it is over. */
+static void vUpdateProgress( TickType_t xStart,
+                             uint32_t * pulLastReportMs,
+                             uint32_t * pulLastReportBytes )
+{
+    uint32_t ulNowMs = ulElapsedMs( xStart );
+
+    xResult.ulElapsedMs = ulNowMs;
+
+    if( ( ulNowMs - *pulLastReportMs ) >= NET_PERF_REPORT_INTERVAL_MS )
+    {
+        LogInfo( "%5lu - %5lu ms: %lu bytes, %lu kbit/s",
+                 *pulLastReportMs, ulNowMs,
+                 xResult.ulBytes - *pulLastReportBytes,
+                 ulKbps( xResult.ulBytes - *pulLastReportBytes, ulNowMs - *pulLastReportMs ) );
+
+        *pulLastReportMs = ulNowMs;
+        *pulLastReportBytes = xResult.ulBytes;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t lSetTimeouts( int lSock )
+{
+    struct timeval xTimeout =
+    {
+        .tv_sec  = NET_PERF_POLL_TIMEOUT_MS / 1000,
+        .tv_usec = ( NET_PERF_POLL_TIMEOUT_MS % 1000 ) * 1000
+    };
+
+    int32_t lError = lwip_setsockopt( lSock, SOL_SOCKET, SO_RCVTIMEO, &xTimeout, sizeof( xTimeout ) );
+
+    if( lError == 0 )
+    {
+        lError = lwip_setsockopt( lSock, SOL_SOCKET, SO_SNDTIMEO, &xTimeout, sizeof( xTimeout ) );
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline BaseType_t xIsTimeout( int lErrno )
+{
+    return( ( lErrno == EAGAIN ) || ( lErrno == EWOULDBLOCK ) || ( lErrno == EINTR ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t lOpenSocket( int lType,
+                            BaseType_t xConnect )
+{
+    struct sockaddr_in xAddr = { 0 };
+    int lSock = lwip_socket( AF_INET, lType, ( lType == SOCK_STREAM ) ? IPPROTO_TCP : IPPROTO_UDP );
+
+    xAddr.sin_family = AF_INET;
+    xAddr.sin_port = lwip_htons( xResult.xConfig.usPort );
+
+    if( lSock < 0 )
+    {
+        LogError( "Failed to create socket." );
+    }
+    else if( lSetTimeouts( lSock ) != 0 )
+    {
+        LogError( "Failed to set socket timeouts." );
+        ( void ) lwip_close( lSock );
+        lSock = -1;
+    }
+    else if( xConnect == pdTRUE )
+    {
+        ( void ) lwip_inet_pton( AF_INET, xResult.xConfig.pcHost, &( xAddr.sin_addr ) );
+
+        if( lwip_connect( lSock, ( struct sockaddr * ) &xAddr, sizeof( xAddr ) ) != 0 )
+        {
+            LogError( "Failed to connect to %s:%u.", xResult.xConfig.pcHost, xResult.xConfig.usPort );
+            ( void ) lwip_close( lSock );
+            lSock = -1;
+        }
+    }
+    else
+    {
+        xAddr.sin_addr.s_addr = lwip_htonl( INADDR_ANY );
+
+        if( lwip_bind( lSock, ( struct sockaddr * ) &xAddr, sizeof( xAddr ) ) != 0 )
+        {
+            LogError( "Failed to bind to port %u.", xResult.xConfig.usPort );
+            ( void ) lwip_close( lSock );
+            lSock = -1;
+        }
+    }
+
+    return lSock;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t lRunTcpTx( int lSock,
+                          uint8_t * pucBuffer )
+{
+    int32_t lError = 0;
+    TickType_t xStart = xTaskGetTickCount();
+    uint32_t ulLastReportMs = 0;
+    uint32_t ulLastReportBytes = 0;
+
+    /* An iperf 2 server reads the leading word as flags, leave it zero */
+    ( void ) memset( pucBuffer, 0, xResult.xConfig.ulLen );
+
+    while( xTestDone( xStart, pdTRUE ) == pdFALSE )
+    {
+        ssize_t xSent = lwip_send( lSock, pucBuffer, xResult.xConfig.ulLen, 0 );
+
+        if( xSent > 0 )
+        {
+            xResult.ulBytes += ( uint32_t ) xSent;
+        }
+        else if( ( xSent < 0 ) && ( xIsTimeout( errno ) == pdFALSE ) )
+        {
+            lError = errno;
+            LogError( "lwip_send failed, errno: %ld.", lError );
+            break;
+        }
+
+        vUpdateProgress( xStart, &ulLastReportMs, &ulLastReportBytes );
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t lRunTcpRx( int lListenSock,
+                          uint8_t * pucBuffer )
+{
+    int32_t lError = 0;
+    int lSock = -1;
+
+    if( lwip_listen( lListenSock, 1 ) != 0 )
+    {
+        lError = errno;
+        LogError( "lwip_listen failed, errno: %ld.", lError );
+    }
+    else
+    {
+        LogInfo( "Waiting for a TCP connection on port %u.", xResult.xConfig.usPort );
+    }
+
+    /* lwip_accept honours the receive timeout of the listening socket */
+    while( ( lError == 0 ) && ( lSock < 0 ) && ( xStopRequested == pdFALSE ) )
+    {
+        lSock = lwip_accept( lListenSock, NULL, NULL );
+
+        if( ( lSock < 0 ) && ( xIsTimeout( errno ) == pdFALSE ) )
+        {
+            lError = errno;
+            LogError( "lwip_accept failed, errno: %ld.", lError );
+        }
+    }
+
+    if( ( lSock >= 0 ) && ( lSetTimeouts( lSock ) == 0 ) )
+    {
+        TickType_t xStart = xTaskGetTickCount();
+        BaseType_t xStarted = pdFALSE;
+        uint32_t ulLastReportMs = 0;
+        uint32_t ulLastReportBytes = 0;
+
+        while( xTestDone( xStart, xStarted ) == pdFALSE )
+        {
+            ssize_t xReceived = lwip_recv( lSock, pucBuffer, xResult.xConfig.ulLen, 0 );
+
+            if( xReceived > 0 )
+            {
+                if( xStarted == pdFALSE )
+                {
+                    xStart = xTaskGetTickCount();
+                    xStarted = pdTRUE;
+                }
+
+                xResult.ulBytes += ( uint32_t ) xReceived;
+            }
+            else if( xReceived == 0 )
+            {
+                /* The peer is done sending */
+                break;
+            }
+            else if( xIsTimeout( errno ) == pdFALSE )
+            {
+                lError = errno;
+                LogError( "lwip_recv failed, errno: %ld.", lError );
+                break;
+            }
+
+            if( xStarted == pdTRUE )
+            {
+                vUpdateProgress( xStart, &ulLastReportMs, &ulLastReportBytes );
+            }
+        }
+    }
+
+    if( lSock >= 0 )
+    {
+        ( void ) lwip_close( lSock );
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vWriteUdpHeader( uint8_t * pucBuffer,
+                             int32_t lId )
+{
+    NetPerfUdpHeader_t xHeader;
+    uint32_t ulNowMs = ( uint32_t ) ( xTaskGetTickCount() * portTICK_PERIOD_MS );
+
+    xHeader.lId = ( int32_t ) lwip_htonl( ( uint32_t ) lId );
+    xHeader.ulSec = lwip_htonl( ulNowMs / 1000 );
+    xHeader.ulUsec = lwip_htonl( ( ulNowMs % 1000 ) * 1000 );
+
+    ( void ) memcpy( pucBuffer, &xHeader, sizeof( xHeader ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t lRunUdpTx( int lSock,
+                          uint8_t * pucBuffer )
+{
+    int32_t lError = 0;
+    int32_t lId = 0;
+    TickType_t xStart = xTaskGetTickCount();
+    uint32_t ulLastReportMs = 0;
+    uint32_t ulLastReportBytes = 0;
+
+    ( void ) memset( pucBuffer, 0, xResult.xConfig.ulLen );
+
+    while( xTestDone( xStart, pdTRUE ) == pdFALSE )
+    {
+        ssize_t xSent = 0;
+
+        /* Stay at or below the target rate, kbit/s times ms is bits */
+        if( ( xResult.xConfig.ulRateKbps > 0 ) &&
+            ( ( ( uint64_t ) xResult.ulBytes * 8 ) >
+              ( ( uint64_t ) xResult.xConfig.ulRateKbps * ulElapsedMs( xStart ) ) ) )
+        {
+            vTaskDelay( 1 );
+            continue;
+        }
+
+        vWriteUdpHeader( pucBuffer, lId );
+
+        xSent = lwip_send( lSock, pucBuffer, xResult.xConfig.ulLen, 0 );
+
+        if( xSent > 0 )
+        {
+            lId++;
+            xResult.ulDatagrams++;
+            xResult.ulBytes += ( uint32_t ) xSent;
+        }
+        else if( ( errno == ENOMEM ) || ( xIsTimeout( errno ) == pdTRUE ) )
+        {
+            /* Out of pbufs, let the dataplane drain */
+            vTaskDelay( 1 );
+        }
+        else
+        {
+            lError = errno;
+            LogError( "lwip_send failed, errno: %ld.", lError );
+            break;
+        }
+
+        vUpdateProgress( xStart, &ulLastReportMs, &ulLastReportBytes );
+    }
+
+    xResult.ulElapsedMs = ulElapsedMs( xStart );
+
+    /* Tell the server that the test is over */
+    for( uint32_t ulIdx = 0; ulIdx < NET_PERF_UDP_FIN_COUNT; ulIdx++ )
+    {
+        vWriteUdpHeader( pucBuffer, -lId );
+        ( void ) lwip_send( lSock, pucBuffer, xResult.xConfig.ulLen, 0 );
+        vTaskDelay( pdMS_TO_TICKS( 10 ) );
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t lRunUdpRx( int lSock,
+                          uint8_t * pucBuffer )
+{
+    int32_t lError = 0;
+    int32_t lExpectedId = 0;
+    TickType_t xStart = xTaskGetTickCount();
+    BaseType_t xStarted = pdFALSE;
+    uint32_t ulLastReportMs = 0;
+    uint32_t ulLastReportBytes = 0;
+
+    LogInfo( "Waiting for UDP datagrams on port %u.", xResult.xConfig.usPort );
+
+    while( xTestDone( xStart, xStarted ) == pdFALSE )
+    {
+        ssize_t xReceived = lwip_recv( lSock, pucBuffer, xResult.xConfig.ulLen, 0 );
+
+        if( xReceived >= ( ssize_t ) sizeof( NetPerfUdpHeader_t ) )
+        {
+            NetPerfUdpHeader_t xHeader;
+            int32_t lId = 0;
+
+            ( void ) memcpy( &xHeader, pucBuffer, sizeof( xHeader ) );
+            lId = ( int32_t ) lwip_ntohl( ( uint32_t ) xHeader.lId );
+
+            if( lId < 0 )
+            {
+                /* Last datagram of the test, the copies which follow are ignored */
+                if( xStarted == pdTRUE )
+                {
+                    break;
+                }
+
+                continue;
+            }
+
+            if( xStarted == pdFALSE )
+            {
+                xStart = xTaskGetTickCount();
+                xStarted = pdTRUE;
+                lExpectedId = lId;
+            }
+
+            xResult.ulDatagrams++;
+            xResult.ulBytes += ( uint32_t ) xReceived;
+
+            if( lId >= lExpectedId )
+            {
+                xResult.ulLost += ( uint32_t ) ( lId - lExpectedId );
+                lExpectedId = lId + 1;
+            }
+            else
+            {
+                /* A late datagram previously counted as lost */
+                xResult.ulOutOfOrder++;
+
+                if( xResult.ulLost > 0 )
+                {
+                    xResult.ulLost--;
+                }
+            }
+        }
+        else if( ( xReceived < 0 ) && ( xIsTimeout( errno ) == pdFALSE ) )
+        {
+            lError = errno;
+            LogError( "lwip_recv failed, errno: %ld.", lError );
+            break;
+        }
+
+        if( xStarted == pdTRUE )
+        {
+            vUpdateProgress( xStart, &ulLastReportMs, &ulLastReportBytes );
+        }
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vNetPerfTask( void * pvParameters )
+{
+    const NetPerfConfig_t * pxConfig = &( xResult.xConfig );
+    uint8_t * pucBuffer = pvPortMalloc( pxConfig->ulLen );
+    int32_t lError = ENOMEM;
+    int lSock = -1;
+
+    ( void ) pvParameters;
+
+    if( pucBuffer != NULL )
+    {
+        lSock = lOpenSocket( ( pxConfig->xProto == NET_PERF_PROTO_TCP ) ? SOCK_STREAM : SOCK_DGRAM,
+                             ( pxConfig->xDir == NET_PERF_DIR_TX ) ? pdTRUE : pdFALSE );
+        lError = ( lSock < 0 ) ? errno : 0;
+    }
+
+    if( lSock >= 0 )
+    {
+        if( pxConfig->xProto == NET_PERF_PROTO_TCP )
+        {
+            lError = ( pxConfig->xDir == NET_PERF_DIR_TX ) ? lRunTcpTx( lSock, pucBuffer ) : lRunTcpRx( lSock, pucBuffer );
+        }
+        else
+        {
+            lError = ( pxConfig->xDir == NET_PERF_DIR_TX ) ? lRunUdpTx( lSock, pucBuffer ) : lRunUdpRx( lSock, pucBuffer );
+        }
+
+        ( void ) lwip_close( lSock );
+    }
+
+    if( pucBuffer != NULL )
+    {
+        vPortFree( pucBuffer );
+    }
+
+    LogInfo( "Test done: %lu bytes in %lu ms, %lu kbit/s.",
+             xResult.ulBytes, xResult.ulElapsedMs, ulKbps( xResult.ulBytes, xResult.ulElapsedMs ) );
+
+    taskENTER_CRITICAL();
+    {
+        xResult.lError = lError;
+        xResult.xState = ( lError == 0 ) ? NET_PERF_STATE_DONE : NET_PERF_STATE_ERROR;
+    }
+    taskEXIT_CRITICAL();
+
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+void NetPerf_GetDefaultConfig( NetPerfConfig_t * pxConfig,
+                               NetPerfProto_t xProto,
+                               NetPerfDir_t xDir )
+{
+    configASSERT( pxConfig != NULL );
+
+    ( void ) memset( pxConfig, 0, sizeof( NetPerfConfig_t ) );
+
+    pxConfig->xProto = xProto;
+    pxConfig->xDir = xDir;
+    pxConfig->usPort = NET_PERF_DEFAULT_PORT;
+    pxConfig->ulLen = NET_PERF_DEFAULT_LEN;
+    pxConfig->ulDurationS = ( xDir == NET_PERF_DIR_TX ) ? NET_PERF_DEFAULT_DURATION_S : 0;
+    pxConfig->ulRateKbps = ( xProto == NET_PERF_PROTO_UDP ) ? NET_PERF_DEFAULT_UDP_RATE_KBPS : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t NetPerf_Start( const NetPerfConfig_t * pxConfig )
+{
+    BaseType_t xStarted = pdFALSE;
+    struct in_addr xAddr;
+
+    configASSERT( pxConfig != NULL );
+
+    if( ( pxConfig->ulLen == 0 ) || ( pxConfig->ulLen > NET_PERF_MAX_LEN ) ||
+        ( ( pxConfig->xProto == NET_PERF_PROTO_UDP ) && ( pxConfig->ulLen < sizeof( NetPerfUdpHeader_t ) ) ) )
+    {
+        LogError( "Invalid buffer length: %lu.", pxConfig->ulLen );
+    }
+    else if( ( pxConfig->xDir == NET_PERF_DIR_TX ) &&
+             ( lwip_inet_pton( AF_INET, pxConfig->pcHost, &xAddr ) != 1 ) )
+    {
+        LogError( "Invalid server address: %s.", pxConfig->pcHost );
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+        {
+            if( xResult.xState != NET_PERF_STATE_RUNNING )
+            {
+                ( void ) memset( &xResult, 0, sizeof( xResult ) );
+                xResult.xConfig = *pxConfig;
+                xResult.xConfig.pcHost[ NET_PERF_HOST_LEN - 1 ] = '\0';
+                xResult.xState = NET_PERF_STATE_RUNNING;
+                xStopRequested = pdFALSE;
+                xStarted = pdTRUE;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( xStarted == pdFALSE )
+        {
+            LogError( "A test is already running." );
+        }
+        else if( xTaskCreate( vNetPerfTask, "NetPerf", NET_PERF_TASK_STACK_SIZE,
+                              NULL, NET_PERF_TASK_PRIORITY, NULL ) != pdPASS )
+        {
+            LogError( "Failed to create the test task." );
+            xResult.lError = ENOMEM;
+            xResult.xState = NET_PERF_STATE_ERROR;
+            xStarted = pdFALSE;
+        }
+    }
+
+    return xStarted;
+}
+
+/*-----------------------------------------------------------*/
+
+void NetPerf_Stop( void )
+{
+    xStopRequested = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+void NetPerf_GetResult( NetPerfResult_t * pxResult )
+{
+    configASSERT( pxResult != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        *pxResult = xResult;
+    }
+    taskEXIT_CRITICAL();
+}
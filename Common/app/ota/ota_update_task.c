@@ -41,6 +41,7 @@
 /* define LOG_LEVEL here if you want to modify the logging level from the default */
 
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE   ota
 
 #include "logging.h"
 
@@ -49,6 +49,7 @@
 /* define LOG_LEVEL here if you want to modify the logging level from the default */
 
 #define LOG_LEVEL    LOG_DEBUG
+#define LOG_MODULE   shadow
 
 #include "logging.h"
 
@@ -342,11 +343,12 @@ static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx )
 {
     MQTTStatus_t xStatus = MQTTSuccess;
 
-    xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                       pxCtx->pcTopicUpdateDelta,
-                                       MQTTQoS1,
-                                       prvIncomingPublishUpdateDeltaCallback,
-                                       pxCtx );
+    xStatus = MqttAgent_SubscribeSyncEx( pxCtx->xAgentHandle,
+                                         pxCtx->pcTopicUpdateDelta,
+                                         MQTTQoS1,
+                                         prvIncomingPublishUpdateDeltaCallback,
+                                         pxCtx,
+                                         MQTTAgentDispatchDeferred );
 
     if( xStatus != MQTTSuccess )
     {
@@ -354,11 +356,12 @@ static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx )
     }
     else
     {
-        xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                           pxCtx->pcTopicUpdateAccepted,
-                                           MQTTQoS1,
-                                           prvIncomingPublishUpdateAcceptedCallback,
-                                           pxCtx );
+        xStatus = MqttAgent_SubscribeSyncEx( pxCtx->xAgentHandle,
+                                             pxCtx->pcTopicUpdateAccepted,
+                                             MQTTQoS1,
+                                             prvIncomingPublishUpdateAcceptedCallback,
+                                             pxCtx,
+                                             MQTTAgentDispatchDeferred );
 
         if( xStatus != MQTTSuccess )
         {
@@ -368,11 +371,12 @@ static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx )
 
     if( xStatus == MQTTSuccess )
     {
-        xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                           pxCtx->pcTopicUpdateRejected,
-                                           MQTTQoS1,
-                                           prvIncomingPublishUpdateRejectedCallback,
-                                           pxCtx );
+        xStatus = MqttAgent_SubscribeSyncEx( pxCtx->xAgentHandle,
+                                             pxCtx->pcTopicUpdateRejected,
+                                             MQTTQoS1,
+                                             prvIncomingPublishUpdateRejectedCallback,
+                                             pxCtx,
+                                             MQTTAgentDispatchDeferred );
 
         if( xStatus != MQTTSuccess )
         {
@@ -37,6 +37,17 @@
 
 #define CLI_UART_TX_STREAM_LEN        2304
 
+/* Send the console output with DMA from a ring instead of 64 byte interrupt driven chunks */
+#ifndef CLI_UART_TX_DMA
+    #define CLI_UART_TX_DMA               1
+#endif
+
+#define CLI_UART_TX_RING_LEN          1024 /* Must be a power of two */
+
+#define CLI_UART_TX_DMA_CHANNEL       GPDMA1_Channel0
+#define CLI_UART_TX_DMA_IRQn          GPDMA1_Channel0_IRQn
+#define CLI_UART_TX_DMA_IRQHandler    GPDMA1_Channel0_IRQHandler
+
 void Task_CLI( void * pvParameters );
 
 
@@ -37,8 +37,12 @@
 #define KEY_ARG_IDX      2
 #define VALUE_ARG_IDX    3
 
+#define LOOKUP_BENCH_ITERATIONS    100
+
 /* Local static functions */
 static void vSubCommand_CommitConfig( ConsoleIO_t * pxCIO );
+static void vSubCommand_Stats( ConsoleIO_t * pxCIO );
+static void vSubCommand_Bench( ConsoleIO_t * pxCIO );
 static void vSubCommand_GetConfig( ConsoleIO_t * pxCIO,
                                    const char * const pcKey );
 static void vSubCommand_GetConfigAll( ConsoleIO_t * pxCIO );
@@ -64,7 +68,12 @@ const CLI_Command_Definition_t xCommandDef_conf =
         "        Set the value of a given runtime config item. This change is staged\r\n"
         "        in volatile memory until a commit operation occurs.\r\n\n"
         "    conf commit\r\n"
-        "        Commit staged config changes to nonvolatile memory.\r\n\n",
+        "        Commit staged config changes to nonvolatile memory.\r\n\n"
+        "    conf stats\r\n"
+        "        Outputs the duration and flash activity of the boot time load and of commits,\r\n"
+        "        and the hits, misses and heap use of the cache.\r\n\n"
+        "    conf bench\r\n"
+        "        Measures the cost of looking up a key by name.\r\n\n",
     .pxCommandInterpreter = vCommand_Configure
 };
 
@@ -82,6 +91,64 @@ static void vSubCommand_CommitConfig( ConsoleIO_t * pxCIO )
     }
 }
 
+static void vSubCommand_Stats( ConsoleIO_t * pxCIO )
+{
+    KVStoreStats_t xStats;
+    KVStoreCacheStats_t xCacheStats;
+    int lRslt = 0;
+
+    KVStore_getStats( &xStats );
+    KVStore_getCacheStats( &xCacheStats );
+
+    lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "           us     read B   prog B   erases\r\n"
+                      "init   %8lu %8lu %8lu %8lu\r\n"
+                      "commit %8lu %8lu %8lu %8lu\r\n"
+                      "Commits: %lu, total prog B: %lu, total erases: %lu\r\n",
+                      ( unsigned long ) xStats.xInit.ulUs,
+                      ( unsigned long ) xStats.xInit.ulReadBytes,
+                      ( unsigned long ) xStats.xInit.ulProgBytes,
+                      ( unsigned long ) xStats.xInit.ulErases,
+                      ( unsigned long ) xStats.xLastCommit.ulUs,
+                      ( unsigned long ) xStats.xLastCommit.ulReadBytes,
+                      ( unsigned long ) xStats.xLastCommit.ulProgBytes,
+                      ( unsigned long ) xStats.xLastCommit.ulErases,
+                      ( unsigned long ) xStats.ulCommits,
+                      ( unsigned long ) xStats.ulCommitProgBytes,
+                      ( unsigned long ) xStats.ulCommitErases );
+
+    if( ( lRslt > 0 ) && ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+    {
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+    }
+
+    lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "Cache: %lu hits, %lu misses, %lu evictions\r\n"
+                      "Cache heap: %lu B held, %lu B peak",
+                      ( unsigned long ) xCacheStats.ulHits,
+                      ( unsigned long ) xCacheStats.ulMisses,
+                      ( unsigned long ) xCacheStats.ulEvictions,
+                      ( unsigned long ) xCacheStats.ulBytesHeld,
+                      ( unsigned long ) xCacheStats.ulBytesHeldPeak );
+
+    if( ( lRslt > 0 ) && ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+    {
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+    }
+
+    #if KV_STORE_CACHE_LAZY
+        lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                          ", %lu B budget\r\n", ( unsigned long ) KV_STORE_CACHE_BUDGET );
+    #else
+        lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "\r\n" );
+    #endif
+
+    if( ( lRslt > 0 ) && ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+    {
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+    }
+}
+
 static void vSubCommand_GetConfig( ConsoleIO_t * pxCIO,
                                    const char * const pcKey )
 {
@@ -358,6 +425,51 @@ static void vSubCommand_SetConfig( ConsoleIO_t * pxCIO,
     }
 }
 
+static void vSubCommand_Bench( ConsoleIO_t * pxCIO )
+{
+    static const char * const pcUnknownKey = "no_such_key";
+    volatile KVStoreKey_t xKey = CS_NUM_KEYS;
+    uint32_t ulKnown = 0;
+    uint32_t ulUnknown = 0;
+    uint32_t ulStart = 0;
+
+    /* Keep interrupts and other tasks out of the measurement */
+    taskENTER_CRITICAL();
+
+    ulStart = DWT->CYCCNT;
+
+    for( uint32_t i = 0; i < LOOKUP_BENCH_ITERATIONS; i++ )
+    {
+        for( uint32_t j = 0; j < CS_NUM_KEYS; j++ )
+        {
+            xKey = kvStringToKey( kvKeyToString( ( KVStoreKey_t ) j ) );
+        }
+    }
+
+    ulKnown = DWT->CYCCNT - ulStart;
+
+    ulStart = DWT->CYCCNT;
+
+    for( uint32_t i = 0; i < LOOKUP_BENCH_ITERATIONS; i++ )
+    {
+        xKey = kvStringToKey( pcUnknownKey );
+    }
+
+    ulUnknown = DWT->CYCCNT - ulStart;
+
+    taskEXIT_CRITICAL();
+
+    ( void ) xKey;
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "kvStringToKey over all %u keys: %lu cycles per lookup\r\n"
+                       "kvStringToKey of an unknown name: %lu cycles per lookup\r\n",
+                       CS_NUM_KEYS,
+                       ( unsigned long ) ( ulKnown / ( LOOKUP_BENCH_ITERATIONS * CS_NUM_KEYS ) ),
+                       ( unsigned long ) ( ulUnknown / LOOKUP_BENCH_ITERATIONS ) );
+    pxCIO->print( pcCliScratchBuffer );
+}
+
 /*
  * CLI format:
  * Argc   1    2      3     4
@@ -365,6 +477,8 @@ static void vSubCommand_SetConfig( ConsoleIO_t * pxCIO,
  *      conf get    <key>
  *      conf set    <key> <value>
  *      conf commit
+ *      conf stats
+ *      conf bench
  */
 static void vCommand_Configure( ConsoleIO_t * pxCIO,
                                 uint32_t ulArgc,
@@ -411,6 +525,16 @@ static void vCommand_Configure( ConsoleIO_t * pxCIO,
             vSubCommand_CommitConfig( pxCIO );
             xSuccess = pdTRUE;
         }
+        else if( 0 == strcmp( "stats", pcMode ) )
+        {
+            vSubCommand_Stats( pxCIO );
+            xSuccess = pdTRUE;
+        }
+        else if( 0 == strcmp( "bench", pcMode ) )
+        {
+            vSubCommand_Bench( pxCIO );
+            xSuccess = pdTRUE;
+        }
         else
         {
             xSuccess = pdFALSE;
@@ -0,0 +1,205 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "crash_log.h"
+
+static void prvCrashLogCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_crashlog =
+{
+    "crashlog",
+    "crashlog\r\n"
+    "    Show or manage the log ring kept in retained memory across resets.\r\n"
+    "    Usage:\r\n"
+    "    crashlog [status]\r\n"
+    "        Print the boot count, reset flags and record range.\r\n"
+    "    crashlog show [boot]\r\n"
+    "        Print all records, or only those of the current boot.\r\n"
+    "    crashlog crash\r\n"
+    "        Print the records kept from the boot that crashed.\r\n"
+    "    crashlog release\r\n"
+    "        Allow the records of the crashed boot to be overwritten.\r\n"
+    "    crashlog clear\r\n"
+    "        Erase all records.\r\n\n",
+    prvCrashLogCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintRecords( ConsoleIO_t * const pxCIO,
+                             uint32_t ulFirstSeq,
+                             uint32_t ulEndSeq )
+{
+    CrashLogRecord_t xRecord;
+
+    for( uint32_t ulSeq = ulFirstSeq; ulSeq != ulEndSeq; ulSeq++ )
+    {
+        if( CrashLog_ReadRecord( ulSeq, &xRecord ) == pdTRUE )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "%6lu %5u %8lu %-4s %.*s\r\n",
+                               ( unsigned long ) xRecord.ulSeq,
+                               ( unsigned int ) xRecord.usBoot,
+                               ( unsigned long ) ( xRecord.ulTick * portTICK_PERIOD_MS ),
+                               CrashLog_TypeToString( xRecord.ucType ),
+                               ( int ) xRecord.ucLen,
+                               xRecord.pcData );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintRecordHeader( ConsoleIO_t * const pxCIO )
+{
+    pxCIO->print( "   seq  boot       ms type text\r\n" );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintStatus( ConsoleIO_t * const pxCIO )
+{
+    CrashLogInfo_t xInfo;
+
+    CrashLog_GetInfo( &xInfo );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "Boot count:    %lu\r\n"
+                       "Reset flags:   0x%08lx\r\n"
+                       "Records:       %lu to %lu, this boot from %lu\r\n",
+                       ( unsigned long ) xInfo.ulBootCount,
+                       ( unsigned long ) xInfo.ulResetFlags,
+                       ( unsigned long ) xInfo.ulFirstSeq,
+                       ( unsigned long ) xInfo.ulNextSeq,
+                       ( unsigned long ) xInfo.ulBootFirstSeq );
+    pxCIO->print( pcCliScratchBuffer );
+
+    if( xInfo.ulPinnedSeq != CRASH_LOG_SEQ_NONE )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "Crash kept:    records %lu to %lu, %lu dropped to protect them\r\n",
+                           ( unsigned long ) xInfo.ulPinnedSeq,
+                           ( unsigned long ) xInfo.ulBootFirstSeq,
+                           ( unsigned long ) xInfo.ulDropped );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vCrashLogPrintCrash( ConsoleIO_t * const pxCIO )
+{
+    CrashLogInfo_t xInfo;
+
+    CrashLog_GetInfo( &xInfo );
+
+    if( xInfo.ulPinnedSeq != CRASH_LOG_SEQ_NONE )
+    {
+        pxCIO->print( "The previous boot crashed, records kept in the crash log:\r\n" );
+        prvPrintRecordHeader( pxCIO );
+        prvPrintRecords( pxCIO, xInfo.ulPinnedSeq, xInfo.ulBootFirstSeq );
+        pxCIO->print( "Run \"crashlog release\" once reported.\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCrashLogCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    BaseType_t xSuccess = pdTRUE;
+    CrashLogInfo_t xInfo;
+
+    CrashLog_GetInfo( &xInfo );
+
+    if( ( ulArgc == 1 ) ||
+        ( ( ulArgc == 2 ) && ( strcmp( "status", ppcArgv[ 1 ] ) == 0 ) ) )
+    {
+        prvPrintStatus( pxCIO );
+    }
+    else if( ( ulArgc >= 2 ) && ( strcmp( "show", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        if( ulArgc == 2 )
+        {
+            prvPrintRecordHeader( pxCIO );
+            prvPrintRecords( pxCIO, xInfo.ulFirstSeq, xInfo.ulNextSeq );
+        }
+        else if( ( ulArgc == 3 ) && ( strcmp( "boot", ppcArgv[ 2 ] ) == 0 ) )
+        {
+            prvPrintRecordHeader( pxCIO );
+            prvPrintRecords( pxCIO, xInfo.ulBootFirstSeq, xInfo.ulNextSeq );
+        }
+        else
+        {
+            xSuccess = pdFALSE;
+        }
+    }
+    else if( ( ulArgc == 2 ) && ( strcmp( "crash", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        if( xInfo.ulPinnedSeq != CRASH_LOG_SEQ_NONE )
+        {
+            vCrashLogPrintCrash( pxCIO );
+        }
+        else
+        {
+            pxCIO->print( "No crash recorded.\r\n" );
+        }
+    }
+    else if( ( ulArgc == 2 ) && ( strcmp( "release", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        CrashLog_Release();
+        pxCIO->print( "Crash records released.\r\n" );
+    }
+    else if( ( ulArgc == 2 ) && ( strcmp( "clear", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        CrashLog_Clear();
+        pxCIO->print( "Crash log cleared.\r\n" );
+    }
+    else
+    {
+        xSuccess = pdFALSE;
+    }
+
+    if( xSuccess == pdFALSE )
+    {
+        pxCIO->print( xCommandDef_crashlog.pcHelpString );
+    }
+}
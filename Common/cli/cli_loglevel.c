@@ -0,0 +1,252 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+#include "logging_levels.h"
+
+/* Debug calls are compiled in so that "loglevel bench" measures a suppressed call */
+#define LOG_LEVEL     LOG_DEBUG
+#define LOG_MODULE    cli
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#define LOGLEVEL_BENCH_ITERATIONS    1000
+
+static void prvLogLevelCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_loglevel =
+{
+    "loglevel",
+    "loglevel\r\n"
+    "    Show or change the runtime log level of each log module.\r\n"
+    "    A module cannot log above the LOG_LEVEL its files were built with.\r\n"
+    "    Usage:\r\n"
+    "    loglevel [list]\r\n"
+    "        Print the current and default level of each module.\r\n"
+    "    loglevel <module|all> <none|error|warn|info|debug>\r\n"
+    "        Change the level of a module until the next reset.\r\n"
+    "    loglevel default\r\n"
+    "        Restore the default level of all modules.\r\n"
+    "    loglevel save\r\n"
+    "        Store the current levels in the log_levels KVStore entry.\r\n"
+    "    loglevel bench\r\n"
+    "        Measure the cost of a log call suppressed by its module level.\r\n\n",
+    prvLogLevelCommand
+};
+
+static const char * const pcLevelNames[] = { "none", "error", "warn", "info", "debug" };
+
+static volatile uint32_t ulBenchArgEvaluations = 0;
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xParseLevel( const char * pcArg,
+                               uint8_t * pucLevel )
+{
+    BaseType_t xResult = pdFALSE;
+
+    for( uint8_t i = 0; i <= LOG_DEBUG; i++ )
+    {
+        if( strcmp( pcArg, pcLevelNames[ i ] ) == 0 )
+        {
+            *pucLevel = i;
+            xResult = pdTRUE;
+            break;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintLevels( ConsoleIO_t * const pxCIO )
+{
+    pxCIO->print( "module       level  default\r\n" );
+
+    for( uint32_t i = 0; i < LOG_MODULE_COUNT; i++ )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-12s %-6s %s\r\n",
+                           pcLoggingModuleName( ( LogModule_t ) i ),
+                           pcLevelNames[ ucLogModuleLevels[ i ] ],
+                           pcLevelNames[ ucLoggingDefaultLevel( ( LogModule_t ) i ) ] );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvBenchArg( void )
+{
+    ulBenchArgEvaluations++;
+
+    return ulBenchArgEvaluations;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBenchSuppressed( ConsoleIO_t * const pxCIO )
+{
+    uint8_t ucSavedLevel = ucLogModuleLevels[ LOG_MODULE_ID( LOG_MODULE ) ];
+    uint32_t ulBaseline = 0;
+    uint32_t ulSuppressed = 0;
+    uint32_t ulStart = 0;
+
+    vLoggingSetModuleLevel( LOG_MODULE_ID( LOG_MODULE ), LOG_INFO );
+    ulBenchArgEvaluations = 0;
+
+    /* Keep interrupts and other tasks out of the measurement */
+    taskENTER_CRITICAL();
+
+    ulStart = DWT->CYCCNT;
+
+    for( uint32_t i = 0; i < LOGLEVEL_BENCH_ITERATIONS; i++ )
+    {
+        __asm volatile ( "" ::: "memory" );
+    }
+
+    ulBaseline = DWT->CYCCNT - ulStart;
+
+    ulStart = DWT->CYCCNT;
+
+    for( uint32_t i = 0; i < LOGLEVEL_BENCH_ITERATIONS; i++ )
+    {
+        LogDebug( "Suppressed %lu", ( unsigned long ) prvBenchArg() );
+        __asm volatile ( "" ::: "memory" );
+    }
+
+    ulSuppressed = DWT->CYCCNT - ulStart;
+
+    taskEXIT_CRITICAL();
+
+    vLoggingSetModuleLevel( LOG_MODULE_ID( LOG_MODULE ), ucSavedLevel );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "%u suppressed LogDebug calls: %lu cycles, empty loop: %lu cycles\r\n"
+                       "Cost per call: %lu.%02lu cycles, arguments evaluated: %lu\r\n",
+                       LOGLEVEL_BENCH_ITERATIONS,
+                       ( unsigned long ) ulSuppressed,
+                       ( unsigned long ) ulBaseline,
+                       ( unsigned long ) ( ( ulSuppressed - ulBaseline ) / LOGLEVEL_BENCH_ITERATIONS ),
+                       ( unsigned long ) ( ( ( ulSuppressed - ulBaseline ) % LOGLEVEL_BENCH_ITERATIONS ) / 10 ),
+                       ( unsigned long ) ulBenchArgEvaluations );
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLogLevelCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    if( ( ulArgc == 1 ) ||
+        ( ( ulArgc == 2 ) && ( strcmp( "list", ppcArgv[ 1 ] ) == 0 ) ) )
+    {
+        prvPrintLevels( pxCIO );
+        xSuccess = pdTRUE;
+    }
+    else if( ( ulArgc == 2 ) && ( strcmp( "default", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        for( uint32_t i = 0; i < LOG_MODULE_COUNT; i++ )
+        {
+            vLoggingSetModuleLevel( ( LogModule_t ) i, ucLoggingDefaultLevel( ( LogModule_t ) i ) );
+        }
+
+        prvPrintLevels( pxCIO );
+        xSuccess = pdTRUE;
+    }
+    else if( ( ulArgc == 2 ) && ( strcmp( "save", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        if( lLoggingSaveModuleLevels() == 0 )
+        {
+            pxCIO->print( "Log levels saved.\r\n" );
+        }
+        else
+        {
+            pxCIO->print( "Error: Failed to save the log levels.\r\n" );
+        }
+
+        xSuccess = pdTRUE;
+    }
+    else if( ( ulArgc == 2 ) && ( strcmp( "bench", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        prvBenchSuppressed( pxCIO );
+        xSuccess = pdTRUE;
+    }
+    else if( ulArgc == 3 )
+    {
+        uint8_t ucLevel = LOG_NONE;
+        LogModule_t xModule = xLoggingFindModule( ppcArgv[ 1 ] );
+
+        xSuccess = pdTRUE;
+
+        if( xParseLevel( ppcArgv[ 2 ], &ucLevel ) == pdFALSE )
+        {
+            pxCIO->print( "Error: Unknown level.\r\n" );
+        }
+        else if( strcmp( "all", ppcArgv[ 1 ] ) == 0 )
+        {
+            for( uint32_t i = 0; i < LOG_MODULE_COUNT; i++ )
+            {
+                vLoggingSetModuleLevel( ( LogModule_t ) i, ucLevel );
+            }
+
+            prvPrintLevels( pxCIO );
+        }
+        else if( xModule < LOG_MODULE_COUNT )
+        {
+            vLoggingSetModuleLevel( xModule, ucLevel );
+            prvPrintLevels( pxCIO );
+        }
+        else
+        {
+            pxCIO->print( "Error: Unknown module.\r\n" );
+        }
+    }
+
+    if( xSuccess == pdFALSE )
+    {
+        pxCIO->print( xCommandDef_loglevel.pcHelpString );
+    }
+}
@@ -345,11 +345,20 @@ void Task_CLI( void * pvParameters )
     FreeRTOS_CLIRegisterCommand( &xCommandDef_uptime );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_rngtest );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_assert );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_netperf );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_logstat );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_crashlog );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_loglevel );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_mqttstat );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_netstat );
 
     char * pcCommandBuffer = NULL;
 
     if( xInitConsoleUart() == pdTRUE )
     {
+        /* Report a crash of the previous boot without waiting to be asked */
+        vCrashLogPrintCrash( &xConsoleIO );
+
         for( ; ; )
         {
             /* Read a line of input */
@@ -0,0 +1,157 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "freertos_command_pool.h"
+#include "mqtt_agent_task.h"
+#include "mqtt_publish_spool.h"
+#include "subscription_manager.h"
+
+static void prvMqttStatCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_mqttstat =
+{
+    "mqttstat",
+    "mqttstat\r\n"
+    "    Display the MQTT agent statistics.\r\n"
+    "    pool: usage of the command structure pool, the number of requests that\r\n"
+    "        could not get a structure and the time spent waiting for one.\r\n"
+    "    callback: calls, drops and execution time of each subscription callback,\r\n"
+    "        in run time counter units.\r\n"
+    "    spool: records stored while offline and replayed once connected, when\r\n"
+    "        DEMO_PUBLISH_SPOOL is enabled.\r\n\n",
+    prvMqttStatCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintPoolStats( ConsoleIO_t * const pxCIO )
+{
+    AgentCommandPoolStats_t xPoolStats;
+
+    Agent_GetPoolStats( &xPoolStats );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "pool: size %lu, in use %lu, high water %lu, alloc failures %lu, "
+                       "wait total %lu ms, wait max %lu ms\r\n",
+                       ( unsigned long ) xPoolStats.ulPoolSize,
+                       ( unsigned long ) xPoolStats.ulInUse,
+                       ( unsigned long ) xPoolStats.ulHighWaterMark,
+                       ( unsigned long ) xPoolStats.ulAllocFailures,
+                       ( unsigned long ) xPoolStats.ulTotalWaitMs,
+                       ( unsigned long ) xPoolStats.ulMaxWaitMs );
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintCallbackStats( ConsoleIO_t * const pxCIO )
+{
+    /* Kept off the CLI task stack */
+    static MQTTAgentCallbackInfo_t xCallbackInfo[ MQTT_AGENT_MAX_CALLBACKS ];
+    MQTTAgentHandle_t xHandle = xGetMqttAgentHandle();
+    size_t uxCount = 0;
+
+    if( xHandle != NULL )
+    {
+        uxCount = MqttAgent_GetCallbackStats( xHandle, xCallbackInfo, MQTT_AGENT_MAX_CALLBACKS );
+    }
+
+    for( size_t uxIdx = 0; uxIdx < uxCount; uxIdx++ )
+    {
+        const MQTTAgentCallbackInfo_t * pxInfo = &( xCallbackInfo[ uxIdx ] );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "callback: task %s, ctx %p, %s, calls %lu, dropped %lu, "
+                           "total %lu, max %lu\r\n",
+                           pxInfo->pcTaskName,
+                           pxInfo->pvCallbackCtx,
+                           ( pxInfo->xDispatchMode == MQTTAgentDispatchDeferred ) ? "deferred" : "inline",
+                           ( unsigned long ) pxInfo->xStats.ulInvocations,
+                           ( unsigned long ) pxInfo->xStats.ulDropped,
+                           ( unsigned long ) pxInfo->xStats.ulTotalRunTime,
+                           ( unsigned long ) pxInfo->xStats.ulMaxRunTime );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if DEMO_PUBLISH_SPOOL
+static void prvPrintSpoolStats( ConsoleIO_t * const pxCIO )
+{
+    MqttSpoolStats_t xSpoolStats = { 0 };
+
+    MqttSpool_GetStats( &xSpoolStats );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "spool: enqueued %lu, errors %lu, drained %lu, flash writes %lu, "
+                       "segments %lu, evicted %lu, corrupt %lu, enqueue max %lu ms\r\n",
+                       ( unsigned long ) xSpoolStats.ulEnqueued,
+                       ( unsigned long ) xSpoolStats.ulEnqueueErrors,
+                       ( unsigned long ) xSpoolStats.ulDrained,
+                       ( unsigned long ) xSpoolStats.ulFlashWrites,
+                       ( unsigned long ) xSpoolStats.ulSegments,
+                       ( unsigned long ) xSpoolStats.ulEvictedSegments,
+                       ( unsigned long ) xSpoolStats.ulCorruptRecords,
+                       ( unsigned long ) xSpoolStats.ulMaxEnqueueMs );
+    pxCIO->print( pcCliScratchBuffer );
+}
+#endif /* DEMO_PUBLISH_SPOOL */
+
+/*-----------------------------------------------------------*/
+
+static void prvMqttStatCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    ( void ) ppcArgv;
+
+    if( ulArgc == 1 )
+    {
+        prvPrintPoolStats( pxCIO );
+        prvPrintCallbackStats( pxCIO );
+#if DEMO_PUBLISH_SPOOL
+        prvPrintSpoolStats( pxCIO );
+#endif
+    }
+    else
+    {
+        pxCIO->print( xCommandDef_mqttstat.pcHelpString );
+    }
+}
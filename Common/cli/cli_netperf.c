@@ -0,0 +1,243 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "net_perf.h"
+
+static void prvNetPerfCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_netperf =
+{
+    "netperf",
+    "netperf\r\n"
+    "    Measure TCP or UDP throughput through lwIP. Compatible with iperf 2 peers.\r\n"
+    "    Usage:\r\n"
+    "    netperf <tcp|udp> tx <server ip> [-p port] [-l len] [-t seconds] [-b kbps]\r\n"
+    "        Send to an iperf 2 server, e.g. \"iperf -s [-u]\".\r\n"
+    "    netperf <tcp|udp> rx [-p port] [-l len] [-t seconds]\r\n"
+    "        Receive from an iperf 2 client, e.g. \"iperf -c <ip> [-u -b 5M]\".\r\n"
+    "        Runs until the peer is done unless -t is given.\r\n"
+    "    netperf status\r\n"
+    "        Print the progress of the running test or the result of the last one.\r\n"
+    "    netperf stop\r\n"
+    "        Stop the running test.\r\n\n"
+    "    Defaults: port 5001, len 1460, 10 seconds for tx, 1000 kbit/s for udp tx (-b 0 is unlimited).\r\n\n",
+    prvNetPerfCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintResult( ConsoleIO_t * const pxCIO )
+{
+    static const char * const pcStateNames[] = { "idle", "running", "done", "error" };
+    NetPerfResult_t xResult;
+    uint32_t ulKbps = 0;
+
+    NetPerf_GetResult( &xResult );
+
+    if( xResult.ulElapsedMs > 0 )
+    {
+        /* bits per millisecond is kbit/s */
+        ulKbps = ( uint32_t ) ( ( ( uint64_t ) xResult.ulBytes * 8 ) / xResult.ulElapsedMs );
+    }
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "%s %s: %s, %lu bytes in %lu ms, %lu kbit/s\r\n",
+                       ( xResult.xConfig.xProto == NET_PERF_PROTO_TCP ) ? "tcp" : "udp",
+                       ( xResult.xConfig.xDir == NET_PERF_DIR_TX ) ? "tx" : "rx",
+                       pcStateNames[ xResult.xState ],
+                       ( unsigned long ) xResult.ulBytes,
+                       ( unsigned long ) xResult.ulElapsedMs,
+                       ( unsigned long ) ulKbps );
+    pxCIO->print( pcCliScratchBuffer );
+
+    if( xResult.xConfig.xProto == NET_PERF_PROTO_UDP )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "datagrams: %lu, lost: %lu, out of order: %lu\r\n",
+                           ( unsigned long ) xResult.ulDatagrams,
+                           ( unsigned long ) xResult.ulLost,
+                           ( unsigned long ) xResult.ulOutOfOrder );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    if( xResult.xState == NET_PERF_STATE_ERROR )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "errno: %ld\r\n", ( long ) xResult.lError );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xParseStartArgs( ConsoleIO_t * const pxCIO,
+                                   uint32_t ulArgc,
+                                   char * ppcArgv[],
+                                   NetPerfConfig_t * pxConfig )
+{
+    BaseType_t xResult = pdTRUE;
+    NetPerfProto_t xProto = NET_PERF_PROTO_TCP;
+    NetPerfDir_t xDir = NET_PERF_DIR_TX;
+    uint32_t ulArgIdx = 3;
+
+    if( strcmp( "udp", ppcArgv[ 1 ] ) == 0 )
+    {
+        xProto = NET_PERF_PROTO_UDP;
+    }
+    else if( strcmp( "tcp", ppcArgv[ 1 ] ) != 0 )
+    {
+        xResult = pdFALSE;
+    }
+
+    if( strcmp( "rx", ppcArgv[ 2 ] ) == 0 )
+    {
+        xDir = NET_PERF_DIR_RX;
+    }
+    else if( strcmp( "tx", ppcArgv[ 2 ] ) != 0 )
+    {
+        xResult = pdFALSE;
+    }
+
+    NetPerf_GetDefaultConfig( pxConfig, xProto, xDir );
+
+    if( ( xResult == pdTRUE ) && ( xDir == NET_PERF_DIR_TX ) )
+    {
+        if( ulArgc > 3 )
+        {
+            ( void ) strncpy( pxConfig->pcHost, ppcArgv[ 3 ], NET_PERF_HOST_LEN - 1 );
+            ulArgIdx++;
+        }
+        else
+        {
+            pxCIO->print( "Error: Server address is required for tx.\r\n" );
+            xResult = pdFALSE;
+        }
+    }
+
+    while( ( xResult == pdTRUE ) && ( ulArgIdx < ulArgc ) )
+    {
+        const char * pcOption = ppcArgv[ ulArgIdx ];
+        uint32_t ulValue = 0;
+
+        if( ( ulArgIdx + 1 ) >= ulArgc )
+        {
+            xResult = pdFALSE;
+            break;
+        }
+
+        ulValue = ( uint32_t ) strtoul( ppcArgv[ ulArgIdx + 1 ], NULL, 0 );
+
+        if( strcmp( "-p", pcOption ) == 0 )
+        {
+            pxConfig->usPort = ( uint16_t ) ulValue;
+        }
+        else if( strcmp( "-l", pcOption ) == 0 )
+        {
+            pxConfig->ulLen = ulValue;
+        }
+        else if( strcmp( "-t", pcOption ) == 0 )
+        {
+            pxConfig->ulDurationS = ulValue;
+        }
+        else if( strcmp( "-b", pcOption ) == 0 )
+        {
+            pxConfig->ulRateKbps = ulValue;
+        }
+        else
+        {
+            xResult = pdFALSE;
+        }
+
+        ulArgIdx += 2;
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( xDir == NET_PERF_DIR_TX ) &&
+        ( pxConfig->ulDurationS == 0 ) )
+    {
+        pxCIO->print( "Error: tx requires a duration.\r\n" );
+        xResult = pdFALSE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvNetPerfCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    if( ( ulArgc == 2 ) && ( strcmp( "status", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        prvPrintResult( pxCIO );
+        xSuccess = pdTRUE;
+    }
+    else if( ( ulArgc == 2 ) && ( strcmp( "stop", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        NetPerf_Stop();
+        pxCIO->print( "Stop requested.\r\n" );
+        xSuccess = pdTRUE;
+    }
+    else if( ulArgc >= 3 )
+    {
+        NetPerfConfig_t xConfig;
+
+        if( xParseStartArgs( pxCIO, ulArgc, ppcArgv, &xConfig ) == pdTRUE )
+        {
+            if( NetPerf_Start( &xConfig ) == pdTRUE )
+            {
+                pxCIO->print( "Test started. Use \"netperf status\" for results.\r\n" );
+            }
+            else
+            {
+                pxCIO->print( "Error: Failed to start the test. Is another test running?\r\n" );
+            }
+
+            xSuccess = pdTRUE;
+        }
+    }
+
+    if( xSuccess == pdFALSE )
+    {
+        pxCIO->print( xCommandDef_netperf.pcHelpString );
+    }
+}
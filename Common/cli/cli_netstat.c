@@ -0,0 +1,117 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "mx_netconn.h"
+
+static void prvNetStatCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_netstat =
+{
+    "netstat",
+    "netstat\r\n"
+    "    Display the counters of the SPI link to the WiFi module.\r\n"
+    "    spi: transactions and the packets and bytes they carried. With\r\n"
+    "        MX_SPI_AGGREGATION, a transaction can carry several packets.\r\n"
+    "    rx ring: buffers posted ahead of incoming frames, the lowest depth reached,\r\n"
+    "        frames which needed an allocation, refills and how long slots stayed\r\n"
+    "        empty in ticks, and frames dropped for lack of a buffer.\r\n"
+    "    tx latency: time from queueing a packet to the start of its SPI transfer,\r\n"
+    "        in run time counter units.\r\n\n",
+    prvNetStatCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvNetStatCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] )
+{
+    ( void ) ppcArgv;
+
+    if( ulArgc == 1 )
+    {
+        MxDataplaneStats_t xStats = { 0 };
+        uint32_t ulRefillAvgTicks = 0;
+        uint32_t ulTxLatencyAvg = 0;
+
+        net_get_dataplane_stats( &xStats );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "spi: transactions %lu, tx packets %lu, tx bytes %lu, rx packets %lu, rx bytes %lu\r\n",
+                           ( unsigned long ) xStats.ulSpiTransactions,
+                           ( unsigned long ) xStats.ulTxPackets,
+                           ( unsigned long ) xStats.ulTxBytes,
+                           ( unsigned long ) xStats.ulRxPackets,
+                           ( unsigned long ) xStats.ulRxBytes );
+        pxCIO->print( pcCliScratchBuffer );
+
+        if( xStats.ulRxRingRefills > 0 )
+        {
+            ulRefillAvgTicks = xStats.ulRxRingRefillTotalTicks / xStats.ulRxRingRefills;
+        }
+
+        if( xStats.ulTxLatencyCount > 0 )
+        {
+            ulTxLatencyAvg = xStats.ulTxLatencyTotal / xStats.ulTxLatencyCount;
+        }
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "rx ring: depth %lu, min depth %lu, misses %lu, refills %lu, "
+                           "refill avg %lu, refill max %lu, drops %lu\r\n",
+                           ( unsigned long ) xStats.ulRxRingDepth,
+                           ( unsigned long ) xStats.ulRxRingMinDepth,
+                           ( unsigned long ) xStats.ulRxRingMisses,
+                           ( unsigned long ) xStats.ulRxRingRefills,
+                           ( unsigned long ) ulRefillAvgTicks,
+                           ( unsigned long ) xStats.ulRxRingRefillMaxTicks,
+                           ( unsigned long ) xStats.ulRxDrops );
+        pxCIO->print( pcCliScratchBuffer );
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "tx latency: packets %lu, avg %lu, max %lu\r\n",
+                           ( unsigned long ) xStats.ulTxLatencyCount,
+                           ( unsigned long ) ulTxLatencyAvg,
+                           ( unsigned long ) xStats.ulTxLatencyMax );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+    else
+    {
+        pxCIO->print( xCommandDef_netstat.pcHelpString );
+    }
+}
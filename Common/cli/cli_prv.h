@@ -122,6 +122,20 @@ char * FreeRTOS_CLIGetOutputBuffer( void );
 
 UART_HandleTypeDef * vInitUartEarly( void );
 
+typedef struct
+{
+    uint32_t ulTxBytes;      /* Bytes sent to the uart */
+    uint32_t ulTxBursts;     /* Interrupt or DMA transfers started */
+    uint32_t ulTxStalls;     /* Times the TX thread waited for the DMA ring to drain */
+    uint32_t ulWriteStalls;  /* Times a console write blocked on a full TX stream */
+} ConsoleStats_t;
+
+void vConsoleGetStats( ConsoleStats_t * pxStats );
+void vConsoleResetStats( void );
+
+/* Print the records kept from a crashed boot, if any. Defined in cli_crashlog.c */
+void vCrashLogPrintCrash( ConsoleIO_t * const pxCIO );
+
 extern const CLI_Command_Definition_t xCommandDef_conf;
 extern const CLI_Command_Definition_t xCommandDef_pki;
 extern const CLI_Command_Definition_t xCommandDef_ps;
@@ -132,5 +146,11 @@ extern const CLI_Command_Definition_t xCommandDef_reset;
 extern const CLI_Command_Definition_t xCommandDef_uptime;
 extern const CLI_Command_Definition_t xCommandDef_rngtest;
 extern const CLI_Command_Definition_t xCommandDef_assert;
+extern const CLI_Command_Definition_t xCommandDef_netperf;
+extern const CLI_Command_Definition_t xCommandDef_logstat;
+extern const CLI_Command_Definition_t xCommandDef_crashlog;
+extern const CLI_Command_Definition_t xCommandDef_loglevel;
+extern const CLI_Command_Definition_t xCommandDef_mqttstat;
+extern const CLI_Command_Definition_t xCommandDef_netstat;
 
 #endif /* _CLI_PRIV */
@@ -35,9 +35,7 @@
 
 #define HW_FIFO_LEN    8
 
-extern volatile StreamBufferHandle_t xLogMBuf;
-
-static char ucLogLineTxBuff[ dlMAX_PRINT_STRING_LENGTH ];
+static char ucLogLineTxBuff[ dlMAX_LOG_LINE_LENGTH ];
 static SemaphoreHandle_t xUartTxSem = NULL;
 
 static volatile BaseType_t xPartialCommand = pdFALSE;
@@ -56,6 +54,8 @@ static BaseType_t xExitFlag = pdFALSE;
 static TaskHandle_t xRxThreadHandle = NULL;
 static TaskHandle_t xTxThreadHandle = NULL;
 
+static volatile ConsoleStats_t xConsoleStats = { 0 };
+
 extern UART_HandleTypeDef xConsoleHandle;
 
 static void txCompleteCallback( UART_HandleTypeDef * pxUartHandle );
@@ -65,9 +65,19 @@ static void rxEventCallback( UART_HandleTypeDef * pxUartHandle,
                              uint16_t usBytesRead );
 static void rxErrorCallback( UART_HandleTypeDef * pxUartHandle );
 
+#if ( CLI_UART_TX_DMA == 1 )
+    static HAL_StatusTypeDef prvInitTxDma( void );
+#endif
+
 /* Should only be called before the scheduler has been initialized / after an assertion has occurred */
 UART_HandleTypeDef * vInitUartEarly( void )
 {
+    /* Blocking transmits fail while an interrupt or DMA transfer is still active */
+    if( xConsoleHandle.gState == HAL_UART_STATE_BUSY_TX )
+    {
+        ( void ) HAL_UART_AbortTransmit( &xConsoleHandle );
+    }
+
     return &xConsoleHandle;
 }
 
@@ -88,6 +98,13 @@ BaseType_t xInitConsoleUart( void )
         xHalRslt = HAL_UART_Init( &xConsoleHandle );
     }
 
+    #if ( CLI_UART_TX_DMA == 1 )
+        if( xHalRslt == HAL_OK )
+        {
+            xHalRslt = prvInitTxDma();
+        }
+    #endif
+
     /* Register callbacks */
     if( xHalRslt == HAL_OK )
     {
@@ -239,97 +256,355 @@ static void vRxThread( void * pvParameters )
     }
 }
 
-/* */
-static void txCompleteCallback( UART_HandleTypeDef * pxUartHandle )
+/* Write a pending log line to the console, wrapped so that it does not clobber a partially typed command */
+static void prvEmitLogLine( void ( * pxWrite )( const void * pvData,
+                                               size_t xLen ) )
 {
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    size_t xBytes = 0;
 
-    ( void ) vTaskNotifyGiveIndexedFromISR( xTxThreadHandle, 1, &xHigherPriorityTaskWoken );
+    /* Take the uart write semaphore (non-blocking) */
+    if( xSemaphoreTake( xUartTxSem, 0 ) == pdTRUE )
+    {
+        xBytes = xLoggingReceive( ucLogLineTxBuff, sizeof( ucLogLineTxBuff ) );
 
-    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        /* All log messages should be less than the maximum length */
+        configASSERT( ( xBytes + CLI_OUTPUT_EOL_LEN + CLI_INPUT_LINE_LEN_MAX ) <= CLI_UART_TX_STREAM_LEN );
+
+        /* If we got a log message to output, add it to the stream buffer to be processed */
+        if( xBytes > 0 )
+        {
+            if( xPartialCommand == pdTRUE )
+            {
+                /* Overwrite existing line contents */
+                pxWrite( "\r\033[K", 4 );
+            }
+
+            /* enqueue the log message */
+            pxWrite( ucLogLineTxBuff, xBytes );
+
+            /* Add CRLF */
+            pxWrite( CLI_OUTPUT_EOL, CLI_OUTPUT_EOL_LEN );
+
+            if( xPartialCommand == pdTRUE )
+            {
+                pxWrite( CLI_PROMPT_STR, CLI_PROMPT_LEN );
+
+                /* Restore current command line contents */
+                if( ulInBufferIdx > 0 )
+                {
+                    pxWrite( pcInputBuffer, ulInBufferIdx );
+                }
+            }
+        }
+
+        ( void ) xSemaphoreGive( xUartTxSem );
+    }
 }
 
-/* Uart transmit thread */
-static void vTxThread( void * pvParameters )
-{
-    uint8_t pucTxBuffer[ CLI_UART_TX_WRITE_SZ_5MS ] = { 0 };
-    HAL_StatusTypeDef xHalStatus = HAL_OK;
+#if ( CLI_UART_TX_DMA == 1 )
 
-    size_t xBytes = 0;
+/*
+ * The TX thread moves bytes from xUartTxStream straight into pucTxRing. DMA
+ * sends the ring one contiguous segment at a time and the transfer complete
+ * callback starts the next segment, so the thread only wakes up for new data
+ * or when the ring is full.
+ */
+    static uint8_t pucTxRing[ CLI_UART_TX_RING_LEN ];
+    static volatile uint32_t ulTxHead = 0;     /* Written by the TX thread */
+    static volatile uint32_t ulTxTail = 0;     /* Advanced by the transfer complete callback */
+    static volatile uint32_t ulTxInFlight = 0; /* Length of the current DMA transfer, 0 when idle */
+    static volatile BaseType_t xTxWaitingForSpace = pdFALSE;
 
-    while( !xExitFlag )
+    static DMA_HandleTypeDef xConsoleTxDma;
+
+    _Static_assert( ( CLI_UART_TX_RING_LEN & ( CLI_UART_TX_RING_LEN - 1 ) ) == 0, "CLI_UART_TX_RING_LEN must be a power of two" );
+
+/*-----------------------------------------------------------*/
+
+    static HAL_StatusTypeDef prvInitTxDma( void )
     {
-        /* Read up to 64 bytes
-         * wait up to BUFFER_READ_TIMEOUT before getting less than 64 */
-        xBytes = xStreamBufferReceive( xUartTxStream,
-                                       pucTxBuffer,
-                                       CLI_UART_TX_WRITE_SZ_5MS,
-                                       BUFFER_READ_TIMEOUT_MS );
-
-        /* If tx buffer is empty */
-        if( xBytes == 0 )
+        HAL_StatusTypeDef xHalRslt = HAL_OK;
+
+        __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+        xConsoleTxDma.Instance = CLI_UART_TX_DMA_CHANNEL;
+        xConsoleTxDma.Init.Request = GPDMA1_REQUEST_USART1_TX;
+        xConsoleTxDma.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+        xConsoleTxDma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+        xConsoleTxDma.Init.SrcInc = DMA_SINC_INCREMENTED;
+        xConsoleTxDma.Init.DestInc = DMA_DINC_FIXED;
+        xConsoleTxDma.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+        xConsoleTxDma.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+        xConsoleTxDma.Init.Priority = DMA_LOW_PRIORITY_LOW_WEIGHT;
+        xConsoleTxDma.Init.SrcBurstLength = 1;
+        xConsoleTxDma.Init.DestBurstLength = 1;
+        xConsoleTxDma.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+        xConsoleTxDma.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+        xConsoleTxDma.Init.Mode = DMA_NORMAL;
+
+        xHalRslt = HAL_DMA_Init( &xConsoleTxDma );
+
+        if( xHalRslt == HAL_OK )
         {
-            /* Take the uart write semaphore (non-blocking) */
-            if( xSemaphoreTake( xUartTxSem, 0 ) == pdTRUE )
+            xHalRslt = HAL_DMA_ConfigChannelAttributes( &xConsoleTxDma, DMA_CHANNEL_NPRIV );
+        }
+
+        if( xHalRslt == HAL_OK )
+        {
+            __HAL_LINKDMA( &xConsoleHandle, hdmatx, xConsoleTxDma );
+
+            HAL_NVIC_SetPriority( CLI_UART_TX_DMA_IRQn, 5, 0 );
+            HAL_NVIC_EnableIRQ( CLI_UART_TX_DMA_IRQn );
+        }
+
+        return xHalRslt;
+    }
+
+/*-----------------------------------------------------------*/
+
+    void CLI_UART_TX_DMA_IRQHandler( void )
+    {
+        HAL_DMA_IRQHandler( &xConsoleTxDma );
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Start a transfer of the next contiguous segment of the ring. Called with interrupts masked or from the callback. */
+    static void prvTxStartNext( void )
+    {
+        uint32_t ulPending = ulTxHead - ulTxTail;
+
+        if( ( ulTxInFlight == 0 ) && ( ulPending > 0 ) )
+        {
+            uint32_t ulOffset = ulTxTail & ( CLI_UART_TX_RING_LEN - 1 );
+            uint32_t ulLen = CLI_UART_TX_RING_LEN - ulOffset;
+
+            if( ulLen > ulPending )
+            {
+                ulLen = ulPending;
+            }
+
+            if( HAL_UART_Transmit_DMA( &xConsoleHandle, &( pucTxRing[ ulOffset ] ), ( uint16_t ) ulLen ) == HAL_OK )
             {
-                xBytes = xMessageBufferReceive( xLogMBuf, ucLogLineTxBuff, dlMAX_PRINT_STRING_LENGTH, 0 );
+                ulTxInFlight = ulLen;
+                xConsoleStats.ulTxBursts++;
+            }
+        }
+    }
 
-                /* All log messages should be less than the maximum length */
-                configASSERT( ( xBytes + CLI_OUTPUT_EOL_LEN + CLI_INPUT_LINE_LEN_MAX ) <= CLI_UART_TX_STREAM_LEN );
+/*-----------------------------------------------------------*/
 
-                /* If we got a log message to output, add it to the stream buffer to be processed */
-                if( xBytes > 0 )
-                {
-                    if( xPartialCommand == pdTRUE )
-                    {
-                        /* Overwrite existing line contents */
-                        ( void ) xStreamBufferSend( xUartTxStream, "\r\033[K", 4, 0 );
-                    }
+    static void txCompleteCallback( UART_HandleTypeDef * pxUartHandle )
+    {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-                    /* enqueue the log message */
-                    ( void ) xStreamBufferSend( xUartTxStream, ucLogLineTxBuff, xBytes, 0 );
+        ( void ) pxUartHandle;
 
-                    /* Add CRLF */
-                    ( void ) xStreamBufferSend( xUartTxStream, CLI_OUTPUT_EOL, CLI_OUTPUT_EOL_LEN, 0 );
+        ulTxTail += ulTxInFlight;
+        xConsoleStats.ulTxBytes += ulTxInFlight;
+        ulTxInFlight = 0;
 
-                    if( xPartialCommand == pdTRUE )
-                    {
-                        ( void ) xStreamBufferSend( xUartTxStream, CLI_PROMPT_STR, CLI_PROMPT_LEN, 0 );
+        prvTxStartNext();
 
-                        /* Restore current command line contents */
-                        if( ulInBufferIdx > 0 )
-                        {
-                            ( void ) xStreamBufferSend( xUartTxStream, pcInputBuffer, ulInBufferIdx, 0 );
-                        }
-                    }
+        if( xTxWaitingForSpace == pdTRUE )
+        {
+            xTxWaitingForSpace = pdFALSE;
+            ( void ) vTaskNotifyGiveIndexedFromISR( xTxThreadHandle, 1, &xHigherPriorityTaskWoken );
+        }
 
-                    ( void ) xSemaphoreGive( xUartTxSem );
-                    xBytes = xStreamBufferReceive( xUartTxStream,
-                                                   pucTxBuffer,
-                                                   CLI_UART_TX_WRITE_SZ_5MS,
-                                                   0 );
-                }
-                else
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Wait until the ring has room, returns the number of contiguous bytes that can be written at ulTxHead */
+    static uint32_t prvTxRingWaitForSpace( void )
+    {
+        uint32_t ulFree = CLI_UART_TX_RING_LEN - ( ulTxHead - ulTxTail );
+
+        if( ulFree == 0 )
+        {
+            xConsoleStats.ulTxStalls++;
+
+            do
+            {
+                ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
+                xTxWaitingForSpace = pdTRUE;
+
+                ulFree = CLI_UART_TX_RING_LEN - ( ulTxHead - ulTxTail );
+
+                if( ulFree == 0 )
                 {
-                    ( void ) xSemaphoreGive( xUartTxSem );
+                    ( void ) ulTaskNotifyTakeIndexed( 1, pdTRUE, portMAX_DELAY );
+                    ulFree = CLI_UART_TX_RING_LEN - ( ulTxHead - ulTxTail );
                 }
             }
+            while( ulFree == 0 );
+
+            xTxWaitingForSpace = pdFALSE;
         }
 
-        /* Transmit if bytes available to transmit */
-        if( xBytes > 0 )
+        if( ulFree > ( CLI_UART_TX_RING_LEN - ( ulTxHead & ( CLI_UART_TX_RING_LEN - 1 ) ) ) )
         {
-            ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
-            xHalStatus = HAL_UART_Transmit_IT( &xConsoleHandle, pucTxBuffer, ( uint16_t ) xBytes );
-/*			configASSERT( xHalStatus == HAL_OK ); */
+            ulFree = CLI_UART_TX_RING_LEN - ( ulTxHead & ( CLI_UART_TX_RING_LEN - 1 ) );
+        }
+
+        return ulFree;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvTxRingCommit( uint32_t ulLen )
+    {
+        UBaseType_t uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+        ulTxHead += ulLen;
+        prvTxStartNext();
+
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvTxRingWrite( const void * pvData,
+                                size_t xLen )
+    {
+        const uint8_t * pucData = ( const uint8_t * ) pvData;
+
+        while( xLen > 0 )
+        {
+            uint32_t ulChunk = prvTxRingWaitForSpace();
+
+            if( ulChunk > xLen )
+            {
+                ulChunk = xLen;
+            }
+
+            ( void ) memcpy( &( pucTxRing[ ulTxHead & ( CLI_UART_TX_RING_LEN - 1 ) ] ), pucData, ulChunk );
+            prvTxRingCommit( ulChunk );
+
+            pucData += ulChunk;
+            xLen -= ulChunk;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Uart transmit thread */
+    static void vTxThread( void * pvParameters )
+    {
+        ( void ) pvParameters;
+
+        while( !xExitFlag )
+        {
+            uint32_t ulSpace = 0;
+            size_t xBytes = 0;
+
+            /* Log lines are only interleaved between writes to the console */
+            if( xStreamBufferIsEmpty( xUartTxStream ) == pdTRUE )
+            {
+                prvEmitLogLine( prvTxRingWrite );
+            }
+
+            ulSpace = prvTxRingWaitForSpace();
+
+            /* Copy straight from the stream buffer into the DMA ring */
+            xBytes = xStreamBufferReceive( xUartTxStream,
+                                           &( pucTxRing[ ulTxHead & ( CLI_UART_TX_RING_LEN - 1 ) ] ),
+                                           ulSpace,
+                                           BUFFER_READ_TIMEOUT_MS );
+
+            if( xBytes > 0 )
+            {
+                prvTxRingCommit( xBytes );
+            }
+        }
+    }
+
+#else /* CLI_UART_TX_DMA == 1 */
+
+/* */
+    static void txCompleteCallback( UART_HandleTypeDef * pxUartHandle )
+    {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+        ( void ) vTaskNotifyGiveIndexedFromISR( xTxThreadHandle, 1, &xHigherPriorityTaskWoken );
+
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvStreamWrite( const void * pvData,
+                                size_t xLen )
+    {
+        ( void ) xStreamBufferSend( xUartTxStream, pvData, xLen, 0 );
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Uart transmit thread */
+    static void vTxThread( void * pvParameters )
+    {
+        uint8_t pucTxBuffer[ CLI_UART_TX_WRITE_SZ_5MS ] = { 0 };
+        HAL_StatusTypeDef xHalStatus = HAL_OK;
+
+        size_t xBytes = 0;
 
-            if( xHalStatus == HAL_OK )
+        while( !xExitFlag )
+        {
+            /* Read up to 64 bytes
+             * wait up to BUFFER_READ_TIMEOUT before getting less than 64 */
+            xBytes = xStreamBufferReceive( xUartTxStream,
+                                           pucTxBuffer,
+                                           CLI_UART_TX_WRITE_SZ_5MS,
+                                           BUFFER_READ_TIMEOUT_MS );
+
+            /* If tx buffer is empty */
+            if( xBytes == 0 )
+            {
+                prvEmitLogLine( prvStreamWrite );
+
+                xBytes = xStreamBufferReceive( xUartTxStream,
+                                               pucTxBuffer,
+                                               CLI_UART_TX_WRITE_SZ_5MS,
+                                               0 );
+            }
+
+            /* Transmit if bytes available to transmit */
+            if( xBytes > 0 )
             {
-                /* Wait for completion event (should be within 1 or 2 ms) */
-                ( void ) ulTaskNotifyTakeIndexed( 1, pdTRUE, portMAX_DELAY );
+                ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
+                xHalStatus = HAL_UART_Transmit_IT( &xConsoleHandle, pucTxBuffer, ( uint16_t ) xBytes );
+/*			configASSERT( xHalStatus == HAL_OK ); */
+
+                if( xHalStatus == HAL_OK )
+                {
+                    xConsoleStats.ulTxBursts++;
+                    xConsoleStats.ulTxBytes += xBytes;
+
+                    /* Wait for completion event (should be within 1 or 2 ms) */
+                    ( void ) ulTaskNotifyTakeIndexed( 1, pdTRUE, portMAX_DELAY );
+                }
             }
         }
     }
+#endif /* CLI_UART_TX_DMA == 1 */
+
+void vConsoleGetStats( ConsoleStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    *pxStats = xConsoleStats;
+    taskEXIT_CRITICAL();
+}
+
+void vConsoleResetStats( void )
+{
+    taskENTER_CRITICAL();
+    ( void ) memset( ( void * ) &xConsoleStats, 0, sizeof( xConsoleStats ) );
+    taskEXIT_CRITICAL();
 }
 
 static void uart_write( const void * const pvOutputBuffer,
@@ -342,6 +617,14 @@ static void uart_write( const void * const pvOutputBuffer,
     if( ( pvOutputBuffer != NULL ) &&
         ( xOutputBufferLen > 0 ) )
     {
+        xBytesSent = xStreamBufferSend( xUartTxStream, pcBuffer, xOutputBufferLen, 0 );
+
+        if( xBytesSent < xOutputBufferLen )
+        {
+            /* The console is not keeping up, block until the TX thread drains the stream */
+            xConsoleStats.ulWriteStalls++;
+        }
+
         while( xBytesSent < xOutputBufferLen )
         {
             xBytesSent += xStreamBufferSend( xUartTxStream,
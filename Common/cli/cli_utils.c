@@ -35,6 +35,8 @@
 
 #include "cli.h"
 #include "cli_prv.h"
+#include "mbedtls_freertos_port.h"
+#include "logging.h"
 
 static void prvPSCommand( ConsoleIO_t * const pxConsoleIO,
                           uint32_t ulArgc,
@@ -64,6 +66,10 @@ static void vAssertCommand( ConsoleIO_t * const pxCIO,
                             uint32_t ulArgc,
                             char * ppcArgv[] );
 
+static void vLogStatCommand( ConsoleIO_t * const pxCIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[] );
+
 
 
 const CLI_Command_Definition_t xCommandDef_ps =
@@ -109,7 +115,8 @@ const CLI_Command_Definition_t xCommandDef_heapStat =
     "    heapstat --kilo\r\n"
     "        Display heap statistics in Kilobytes (KB).\r\n\n"
     "    heapstat --mega\r\n"
-    "        Display heap statistics in Megabytes (MB).\r\n\n",
+    "        Display heap statistics in Megabytes (MB).\r\n\n"
+    "    Rows starting with TLS show the mbedtls allocator usage.\r\n\n",
     vHeapStatCommand
 };
 
@@ -137,6 +144,19 @@ const CLI_Command_Definition_t xCommandDef_assert =
     vAssertCommand
 };
 
+const CLI_Command_Definition_t xCommandDef_logstat =
+{
+    "logstat",
+    "logstat\r\n"
+    "    logstat\r\n"
+    "        Display the number of log calls, the CPU cycles spent in them and the number of\r\n"
+    "        messages dropped because the log buffer was full, followed by the console\r\n"
+    "        transmit counters. Stalls show where output was held back by the uart.\r\n\n"
+    "    logstat reset\r\n"
+    "        Reset the log and console statistics.\r\n\n",
+    vLogStatCommand
+};
+
 /*-----------------------------------------------------------*/
 
 /* Returns up to 9 character string representing the task state */
@@ -615,7 +635,63 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
         }
 
         pxCIO->write( pcCliScratchBuffer, xLen );
+
+        MbedtlsMemStats_t xTlsStats;
+
+        mbedtls_platform_get_memory_stats( &xTlsStats );
+
+        const struct
+        {
+            const char * pcName;
+            size_t xValue;
+            size_t xTotal;
+        }
+        xTlsRows[] =
+        {
+            { "TLS Heap Alloc.",  xTlsStats.uxHeapUsed,  xHeapSize             },
+            { "TLS Heap Peak",    xTlsStats.uxHeapPeak,  xHeapSize             },
+            { "TLS Arena Total",  xTlsStats.uxArenaSize, xTlsStats.uxArenaSize },
+            { "TLS Arena Alloc.", xTlsStats.uxArenaUsed, xTlsStats.uxArenaSize },
+            { "TLS Arena Peak",   xTlsStats.uxArenaPeak, xTlsStats.uxArenaSize },
+        };
+
+        pxCIO->print( "|------------------|-------------|-------------|---------|\r\n" );
+
+        for( size_t uxRow = 0; uxRow < ( sizeof( xTlsRows ) / sizeof( xTlsRows[ 0 ] ) ); uxRow++ )
+        {
+            /* Skip the arena rows when mbedtls allocates from the FreeRTOS heap only */
+            if( xTlsRows[ uxRow ].xTotal == 0 )
+            {
+                continue;
+            }
+
+            xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormatString,
+                             xTlsRows[ uxRow ].pcName,
+                             xTlsRows[ uxRow ].xValue / xDivisor,
+                             xTlsRows[ uxRow ].xValue,
+                             ( 100 * xTlsRows[ uxRow ].xValue ) / xTlsRows[ uxRow ].xTotal );
+
+            if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+            {
+                xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+            }
+
+            pxCIO->write( pcCliScratchBuffer, xLen );
+        }
+
         pxCIO->print( "+--------------------------------------------------------+\r\n" );
+
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                         "TLS allocations: %lu, frees: %lu, from heap: %lu, failed: %lu, arena fragmentation: %lu %%\r\n",
+                         xTlsStats.ulAllocCount, xTlsStats.ulFreeCount, xTlsStats.ulHeapAllocCount,
+                         xTlsStats.ulFailCount, xTlsStats.ulFragmentationPct );
+
+        if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+        }
+
+        pxCIO->write( pcCliScratchBuffer, xLen );
     }
 }
 
@@ -666,3 +742,67 @@ static void vAssertCommand( ConsoleIO_t * const pxCIO,
 {
     configASSERT( 0 );
 }
+
+static void vLogStatCommand( ConsoleIO_t * const pxCIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[] )
+{
+    int lRslt = 0;
+    LoggingStats_t xStats;
+    ConsoleStats_t xConsoleStats;
+
+    if( ( ulArgc == 2 ) && ( strcmp( "reset", ppcArgv[ 1 ] ) == 0 ) )
+    {
+        vLoggingResetStats();
+        vConsoleResetStats();
+        pxCIO->print( "Log statistics reset.\r\n" );
+    }
+    else if( ulArgc == 1 )
+    {
+        vLoggingGetStats( &xStats );
+
+        lRslt = snprintf( pcCliScratchBuffer,
+                          CLI_OUTPUT_SCRATCH_BUF_LEN,
+                          "Mode:             %s\r\n"
+                          "Calls:            %lu\r\n"
+                          "Average cycles:   %lu\r\n"
+                          "Max cycles:       %lu\r\n"
+                          "Dropped messages: %lu\r\n",
+                          ( LOGGING_DEFERRED == 1 ) ? "deferred" : "immediate",
+                          ( unsigned long ) xStats.ulCalls,
+                          ( unsigned long ) ( ( xStats.ulCalls > 0 ) ? ( xStats.ulCyclesTotal / xStats.ulCalls ) : 0 ),
+                          ( unsigned long ) xStats.ulCyclesMax,
+                          ( unsigned long ) xStats.ulDropped );
+
+        if( ( lRslt > 0 ) &&
+            ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+        {
+            pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+        }
+
+        vConsoleGetStats( &xConsoleStats );
+
+        lRslt = snprintf( pcCliScratchBuffer,
+                          CLI_OUTPUT_SCRATCH_BUF_LEN,
+                          "Console mode:     %s\r\n"
+                          "Console bytes:    %lu\r\n"
+                          "Console bursts:   %lu\r\n"
+                          "TX ring stalls:   %lu\r\n"
+                          "Writer stalls:    %lu\r\n",
+                          ( CLI_UART_TX_DMA == 1 ) ? "dma" : "interrupt",
+                          ( unsigned long ) xConsoleStats.ulTxBytes,
+                          ( unsigned long ) xConsoleStats.ulTxBursts,
+                          ( unsigned long ) xConsoleStats.ulTxStalls,
+                          ( unsigned long ) xConsoleStats.ulWriteStalls );
+
+        if( ( lRslt > 0 ) &&
+            ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+        {
+            pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+        }
+    }
+    else
+    {
+        pxCIO->print( xCommandDef_logstat.pcHelpString );
+    }
+}
@@ -30,6 +30,9 @@
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
@@ -39,6 +42,7 @@
 
 /* Project Includes */
 #include "logging.h"
+#include "crash_log.h"
 
 /*-----------------------------------------------------------*/
 /* todo take into account maximum cli line length */
@@ -52,6 +56,73 @@ UART_HandleTypeDef * pxEarlyUart = NULL;
 
 static char pcPrintBuff[ dlMAX_LOG_LINE_LENGTH ];
 
+static atomic_uint_least32_t ulLogCalls = 0;
+static atomic_uint_least32_t ulLogCyclesTotal = 0;
+static atomic_uint_least32_t ulLogCyclesMax = 0;
+static atomic_uint_least32_t ulLogDropped = 0;
+
+#if ( LOGGING_DEFERRED == 1 )
+
+    #define LOG_TASK_NAME_LEN    10
+    #define LOG_FLAG_TRUNCATED   0x1
+
+/* A deferred log call. The arguments are stored in the order of the conversion specifiers of pcFormat. */
+    typedef struct
+    {
+        const char * pcLogLevel;
+        const char * pcFileName;
+        const char * pcFormat;
+        uint32_t ulTick;
+        uint16_t usLineNumber;
+        uint8_t ucArgsLen;
+        uint8_t ucFlags;
+        char pcTaskName[ LOG_TASK_NAME_LEN ];
+    } LogRecordHeader_t;
+
+    #define LOG_RECORD_ARGS_LEN    ( dlDEFERRED_LOG_SLOT_SIZE - sizeof( atomic_uint_least32_t ) - sizeof( LogRecordHeader_t ) )
+
+    typedef struct
+    {
+        atomic_uint_least32_t ulSeq;
+        LogRecordHeader_t xHeader;
+        uint8_t pucArgs[ LOG_RECORD_ARGS_LEN ];
+    } LogSlot_t;
+
+    _Static_assert( ( dlDEFERRED_LOG_SLOTS & ( dlDEFERRED_LOG_SLOTS - 1 ) ) == 0, "dlDEFERRED_LOG_SLOTS must be a power of two" );
+
+    static LogSlot_t xLogSlots[ dlDEFERRED_LOG_SLOTS ];
+    static atomic_uint_least32_t ulLogHead = 0;
+    static atomic_uint_least32_t ulLogTail = 0;
+    static atomic_bool xLogRingInitialized = false;
+
+/* Only accessed by the consumer */
+    static uint32_t ulLogDroppedReported = 0;
+
+/* Kinds of argument a conversion specifier consumes */
+    typedef enum
+    {
+        LOG_ARG_NONE,
+        LOG_ARG_INT,
+        LOG_ARG_LONG,
+        LOG_ARG_LONG_LONG,
+        LOG_ARG_SIZE,
+        LOG_ARG_PTRDIFF,
+        LOG_ARG_INTMAX,
+        LOG_ARG_PTR,
+        LOG_ARG_DOUBLE,
+        LOG_ARG_LONG_DOUBLE,
+        LOG_ARG_STRING
+    } LogArgType_t;
+
+    typedef struct
+    {
+        const char * pcStart;     /* The '%' */
+        size_t xLen;              /* Length of the specifier including the conversion character */
+        uint32_t ulNumStars;      /* '*' width and precision, each consumes an int */
+        LogArgType_t xType;
+    } LogConvSpec_t;
+#endif /* LOGGING_DEFERRED == 1 */
+
 /* Should only be called during an assert with the scheduler suspended. */
 void vDyingGasp( void )
 {
@@ -64,7 +135,7 @@ void vDyingGasp( void )
 
     do
     {
-        xNumBytes = xMessageBufferReceiveFromISR( xLogMBuf, pcPrintBuff, dlMAX_PRINT_STRING_LENGTH, 0 );
+        xNumBytes = xLoggingReceive( pcPrintBuff, dlMAX_LOG_LINE_LENGTH );
         ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) pcPrintBuff, xNumBytes, 10 * 1000 );
         ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) "\r\n", 2, 10 * 1000 );
 
@@ -139,6 +210,11 @@ static void vSendLogMessage( const char * buffer,
                 ( void ) xMessageBufferSendFromISR( xLogMBuf, buffer, count, &xHigherPriorityTaskWoken );
             }
         }
+        else
+        {
+            /* The console is not keeping up */
+            ( void ) atomic_fetch_add_explicit( &ulLogDropped, 1, memory_order_relaxed );
+        }
 
         taskEXIT_CRITICAL_FROM_ISR( uxContext );
 
@@ -162,25 +238,686 @@ static void vSendLogMessage( const char * buffer,
                 ( void ) xMessageBufferSend( xLogMBuf, buffer, count, 0 );
             }
         }
+        else
+        {
+            ( void ) atomic_fetch_add_explicit( &ulLogDropped, 1, memory_order_relaxed );
+        }
     }
 }
 
 void vLoggingInit( void )
 {
+    #if ( LOGGING_DEFERRED == 1 )
+        for( uint32_t ulIdx = 0; ulIdx < dlDEFERRED_LOG_SLOTS; ulIdx++ )
+        {
+            atomic_init( &( xLogSlots[ ulIdx ].ulSeq ), ulIdx );
+        }
+
+        atomic_store( &xLogRingInitialized, true );
+    #endif
+
     xLogMBuf = xMessageBufferCreate( dlLOGGING_STREAM_LENGTH );
+
+    /* Enable the DWT cycle counter used to measure the cost of a log call */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 }
 
 /*-----------------------------------------------------------*/
 
-void vLoggingPrintf( const char * const pcLogLevel,
-                     const char * const pcFileName,
-                     const unsigned long ulLineNumber,
-                     const char * const pcFormat,
-                     ... )
+static void prvAtomicMax( atomic_uint_least32_t * pulTarget,
+                          uint32_t ulValue )
+{
+    uint32_t ulCurrent = atomic_load_explicit( pulTarget, memory_order_relaxed );
+
+    while( ( ulValue > ulCurrent ) &&
+           !atomic_compare_exchange_weak_explicit( pulTarget, &ulCurrent, ulValue,
+                                                   memory_order_relaxed, memory_order_relaxed ) )
+    {
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingGetStats( LoggingStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    pxStats->ulCalls = atomic_load( &ulLogCalls );
+    pxStats->ulCyclesTotal = atomic_load( &ulLogCyclesTotal );
+    pxStats->ulCyclesMax = atomic_load( &ulLogCyclesMax );
+    pxStats->ulDropped = atomic_load( &ulLogDropped );
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingResetStats( void )
+{
+    atomic_store( &ulLogCalls, 0 );
+    atomic_store( &ulLogCyclesTotal, 0 );
+    atomic_store( &ulLogCyclesMax, 0 );
+    atomic_store( &ulLogDropped, 0 );
+
+    #if ( LOGGING_DEFERRED == 1 )
+        ulLogDroppedReported = 0;
+    #endif
+}
+
+/*-----------------------------------------------------------*/
+
+/* Remove any \r\n\0 characters at the end of the message and add the file name and line number trailer. */
+static uint32_t ulFinishLogLine( char * pcBuff,
+                                 uint32_t ulLenTotal,
+                                 const char * const pcFileName,
+                                 const unsigned long ulLineNumber )
+{
+    int32_t lLenPart = -1;
+
+    while( ulLenTotal > 0 &&
+           ( pcBuff[ ulLenTotal - 1 ] == '\r' ||
+             pcBuff[ ulLenTotal - 1 ] == '\n' ||
+             pcBuff[ ulLenTotal - 1 ] == '\0' ) )
+    {
+        pcBuff[ ulLenTotal - 1 ] = '\0';
+        ulLenTotal--;
+    }
+
+    if( ( pcFileName != NULL ) &&
+        ( ulLineNumber > 0 ) &&
+        ( ulLenTotal < dlMAX_LOG_LINE_LENGTH ) )
+    {
+        /* Add the trailer including file name and line number */
+        lLenPart = snprintf( &pcBuff[ ulLenTotal ],
+                             ( dlMAX_LOG_LINE_LENGTH - ulLenTotal ),
+                             " (%s:%lu)",
+                             pcFileName,
+                             ulLineNumber );
+
+        configASSERT( lLenPart > 0 );
+
+        if( lLenPart + ulLenTotal < dlMAX_LOG_LINE_LENGTH )
+        {
+            ulLenTotal += lLenPart;
+        }
+        else
+        {
+            ulLenTotal = dlMAX_LOG_LINE_LENGTH;
+        }
+    }
+
+    return ulLenTotal;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( LOGGING_DEFERRED == 1 )
+
+/*
+ * Parse the conversion specifier starting at pcFormat[ 0 ] == '%' and find the
+ * kind of argument it consumes, LOG_ARG_NONE for "%%".
+ */
+    static void prvParseConvSpec( const char * pcFormat,
+                                  LogConvSpec_t * pxSpec )
+    {
+        const char * pcIter = pcFormat + 1;
+        uint32_t ulLongs = 0;
+        char cLength = '\0';
+
+        pxSpec->pcStart = pcFormat;
+        pxSpec->ulNumStars = 0;
+        pxSpec->xType = LOG_ARG_NONE;
+
+        /* Flags */
+        while( ( *pcIter != '\0' ) && ( strchr( "-+ #0", *pcIter ) != NULL ) )
+        {
+            pcIter++;
+        }
+
+        /* Width and precision */
+        while( ( *pcIter == '*' ) || ( *pcIter == '.' ) || isdigit( ( unsigned char ) *pcIter ) )
+        {
+            if( *pcIter == '*' )
+            {
+                pxSpec->ulNumStars++;
+            }
+
+            pcIter++;
+        }
+
+        /* Length modifier */
+        while( ( *pcIter != '\0' ) && ( strchr( "hljztL", *pcIter ) != NULL ) )
+        {
+            if( *pcIter == 'l' )
+            {
+                ulLongs++;
+            }
+
+            cLength = *pcIter;
+            pcIter++;
+        }
+
+        switch( *pcIter )
+        {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+
+                if( ulLongs >= 2 )
+                {
+                    pxSpec->xType = LOG_ARG_LONG_LONG;
+                }
+                else if( ulLongs == 1 )
+                {
+                    pxSpec->xType = LOG_ARG_LONG;
+                }
+                else if( cLength == 'z' )
+                {
+                    pxSpec->xType = LOG_ARG_SIZE;
+                }
+                else if( cLength == 't' )
+                {
+                    pxSpec->xType = LOG_ARG_PTRDIFF;
+                }
+                else if( cLength == 'j' )
+                {
+                    pxSpec->xType = LOG_ARG_INTMAX;
+                }
+                else
+                {
+                    pxSpec->xType = LOG_ARG_INT;
+                }
+
+                break;
+
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                pxSpec->xType = ( cLength == 'L' ) ? LOG_ARG_LONG_DOUBLE : LOG_ARG_DOUBLE;
+                break;
+
+            case 'p':
+                pxSpec->xType = LOG_ARG_PTR;
+                break;
+
+            case 's':
+                pxSpec->xType = LOG_ARG_STRING;
+                break;
+
+            case 'n':
+                /* Writing through a pointer after the fact makes no sense, the pointer is skipped */
+                pxSpec->xType = LOG_ARG_PTR;
+                break;
+
+            default:
+                /* "%%" or an unknown conversion */
+                break;
+        }
+
+        if( *pcIter != '\0' )
+        {
+            pcIter++;
+        }
+
+        pxSpec->xLen = ( size_t ) ( pcIter - pcFormat );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static size_t prvArgSize( LogArgType_t xType )
+    {
+        static const uint8_t ucSizes[] =
+        {
+            [ LOG_ARG_NONE ] = 0,
+            [ LOG_ARG_INT ] = sizeof( int ),
+            [ LOG_ARG_LONG ] = sizeof( long ),
+            [ LOG_ARG_LONG_LONG ] = sizeof( long long ),
+            [ LOG_ARG_SIZE ] = sizeof( size_t ),
+            [ LOG_ARG_PTRDIFF ] = sizeof( ptrdiff_t ),
+            [ LOG_ARG_INTMAX ] = sizeof( intmax_t ),
+            [ LOG_ARG_PTR ] = sizeof( void * ),
+            [ LOG_ARG_DOUBLE ] = sizeof( double ),
+            [ LOG_ARG_LONG_DOUBLE ] = sizeof( long double ),
+            [ LOG_ARG_STRING ] = 0
+        };
+
+        return ucSizes[ xType ];
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Copy the arguments of a log call into pucArgs. Returns pdFALSE if they did not all fit. */
+    static BaseType_t prvCaptureArgs( const char * pcFormat,
+                                      va_list args,
+                                      uint8_t * pucArgs,
+                                      uint8_t * pucArgsLen )
+    {
+        BaseType_t xComplete = pdTRUE;
+        size_t xOffset = 0;
+
+        while( ( xComplete == pdTRUE ) && ( ( pcFormat = strchr( pcFormat, '%' ) ) != NULL ) )
+        {
+            LogConvSpec_t xSpec;
+
+            prvParseConvSpec( pcFormat, &xSpec );
+            pcFormat += xSpec.xLen;
+
+            for( uint32_t ulStar = 0; ( ulStar < xSpec.ulNumStars ) && ( xComplete == pdTRUE ); ulStar++ )
+            {
+                int lValue = va_arg( args, int );
+
+                if( ( xOffset + sizeof( int ) ) <= LOG_RECORD_ARGS_LEN )
+                {
+                    ( void ) memcpy( &pucArgs[ xOffset ], &lValue, sizeof( int ) );
+                    xOffset += sizeof( int );
+                }
+                else
+                {
+                    xComplete = pdFALSE;
+                }
+            }
+
+            if( xComplete == pdFALSE )
+            {
+                break;
+            }
+
+            switch( xSpec.xType )
+            {
+                case LOG_ARG_STRING:
+                   {
+                       const char * pcStr = va_arg( args, const char * );
+                       size_t xLen = 0;
+
+                       if( pcStr == NULL )
+                       {
+                           pcStr = "(null)";
+                       }
+
+                       xLen = strnlen( pcStr, LOG_RECORD_ARGS_LEN );
+
+                       if( ( xOffset + xLen + 1 ) > LOG_RECORD_ARGS_LEN )
+                       {
+                           xLen = LOG_RECORD_ARGS_LEN - xOffset - 1;
+                           xComplete = pdFALSE;
+                       }
+
+                       if( xOffset < LOG_RECORD_ARGS_LEN )
+                       {
+                           ( void ) memcpy( &pucArgs[ xOffset ], pcStr, xLen );
+                           pucArgs[ xOffset + xLen ] = '\0';
+                           xOffset += xLen + 1;
+                       }
+                   }
+                   break;
+
+                case LOG_ARG_NONE:
+                    break;
+
+                default:
+                   {
+                       union
+                       {
+                           int lInt;
+                           long lLong;
+                           long long llLongLong;
+                           size_t xSize;
+                           ptrdiff_t xPtrDiff;
+                           intmax_t xIntMax;
+                           void * pvPtr;
+                           double dDouble;
+                           long double ldLongDouble;
+                       } xValue;
+                       size_t xSize = prvArgSize( xSpec.xType );
+
+                       switch( xSpec.xType )
+                       {
+                           case LOG_ARG_INT: xValue.lInt = va_arg( args, int ); break;
+                           case LOG_ARG_LONG: xValue.lLong = va_arg( args, long ); break;
+                           case LOG_ARG_LONG_LONG: xValue.llLongLong = va_arg( args, long long ); break;
+                           case LOG_ARG_SIZE: xValue.xSize = va_arg( args, size_t ); break;
+                           case LOG_ARG_PTRDIFF: xValue.xPtrDiff = va_arg( args, ptrdiff_t ); break;
+                           case LOG_ARG_INTMAX: xValue.xIntMax = va_arg( args, intmax_t ); break;
+                           case LOG_ARG_DOUBLE: xValue.dDouble = va_arg( args, double ); break;
+                           case LOG_ARG_LONG_DOUBLE: xValue.ldLongDouble = va_arg( args, long double ); break;
+                           default: xValue.pvPtr = va_arg( args, void * ); break;
+                       }
+
+                       if( ( xOffset + xSize ) <= LOG_RECORD_ARGS_LEN )
+                       {
+                           ( void ) memcpy( &pucArgs[ xOffset ], &xValue, xSize );
+                           xOffset += xSize;
+                       }
+                       else
+                       {
+                           xComplete = pdFALSE;
+                       }
+                   }
+                   break;
+            }
+        }
+
+        *pucArgsLen = ( uint8_t ) xOffset;
+
+        return xComplete;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvLogDeferred( const char * const pcLogLevel,
+                                const char * const pcFileName,
+                                const unsigned long ulLineNumber,
+                                const char * const pcFormat,
+                                va_list args )
+    {
+        uint32_t ulPos = atomic_load_explicit( &ulLogHead, memory_order_relaxed );
+        LogSlot_t * pxSlot = NULL;
+        const char * pcTaskName = pcTaskGetName( NULL );
+
+        /* Claim a slot, see the lwIP sys_arch mailbox ring for the algorithm */
+        for( ; ; )
+        {
+            int32_t lDiff;
+
+            pxSlot = &( xLogSlots[ ulPos & ( dlDEFERRED_LOG_SLOTS - 1 ) ] );
+            lDiff = ( int32_t ) ( atomic_load_explicit( &( pxSlot->ulSeq ), memory_order_acquire ) - ulPos );
+
+            if( lDiff == 0 )
+            {
+                if( atomic_compare_exchange_weak_explicit( &ulLogHead, &ulPos, ulPos + 1,
+                                                           memory_order_relaxed, memory_order_relaxed ) )
+                {
+                    break;
+                }
+            }
+            else if( lDiff < 0 )
+            {
+                /* Full, drop the record rather than wait for the uart */
+                ( void ) atomic_fetch_add_explicit( &ulLogDropped, 1, memory_order_relaxed );
+                return;
+            }
+            else
+            {
+                ulPos = atomic_load_explicit( &ulLogHead, memory_order_relaxed );
+            }
+        }
+
+        pxSlot->xHeader.pcLogLevel = pcLogLevel;
+        pxSlot->xHeader.pcFileName = pcFileName;
+        pxSlot->xHeader.pcFormat = pcFormat;
+        pxSlot->xHeader.usLineNumber = ( uint16_t ) ulLineNumber;
+        pxSlot->xHeader.ulTick = ( xPortIsInsideInterrupt() == pdTRUE ) ? xTaskGetTickCountFromISR() : xTaskGetTickCount();
+        pxSlot->xHeader.ucFlags = 0;
+        ( void ) strncpy( pxSlot->xHeader.pcTaskName, ( pcTaskName != NULL ) ? pcTaskName : "", LOG_TASK_NAME_LEN );
+
+        if( prvCaptureArgs( pcFormat, args, pxSlot->pucArgs, &( pxSlot->xHeader.ucArgsLen ) ) == pdFALSE )
+        {
+            pxSlot->xHeader.ucFlags |= LOG_FLAG_TRUNCATED;
+        }
+
+        atomic_store_explicit( &( pxSlot->ulSeq ), ulPos + 1, memory_order_release );
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Format a single captured argument with the conversion specifier it was captured for. */
+    static int32_t prvFormatArg( char * pcBuff,
+                                 size_t xBuffLen,
+                                 const LogConvSpec_t * pxSpec,
+                                 const uint8_t * pucArgs,
+                                 size_t * pxOffset,
+                                 size_t xArgsLen )
+    {
+        char pcSpec[ 24 ];
+        int lStars[ 2 ] = { 0 };
+        int32_t lLen = -1;
+        size_t xSize = prvArgSize( pxSpec->xType );
+
+        if( pxSpec->xLen >= sizeof( pcSpec ) )
+        {
+            return -1;
+        }
+
+        ( void ) memcpy( pcSpec, pxSpec->pcStart, pxSpec->xLen );
+        pcSpec[ pxSpec->xLen ] = '\0';
+
+        for( uint32_t ulStar = 0; ulStar < pxSpec->ulNumStars; ulStar++ )
+        {
+            if( ( ulStar >= 2 ) || ( ( *pxOffset + sizeof( int ) ) > xArgsLen ) )
+            {
+                return -1;
+            }
+
+            ( void ) memcpy( &lStars[ ulStar ], &pucArgs[ *pxOffset ], sizeof( int ) );
+            *pxOffset += sizeof( int );
+        }
+
+        if( pxSpec->xType == LOG_ARG_STRING )
+        {
+            xSize = strnlen( ( const char * ) &pucArgs[ *pxOffset ], xArgsLen - *pxOffset ) + 1;
+        }
+
+        if( ( *pxOffset + xSize ) > xArgsLen )
+        {
+            return -1;
+        }
+
+        #define prvSNPRINTF_ARG( xArg )                                                                \
+    ( ( pxSpec->ulNumStars == 0 ) ? snprintf( pcBuff, xBuffLen, pcSpec, xArg ) :                       \
+      ( pxSpec->ulNumStars == 1 ) ? snprintf( pcBuff, xBuffLen, pcSpec, lStars[ 0 ], xArg ) :          \
+      snprintf( pcBuff, xBuffLen, pcSpec, lStars[ 0 ], lStars[ 1 ], xArg ) )
+
+        {
+            union
+            {
+                int lInt;
+                long lLong;
+                long long llLongLong;
+                size_t xSize;
+                ptrdiff_t xPtrDiff;
+                intmax_t xIntMax;
+                void * pvPtr;
+                double dDouble;
+                long double ldLongDouble;
+            } xValue;
+
+            if( pxSpec->xType != LOG_ARG_STRING )
+            {
+                ( void ) memcpy( &xValue, &pucArgs[ *pxOffset ], xSize );
+            }
+
+            switch( pxSpec->xType )
+            {
+                case LOG_ARG_NONE: lLen = snprintf( pcBuff, xBuffLen, "%s", ( pcSpec[ 1 ] == '%' ) ? "%" : "" ); break;
+                case LOG_ARG_INT: lLen = prvSNPRINTF_ARG( xValue.lInt ); break;
+                case LOG_ARG_LONG: lLen = prvSNPRINTF_ARG( xValue.lLong ); break;
+                case LOG_ARG_LONG_LONG: lLen = prvSNPRINTF_ARG( xValue.llLongLong ); break;
+                case LOG_ARG_SIZE: lLen = prvSNPRINTF_ARG( xValue.xSize ); break;
+                case LOG_ARG_PTRDIFF: lLen = prvSNPRINTF_ARG( xValue.xPtrDiff ); break;
+                case LOG_ARG_INTMAX: lLen = prvSNPRINTF_ARG( xValue.xIntMax ); break;
+                case LOG_ARG_DOUBLE: lLen = prvSNPRINTF_ARG( xValue.dDouble ); break;
+                case LOG_ARG_LONG_DOUBLE: lLen = prvSNPRINTF_ARG( xValue.ldLongDouble ); break;
+                case LOG_ARG_STRING: lLen = prvSNPRINTF_ARG( ( const char * ) &pucArgs[ *pxOffset ] ); break;
+
+                default:
+
+                    if( pcSpec[ pxSpec->xLen - 1 ] == 'n' )
+                    {
+                        lLen = 0;
+                    }
+                    else
+                    {
+                        lLen = prvSNPRINTF_ARG( xValue.pvPtr );
+                    }
+
+                    break;
+            }
+        }
+
+        #undef prvSNPRINTF_ARG
+
+        *pxOffset += xSize;
+
+        return lLen;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Format the oldest deferred record into pcBuff. Returns the line length or 0 if the ring is empty. */
+    static size_t prvFormatDeferred( char * pcBuff,
+                                     size_t xBuffLen )
+    {
+        uint32_t ulPos = atomic_load_explicit( &ulLogTail, memory_order_relaxed );
+        LogSlot_t * pxSlot = &( xLogSlots[ ulPos & ( dlDEFERRED_LOG_SLOTS - 1 ) ] );
+        uint32_t ulLenTotal = 0;
+        uint32_t ulDropped = 0;
+        int32_t lLenPart = -1;
+
+        configASSERT( xBuffLen >= dlMAX_LOG_LINE_LENGTH );
+
+        if( atomic_load_explicit( &xLogRingInitialized, memory_order_relaxed ) == false )
+        {
+            return 0;
+        }
+
+        /* Report dropped records in place of the next line */
+        ulDropped = atomic_load_explicit( &ulLogDropped, memory_order_relaxed ) - ulLogDroppedReported;
+
+        if( ulDropped > 0 )
+        {
+            ulLogDroppedReported += ulDropped;
+            lLenPart = snprintf( pcBuff, xBuffLen, "<WRN> %8lu [%-10.10s] %lu log messages dropped",
+                                 ( ( unsigned long ) xTaskGetTickCount() / portTICK_PERIOD_MS ) & 0xFFFFFF,
+                                 "logging", ( unsigned long ) ulDropped );
+            return ( lLenPart > 0 ) ? ( size_t ) lLenPart : 0;
+        }
+
+        /* Single consumer: the uart TX thread, or vDyingGasp with the scheduler suspended */
+        if( ( int32_t ) ( atomic_load_explicit( &( pxSlot->ulSeq ), memory_order_acquire ) - ( ulPos + 1 ) ) != 0 )
+        {
+            return 0;
+        }
+
+        lLenPart = snprintf( pcBuff,
+                             dlMAX_PRINT_STRING_LENGTH,
+                             "<%-3.3s> %8lu [%-10.10s] ",
+                             pxSlot->xHeader.pcLogLevel,
+                             ( ( unsigned long ) pxSlot->xHeader.ulTick / portTICK_PERIOD_MS ) & 0xFFFFFF,
+                             pxSlot->xHeader.pcTaskName );
+
+        configASSERT( lLenPart > 0 );
+        ulLenTotal = ( lLenPart < dlMAX_PRINT_STRING_LENGTH ) ? lLenPart : dlMAX_PRINT_STRING_LENGTH;
+
+        {
+            const char * pcFormat = pxSlot->xHeader.pcFormat;
+            size_t xOffset = 0;
+
+            while( ( *pcFormat != '\0' ) && ( ulLenTotal < dlMAX_PRINT_STRING_LENGTH ) )
+            {
+                const char * pcNext = strchr( pcFormat, '%' );
+                size_t xLiteralLen = ( pcNext != NULL ) ? ( size_t ) ( pcNext - pcFormat ) : strlen( pcFormat );
+
+                /* Copy the text up to the next conversion */
+                if( xLiteralLen > ( dlMAX_PRINT_STRING_LENGTH - ulLenTotal ) )
+                {
+                    xLiteralLen = dlMAX_PRINT_STRING_LENGTH - ulLenTotal;
+                }
+
+                ( void ) memcpy( &pcBuff[ ulLenTotal ], pcFormat, xLiteralLen );
+                ulLenTotal += xLiteralLen;
+                pcFormat += xLiteralLen;
+
+                if( ( pcNext != NULL ) && ( ulLenTotal < dlMAX_PRINT_STRING_LENGTH ) )
+                {
+                    LogConvSpec_t xSpec;
+
+                    prvParseConvSpec( pcFormat, &xSpec );
+                    pcFormat += xSpec.xLen;
+
+                    lLenPart = prvFormatArg( &pcBuff[ ulLenTotal ], dlMAX_PRINT_STRING_LENGTH - ulLenTotal,
+                                             &xSpec, pxSlot->pucArgs, &xOffset, pxSlot->xHeader.ucArgsLen );
+
+                    if( lLenPart < 0 )
+                    {
+                        /* Arguments were truncated when captured */
+                        lLenPart = snprintf( &pcBuff[ ulLenTotal ], dlMAX_PRINT_STRING_LENGTH - ulLenTotal, "..." );
+                        ulLenTotal += ( lLenPart > 0 ) ? lLenPart : 0;
+                        break;
+                    }
+
+                    ulLenTotal += lLenPart;
+                }
+            }
+
+            if( ulLenTotal > dlMAX_PRINT_STRING_LENGTH )
+            {
+                ulLenTotal = dlMAX_PRINT_STRING_LENGTH;
+            }
+
+            pcBuff[ ulLenTotal ] = '\0';
+        }
+
+        ulLenTotal = ulFinishLogLine( pcBuff, ulLenTotal, pxSlot->xHeader.pcFileName, pxSlot->xHeader.usLineNumber );
+
+        CrashLog_Append( CRASH_LOG_TYPE_LOG, pcBuff, ulLenTotal );
+
+        /* Hand the slot back to producers */
+        atomic_store_explicit( &ulLogTail, ulPos + 1, memory_order_relaxed );
+        atomic_store_explicit( &( pxSlot->ulSeq ), ulPos + dlDEFERRED_LOG_SLOTS, memory_order_release );
+
+        return ulLenTotal;
+    }
+#endif /* LOGGING_DEFERRED == 1 */
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Get the next log line to output. Called by the uart TX thread and by
+ * vDyingGasp, pcBuffer must hold at least dlMAX_LOG_LINE_LENGTH bytes.
+ */
+size_t xLoggingReceive( char * pcBuffer,
+                        size_t xBufferLen )
+{
+    size_t xBytes = 0;
+
+    #if ( LOGGING_DEFERRED == 1 )
+        xBytes = prvFormatDeferred( pcBuffer, xBufferLen );
+    #endif
+
+    /* Lines logged before the scheduler started, or all lines when not deferred */
+    if( ( xBytes == 0 ) && ( xLogMBuf != NULL ) )
+    {
+        if( xPortIsInsideInterrupt() == pdTRUE )
+        {
+            xBytes = xMessageBufferReceiveFromISR( xLogMBuf, pcBuffer, xBufferLen, NULL );
+        }
+        else
+        {
+            xBytes = xMessageBufferReceive( xLogMBuf, pcBuffer, xBufferLen, 0 );
+        }
+    }
+
+    return xBytes;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLogImmediate( const char * const pcLogLevel,
+                             const char * const pcFileName,
+                             const unsigned long ulLineNumber,
+                             const char * const pcFormat,
+                             va_list args )
 {
     uint32_t ulLenTotal = 0;
     int32_t lLenPart = -1;
-    va_list args;
     const char * pcTaskName = NULL;
     BaseType_t xSchedulerWasSuspended = pdFALSE;
 
@@ -223,12 +960,10 @@ void vLoggingPrintf( const char * const pcLogLevel,
     if( ulLenTotal < dlMAX_PRINT_STRING_LENGTH )
     {
         /* There are a variable number of parameters. */
-        va_start( args, pcFormat );
         lLenPart = vsnprintf( &pcPrintBuff[ ulLenTotal ],
                               ( dlMAX_PRINT_STRING_LENGTH - ulLenTotal ),
                               pcFormat,
                               args );
-        va_end( args );
 
         configASSERT( lLenPart > 0 );
 
@@ -242,45 +977,56 @@ void vLoggingPrintf( const char * const pcLogLevel,
         }
     }
 
-    /* remove any \r\n\0 characters at the end of the message */
-    while( ulLenTotal > 0 &&
-           ( pcPrintBuff[ ulLenTotal - 1 ] == '\r' ||
-             pcPrintBuff[ ulLenTotal - 1 ] == '\n' ||
-             pcPrintBuff[ ulLenTotal - 1 ] == '\0' ) )
+    ulLenTotal = ulFinishLogLine( pcPrintBuff, ulLenTotal, pcFileName, ulLineNumber );
+
+    CrashLog_Append( CRASH_LOG_TYPE_LOG, pcPrintBuff, ulLenTotal );
+
+    vSendLogMessage( ( void * ) pcPrintBuff, ulLenTotal );
+
+    if( xSchedulerWasSuspended == pdTRUE )
     {
-        pcPrintBuff[ ulLenTotal - 1 ] = '\0';
-        ulLenTotal--;
+        xTaskResumeAll();
     }
+}
 
-    if( ( pcFileName != NULL ) &&
-        ( ulLineNumber > 0 ) &&
-        ( ulLenTotal < dlMAX_LOG_LINE_LENGTH ) )
+/*-----------------------------------------------------------*/
+
+void vLoggingPrintf( const char * const pcLogLevel,
+                     const char * const pcFileName,
+                     const unsigned long ulLineNumber,
+                     const char * const pcFormat,
+                     ... )
+{
+    va_list args;
+    uint32_t ulCycles = DWT->CYCCNT;
+
+    /* Recorded right away, a deferred line may not be formatted before the reset */
+    if( strcmp( pcLogLevel, "ASRT" ) == 0 )
     {
-        /* Add the trailer including file name and line number */
-        lLenPart = snprintf( &pcPrintBuff[ ulLenTotal ],
-                             ( dlMAX_LOG_LINE_LENGTH - ulLenTotal ),
-                             " (%s:%lu)",
-                             pcFileName,
-                             ulLineNumber );
+        CrashLog_RecordAssert( pcFileName, ulLineNumber );
+    }
 
-        configASSERT( lLenPart > 0 );
+    /* There are a variable number of parameters. */
+    va_start( args, pcFormat );
 
-        if( lLenPart + ulLenTotal < dlMAX_LOG_LINE_LENGTH )
+    #if ( LOGGING_DEFERRED == 1 )
+        if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
         {
-            ulLenTotal += lLenPart;
+            prvLogDeferred( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
         }
         else
-        {
-            ulLenTotal = dlMAX_LOG_LINE_LENGTH;
-        }
+    #endif
+    {
+        prvLogImmediate( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
     }
 
-    vSendLogMessage( ( void * ) pcPrintBuff, ulLenTotal );
+    va_end( args );
 
-    if( xSchedulerWasSuspended == pdTRUE )
-    {
-        xTaskResumeAll();
-    }
+    ulCycles = DWT->CYCCNT - ulCycles;
+
+    ( void ) atomic_fetch_add_explicit( &ulLogCalls, 1, memory_order_relaxed );
+    ( void ) atomic_fetch_add_explicit( &ulLogCyclesTotal, ulCycles, memory_order_relaxed );
+    prvAtomicMax( &ulLogCyclesMax, ulCycles );
 }
 
 /*-----------------------------------------------------------*/
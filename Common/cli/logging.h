@@ -29,9 +29,12 @@
 
 /* Standard Include. */
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* Include header for logging level macros. */
 #include "logging_levels.h"
+#include "logging_modules.h"
 #include "cli.h"
 /* Dimensions the arrays into which print messages are created. */
 
@@ -46,6 +49,29 @@
 
 #define LOGGING_TIMEOUT_MS    100
 
+/*
+ * With LOGGING_DEFERRED set to 1, a log call made while the scheduler is running
+ * only records the format string pointer, tick count, task name and raw
+ * arguments into a lock-free ring. The line is formatted later by the uart TX
+ * thread. %s arguments are copied when the call is made and are truncated
+ * to the room left in the record.
+ */
+#ifndef LOGGING_DEFERRED
+    #define LOGGING_DEFERRED    0
+#endif
+
+#define dlDEFERRED_LOG_SLOTS        32  /* Must be a power of two */
+#define dlDEFERRED_LOG_SLOT_SIZE    128 /* Bytes per record including the header */
+
+/* Cost of vLoggingPrintf measured with the DWT cycle counter */
+typedef struct
+{
+    uint32_t ulCalls;
+    uint32_t ulCyclesTotal; /* Wraps, reset with vLoggingResetStats before measuring */
+    uint32_t ulCyclesMax;
+    uint32_t ulDropped;     /* Records lost because the deferred ring was full */
+} LoggingStats_t;
+
 #ifndef LOG_LEVEL
     #define LOG_LEVEL         LOG_INFO
 #endif
@@ -68,6 +94,19 @@ void vLoggingInit( void );
 void vLoggingDeInit( void );
 void vDyingGasp( void );
 void vInitLoggingEarly( void );
+size_t xLoggingReceive( char * pcBuffer,
+                        size_t xBufferLen );
+void vLoggingGetStats( LoggingStats_t * pxStats );
+void vLoggingResetStats( void );
+
+/* Runtime module levels, see logging_modules.h */
+LogModule_t xLoggingFindModule( const char * pcName );
+const char * pcLoggingModuleName( LogModule_t xModule );
+uint8_t ucLoggingDefaultLevel( LogModule_t xModule );
+void vLoggingSetModuleLevel( LogModule_t xModule,
+                             uint8_t ucLevel );
+void vLoggingLoadModuleLevels( void );
+int32_t lLoggingSaveModuleLevels( void );
 
 /* task.h cannot be included here because this file is included by FreeRTOSConfig.h */
 extern void vTaskSuspendAll( void );
@@ -88,6 +127,13 @@ extern void vTaskSuspendAll( void );
 
 #define LogKernel( ... )        SdkLog( "KRN", __VA_ARGS__ )
 
+/* Runtime filter for files that define LOG_MODULE, a no-op for all others */
+#if defined( LOG_MODULE )
+    #define LOG_ENABLED( level )    ( ucLogModuleLevels[ LOG_MODULE_ID( LOG_MODULE ) ] >= ( level ) )
+#else
+    #define LOG_ENABLED( level )    ( 1 )
+#endif
+
 #if !defined( LOG_LEVEL ) ||       \
     ( ( LOG_LEVEL != LOG_NONE ) && \
     ( LOG_LEVEL != LOG_ERROR ) &&  \
@@ -99,25 +145,25 @@ extern void vTaskSuspendAll( void );
 #else
 
     #if ( LOG_LEVEL >= LOG_ERROR )
-        #define LogError( ... )    SdkLog( "ERR", REMOVE_PARENS( __VA_ARGS__ ) )
+        #define LogError( ... )    do { if( LOG_ENABLED( LOG_ERROR ) ) { SdkLog( "ERR", REMOVE_PARENS( __VA_ARGS__ ) ); } } while( 0 )
     #else
         #define LogError( ... )
     #endif
 
     #if ( LOG_LEVEL >= LOG_WARN )
-        #define LogWarn( ... )    SdkLog( "WRN", REMOVE_PARENS( __VA_ARGS__ ) )
+        #define LogWarn( ... )    do { if( LOG_ENABLED( LOG_WARN ) ) { SdkLog( "WRN", REMOVE_PARENS( __VA_ARGS__ ) ); } } while( 0 )
     #else
         #define LogWarn( ... )
     #endif
 
     #if ( LOG_LEVEL >= LOG_INFO )
-        #define LogInfo( ... )    SdkLog( "INF", REMOVE_PARENS( __VA_ARGS__ ) )
+        #define LogInfo( ... )    do { if( LOG_ENABLED( LOG_INFO ) ) { SdkLog( "INF", REMOVE_PARENS( __VA_ARGS__ ) ); } } while( 0 )
     #else
         #define LogInfo( ... )
     #endif
 
     #if ( LOG_LEVEL >= LOG_DEBUG )
-        #define LogDebug( ... )    SdkLog( "DBG", REMOVE_PARENS( __VA_ARGS__ ) )
+        #define LogDebug( ... )    do { if( LOG_ENABLED( LOG_DEBUG ) ) { SdkLog( "DBG", REMOVE_PARENS( __VA_ARGS__ ) ); } } while( 0 )
     #else
         #define LogDebug( ... )
     #endif
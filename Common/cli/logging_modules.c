@@ -0,0 +1,187 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/* Standard includes. */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+
+#include "logging.h"
+#include "kvstore.h"
+
+#define LOG_MODULE_LEVEL( name, level )    level,
+#define LOG_MODULE_NAME( name, level )     #name,
+
+volatile uint8_t ucLogModuleLevels[ LOG_MODULE_COUNT ] = { LOG_MODULE_LIST( LOG_MODULE_LEVEL ) };
+
+static const uint8_t ucLogModuleDefaults[ LOG_MODULE_COUNT ] = { LOG_MODULE_LIST( LOG_MODULE_LEVEL ) };
+
+static const char * const pcLogModuleNames[ LOG_MODULE_COUNT ] = { LOG_MODULE_LIST( LOG_MODULE_NAME ) };
+
+/*-----------------------------------------------------------*/
+
+LogModule_t xLoggingFindModule( const char * pcName )
+{
+    LogModule_t xModule = LOG_MODULE_COUNT;
+
+    configASSERT( pcName != NULL );
+
+    for( uint32_t i = 0; i < LOG_MODULE_COUNT; i++ )
+    {
+        if( strcmp( pcName, pcLogModuleNames[ i ] ) == 0 )
+        {
+            xModule = ( LogModule_t ) i;
+            break;
+        }
+    }
+
+    return xModule;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcLoggingModuleName( LogModule_t xModule )
+{
+    configASSERT( xModule < LOG_MODULE_COUNT );
+
+    return pcLogModuleNames[ xModule ];
+}
+
+/*-----------------------------------------------------------*/
+
+uint8_t ucLoggingDefaultLevel( LogModule_t xModule )
+{
+    configASSERT( xModule < LOG_MODULE_COUNT );
+
+    return ucLogModuleDefaults[ xModule ];
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingSetModuleLevel( LogModule_t xModule,
+                             uint8_t ucLevel )
+{
+    configASSERT( xModule < LOG_MODULE_COUNT );
+
+    if( ucLevel > LOG_DEBUG )
+    {
+        ucLevel = LOG_DEBUG;
+    }
+
+    /* A byte store, so readers never see a torn value */
+    ucLogModuleLevels[ xModule ] = ucLevel;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * The log_levels entry holds space separated <module>=<level> pairs for the
+ * modules that differ from their default, e.g. "mx_netconn=4 shadow=1".
+ */
+void vLoggingLoadModuleLevels( void )
+{
+    char pcBuffer[ KVSTORE_VAL_MAX_LEN ];
+    char * pcSavePtr = NULL;
+    char * pcToken = NULL;
+
+    ( void ) KVStore_getString( CS_LOG_LEVELS, pcBuffer, sizeof( pcBuffer ) );
+
+    pcToken = strtok_r( pcBuffer, " ", &pcSavePtr );
+
+    while( pcToken != NULL )
+    {
+        char * pcValue = strchr( pcToken, '=' );
+        LogModule_t xModule = LOG_MODULE_COUNT;
+
+        if( pcValue != NULL )
+        {
+            *pcValue = '\0';
+            pcValue++;
+            xModule = xLoggingFindModule( pcToken );
+        }
+
+        if( ( xModule < LOG_MODULE_COUNT ) &&
+            ( *pcValue >= '0' ) &&
+            ( *pcValue <= ( '0' + LOG_DEBUG ) ) )
+        {
+            vLoggingSetModuleLevel( xModule, ( uint8_t ) ( *pcValue - '0' ) );
+        }
+        else
+        {
+            LogWarn( "Ignoring log level entry: %s", pcToken );
+        }
+
+        pcToken = strtok_r( NULL, " ", &pcSavePtr );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t lLoggingSaveModuleLevels( void )
+{
+    char pcBuffer[ KVSTORE_VAL_MAX_LEN ];
+    size_t xLen = 0;
+    int32_t lResult = 0;
+
+    pcBuffer[ 0 ] = '\0';
+
+    for( uint32_t i = 0; ( i < LOG_MODULE_COUNT ) && ( lResult == 0 ); i++ )
+    {
+        if( ucLogModuleLevels[ i ] != ucLogModuleDefaults[ i ] )
+        {
+            int lRslt = snprintf( &pcBuffer[ xLen ], sizeof( pcBuffer ) - xLen,
+                                  "%s%s=%u",
+                                  ( xLen > 0 ) ? " " : "",
+                                  pcLogModuleNames[ i ],
+                                  ( unsigned int ) ucLogModuleLevels[ i ] );
+
+            if( ( lRslt > 0 ) && ( ( size_t ) lRslt < ( sizeof( pcBuffer ) - xLen ) ) )
+            {
+                xLen += ( size_t ) lRslt;
+            }
+            else
+            {
+                LogError( "Too many modules differ from their default level to be saved." );
+                lResult = -1;
+            }
+        }
+    }
+
+    if( lResult == 0 )
+    {
+        if( ( KVStore_setString( CS_LOG_LEVELS, pcBuffer ) != pdTRUE ) ||
+            ( KVStore_xCommitKey( CS_LOG_LEVELS ) != pdTRUE ) )
+        {
+            lResult = -1;
+        }
+    }
+
+    return lResult;
+}
@@ -0,0 +1,76 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file logging_modules.h
+ * @brief Registry of log modules whose level can be changed at runtime.
+ *
+ * A source file joins a module by defining LOG_MODULE before it first includes
+ * logging.h, next to LOG_LEVEL:
+ *
+ *     #define LOG_LEVEL     LOG_DEBUG
+ *     #define LOG_MODULE    mx_netconn
+ *     #include "logging.h"
+ *
+ * LOG_LEVEL remains the compile time ceiling. Calls above it are removed by the
+ * preprocessor. Calls at or below it are kept and filtered at runtime against the
+ * level of the module, a single byte load and compare made before any of the
+ * arguments are evaluated.
+ */
+#ifndef LOGGING_MODULES_H
+#define LOGGING_MODULES_H
+
+#include <stdint.h>
+
+/*
+ * X( name, default runtime level )
+ * The name is used by the "loglevel" command and in the log_levels KVStore entry.
+ */
+#define LOG_MODULE_LIST( X )       \
+    X( cli, LOG_INFO )             \
+    X( mqtt_agent, LOG_INFO )      \
+    X( shadow, LOG_INFO )          \
+    X( ota, LOG_INFO )             \
+    X( tls, LOG_INFO )             \
+    X( mx_netconn, LOG_INFO )      \
+    X( net_perf, LOG_INFO )
+
+#define LOG_MODULE_ENUM( name, level )    LOG_MODULE_ID_ ## name,
+
+typedef enum
+{
+    LOG_MODULE_LIST( LOG_MODULE_ENUM )
+    LOG_MODULE_COUNT
+} LogModule_t;
+
+#define LOG_MODULE_ID( name )     LOG_MODULE_ID_( name )
+#define LOG_MODULE_ID_( name )    LOG_MODULE_ID_ ## name
+
+/* Current level of each module, indexed by LogModule_t */
+extern volatile uint8_t ucLogModuleLevels[ LOG_MODULE_COUNT ];
+
+#endif /* LOGGING_MODULES_H */
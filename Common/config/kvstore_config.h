@@ -40,6 +40,11 @@ typedef enum KvStoreEnum
     CS_PROVISIONED,
     CS_THING_GROUP_NAME,
 #endif
+    /* New keys go last, the PSA backend stores each key under an ID derived from its position */
+#if !defined(__USE_STSAFE__)
+    CS_TLS_SESSION,
+#endif
+    CS_LOG_LEVELS,
     CS_NUM_KEYS
 } KVStoreKey_t;
 
@@ -105,6 +110,16 @@ typedef enum KvStoreEnum
 #endif
 /* -------------------------------- Values for common attributes -------------------------------- */
 
+/* Resumable TLS session of the MQTT connection, only written when KV_STORE_PERSIST_TLS_SESSION is set.
+ * Not available with the STSAFE KVStore backend, whose fixed size values are too small to hold a serialized session. */
+#if !defined(__USE_STSAFE__)
+#define KV_STORE_TLS_SESSION_STRING    "tls_session",
+#define KV_STORE_TLS_SESSION_DFLT      { KV_TYPE_BLOB, 0, .blob = NULL },      /* CS_TLS_SESSION                 */
+#else
+#define KV_STORE_TLS_SESSION_STRING
+#define KV_STORE_TLS_SESSION_DFLT
+#endif
+
 /* Array to map between strings and KVStoreKey_t IDs */
 #if defined(FLEET_PROVISION_DEMO)  && !defined(__USE_STSAFE__)
 #define KV_STORE_STRINGS   \
@@ -116,7 +131,9 @@ typedef enum KvStoreEnum
         "wifi_credential", \
         "time_hwm",        \
         "provision_state", \
-		    "group_name"       \
+		    "group_name",      \
+        KV_STORE_TLS_SESSION_STRING \
+        "log_levels"       \
     }
 #else
 #define KV_STORE_STRINGS   \
@@ -126,7 +143,9 @@ typedef enum KvStoreEnum
         "mqtt_port",       \
         "wifi_ssid",       \
         "wifi_credential", \
-        "time_hwm"         \
+        "time_hwm",        \
+        KV_STORE_TLS_SESSION_STRING \
+        "log_levels"       \
     }
 #endif
 
@@ -141,6 +160,8 @@ typedef enum KvStoreEnum
         KV_DFLT( KV_TYPE_UINT32, 0 ),                              /* CS_TIME_HWM_S_1970             */ \
 		    KV_DFLT( KV_TYPE_UINT32, 0 ),                              /* CS_PROVISIONED                 */ \
 		    KV_DFLT( KV_TYPE_STRING, THING_GROUP_NAME_DFLT ),          /* CS_THING_GROUP_NAME            */ \
+        KV_STORE_TLS_SESSION_DFLT                                                                    \
+        KV_DFLT( KV_TYPE_STRING, "" ),                             /* CS_LOG_LEVELS                  */ \
     }
 #else
 #define KV_STORE_DEFAULTS                                                          \
@@ -151,6 +172,8 @@ typedef enum KvStoreEnum
         KV_DFLT( KV_TYPE_STRING, WIFI_SSID_DFLT ),                 /* CS_WIFI_SSID                   */ \
         KV_DFLT( KV_TYPE_STRING, WIFI_PASSWORD_DFLT ),             /* CS_WIFI_CREDENTIAL             */ \
         KV_DFLT( KV_TYPE_UINT32, 0 ),                              /* CS_TIME_HWM_S_1970             */ \
+        KV_STORE_TLS_SESSION_DFLT                                                                    \
+        KV_DFLT( KV_TYPE_STRING, "" ),                             /* CS_LOG_LEVELS                  */ \
     }
 #endif
 
@@ -0,0 +1,21 @@
+/* Generated by Tools/macro_to_kvfile.py --key-hash from kvstore_config.h, do not edit. */
+
+#ifndef _KVSTORE_KEY_HASH_H
+#define _KVSTORE_KEY_HASH_H
+
+/* Minimal perfect hash of the key names:
+ *   tls_session          slot 1
+ *   thing_name           slot 9
+ *   mqtt_endpoint        slot 5
+ *   mqtt_port            slot 8
+ *   wifi_ssid            slot 4
+ *   wifi_credential      slot 0
+ *   time_hwm             slot 7
+ *   provision_state      slot 3
+ *   group_name           slot 2
+ *   log_levels           slot 6
+ */
+#define KV_STORE_HASH_SEED     0x811C9F3DUL
+#define KV_STORE_HASH_SLOTS    10
+
+#endif /* _KVSTORE_KEY_HASH_H */
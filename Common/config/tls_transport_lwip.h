@@ -25,6 +25,8 @@
 
 /* Lwip related definitions */
 
+#include "sock_event.h"
+
 #define sock_socket         lwip_socket
 #define sock_connect        lwip_connect
 #define sock_send           lwip_send
@@ -34,6 +36,9 @@
 #define sock_fcntl          lwip_fcntl
 #define sock_select         lwip_select
 
+#define sock_set_recv_callback    lwip_sock_set_recv_callback
+#define sock_recv_pending         lwip_sock_recv_pending
+
 #define dns_getaddrinfo     lwip_getaddrinfo
 #define dns_freeaddrinfo    lwip_freeaddrinfo
 
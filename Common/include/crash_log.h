@@ -0,0 +1,129 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file crash_log.h
+ * @brief Log ring kept in retained SRAM so that the context of an assert or
+ * fault survives the reset that follows it.
+ *
+ * Records are fixed size and carry a CRC, so a record torn by a reset or
+ * a region holding random data after a power cycle is simply skipped.
+ * When the previous boot ended with an assert, a fault or a watchdog reset,
+ * its records are pinned and new records are dropped rather than overwrite
+ * them until CrashLog_Release or CrashLog_Clear is called.
+ */
+#ifndef CRASH_LOG_H
+#define CRASH_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#define CRASH_LOG_RECORD_SIZE    128
+#define CRASH_LOG_DATA_LEN       ( CRASH_LOG_RECORD_SIZE - 16 )
+#define CRASH_LOG_SLOTS          120 /* Region must fit in the 16 KB of SRAM4 */
+#define CRASH_LOG_SEQ_NONE       0xFFFFFFFFUL
+
+typedef enum
+{
+    CRASH_LOG_TYPE_BOOT = 1,
+    CRASH_LOG_TYPE_LOG,
+    CRASH_LOG_TYPE_ASSERT,
+    CRASH_LOG_TYPE_FAULT
+} CrashLogType_t;
+
+typedef struct
+{
+    uint32_t ulSeq;
+    uint32_t ulTick;
+    uint16_t usBoot;    /* Low 16 bits of the boot count */
+    uint8_t ucType;     /* CrashLogType_t */
+    uint8_t ucLen;      /* Bytes used in pcData, not NUL terminated */
+    char pcData[ CRASH_LOG_DATA_LEN ];
+    uint32_t ulCrc;
+} CrashLogRecord_t;
+
+typedef struct
+{
+    uint32_t ulBootCount;
+    uint32_t ulResetFlags;    /* RCC->CSR of this boot */
+    uint32_t ulFirstSeq;      /* Oldest record still in the ring */
+    uint32_t ulNextSeq;       /* Sequence number of the next record */
+    uint32_t ulBootFirstSeq;  /* First record of this boot */
+    uint32_t ulPinnedSeq;     /* First pinned record or CRASH_LOG_SEQ_NONE */
+    uint32_t ulDropped;       /* Records dropped this boot to protect pinned records */
+} CrashLogInfo_t;
+
+/**
+ * @brief Validate the retained region, start a new boot and record the reset cause.
+ * Must be called before the reset flags are cleared.
+ */
+void CrashLog_Init( uint32_t ulResetFlags );
+
+/**
+ * @brief Append a record, truncated to CRASH_LOG_DATA_LEN. Safe to call from an ISR
+ * or a fault handler. Does nothing before CrashLog_Init.
+ */
+void CrashLog_Append( CrashLogType_t xType,
+                      const char * pcData,
+                      size_t uxLen );
+
+/**
+ * @brief Append a CRASH_LOG_TYPE_ASSERT record for the failed assertion.
+ */
+void CrashLog_RecordAssert( const char * pcFileName,
+                            uint32_t ulLineNumber );
+
+/**
+ * @brief Append a CRASH_LOG_TYPE_FAULT record with the stacked registers and fault status.
+ * @param pulStackFrame Exception stack frame: r0, r1, r2, r3, r12, lr, pc, psr.
+ */
+void CrashLog_RecordFault( const uint32_t * pulStackFrame );
+
+/**
+ * @brief Copy the record with the given sequence number.
+ * @return pdTRUE if the record is present and its CRC is valid.
+ */
+BaseType_t CrashLog_ReadRecord( uint32_t ulSeq,
+                                CrashLogRecord_t * pxRecord );
+
+void CrashLog_GetInfo( CrashLogInfo_t * pxInfo );
+
+/**
+ * @brief Unpin the records of a crashed boot once they have been reported.
+ */
+void CrashLog_Release( void );
+
+/**
+ * @brief Erase all records.
+ */
+void CrashLog_Clear( void );
+
+const char * CrashLog_TypeToString( uint8_t ucType );
+
+#endif /* CRASH_LOG_H */
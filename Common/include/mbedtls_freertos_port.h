@@ -21,13 +21,16 @@
 
 /**
  * @file mbedtls_freertos_port.h
- * @brief mbed TLS threading functions implemented for FreeRTOS.
+ * @brief mbed TLS threading and memory functions implemented for FreeRTOS.
  */
 
 
 #ifndef MBEDTLS_FREERTOS_PORT_H_
 #define MBEDTLS_FREERTOS_PORT_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
 #include "semphr.h"
@@ -45,4 +48,36 @@ typedef struct mbedtls_threading_mutex
     int mbedtls_platform_threading_init( void );
 #endif
 
+/**
+ * @brief Memory usage of mbed TLS allocations.
+ *
+ * Arena figures are zero unless MBEDTLS_FREERTOS_ARENA_SIZE is defined in the
+ * mbed TLS configuration.
+ */
+typedef struct
+{
+    size_t uxArenaSize;          /**< Size of the dedicated arena in bytes. */
+    size_t uxArenaUsed;          /**< Bytes of arena blocks currently allocated. */
+    size_t uxArenaPeak;          /**< Highest value of uxArenaUsed. */
+    size_t uxArenaPagesUsed;     /**< Arena pages currently assigned to a size class. */
+    size_t uxHeapUsed;           /**< Bytes currently allocated from the FreeRTOS heap. */
+    size_t uxHeapPeak;           /**< Highest value of uxHeapUsed. */
+    size_t uxTotalPeak;          /**< Highest combined arena and heap usage. */
+    uint32_t ulAllocCount;       /**< Successful allocations. */
+    uint32_t ulFreeCount;        /**< Blocks freed. */
+    uint32_t ulHeapAllocCount;   /**< Allocations served by the FreeRTOS heap. */
+    uint32_t ulFailCount;        /**< Allocations that could not be served. */
+    uint32_t ulFragmentationPct; /**< Share of assigned arena pages not holding live blocks. */
+} MbedtlsMemStats_t;
+
+/**
+ * @brief Get a snapshot of the mbed TLS memory usage statistics.
+ */
+void mbedtls_platform_get_memory_stats( MbedtlsMemStats_t * pxStats );
+
+/**
+ * @brief Restart peak tracking from the current usage, e.g. before a handshake.
+ */
+void mbedtls_platform_reset_memory_peak( void );
+
 #endif /* ifndef MBEDTLS_FREERTOS_PORT_H_ */
@@ -46,6 +46,8 @@
 
 #include "PkiObject.h"
 
+#include "kvstore.h"
+
 #ifdef MBEDTLS_TRANSPORT_PKCS11
     #include "core_pkcs11_config.h"
     #include "core_pkcs11.h"
@@ -96,6 +98,30 @@ typedef enum TlsTransportStatus
 
 typedef void ( * GenericCallback_t )( void * );
 
+/**
+ * @brief Handshake duration statistics, kept separately for full and resumed handshakes.
+ */
+typedef struct TlsHandshakeStats
+{
+    uint32_t ulFullCount;
+    uint32_t ulFullTotalMs;
+    uint32_t ulFullMaxMs;
+    uint32_t ulResumedCount;
+    uint32_t ulResumedTotalMs;
+    uint32_t ulResumedMaxMs;
+    uint32_t ulResumeRejected; /* Session offered but the server performed a full handshake. */
+} TlsHandshakeStats_t;
+
+/**
+ * @brief Count of TLS application data records written by a network context.
+ */
+typedef struct TlsTransportTxStats
+{
+    uint32_t ulRecords;
+    uint32_t ulPlaintextBytes;
+    uint32_t ulWireBytes; /* Plaintext plus record header, explicit IV and MAC / tag. */
+} TlsTransportTxStats_t;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -120,6 +146,28 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
                                                   const size_t uxNumRootCA );
 
 
+/**
+ * @brief Persist the resumable TLS session of a network context in the given KVStore key.
+ *
+ * Any session previously stored under xKey is loaded and offered on the next call to
+ * mbedtls_transport_connect. After each full handshake the new session is written back.
+ * Sessions are always cached in RAM for the lifetime of the context, whether or not a
+ * KVStore key is configured. The stored session includes the master secret, so only use
+ * a key whose backend protects it, see KV_STORE_PERSIST_TLS_SESSION.
+ *
+ * @param[in] pxNetworkContext Network context returned by mbedtls_transport_allocate.
+ * @param[in] xKey KVStore key of type KV_TYPE_BLOB, or CS_NUM_KEYS to disable persistence.
+ *
+ * @return #TLS_TRANSPORT_SUCCESS or #TLS_TRANSPORT_INVALID_PARAMETER.
+ */
+TlsTransportStatus_t mbedtls_transport_setsessionstore( NetworkContext_t * pxNetworkContext,
+                                                        KVStoreKey_t xKey );
+
+/**
+ * @brief Copy the handshake timing statistics accumulated by all network contexts.
+ */
+void mbedtls_transport_gethandshakestats( TlsHandshakeStats_t * pxStats );
+
 int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
                                            GenericCallback_t pxCallback,
                                            void * pvCtx );
@@ -195,6 +243,30 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
                                 const void * pBuffer,
                                 size_t uxBytesToSend );
 
+/**
+ * @brief Sends a list of buffers over an established TLS connection.
+ *
+ * This is the TLS version of the transport interface's #TransportWritev_t
+ * function. Consecutive segments are gathered into a single TLS record of up to
+ * the negotiated maximum fragment size rather than one record per segment.
+ *
+ * @return Number of bytes (> 0) sent on success;
+ * 0 if the socket times out without sending any bytes;
+ * else a negative value to represent error.
+ */
+int32_t mbedtls_transport_writev( NetworkContext_t * pxNetworkContext,
+                                  TransportOutVector_t * pxIoVec,
+                                  size_t uxIoVecCount );
+
+/**
+ * @brief Copy the transmit record statistics of a network context.
+ *
+ * The counters accumulate over every connection made with the context and are
+ * logged by mbedtls_transport_disconnect.
+ */
+void mbedtls_transport_gettxstats( NetworkContext_t * pxNetworkContext,
+                                   TlsTransportTxStats_t * pxStats );
+
 
 #ifdef MBEDTLS_TRANSPORT_PKCS11
     extern mbedtls_pk_info_t mbedtls_pkcs11_pk_ecdsa;
@@ -0,0 +1,117 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file net_perf.h
+ * @brief iperf style TCP and UDP throughput benchmark running over the lwIP socket API.
+ *
+ * Only lwIP sockets and the FreeRTOS task API are used so that the benchmark
+ * measures the same code path whether lwIP runs over the MXCHIP netif or any
+ * other netif.
+ */
+#ifndef NET_PERF_H
+#define NET_PERF_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#define NET_PERF_DEFAULT_PORT           5001
+#define NET_PERF_DEFAULT_DURATION_S     10
+#define NET_PERF_DEFAULT_LEN            1460
+#define NET_PERF_DEFAULT_UDP_RATE_KBPS  1000
+#define NET_PERF_MAX_LEN                8192
+#define NET_PERF_HOST_LEN               40
+
+typedef enum
+{
+    NET_PERF_PROTO_TCP,
+    NET_PERF_PROTO_UDP
+} NetPerfProto_t;
+
+typedef enum
+{
+    NET_PERF_DIR_TX, /* Client, connects to pcHost and sends */
+    NET_PERF_DIR_RX  /* Server, listens on usPort and receives */
+} NetPerfDir_t;
+
+typedef enum
+{
+    NET_PERF_STATE_IDLE,
+    NET_PERF_STATE_RUNNING,
+    NET_PERF_STATE_DONE,
+    NET_PERF_STATE_ERROR
+} NetPerfState_t;
+
+typedef struct
+{
+    NetPerfProto_t xProto;
+    NetPerfDir_t xDir;
+    char pcHost[ NET_PERF_HOST_LEN ]; /* IPv4 address of the server, TX only */
+    uint16_t usPort;
+    uint32_t ulLen;                   /* Bytes per send / recv call */
+    uint32_t ulDurationS;             /* Test length, 0 for RX runs until the peer is done */
+    uint32_t ulRateKbps;              /* UDP TX target rate, 0 for unlimited */
+} NetPerfConfig_t;
+
+typedef struct
+{
+    NetPerfConfig_t xConfig;
+    NetPerfState_t xState;
+    int32_t lError;           /* errno of the failed call when xState is NET_PERF_STATE_ERROR */
+    uint32_t ulBytes;
+    uint32_t ulElapsedMs;     /* From the first byte sent or received */
+    uint32_t ulDatagrams;     /* UDP only */
+    uint32_t ulLost;          /* UDP RX only, from gaps in the sequence numbers */
+    uint32_t ulOutOfOrder;    /* UDP RX only */
+} NetPerfResult_t;
+
+/**
+ * @brief Fill pxConfig with the defaults for the given protocol and direction.
+ */
+void NetPerf_GetDefaultConfig( NetPerfConfig_t * pxConfig,
+                               NetPerfProto_t xProto,
+                               NetPerfDir_t xDir );
+
+/**
+ * @brief Start a test in a dedicated task.
+ *
+ * @return pdTRUE if the test was started, pdFALSE if a test is already running
+ * or the configuration is invalid.
+ */
+BaseType_t NetPerf_Start( const NetPerfConfig_t * pxConfig );
+
+/**
+ * @brief Ask the running test to finish. Results so far are kept.
+ */
+void NetPerf_Stop( void );
+
+/**
+ * @brief Copy the progress of the running test or the result of the last one.
+ */
+void NetPerf_GetResult( NetPerfResult_t * pxResult );
+
+#endif /* NET_PERF_H */
@@ -27,8 +27,16 @@
 #include "semphr.h"
 #include "kvstore.h"
 #include "kvstore_prv.h"
+#include "kvstore_key_hash.h"
 #include <string.h>
 
+#if ( KV_STORE_NVIMPL_LITTLEFS || KV_STORE_NVIMPL_LFS_LOG )
+#include "lfs.h"
+#include "lfs_port.h"
+#elif ( KV_STORE_NVIMPL_STSAFE && defined(__USE_STSAFE__) )
+#include <stsafe_key_value_store.h>
+#endif
+
 static SemaphoreHandle_t xKvMutex = NULL;
 
 #if KV_STORE_CACHE_ENABLE
@@ -43,6 +51,101 @@ const char *const kvStoreKeyMap[CS_NUM_KEYS] = KV_STORE_STRINGS;
 
 const KVStoreDefaultEntry_t kvStoreDefaults[CS_NUM_KEYS] = KV_STORE_DEFAULTS;
 
+static KVStoreStats_t xKvStats = { 0 };
+
+_Static_assert(CS_NUM_KEYS <= KV_STORE_HASH_SLOTS, "Run Tools/macro_to_kvfile.py --key-hash to regenerate kvstore_key_hash.h");
+_Static_assert(CS_NUM_KEYS < UINT8_MAX, "ucKeyHashSlots holds one byte per key");
+
+/* Key whose name hashes to each slot, CS_NUM_KEYS for the slots of keys not in this build */
+static uint8_t ucKeyHashSlots[KV_STORE_HASH_SLOTS];
+
+/*
+ * @brief Seeded FNV-1a of a key name mapped to a slot, must match key_hash in Tools/macro_to_kvfile.py.
+ */
+static uint32_t prvKeyHash(const char *pcKey)
+{
+  uint32_t ulHash = KV_STORE_HASH_SEED;
+
+  while (*pcKey != '\0')
+  {
+    ulHash = (ulHash ^ (uint8_t) *pcKey) * 16777619UL;
+    pcKey++;
+  }
+
+  return (uint32_t) (((uint64_t) ulHash * KV_STORE_HASH_SLOTS) >> 32);
+}
+
+static void prvKeyHashInit(void)
+{
+  (void) memset(ucKeyHashSlots, CS_NUM_KEYS, sizeof(ucKeyHashSlots));
+
+  for (uint32_t i = 0; i < CS_NUM_KEYS; i++)
+  {
+    uint32_t ulSlot = prvKeyHash(kvStoreKeyMap[i]);
+
+    /* A key name was added or renamed without regenerating kvstore_key_hash.h */
+    configASSERT(ucKeyHashSlots[ulSlot] == CS_NUM_KEYS);
+
+    ucKeyHashSlots[ulSlot] = (uint8_t) i;
+  }
+}
+
+/*
+ * @brief Record the cycle counter and flash counters at the start of an operation.
+ */
+static void prvOpStatsStart(KVStoreOpStats_t *pxOp)
+{
+#if ( KV_STORE_NVIMPL_LITTLEFS || KV_STORE_NVIMPL_LFS_LOG )
+  LfsPortStats_t xLfsStats;
+
+  vLfsPortGetStats(&xLfsStats);
+
+  pxOp->ulReadBytes = xLfsStats.ulReadBytes;
+  pxOp->ulProgBytes = xLfsStats.ulProgBytes;
+  pxOp->ulErases = xLfsStats.ulErases;
+#elif ( KV_STORE_NVIMPL_STSAFE && defined(__USE_STSAFE__) )
+  /* Bytes written to the STSAFE data zone, which has no erase */
+  pxOp->ulReadBytes = 0;
+  pxOp->ulProgBytes = pfKvs_getBytesWritten();
+  pxOp->ulErases = 0;
+#else
+  pxOp->ulReadBytes = 0;
+  pxOp->ulProgBytes = 0;
+  pxOp->ulErases = 0;
+#endif
+
+  pxOp->ulUs = DWT->CYCCNT;
+}
+
+/*
+ * @brief Turn the values recorded by prvOpStatsStart into the duration and flash activity of the operation.
+ */
+static void prvOpStatsEnd(KVStoreOpStats_t *pxOp)
+{
+  uint32_t ulCycles = DWT->CYCCNT - pxOp->ulUs;
+
+  pxOp->ulUs = ulCycles / (SystemCoreClock / 1000000);
+
+#if ( KV_STORE_NVIMPL_LITTLEFS || KV_STORE_NVIMPL_LFS_LOG )
+  LfsPortStats_t xLfsStats;
+
+  vLfsPortGetStats(&xLfsStats);
+
+  pxOp->ulReadBytes = xLfsStats.ulReadBytes - pxOp->ulReadBytes;
+  pxOp->ulProgBytes = xLfsStats.ulProgBytes - pxOp->ulProgBytes;
+  pxOp->ulErases = xLfsStats.ulErases - pxOp->ulErases;
+#elif ( KV_STORE_NVIMPL_STSAFE && defined(__USE_STSAFE__) )
+  pxOp->ulProgBytes = pfKvs_getBytesWritten() - pxOp->ulProgBytes;
+#endif
+}
+
+void KVStore_getStats(KVStoreStats_t *pxStats)
+{
+  configASSERT(pxStats != NULL);
+
+  *pxStats = xKvStats;
+}
+
 static size_t xReadEntryOrDefault(KVStoreKey_t xKey, void *pvBuffer, size_t xBufferSize)
 {
   size_t xLength = 0;
@@ -120,6 +223,14 @@ void KVStore_init(void)
 
   (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
 
+  prvKeyHashInit();
+
+  /* Enable the DWT cycle counter used to time the KVStore operations */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  prvOpStatsStart(&(xKvStats.xInit));
+
 #if KV_STORE_NVIMPL_ENABLE
   vprvNvImplInit();
 #endif
@@ -128,6 +239,8 @@ void KVStore_init(void)
   vprvCacheInit();
 #endif
 
+  prvOpStatsEnd(&(xKvStats.xInit));
+
   (void) xSemaphoreGive(xKvMutex);
 }
 
@@ -137,7 +250,11 @@ BaseType_t KVStore_setBlob(KVStoreKey_t key, size_t xLength, const void *pvNewVa
 
   if ((key < CS_NUM_KEYS) && (pvNewValue != NULL) && (xLength > 0) && (kvStoreDefaults[key].type == KV_TYPE_BLOB))
   {
+    (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
     xReturn = WRITE_ENTRY(key, KV_TYPE_BLOB, xLength, pvNewValue);
+
+    (void) xSemaphoreGive(xKvMutex);
   }
 
   return xReturn;
@@ -149,7 +266,11 @@ BaseType_t KVStore_setString(KVStoreKey_t key, const char *pcNewValue)
 
   if ((key < CS_NUM_KEYS) && (pcNewValue != NULL) && (kvStoreDefaults[key].type == KV_TYPE_STRING))
   {
+    (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
     xReturn = WRITE_ENTRY(key, KV_TYPE_STRING, strlen(pcNewValue) + 1, (const void*) pcNewValue);
+
+    (void) xSemaphoreGive(xKvMutex);
   }
 
   return xReturn;
@@ -161,7 +282,11 @@ BaseType_t KVStore_setUInt32(KVStoreKey_t key, uint32_t ulNewVal)
 
   if ((key < CS_NUM_KEYS) && (kvStoreDefaults[key].type == KV_TYPE_UINT32))
   {
+    (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
     xReturn = WRITE_ENTRY(key, KV_TYPE_UINT32, sizeof(uint32_t), (const void*) &ulNewVal);
+
+    (void) xSemaphoreGive(xKvMutex);
   }
 
   return xReturn;
@@ -173,7 +298,11 @@ BaseType_t KVStore_setInt32(KVStoreKey_t key, int32_t lNewVal)
 
   if ((key < CS_NUM_KEYS) && (kvStoreDefaults[key].type == KV_TYPE_INT32))
   {
+    (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
     xReturn = WRITE_ENTRY(key, KV_TYPE_INT32, sizeof(int32_t), (const void*) &lNewVal);
+
+    (void) xSemaphoreGive(xKvMutex);
   }
 
   return xReturn;
@@ -185,7 +314,11 @@ BaseType_t KVStore_setUBase(KVStoreKey_t key, UBaseType_t uxNewVal)
 
   if ((key < CS_NUM_KEYS) && (kvStoreDefaults[key].type == KV_TYPE_UBASE_T))
   {
+    (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
     xReturn = WRITE_ENTRY(key, KV_TYPE_UBASE_T, sizeof(UBaseType_t), (const void*) &uxNewVal);
+
+    (void) xSemaphoreGive(xKvMutex);
   }
 
   return xReturn;
@@ -197,7 +330,11 @@ BaseType_t KVStore_setBase(KVStoreKey_t key, BaseType_t xNewVal)
 
   if ((key < CS_NUM_KEYS) && (kvStoreDefaults[key].type == KV_TYPE_BASE_T))
   {
+    (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
     xReturn = WRITE_ENTRY(key, KV_TYPE_BASE_T, sizeof(BaseType_t), (const void*) &xNewVal);
+
+    (void) xSemaphoreGive(xKvMutex);
   }
 
   return xReturn;
@@ -209,6 +346,9 @@ size_t KVStore_getSize(KVStoreKey_t xKey)
 
   if (xKey < CS_NUM_KEYS)
   {
+    /* The lazy cache may load or drop the value */
+    (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
     /* First check cache if available */
 #if KV_STORE_CACHE_ENABLE
     xDataLen = prvGetCacheEntryLength(xKey);
@@ -217,6 +357,8 @@ size_t KVStore_getSize(KVStoreKey_t xKey)
     xDataLen = xprvGetValueLengthFromImpl( xKey );
 #endif
 
+    (void) xSemaphoreGive(xKvMutex);
+
     if (xDataLen == 0)
     {
       /* Otherwise read default value */
@@ -462,6 +604,70 @@ UBaseType_t KVStore_getUBase(KVStoreKey_t key, BaseType_t *pxSuccess)
   return xReturnValue;
 }
 
+/*
+ * @brief Commit the pending change of xKey, or of every key when xKey is CS_NUM_KEYS.
+ */
+static BaseType_t prvCommit(KVStoreKey_t xKey)
+{
+  BaseType_t xSuccess = pdTRUE;
+  KVStoreOpStats_t xOpStats;
+
+  /* Hold the mutex so that a value set during the commit is not marked as stored */
+  (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
+  prvOpStatsStart(&xOpStats);
+
+#if KV_STORE_CACHE_ENABLE
+  xSuccess = xprvCommitCacheEntries(xKey);
+#else
+  /* Values are written to storage as soon as they are set */
+  (void) xKey;
+#endif
+
+  prvOpStatsEnd(&xOpStats);
+
+  xKvStats.xLastCommit = xOpStats;
+  xKvStats.ulCommits++;
+  xKvStats.ulCommitProgBytes += xOpStats.ulProgBytes;
+  xKvStats.ulCommitErases += xOpStats.ulErases;
+
+  (void) xSemaphoreGive(xKvMutex);
+
+  return xSuccess;
+}
+
+BaseType_t KVStore_xCommitChanges(void)
+{
+  return prvCommit(CS_NUM_KEYS);
+}
+
+BaseType_t KVStore_xCommitKey(KVStoreKey_t xKey)
+{
+  BaseType_t xSuccess = pdFALSE;
+
+  if (xKey < CS_NUM_KEYS)
+  {
+    xSuccess = prvCommit(xKey);
+  }
+
+  return xSuccess;
+}
+
+void KVStore_getCacheStats(KVStoreCacheStats_t *pxStats)
+{
+  configASSERT(pxStats != NULL);
+
+#if KV_STORE_CACHE_ENABLE
+  (void) xSemaphoreTake(xKvMutex, portMAX_DELAY);
+
+  vprvGetCacheStats(pxStats);
+
+  (void) xSemaphoreGive(xKvMutex);
+#else
+  (void) memset(pxStats, 0, sizeof(KVStoreCacheStats_t));
+#endif
+}
+
 const char* kvKeyToString(KVStoreKey_t xKey)
 {
   const char *retVal = NULL;
@@ -478,12 +684,14 @@ KVStoreKey_t kvStringToKey(const char *pcKey)
 {
   KVStoreKey_t xKey = CS_NUM_KEYS;
 
-  for (uint32_t i = 0; i < CS_NUM_KEYS; i++)
+  if (pcKey != NULL)
   {
-    if (0 == strcmp(kvStoreKeyMap[i], pcKey))
+    uint8_t ucKey = ucKeyHashSlots[prvKeyHash(pcKey)];
+
+    /* Names that are not keys also land in a slot, one compare tells them apart */
+    if ((ucKey < CS_NUM_KEYS) && (0 == strcmp(kvStoreKeyMap[ucKey], pcKey)))
     {
-      xKey = i;
-      break;
+      xKey = (KVStoreKey_t) ucKey;
     }
   }
 
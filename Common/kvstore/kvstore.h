@@ -67,6 +67,34 @@ extern const char * const kvStoreKeyMap[ CS_NUM_KEYS ];
 
 typedef enum KvStoreEnum KVStoreKey_t;
 
+/* Duration and flash activity of one KVStore operation */
+typedef struct
+{
+    uint32_t ulUs;
+    uint32_t ulReadBytes; /* Only counted by the littlefs backends */
+    uint32_t ulProgBytes;
+    uint32_t ulErases;
+} KVStoreOpStats_t;
+
+typedef struct
+{
+    KVStoreOpStats_t xInit;
+    KVStoreOpStats_t xLastCommit;
+    uint32_t ulCommits;
+    uint32_t ulCommitProgBytes; /* Total of all commits since boot */
+    uint32_t ulCommitErases;
+} KVStoreStats_t;
+
+/* Activity of the RAM cache of KVStore values */
+typedef struct
+{
+    uint32_t ulHits;
+    uint32_t ulMisses;        /* Reads that had to load the value, KV_STORE_CACHE_LAZY only */
+    uint32_t ulEvictions;     /* Values dropped to stay within KV_STORE_CACHE_BUDGET */
+    uint32_t ulBytesHeld;     /* Heap used by values larger than a pointer */
+    uint32_t ulBytesHeldPeak;
+} KVStoreCacheStats_t;
+
 /* Public function definitions */
 void KVStore_init( void );
 
@@ -116,4 +144,11 @@ KVStoreKey_t kvStringToKey( const char * pcKey );
 
 BaseType_t KVStore_xCommitChanges( void );
 
+/* Store the pending change of a single key, leaving the changes to other keys staged */
+BaseType_t KVStore_xCommitKey( KVStoreKey_t xKey );
+
+void KVStore_getStats( KVStoreStats_t * pxStats );
+
+void KVStore_getCacheStats( KVStoreCacheStats_t * pxStats );
+
 #endif /* _KVSTORE_H */
@@ -29,6 +29,10 @@
 
 #if KV_STORE_CACHE_ENABLE
 
+    #if KV_STORE_CACHE_LAZY && !KV_STORE_NVIMPL_ENABLE
+        #error "KV_STORE_CACHE_LAZY reads values from non-volatile storage and requires KV_STORE_NVIMPL_ENABLE."
+    #endif
+
     typedef struct
     {
         KVStoreValueType_t type;
@@ -43,10 +47,20 @@
             int32_t lData;
         };
         BaseType_t xChangePending;
+        #if KV_STORE_CACHE_LAZY
+            BaseType_t xLoaded; /* pdFALSE until the value has been read from non-volatile storage */
+            uint32_t ulLastUse; /* ulUseCount at the last access, the lowest one is evicted first */
+        #endif
     } KVStoreCacheEntry_t;
 
     static KVStoreCacheEntry_t kvStoreCache[ CS_NUM_KEYS ] = { 0 };
 
+    static KVStoreCacheStats_t xCacheStats = { 0 };
+
+    #if KV_STORE_CACHE_LAZY
+        static uint32_t ulUseCount = 0;
+    #endif
+
 
     static inline void * pvGetDataWritePtr( KVStoreKey_t key )
     {
@@ -92,6 +106,13 @@
         {
             kvStoreCache[ key ].pvData = pvPortMalloc( xNewLength );
             kvStoreCache[ key ].length = xNewLength;
+
+            xCacheStats.ulBytesHeld += xNewLength;
+
+            if( xCacheStats.ulBytesHeld > xCacheStats.ulBytesHeldPeak )
+            {
+                xCacheStats.ulBytesHeldPeak = xCacheStats.ulBytesHeld;
+            }
         }
         else
         {
@@ -105,6 +126,8 @@
         /* Check if data is heap allocated > sizeof( void * ) */
         if( kvStoreCache[ key ].length > sizeof( void * ) )
         {
+            xCacheStats.ulBytesHeld -= kvStoreCache[ key ].length;
+
             vPortFree( kvStoreCache[ key ].pvData );
             kvStoreCache[ key ].pvData = NULL;
             kvStoreCache[ key ].length = 0;
@@ -119,7 +142,9 @@
     static inline void vReallocDataBuffer( KVStoreKey_t key,
                                            size_t xNewLength )
     {
-        if( xNewLength > kvStoreCache[ key ].length )
+        /* A value that now fits in the entry must not keep using the heap buffer */
+        if( ( xNewLength > kvStoreCache[ key ].length ) ||
+            ( xNewLength <= sizeof( void * ) ) )
         {
             /* Need to allocate a bigger buffer */
             vClearDataBuffer( key );
@@ -127,16 +152,105 @@
         }
         else /* New value is same size or smaller. Re-use already allocated buffer */
         {
+            xCacheStats.ulBytesHeld -= kvStoreCache[ key ].length - xNewLength;
             kvStoreCache[ key ].length = xNewLength;
         }
     }
 
+    #if KV_STORE_CACHE_LAZY
+
+/*
+ * @brief Read the value of a key from the storage nvm store into the cache if it is not there yet.
+ * @param[in] xKey The key to load.
+ * @return pdTRUE if the value was already in the cache, pdFALSE if it was read.
+ */
+        static BaseType_t prvCacheLoad( KVStoreKey_t xKey )
+        {
+            BaseType_t xWasLoaded = kvStoreCache[ xKey ].xLoaded;
+
+            if( xWasLoaded == pdFALSE )
+            {
+                size_t xNvLength = xprvGetValueLengthFromImpl( xKey );
+
+                kvStoreCache[ xKey ].type = KV_TYPE_NONE;
+                kvStoreCache[ xKey ].xLoaded = pdTRUE;
+
+                if( xNvLength > 0 )
+                {
+                    KVStoreValueType_t xType = KV_TYPE_NONE;
+                    size_t xLength = 0;
+
+                    vAllocateDataBuffer( xKey, xNvLength );
+
+                    if( ( xprvReadValueFromImpl( xKey, &xType, &xLength, pvGetDataWritePtr( xKey ), xNvLength ) == pdTRUE ) &&
+                        ( xLength == xNvLength ) )
+                    {
+                        kvStoreCache[ xKey ].type = xType;
+                    }
+                    else
+                    {
+                        vClearDataBuffer( xKey );
+                    }
+                }
+            }
+
+            kvStoreCache[ xKey ].ulLastUse = ++ulUseCount;
+
+            return xWasLoaded;
+        }
+
+/*
+ * @brief Drop the least recently used values held on the heap until the rest fits in KV_STORE_CACHE_BUDGET.
+ * Values waiting for a commit are kept. Values of sizeof( void * ) or less live in the cache entry itself and are
+ * never dropped, so hot scalars stay pinned at no heap cost.
+ * Must be called with the KVStore mutex held, a reader may be copying any of the dropped buffers.
+ */
+        static void prvCacheEvict( void )
+        {
+            while( xCacheStats.ulBytesHeld > KV_STORE_CACHE_BUDGET )
+            {
+                uint32_t ulVictim = CS_NUM_KEYS;
+
+                for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+                {
+                    if( ( kvStoreCache[ i ].xLoaded == pdTRUE ) &&
+                        ( kvStoreCache[ i ].xChangePending == pdFALSE ) &&
+                        ( kvStoreCache[ i ].length > sizeof( void * ) ) &&
+                        ( ( ulVictim == CS_NUM_KEYS ) ||
+                          ( kvStoreCache[ i ].ulLastUse < kvStoreCache[ ulVictim ].ulLastUse ) ) )
+                    {
+                        ulVictim = i;
+                    }
+                }
+
+                if( ulVictim == CS_NUM_KEYS )
+                {
+                    break;
+                }
+
+                vClearDataBuffer( ulVictim );
+                kvStoreCache[ ulVictim ].type = KV_TYPE_NONE;
+                kvStoreCache[ ulVictim ].xLoaded = pdFALSE;
+                xCacheStats.ulEvictions++;
+            }
+        }
+
+    #endif /* KV_STORE_CACHE_LAZY */
+
 /*
  * @brief Initialize the Key Value Store Cache by reading each entry from the storage nvm store.
+ * With KV_STORE_CACHE_LAZY, entries are only marked as not loaded and are read on first use.
  */
     void vprvCacheInit( void )
     {
-        #if KV_STORE_NVIMPL_ENABLE
+        #if KV_STORE_CACHE_LAZY
+            for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+            {
+                kvStoreCache[ i ].xChangePending = pdFALSE;
+                kvStoreCache[ i ].type = KV_TYPE_NONE;
+                kvStoreCache[ i ].xLoaded = pdFALSE;
+            }
+        #elif KV_STORE_NVIMPL_ENABLE
             /* Read from file system into ram */
             for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
             {
@@ -159,7 +273,7 @@
                     ( void ) xprvReadValueFromImpl( i, pxType, pxLength, pvGetDataWritePtr( i ), *pxLength );
                 }
             }
-        #endif /* KV_STORE_NVIMPL_ENABLE */
+        #endif /* KV_STORE_CACHE_LAZY */
     }
 
 /*
@@ -170,6 +284,15 @@
     size_t prvGetCacheEntryLength( KVStoreKey_t xKey )
     {
         configASSERT( xKey < CS_NUM_KEYS );
+
+        #if KV_STORE_CACHE_LAZY
+            /* Do not read a value only to find out its size */
+            if( kvStoreCache[ xKey ].xLoaded == pdFALSE )
+            {
+                return xprvGetValueLengthFromImpl( xKey );
+            }
+        #endif
+
         return kvStoreCache[ xKey ].length;
     }
 
@@ -181,6 +304,11 @@
     KVStoreValueType_t prvGetCacheEntryType( KVStoreKey_t xKey )
     {
         configASSERT( xKey < CS_NUM_KEYS );
+
+        #if KV_STORE_CACHE_LAZY
+            ( void ) prvCacheLoad( xKey );
+        #endif
+
         return kvStoreCache[ xKey ].type;
     }
 
@@ -202,6 +330,11 @@
         configASSERT( xLength > 0 );
         configASSERT( pvNewValue != NULL );
 
+        #if KV_STORE_CACHE_LAZY
+            /* Load the stored value so that writing the same value again is not a change */
+            ( void ) prvCacheLoad( xKey );
+        #endif
+
         /* Check if value is not currently set */
         if( kvStoreCache[ xKey ].type == KV_TYPE_NONE )
         {
@@ -244,6 +377,10 @@
             }
         }
 
+        #if KV_STORE_CACHE_LAZY
+            prvCacheEvict();
+        #endif
+
         return pdTRUE;
     }
 
@@ -260,6 +397,19 @@
         configASSERT( xKey < CS_NUM_KEYS );
         configASSERT( pvBuffer != NULL );
 
+        #if KV_STORE_CACHE_LAZY
+            if( prvCacheLoad( xKey ) == pdTRUE )
+            {
+                xCacheStats.ulHits++;
+            }
+            else
+            {
+                xCacheStats.ulMisses++;
+            }
+        #else
+            xCacheStats.ulHits++;
+        #endif
+
         pvDataPtr = pvGetDataReadPtr( xKey );
 
         if( pvDataPtr != NULL )
@@ -286,31 +436,72 @@
             }
         }
 
+        #if KV_STORE_CACHE_LAZY
+            prvCacheEvict();
+        #endif
+
         return( xDataLen > 0 );
     }
 
-    BaseType_t KVStore_xCommitChanges( void )
+    void vprvGetCacheStats( KVStoreCacheStats_t * pxStats )
+    {
+        configASSERT( pxStats != NULL );
+
+        *pxStats = xCacheStats;
+    }
+
+/*
+ * @brief Write the values changed since the last commit to the storage nvm store.
+ * Must be called with the KVStore mutex held.
+ * @param[in] xKey The only key to write, or CS_NUM_KEYS to write every changed key.
+ * @return pdTRUE if every changed value was stored. Values that were not stored stay pending for the next commit.
+ */
+    BaseType_t xprvCommitCacheEntries( KVStoreKey_t xKey )
     {
         BaseType_t xSuccess = pdTRUE;
 
+        configASSERT( xKey <= CS_NUM_KEYS );
+
         #if KV_STORE_NVIMPL_ENABLE
+            BaseType_t xWritten[ CS_NUM_KEYS ] = { pdFALSE };
+
+            for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+            {
+                if( ( ( xKey == CS_NUM_KEYS ) || ( xKey == i ) ) &&
+                    ( kvStoreCache[ i ].xChangePending == pdTRUE ) )
+                {
+                    xWritten[ i ] = xprvWriteValueToImpl( i,
+                                                          kvStoreCache[ i ].type,
+                                                          kvStoreCache[ i ].length,
+                                                          pvGetDataReadPtr( i ) );
+                    xSuccess &= xWritten[ i ];
+                }
+            }
+
+            #if KV_STORE_NVIMPL_BATCHED
+                /* Always called so that the backend can drop a partially staged commit.
+                 * Staged values are only stored once the whole batch is. */
+                if( xprvCommitToImpl() != pdTRUE )
+                {
+                    ( void ) memset( xWritten, 0, sizeof( xWritten ) );
+                    xSuccess = pdFALSE;
+                }
+            #endif
+
             for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
             {
-                if( kvStoreCache[ i ].xChangePending == pdTRUE )
+                if( xWritten[ i ] == pdTRUE )
                 {
-                    xSuccess &= xprvWriteValueToImpl( i,
-                                                      kvStoreCache[ i ].type,
-                                                      kvStoreCache[ i ].length,
-                                                      pvGetDataReadPtr( i ) );
+                    kvStoreCache[ i ].xChangePending = pdFALSE;
                 }
             }
+
+            #if KV_STORE_CACHE_LAZY
+                /* Committed values can now be dropped */
+                prvCacheEvict();
+            #endif
         #endif /* if KV_STORE_NVIMPL_ENABLE */
-        return xSuccess;
-    }
-#else
-    // TODO :
-    BaseType_t KVStore_xCommitChanges( void )
-    {
 
+        return xSuccess;
     }
 #endif /* KV_STORE_CACHE_ENABLE */
@@ -0,0 +1,751 @@
+/*
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * KVStore backend that keeps all keys in a single littlefs file.
+ *
+ * Every commit appends one record to KVSTORE_LOG_FILE:
+ *
+ *     KVLogCommitHeader_t | entry | entry | ...
+ *     entry: KVLogEntryHeader_t | key name (no terminator) | value
+ *
+ * The record is written with a single lfs_file_write followed by lfs_file_sync,
+ * which littlefs makes visible atomically. The CRC in the header additionally
+ * rejects a damaged tail. At boot the log is scanned once to build an index of
+ * the file offset of the newest value of each key, so later reads are a seek and
+ * a read of the already open file. Keys are stored by name so that the log stays
+ * valid when keys are added to or removed from kvstore_config.h.
+ *
+ * When the log grows past KVSTORE_LOG_COMPACT_SIZE and more than half of it is
+ * stale, the live values are written to KVSTORE_LOG_TMP_FILE as a single record
+ * and the file is renamed over the log.
+ *
+ * If the log does not exist yet, the values stored by the per key file backend
+ * under /cfg/ are imported in one record. Those files are left in place.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#include "logging.h"
+#include "kvstore_prv.h"
+#include <string.h>
+
+#if KV_STORE_NVIMPL_LFS_LOG
+    #include "lfs.h"
+    #include "lfs_util.h"
+    #include "lfs_port.h"
+
+    #if !KV_STORE_CACHE_ENABLE
+        #error "KV_STORE_NVIMPL_LFS_LOG stages writes until KVStore_xCommitChanges and requires KV_STORE_CACHE_ENABLE."
+    #endif
+
+    #define KVSTORE_LOG_FILE              "/kvstore.log"
+    #define KVSTORE_LOG_TMP_FILE          "/kvstore.tmp"
+    #define KVSTORE_LOG_COMPACT_SIZE      4096
+    #define KVSTORE_LOG_MAGIC             0x474C564BUL /* "KVLG" */
+
+    #define KVSTORE_LEGACY_PREFIX         "/cfg/"
+    #define KVSTORE_LEGACY_MAX_FNAME      ( sizeof( KVSTORE_LEGACY_PREFIX ) + KVSTORE_KEY_MAX_LEN )
+
+    typedef struct
+    {
+        uint32_t ulMagic;
+        uint32_t ulLength; /* Bytes of entries following the header */
+        uint32_t ulCrc;    /* lfs_crc of the entries */
+    } KVLogCommitHeader_t;
+
+    typedef struct
+    {
+        uint8_t ucKeyLen; /* Length of the key name following this header */
+        uint8_t ucType;
+        uint16_t usLength; /* Length of the value following the key name */
+    } KVLogEntryHeader_t;
+
+    #define KVSTORE_LOG_MAX_ENTRY         ( sizeof( KVLogEntryHeader_t ) + KVSTORE_KEY_MAX_LEN + KVSTORE_VAL_MAX_LEN )
+    #define KVSTORE_LOG_MAX_RECORD        ( CS_NUM_KEYS * KVSTORE_LOG_MAX_ENTRY )
+
+    typedef struct
+    {
+        lfs_off_t xOffset; /* Offset of the value in the log, 0 when the key is not stored */
+        uint16_t usLength;
+        uint8_t ucType;
+    } KVLogIndexEntry_t;
+
+    /* Header of a value stored by kvstore_nv_littlefs.c */
+    typedef struct
+    {
+        KVStoreValueType_t type;
+        size_t length;
+    } KVStoreLegacyTLVHeader_t;
+
+    static KVLogIndexEntry_t xLogIndex[ CS_NUM_KEYS ] = { 0 };
+    static lfs_file_t xLogFile = { 0 };
+    static BaseType_t xLogFileOpen = pdFALSE;
+    static lfs_soff_t xLogSize = 0;
+
+    /* Entries written by xprvWriteValueToImpl since the last xprvCommitToImpl */
+    static uint8_t * pucStaging = NULL;
+    static size_t xStagingLen = 0;
+    static BaseType_t xStagingFailed = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+    static inline void vLfsSSizeToErr( lfs_ssize_t * pxReturnValue,
+                                       size_t xExpectedLength )
+    {
+        if( *pxReturnValue == xExpectedLength )
+        {
+            *pxReturnValue = LFS_ERR_OK;
+        }
+        else if( *pxReturnValue >= 0 )
+        {
+            *pxReturnValue = LFS_ERR_CORRUPT;
+        }
+        else
+        {
+            /* Pass through the error code otherwise */
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static KVStoreKey_t prvFindKey( const char * pcName,
+                                    size_t xNameLen )
+    {
+        KVStoreKey_t xKey = CS_NUM_KEYS;
+
+        for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+        {
+            if( ( strncmp( kvStoreKeyMap[ i ], pcName, xNameLen ) == 0 ) &&
+                ( kvStoreKeyMap[ i ][ xNameLen ] == '\0' ) )
+            {
+                xKey = ( KVStoreKey_t ) i;
+                break;
+            }
+        }
+
+        return xKey;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Point the index at the values of a record's entries.
+ * @param[in] pucEntries The entries of the record.
+ * @param[in] xLength Length of pucEntries.
+ * @param[in] xBase Offset of pucEntries in the log.
+ * @return pdTRUE if all entries were well formed.
+ */
+    static BaseType_t prvIndexEntries( const uint8_t * pucEntries,
+                                       size_t xLength,
+                                       lfs_off_t xBase )
+    {
+        size_t xPos = 0;
+        BaseType_t xResult = pdTRUE;
+
+        while( ( xResult == pdTRUE ) && ( xPos < xLength ) )
+        {
+            KVLogEntryHeader_t xEntry;
+
+            if( ( xLength - xPos ) < sizeof( KVLogEntryHeader_t ) )
+            {
+                xResult = pdFALSE;
+            }
+            else
+            {
+                ( void ) memcpy( &xEntry, &pucEntries[ xPos ], sizeof( KVLogEntryHeader_t ) );
+                xPos += sizeof( KVLogEntryHeader_t );
+
+                if( ( xLength - xPos ) < ( ( size_t ) xEntry.ucKeyLen + xEntry.usLength ) )
+                {
+                    xResult = pdFALSE;
+                }
+            }
+
+            if( xResult == pdTRUE )
+            {
+                KVStoreKey_t xKey = prvFindKey( ( const char * ) &pucEntries[ xPos ], xEntry.ucKeyLen );
+
+                xPos += xEntry.ucKeyLen;
+
+                /* Keys unknown to this build are skipped and dropped by the next compaction */
+                if( xKey < CS_NUM_KEYS )
+                {
+                    xLogIndex[ xKey ].xOffset = xBase + xPos;
+                    xLogIndex[ xKey ].usLength = xEntry.usLength;
+                    xLogIndex[ xKey ].ucType = xEntry.ucType;
+                }
+
+                xPos += xEntry.usLength;
+            }
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Read every record of the open log and build the index.
+ * @return Offset of the end of the last valid record.
+ */
+    static lfs_soff_t prvScanLog( lfs_t * pxLfsCtx )
+    {
+        lfs_soff_t xOffset = 0;
+        BaseType_t xValid = pdTRUE;
+
+        ( void ) memset( xLogIndex, 0, sizeof( xLogIndex ) );
+        ( void ) lfs_file_rewind( pxLfsCtx, &xLogFile );
+
+        while( xValid == pdTRUE )
+        {
+            KVLogCommitHeader_t xHeader;
+            uint8_t * pucEntries = NULL;
+            lfs_ssize_t lReturn = lfs_file_read( pxLfsCtx, &xLogFile, &xHeader, sizeof( xHeader ) );
+
+            if( lReturn != sizeof( xHeader ) )
+            {
+                /* End of the log, or a truncated header */
+                xValid = pdFALSE;
+            }
+            else if( ( xHeader.ulMagic != KVSTORE_LOG_MAGIC ) ||
+                     ( xHeader.ulLength == 0 ) ||
+                     ( xHeader.ulLength > KVSTORE_LOG_MAX_RECORD ) )
+            {
+                LogWarn( "Invalid record header at offset %ld.", ( long ) xOffset );
+                xValid = pdFALSE;
+            }
+            else
+            {
+                pucEntries = pvPortMalloc( xHeader.ulLength );
+                xValid = ( pucEntries != NULL ) ? pdTRUE : pdFALSE;
+            }
+
+            if( xValid == pdTRUE )
+            {
+                lReturn = lfs_file_read( pxLfsCtx, &xLogFile, pucEntries, xHeader.ulLength );
+
+                if( ( lReturn != ( lfs_ssize_t ) xHeader.ulLength ) ||
+                    ( lfs_crc( 0xFFFFFFFF, pucEntries, xHeader.ulLength ) != xHeader.ulCrc ) )
+                {
+                    LogWarn( "Discarding damaged record at offset %ld.", ( long ) xOffset );
+                    xValid = pdFALSE;
+                }
+                else
+                {
+                    xValid = prvIndexEntries( pucEntries, xHeader.ulLength, xOffset + sizeof( xHeader ) );
+                }
+            }
+
+            if( xValid == pdTRUE )
+            {
+                xOffset += sizeof( xHeader ) + xHeader.ulLength;
+            }
+
+            if( pucEntries != NULL )
+            {
+                vPortFree( pucEntries );
+            }
+        }
+
+        return xOffset;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Add an entry to the staging buffer.
+ */
+    static BaseType_t prvStageEntry( KVStoreKey_t xKey,
+                                     KVStoreValueType_t xType,
+                                     size_t xLength,
+                                     const void * pvData )
+    {
+        size_t xKeyLen = strlen( kvStoreKeyMap[ xKey ] );
+        size_t xEntryLen = sizeof( KVLogEntryHeader_t ) + xKeyLen + xLength;
+        uint8_t * pucNew = NULL;
+        BaseType_t xResult = pdFALSE;
+
+        if( ( xKeyLen <= KVSTORE_KEY_MAX_LEN ) &&
+            ( xLength < KVSTORE_VAL_MAX_LEN ) )
+        {
+            pucNew = pvPortMalloc( xStagingLen + xEntryLen );
+        }
+
+        if( pucNew != NULL )
+        {
+            KVLogEntryHeader_t xEntry =
+            {
+                .ucKeyLen = ( uint8_t ) xKeyLen,
+                .ucType   = ( uint8_t ) xType,
+                .usLength = ( uint16_t ) xLength
+            };
+            size_t xPos = xStagingLen;
+
+            if( pucStaging != NULL )
+            {
+                ( void ) memcpy( pucNew, pucStaging, xStagingLen );
+                vPortFree( pucStaging );
+            }
+
+            ( void ) memcpy( &pucNew[ xPos ], &xEntry, sizeof( xEntry ) );
+            xPos += sizeof( xEntry );
+            ( void ) memcpy( &pucNew[ xPos ], kvStoreKeyMap[ xKey ], xKeyLen );
+            xPos += xKeyLen;
+            ( void ) memcpy( &pucNew[ xPos ], pvData, xLength );
+
+            pucStaging = pucNew;
+            xStagingLen += xEntryLen;
+            xResult = pdTRUE;
+        }
+
+        return xResult;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvDropStaging( void )
+    {
+        if( pucStaging != NULL )
+        {
+            vPortFree( pucStaging );
+            pucStaging = NULL;
+        }
+
+        xStagingLen = 0;
+        xStagingFailed = pdFALSE;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Write one record holding pucEntries to a file opened for writing and sync it.
+ */
+    static int prvWriteRecord( lfs_t * pxLfsCtx,
+                               lfs_file_t * pxFile,
+                               const uint8_t * pucEntries,
+                               size_t xLength )
+    {
+        lfs_ssize_t lReturn = LFS_ERR_NOMEM;
+        uint8_t * pucRecord = pvPortMalloc( sizeof( KVLogCommitHeader_t ) + xLength );
+
+        if( pucRecord != NULL )
+        {
+            KVLogCommitHeader_t xHeader =
+            {
+                .ulMagic  = KVSTORE_LOG_MAGIC,
+                .ulLength = ( uint32_t ) xLength,
+                .ulCrc    = lfs_crc( 0xFFFFFFFF, pucEntries, xLength )
+            };
+
+            /* A single write, so the record reaches the file in one piece */
+            ( void ) memcpy( pucRecord, &xHeader, sizeof( xHeader ) );
+            ( void ) memcpy( &pucRecord[ sizeof( xHeader ) ], pucEntries, xLength );
+
+            lReturn = lfs_file_write( pxLfsCtx, pxFile, pucRecord, sizeof( xHeader ) + xLength );
+            vLfsSSizeToErr( &lReturn, sizeof( xHeader ) + xLength );
+
+            vPortFree( pucRecord );
+        }
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            lReturn = lfs_file_sync( pxLfsCtx, pxFile );
+        }
+
+        return ( int ) lReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static int prvOpenLog( lfs_t * pxLfsCtx )
+    {
+        int lReturn = lfs_file_open( pxLfsCtx, &xLogFile, KVSTORE_LOG_FILE, LFS_O_RDWR | LFS_O_CREAT );
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            xLogFileOpen = pdTRUE;
+            xLogSize = prvScanLog( pxLfsCtx );
+
+            /* Drop a damaged tail so that new records follow the last valid one */
+            if( xLogSize < lfs_file_size( pxLfsCtx, &xLogFile ) )
+            {
+                LogWarn( "Truncating " KVSTORE_LOG_FILE " from %ld to %ld bytes.",
+                         ( long ) lfs_file_size( pxLfsCtx, &xLogFile ), ( long ) xLogSize );
+                lReturn = lfs_file_truncate( pxLfsCtx, &xLogFile, ( lfs_off_t ) xLogSize );
+
+                if( lReturn == LFS_ERR_OK )
+                {
+                    lReturn = lfs_file_sync( pxLfsCtx, &xLogFile );
+                }
+            }
+        }
+        else
+        {
+            LogError( "Failed to open " KVSTORE_LOG_FILE ": %d.", lReturn );
+        }
+
+        return lReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Number of entry bytes a record holding only the newest value of each key takes.
+ */
+    static size_t prvLiveLength( void )
+    {
+        size_t xLiveLen = 0;
+
+        for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+        {
+            if( xLogIndex[ i ].xOffset != 0 )
+            {
+                xLiveLen += sizeof( KVLogEntryHeader_t ) + strlen( kvStoreKeyMap[ i ] ) + xLogIndex[ i ].usLength;
+            }
+        }
+
+        return xLiveLen;
+    }
+
+/*
+ * @brief Rewrite the live values as a single record and replace the log with it.
+ */
+    static int prvCompactLog( lfs_t * pxLfsCtx )
+    {
+        size_t xLiveLen = prvLiveLength();
+        uint8_t * pucEntries = NULL;
+        int lReturn = LFS_ERR_OK;
+
+        /* Build the record by staging the live values */
+        prvDropStaging();
+
+        for( uint32_t i = 0; ( i < CS_NUM_KEYS ) && ( lReturn == LFS_ERR_OK ); i++ )
+        {
+            if( xLogIndex[ i ].xOffset != 0 )
+            {
+                uint8_t pucValue[ KVSTORE_VAL_MAX_LEN ];
+                lfs_ssize_t lRead = LFS_ERR_OK;
+
+                lRead = lfs_file_seek( pxLfsCtx, &xLogFile, xLogIndex[ i ].xOffset, LFS_SEEK_SET );
+
+                if( lRead >= 0 )
+                {
+                    lRead = lfs_file_read( pxLfsCtx, &xLogFile, pucValue, xLogIndex[ i ].usLength );
+                    vLfsSSizeToErr( &lRead, xLogIndex[ i ].usLength );
+                }
+
+                if( ( lRead != LFS_ERR_OK ) ||
+                    ( prvStageEntry( ( KVStoreKey_t ) i, ( KVStoreValueType_t ) xLogIndex[ i ].ucType,
+                                     xLogIndex[ i ].usLength, pucValue ) != pdTRUE ) )
+                {
+                    lReturn = LFS_ERR_CORRUPT;
+                }
+            }
+        }
+
+        pucEntries = pucStaging;
+        configASSERT( ( lReturn != LFS_ERR_OK ) || ( xStagingLen == xLiveLen ) );
+
+        if( ( lReturn == LFS_ERR_OK ) && ( xLiveLen > 0 ) )
+        {
+            lfs_file_t xTmpFile = { 0 };
+
+            lReturn = lfs_file_open( pxLfsCtx, &xTmpFile, KVSTORE_LOG_TMP_FILE, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC );
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                lReturn = prvWriteRecord( pxLfsCtx, &xTmpFile, pucEntries, xLiveLen );
+                ( void ) lfs_file_close( pxLfsCtx, &xTmpFile );
+            }
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                ( void ) lfs_file_close( pxLfsCtx, &xLogFile );
+                xLogFileOpen = pdFALSE;
+
+                /* Atomic in littlefs, either the old or the compacted log survives a reset */
+                lReturn = lfs_rename( pxLfsCtx, KVSTORE_LOG_TMP_FILE, KVSTORE_LOG_FILE );
+
+                if( prvOpenLog( pxLfsCtx ) != LFS_ERR_OK )
+                {
+                    lReturn = LFS_ERR_IO;
+                }
+            }
+            else
+            {
+                ( void ) lfs_remove( pxLfsCtx, KVSTORE_LOG_TMP_FILE );
+            }
+        }
+
+        prvDropStaging();
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            LogInfo( "Compacted " KVSTORE_LOG_FILE " to %ld bytes.", ( long ) xLogSize );
+        }
+        else
+        {
+            LogError( "Failed to compact " KVSTORE_LOG_FILE ": %d.", lReturn );
+        }
+
+        return lReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Stage the values stored by the per key file backend, if any.
+ */
+    static void prvStageLegacyFiles( lfs_t * pxLfsCtx )
+    {
+        for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+        {
+            char pcFileName[ KVSTORE_LEGACY_MAX_FNAME ] = { 0 };
+            lfs_file_t xFile = { 0 };
+
+            ( void ) strncpy( pcFileName, KVSTORE_LEGACY_PREFIX, KVSTORE_LEGACY_MAX_FNAME );
+            ( void ) strncat( pcFileName, kvStoreKeyMap[ i ], KVSTORE_LEGACY_MAX_FNAME - strlen( pcFileName ) - 1 );
+
+            if( lfs_file_open( pxLfsCtx, &xFile, pcFileName, LFS_O_RDONLY ) == LFS_ERR_OK )
+            {
+                KVStoreLegacyTLVHeader_t xTlvHeader = { 0 };
+                uint8_t pucValue[ KVSTORE_VAL_MAX_LEN ];
+                lfs_ssize_t lReturn = lfs_file_read( pxLfsCtx, &xFile, &xTlvHeader, sizeof( xTlvHeader ) );
+
+                vLfsSSizeToErr( &lReturn, sizeof( xTlvHeader ) );
+
+                if( ( lReturn == LFS_ERR_OK ) &&
+                    ( xTlvHeader.length > 0 ) &&
+                    ( xTlvHeader.length < KVSTORE_VAL_MAX_LEN ) )
+                {
+                    lReturn = lfs_file_read( pxLfsCtx, &xFile, pucValue, xTlvHeader.length );
+                    vLfsSSizeToErr( &lReturn, xTlvHeader.length );
+
+                    if( ( lReturn == LFS_ERR_OK ) &&
+                        ( prvStageEntry( ( KVStoreKey_t ) i, xTlvHeader.type, xTlvHeader.length, pucValue ) == pdTRUE ) )
+                    {
+                        LogInfo( "Importing %s from %s.", kvStoreKeyMap[ i ], pcFileName );
+                    }
+                }
+
+                ( void ) lfs_file_close( pxLfsCtx, &xFile );
+            }
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Get the length of a value stored in the KVStore implementation
+ * @param[in] xKey Key to lookup
+ * @return length of the value stored in the KVStore or 0 if not found.
+ */
+    size_t xprvGetValueLengthFromImpl( KVStoreKey_t xKey )
+    {
+        size_t xLength = 0;
+
+        configASSERT( xKey < CS_NUM_KEYS );
+
+        if( xLogIndex[ xKey ].xOffset != 0 )
+        {
+            xLength = xLogIndex[ xKey ].usLength;
+        }
+
+        return xLength;
+    }
+
+/*
+ * @brief Read the value for the given key into a given buffer.
+ * @param[in] xKey The key to lookup
+ * @param[out] pxType The type of the value returned.
+ * @param[out] pxLength Pointer to store the length of the read value in.
+ * @param[out] pvBuffer The buffer to copy the value to.
+ * @param[in] xBufferSize The length of the provided buffer.
+ * @return pdTRUE on success, otherwise pdFALSE.
+ */
+    BaseType_t xprvReadValueFromImpl( KVStoreKey_t xKey,
+                                      KVStoreValueType_t * pxType,
+                                      size_t * pxLength,
+                                      void * pvBuffer,
+                                      size_t xBufferSize )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+        lfs_ssize_t lReturn = LFS_ERR_NOENT;
+        size_t xReadLen = 0;
+
+        configASSERT( xKey < CS_NUM_KEYS );
+
+        if( ( xLogFileOpen == pdTRUE ) &&
+            ( xLogIndex[ xKey ].xOffset != 0 ) &&
+            ( pvBuffer != NULL ) )
+        {
+            xReadLen = xLogIndex[ xKey ].usLength;
+
+            if( xReadLen > xBufferSize )
+            {
+                xReadLen = xBufferSize;
+            }
+
+            lReturn = lfs_file_seek( pLfsCtx, &xLogFile, xLogIndex[ xKey ].xOffset, LFS_SEEK_SET );
+
+            if( lReturn >= 0 )
+            {
+                lReturn = lfs_file_read( pLfsCtx, &xLogFile, pvBuffer, xReadLen );
+                vLfsSSizeToErr( &lReturn, xReadLen );
+            }
+        }
+
+        if( pxType != NULL )
+        {
+            *pxType = ( lReturn == LFS_ERR_OK ) ? ( KVStoreValueType_t ) xLogIndex[ xKey ].ucType : KV_TYPE_NONE;
+        }
+
+        if( pxLength != NULL )
+        {
+            *pxLength = ( lReturn == LFS_ERR_OK ) ? xLogIndex[ xKey ].usLength : 0;
+        }
+
+        return( lReturn == LFS_ERR_OK );
+    }
+
+/*
+ * @brief Stage a value for a given key. Staged values are written by xprvCommitToImpl.
+ * @param[in] xKey Key to store the given value in.
+ * @param[in] xType Type of value to record.
+ * @param[in] xLength length of the value given in pxDataUnion.
+ * @param[in] pxData Pointer to a buffer containing the value to be stored.
+ * The caller must free any heap allocated buffers passed into this function.
+ */
+    BaseType_t xprvWriteValueToImpl( KVStoreKey_t xKey,
+                                     KVStoreValueType_t xType,
+                                     size_t xLength,
+                                     const void * pvData )
+    {
+        BaseType_t xResult = pdFALSE;
+
+        if( ( xKey < CS_NUM_KEYS ) && ( pvData != NULL ) )
+        {
+            xResult = prvStageEntry( xKey, xType, xLength, pvData );
+        }
+
+        if( xResult != pdTRUE )
+        {
+            LogError( "Failed to stage a value of %lu bytes for key: %s.",
+                      ( unsigned long ) xLength, ( xKey < CS_NUM_KEYS ) ? kvStoreKeyMap[ xKey ] : "?" );
+            xStagingFailed = pdTRUE;
+        }
+
+        return xResult;
+    }
+
+/*
+ * @brief Append all staged values to the log as a single record.
+ * @return pdTRUE if the record was stored or nothing was staged. A commit with a value
+ * that failed to stage is dropped entirely.
+ */
+    BaseType_t xprvCommitToImpl( void )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+        int lReturn = LFS_ERR_OK;
+
+        if( xStagingFailed == pdTRUE )
+        {
+            lReturn = LFS_ERR_NOMEM;
+        }
+        else if( xStagingLen == 0 )
+        {
+            /* Nothing to do */
+        }
+        else if( xLogFileOpen != pdTRUE )
+        {
+            lReturn = LFS_ERR_IO;
+        }
+        else
+        {
+            lReturn = lfs_file_seek( pLfsCtx, &xLogFile, xLogSize, LFS_SEEK_SET );
+
+            if( lReturn >= 0 )
+            {
+                lReturn = prvWriteRecord( pLfsCtx, &xLogFile, pucStaging, xStagingLen );
+            }
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                ( void ) prvIndexEntries( pucStaging, xStagingLen, xLogSize + sizeof( KVLogCommitHeader_t ) );
+                xLogSize += sizeof( KVLogCommitHeader_t ) + xStagingLen;
+            }
+            else
+            {
+                LogError( "Failed to append %lu bytes to " KVSTORE_LOG_FILE ": %d.",
+                          ( unsigned long ) xStagingLen, lReturn );
+
+                /* Remove whatever part of the record reached the file */
+                if( lfs_file_truncate( pLfsCtx, &xLogFile, ( lfs_off_t ) xLogSize ) == LFS_ERR_OK )
+                {
+                    ( void ) lfs_file_sync( pLfsCtx, &xLogFile );
+                }
+            }
+        }
+
+        prvDropStaging();
+
+        if( ( lReturn == LFS_ERR_OK ) &&
+            ( xLogSize > KVSTORE_LOG_COMPACT_SIZE ) )
+        {
+            /* The new record is already stored, a failed compaction only costs space */
+            if( ( ( sizeof( KVLogCommitHeader_t ) + prvLiveLength() ) * 2 ) < ( size_t ) xLogSize )
+            {
+                ( void ) prvCompactLog( pLfsCtx );
+            }
+        }
+
+        return( lReturn == LFS_ERR_OK );
+    }
+
+    void vprvNvImplInit( void )
+    {
+        lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+        struct lfs_info xFileInfo = { 0 };
+        BaseType_t xNewLog = ( lfs_stat( pLfsCtx, KVSTORE_LOG_FILE, &xFileInfo ) != LFS_ERR_OK );
+
+        LogInfo( "* Conf from lfs log *" );
+
+        if( xLogFileOpen == pdTRUE )
+        {
+            ( void ) lfs_file_close( pLfsCtx, &xLogFile );
+            xLogFileOpen = pdFALSE;
+        }
+
+        prvDropStaging();
+
+        if( ( prvOpenLog( pLfsCtx ) == LFS_ERR_OK ) &&
+            ( xNewLog == pdTRUE ) )
+        {
+            prvStageLegacyFiles( pLfsCtx );
+            ( void ) xprvCommitToImpl();
+        }
+    }
+#endif /* KV_STORE_NVIMPL_LFS_LOG */
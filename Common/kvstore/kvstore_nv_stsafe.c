@@ -33,6 +33,10 @@
 #if (KV_STORE_NVIMPL_STSAFE) && (defined(__USE_STSAFE__))
 #include <stsafe_key_value_store.h>
 
+#if KV_STORE_STSAFE_WRITE_BACK && !KV_STORE_CACHE_ENABLE
+#error "KV_STORE_STSAFE_WRITE_BACK holds writes until KVStore_xCommitChanges and requires KV_STORE_CACHE_ENABLE."
+#endif
+
 /*
  * @brief Get the length of a value stored in the KVStore implementation
  * @param[in] xKey Key to lookup
@@ -137,6 +141,17 @@ BaseType_t xprvWriteValueToImpl(const KVStoreKey_t xKey, const KVStoreValueType_
   return xResult;
 }
 
+#if KV_STORE_STSAFE_WRITE_BACK
+/*
+ * @brief Write the keys changed by xprvWriteValueToImpl since the last call to the STSAFE zone.
+ * @return pdTRUE on success, otherwise pdFALSE. Keys that were not written are retried on the next call.
+ */
+BaseType_t xprvCommitToImpl(void)
+{
+  return pfKvs_commit() ? pdTRUE : pdFALSE;
+}
+#endif
+
 void vprvNvImplInit(void)
 {
   LogInfo("* Conf from STSAFE *");
@@ -72,6 +72,13 @@ extern const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ];
 
     void vprvNvImplInit( void );
 
+/* Set for backends that stage the writes of a commit and persist them together in xprvCommitToImpl */
+    #define KV_STORE_NVIMPL_BATCHED    ( KV_STORE_NVIMPL_LFS_LOG || ( KV_STORE_NVIMPL_STSAFE && KV_STORE_STSAFE_WRITE_BACK ) )
+
+    #if KV_STORE_NVIMPL_BATCHED
+        BaseType_t xprvCommitToImpl( void );
+    #endif
+
 #endif /* KV_STORE_NVIMPL_ENABLE */
 
 
@@ -90,6 +97,10 @@ extern const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ];
 
     void vprvCacheInit( void );
 
+    BaseType_t xprvCommitCacheEntries( KVStoreKey_t xKey );
+
+    void vprvGetCacheStats( KVStoreCacheStats_t * pxStats );
+
     size_t prvGetCacheEntryLength( KVStoreKey_t xKey );
     KVStoreValueType_t prvGetCacheEntryType( KVStoreKey_t xKey );
 
@@ -37,6 +37,8 @@
 #include "queue.h"
 #include "semphr.h"
 
+#include "lwip/opt.h"
+
 #define SYS_MBOX_NULL                     ( ( QueueHandle_t ) NULL )
 #define SYS_SEM_NULL                      ( ( SemaphoreHandle_t ) NULL )
 #define SYS_DEFAULT_THREAD_STACK_DEPTH    configMINIMAL_STACK_SIZE
@@ -45,6 +47,12 @@ typedef SemaphoreHandle_t   sys_sem_t;
 typedef SemaphoreHandle_t   sys_mutex_t;
 typedef TaskHandle_t        sys_thread_t;
 
+/* Set LWIP_FREERTOS_MBOX_RING to 1 in lwipopts to back mailboxes with a lock-free ring instead of a queue */
+#ifndef LWIP_FREERTOS_MBOX_RING
+    #define LWIP_FREERTOS_MBOX_RING    0
+#endif
+
+#if ( LWIP_FREERTOS_MBOX_RING == 0 )
 struct sys_mbox
 {
     QueueHandle_t xMbox;
@@ -54,6 +62,18 @@ typedef struct sys_mbox sys_mbox_t;
 
 #define sys_mbox_valid( x )          ( ( ( ( x ) == NULL ) || ( ( x )->xMbox == NULL ) ) ? pdFALSE : pdTRUE )
 #define sys_mbox_set_invalid( x )    do { if( ( x ) != NULL ) { ( x )->xMbox = NULL; ( x )->xTask = NULL; } } while( 0 )
+#else
+struct sys_mbox_ring;
+
+struct sys_mbox
+{
+    struct sys_mbox_ring * pxRing;
+};
+typedef struct sys_mbox sys_mbox_t;
+
+#define sys_mbox_valid( x )          ( ( ( ( x ) == NULL ) || ( ( x )->pxRing == NULL ) ) ? pdFALSE : pdTRUE )
+#define sys_mbox_set_invalid( x )    do { if( ( x ) != NULL ) { ( x )->pxRing = NULL; } } while( 0 )
+#endif /* LWIP_FREERTOS_MBOX_RING == 0 */
 #define sys_sem_valid( x )           ( ( ( * x ) == NULL ) ? pdFALSE : pdTRUE )
 #define sys_sem_set_invalid( x )     ( ( * x ) = NULL )
 
@@ -47,6 +47,10 @@
 #define DEFAULT_TCP_RECVMBOX_SIZE     16
 #define DEFAULT_ACCEPTMBOX_SIZE       16
 
+/* Back mailboxes with a lock-free ring and task notifications rather than a FreeRTOS queue.
+ * Mailbox lengths are rounded up to a power of two. */
+#define LWIP_FREERTOS_MBOX_RING       0
+
 /*fix http IOT issue */
 #define LWIP_WND_SCALE                1
 #define TCP_RCV_SCALE                 1
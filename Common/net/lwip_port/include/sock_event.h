@@ -0,0 +1,56 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file sock_event.h
+ * @brief Per socket receive-ready callbacks driven by lwIP netconn events.
+ */
+#ifndef SOCK_EVENT_H
+#define SOCK_EVENT_H
+
+#include <stdbool.h>
+
+typedef void ( * SockEventCallback_t )( void * pvCtx );
+
+/**
+ * @brief Register a callback invoked whenever data or an error is received on a socket.
+ *
+ * The callback is called from the lwIP tcpip thread with the core lock held, so it
+ * must not block or call back into lwIP. Pass NULL to remove a callback. A callback
+ * must be removed before the socket is closed.
+ *
+ * @return 0 on success, -1 if the socket is not valid.
+ */
+int lwip_sock_set_recv_callback( int lSock,
+                                 SockEventCallback_t pxCallback,
+                                 void * pvCtx );
+
+/**
+ * @brief Check whether received data is waiting to be read from a socket.
+ */
+bool lwip_sock_recv_pending( int lSock );
+
+#endif /* SOCK_EVENT_H */
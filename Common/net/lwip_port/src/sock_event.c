@@ -0,0 +1,165 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file sock_event.c
+ * @brief Per socket receive-ready callbacks driven by lwIP netconn events.
+ *
+ * Every lwIP socket owns a netconn whose event callback updates the socket's
+ * select() state. The netconn callback of a registered socket is replaced with
+ * one that forwards each event to the original handler and then invokes the
+ * registered callback for receive and error events. This lets a task be woken
+ * directly from the tcpip thread instead of from a helper task blocked in select().
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_ERROR
+
+#include "logging.h"
+
+#include "lwip/opt.h"
+#include "lwip/api.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "lwip/priv/sockets_priv.h"
+
+#include "sock_event.h"
+
+#if !LWIP_TCPIP_CORE_LOCKING
+    #error "sock_event requires LWIP_TCPIP_CORE_LOCKING"
+#endif
+
+#if !( LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL )
+    #error "sock_event requires LWIP_SOCKET_SELECT or LWIP_SOCKET_POLL"
+#endif
+
+/* lwIP allocates one socket per netconn */
+#define SOCK_EVENT_NUM_SOCKETS    MEMP_NUM_NETCONN
+
+typedef struct
+{
+    SockEventCallback_t pxCallback;
+    void * pvCtx;
+} SockEventEntry_t;
+
+static SockEventEntry_t xSockEvents[ SOCK_EVENT_NUM_SOCKETS ] = { 0 };
+
+/* The event handler installed by the lwIP sockets layer, shared by all sockets */
+static netconn_callback xLwipEventCallback = NULL;
+
+/*-----------------------------------------------------------*/
+
+static void prvSockEventCallback( struct netconn * pxConn,
+                                  enum netconn_evt xEvent,
+                                  u16_t usLen )
+{
+    int lIdx = -1;
+
+    configASSERT( xLwipEventCallback != NULL );
+
+    xLwipEventCallback( pxConn, xEvent, usLen );
+
+    if( pxConn != NULL )
+    {
+        lIdx = pxConn->callback_arg.socket - LWIP_SOCKET_OFFSET;
+    }
+
+    if( ( lIdx >= 0 ) &&
+        ( lIdx < SOCK_EVENT_NUM_SOCKETS ) &&
+        ( ( xEvent == NETCONN_EVT_RCVPLUS ) || ( xEvent == NETCONN_EVT_ERROR ) ) &&
+        ( xSockEvents[ lIdx ].pxCallback != NULL ) )
+    {
+        xSockEvents[ lIdx ].pxCallback( xSockEvents[ lIdx ].pvCtx );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+int lwip_sock_set_recv_callback( int lSock,
+                                 SockEventCallback_t pxCallback,
+                                 void * pvCtx )
+{
+    int lIdx = lSock - LWIP_SOCKET_OFFSET;
+    int lResult = -1;
+
+    if( ( lIdx >= 0 ) && ( lIdx < SOCK_EVENT_NUM_SOCKETS ) )
+    {
+        struct lwip_sock * pxSock = lwip_socket_dbg_get_socket( lSock );
+
+        LOCK_TCPIP_CORE();
+
+        if( ( pxSock != NULL ) && ( pxSock->conn != NULL ) )
+        {
+            if( pxSock->conn->callback != prvSockEventCallback )
+            {
+                configASSERT( ( xLwipEventCallback == NULL ) ||
+                              ( xLwipEventCallback == pxSock->conn->callback ) );
+
+                xLwipEventCallback = pxSock->conn->callback;
+                pxSock->conn->callback = prvSockEventCallback;
+            }
+
+            xSockEvents[ lIdx ].pxCallback = pxCallback;
+            xSockEvents[ lIdx ].pvCtx = pvCtx;
+            lResult = 0;
+        }
+        else if( pxCallback == NULL )
+        {
+            /* Removing the callback of a socket that is already gone */
+            xSockEvents[ lIdx ].pxCallback = NULL;
+            xSockEvents[ lIdx ].pvCtx = NULL;
+            lResult = 0;
+        }
+        else
+        {
+            LogError( "Socket %d is not open.", lSock );
+        }
+
+        UNLOCK_TCPIP_CORE();
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+bool lwip_sock_recv_pending( int lSock )
+{
+    struct lwip_sock * pxSock = lwip_socket_dbg_get_socket( lSock );
+    bool xPending = false;
+
+    SYS_ARCH_DECL_PROTECT( lev );
+
+    if( pxSock != NULL )
+    {
+        SYS_ARCH_PROTECT( lev );
+        xPending = ( pxSock->rcvevent > 0 ) || ( pxSock->lastdata.pbuf != NULL );
+        SYS_ARCH_UNPROTECT( lev );
+    }
+
+    return xPending;
+}
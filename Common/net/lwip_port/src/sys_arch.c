@@ -50,6 +50,10 @@
 #include "lwip/stats.h"
 #include "main.h"
 
+#if LWIP_FREERTOS_MBOX_RING
+    #include <stdatomic.h>
+#endif
+
 #if !INCLUDE_xTaskAbortDelay
     #error "lwIP FreeRTOS port requires INCLUDE_xTaskAbortDelay"
 #endif
@@ -62,6 +66,8 @@
  * the interrupt handler setting this variable manually. */
 portBASE_TYPE xInsideISR = pdFALSE;
 
+#if ( LWIP_FREERTOS_MBOX_RING == 0 )
+
 /*---------------------------------------------------------------------------*
 * Routine:  sys_mbox_new
 *---------------------------------------------------------------------------*
@@ -360,6 +366,424 @@ u32_t sys_arch_mbox_tryfetch( sys_mbox_t * pxMailBox,
     return ulReturn;
 }
 
+#else /* LWIP_FREERTOS_MBOX_RING == 0 */
+
+/*
+ * Mailboxes are bounded rings of message pointers with a sequence number per
+ * slot. Producers and the consumer claim slots with a compare and swap on the
+ * head or tail index and never enter a critical section, so posting from the
+ * network interface or an ISR does not contend with the tcpip thread. A
+ * consumer which finds the ring empty registers itself in xTask and sleeps on
+ * a direct to task notification which the next producer gives.
+ */
+
+#define MBOX_NOTIFY_IDX    ( configTASK_NOTIFICATION_ARRAY_ENTRIES - 1 )
+
+typedef struct
+{
+    atomic_uint_least32_t ulSeq;
+    void * pvMsg;
+} MboxSlot_t;
+
+struct sys_mbox_ring
+{
+    atomic_uint_least32_t ulHead;       /* Next position to post to */
+    atomic_uint_least32_t ulTail;       /* Next position to fetch from */
+    _Atomic( TaskHandle_t ) xTask;      /* Consumer waiting for a message */
+    uint32_t ulMask;                    /* Ring length - 1, the length is a power of two */
+    MboxSlot_t xSlots[];
+};
+
+/*---------------------------------------------------------------------------*/
+
+static BaseType_t prvRingPost( struct sys_mbox_ring * pxRing,
+                               void * pvMsg )
+{
+    uint32_t ulPos = atomic_load_explicit( &( pxRing->ulHead ), memory_order_relaxed );
+    MboxSlot_t * pxSlot = NULL;
+
+    for( ; ; )
+    {
+        int32_t lDiff;
+
+        pxSlot = &( pxRing->xSlots[ ulPos & pxRing->ulMask ] );
+        lDiff = ( int32_t ) ( atomic_load_explicit( &( pxSlot->ulSeq ), memory_order_acquire ) - ulPos );
+
+        if( lDiff == 0 )
+        {
+            /* The slot is free, claim it */
+            if( atomic_compare_exchange_weak_explicit( &( pxRing->ulHead ), &ulPos, ulPos + 1,
+                                                       memory_order_relaxed, memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if( lDiff < 0 )
+        {
+            /* The slot still holds the message posted one lap ago */
+            return pdFALSE;
+        }
+        else
+        {
+            ulPos = atomic_load_explicit( &( pxRing->ulHead ), memory_order_relaxed );
+        }
+    }
+
+    pxSlot->pvMsg = pvMsg;
+    atomic_store_explicit( &( pxSlot->ulSeq ), ulPos + 1, memory_order_release );
+
+    /* Order the publication above before reading xTask, pairs with the fence in sys_arch_mbox_fetch */
+    atomic_thread_fence( memory_order_seq_cst );
+
+    return pdTRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static BaseType_t prvRingFetch( struct sys_mbox_ring * pxRing,
+                                void ** ppvMsg )
+{
+    uint32_t ulPos = atomic_load_explicit( &( pxRing->ulTail ), memory_order_relaxed );
+    MboxSlot_t * pxSlot = NULL;
+
+    for( ; ; )
+    {
+        int32_t lDiff;
+
+        pxSlot = &( pxRing->xSlots[ ulPos & pxRing->ulMask ] );
+        lDiff = ( int32_t ) ( atomic_load_explicit( &( pxSlot->ulSeq ), memory_order_acquire ) - ( ulPos + 1 ) );
+
+        if( lDiff == 0 )
+        {
+            if( atomic_compare_exchange_weak_explicit( &( pxRing->ulTail ), &ulPos, ulPos + 1,
+                                                       memory_order_relaxed, memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if( lDiff < 0 )
+        {
+            /* Empty */
+            return pdFALSE;
+        }
+        else
+        {
+            ulPos = atomic_load_explicit( &( pxRing->ulTail ), memory_order_relaxed );
+        }
+    }
+
+    *ppvMsg = pxSlot->pvMsg;
+
+    /* Hand the slot back to producers for the next lap */
+    atomic_store_explicit( &( pxSlot->ulSeq ), ulPos + pxRing->ulMask + 1, memory_order_release );
+
+    return pdTRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void prvRingWakeConsumer( struct sys_mbox_ring * pxRing )
+{
+    TaskHandle_t xTask = atomic_load_explicit( &( pxRing->xTask ), memory_order_relaxed );
+
+    if( xTask != NULL )
+    {
+        if( xInsideISR != pdFALSE )
+        {
+            portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+            vTaskNotifyGiveIndexedFromISR( xTask, MBOX_NOTIFY_IDX, &xHigherPriorityTaskWoken );
+            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        }
+        else
+        {
+            ( void ) xTaskNotifyGiveIndexed( xTask, MBOX_NOTIFY_IDX );
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  sys_mbox_new
+*---------------------------------------------------------------------------*
+* Description:
+*      Creates a new mailbox. The length is rounded up to a power of two.
+* Inputs:
+*      int size                -- Size of elements in the mailbox
+* Outputs:
+*      sys_mbox_t              -- Handle to new mailbox
+*---------------------------------------------------------------------------*/
+err_t sys_mbox_new( sys_mbox_t * pxMailBox,
+                    int iSize )
+{
+    err_t xReturn = ERR_MEM;
+    struct sys_mbox_ring * pxRing = NULL;
+    uint32_t ulLen = 1;
+
+    while( ulLen < ( uint32_t ) iSize )
+    {
+        ulLen <<= 1;
+    }
+
+    pxRing = pvPortMalloc( sizeof( struct sys_mbox_ring ) + ( ulLen * sizeof( MboxSlot_t ) ) );
+
+    if( pxRing != NULL )
+    {
+        atomic_init( &( pxRing->ulHead ), 0 );
+        atomic_init( &( pxRing->ulTail ), 0 );
+        atomic_init( &( pxRing->xTask ), NULL );
+        pxRing->ulMask = ulLen - 1;
+
+        for( uint32_t ulIdx = 0; ulIdx < ulLen; ulIdx++ )
+        {
+            atomic_init( &( pxRing->xSlots[ ulIdx ].ulSeq ), ulIdx );
+            pxRing->xSlots[ ulIdx ].pvMsg = NULL;
+        }
+
+        pxMailBox->pxRing = pxRing;
+        xReturn = ERR_OK;
+        SYS_STATS_INC_USED( mbox );
+    }
+
+    return xReturn;
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  sys_mbox_free
+*---------------------------------------------------------------------------*
+* Description:
+*      Deallocates a mailbox. If there are messages still present in the
+*      mailbox when the mailbox is deallocated, it is an indication of a
+*      programming error in lwIP and the developer should be notified.
+* Inputs:
+*      sys_mbox_t mbox         -- Handle of mailbox
+*---------------------------------------------------------------------------*/
+void sys_mbox_free( sys_mbox_t * pxMailBox )
+{
+    struct sys_mbox_ring * pxRing;
+    TaskHandle_t xTask;
+
+    if( ( pxMailBox != NULL ) && ( pxMailBox->pxRing != NULL ) )
+    {
+        pxRing = pxMailBox->pxRing;
+
+        uint32_t ulMessagesWaiting = atomic_load( &( pxRing->ulHead ) ) - atomic_load( &( pxRing->ulTail ) );
+        configASSERT( ( ulMessagesWaiting == 0 ) );
+
+        #if SYS_STATS
+        {
+            if( ulMessagesWaiting != 0UL )
+            {
+                SYS_STATS_INC( mbox.err );
+            }
+
+            SYS_STATS_DEC( mbox.used );
+        }
+        #endif /* SYS_STATS */
+
+        ( ( sys_mbox_t volatile * ) pxMailBox )->pxRing = NULL;
+        xTask = atomic_exchange( &( pxRing->xTask ), NULL );
+
+        /* The waiting consumer notices that the mailbox is gone when it wakes up */
+        if( xTask != NULL )
+        {
+            ( void ) xTaskNotifyGiveIndexed( xTask, MBOX_NOTIFY_IDX );
+        }
+
+        vPortFree( pxRing );
+    }
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  sys_mbox_post
+*---------------------------------------------------------------------------*
+* Description:
+*      Post the "msg" to the mailbox. Waits a tick at a time while the
+*      mailbox is full.
+* Inputs:
+*      sys_mbox_t mbox         -- Handle of mailbox
+*      void *data              -- Pointer to data to post
+*---------------------------------------------------------------------------*/
+void sys_mbox_post( sys_mbox_t * pxMailBox,
+                    void * pxMessageToPost )
+{
+    while( prvRingPost( pxMailBox->pxRing, pxMessageToPost ) != pdTRUE )
+    {
+        vTaskDelay( 1 );
+    }
+
+    prvRingWakeConsumer( pxMailBox->pxRing );
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  sys_mbox_trypost
+*---------------------------------------------------------------------------*
+* Description:
+*      Try to post the "msg" to the mailbox.  Returns immediately with
+*      error if cannot.
+* Inputs:
+*      sys_mbox_t mbox         -- Handle of mailbox
+*      void *msg               -- Pointer to data to post
+* Outputs:
+*      err_t                   -- ERR_OK if message posted, else ERR_MEM
+*                                  if not.
+*---------------------------------------------------------------------------*/
+err_t sys_mbox_trypost( sys_mbox_t * pxMailBox,
+                        void * pxMessageToPost )
+{
+    err_t xReturn = ERR_OK;
+
+    if( prvRingPost( pxMailBox->pxRing, pxMessageToPost ) == pdTRUE )
+    {
+        prvRingWakeConsumer( pxMailBox->pxRing );
+    }
+    else
+    {
+        /* The mailbox was already full. */
+        xReturn = ERR_MEM;
+        SYS_STATS_INC( mbox.err );
+    }
+
+    return xReturn;
+}
+
+err_t sys_mbox_trypost_fromisr( sys_mbox_t * pxMailBox,
+                                void * pxMessageToPost )
+{
+    err_t xReturn;
+
+    xInsideISR = pdTRUE;
+    xReturn = sys_mbox_trypost( pxMailBox, pxMessageToPost );
+    xInsideISR = pdFALSE;
+
+    return xReturn;
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  sys_arch_mbox_fetch
+*---------------------------------------------------------------------------*
+* Description:
+*      Blocks the thread until a message arrives in the mailbox, but does
+*      not block the thread longer than "timeout" milliseconds. A timeout
+*      of 0 waits forever. The "msg" parameter maybe NULL to indicate that
+*      the message should be dropped. Only one task may wait on a mailbox
+*      at a time.
+* Inputs:
+*      sys_mbox_t mbox         -- Handle of mailbox
+*      void **msg              -- Pointer to pointer to msg received
+*      u32_t timeout           -- Number of milliseconds until timeout
+* Outputs:
+*      u32_t                   -- SYS_ARCH_TIMEOUT if timeout, else 1
+*---------------------------------------------------------------------------*/
+u32_t sys_arch_mbox_fetch( sys_mbox_t * pxMailBox,
+                           void ** ppvBuffer,
+                           u32_t ulTimeOut )
+{
+    void * pvDummy;
+    unsigned long ulReturn = SYS_ARCH_TIMEOUT;
+    sys_mbox_t volatile * pvxMailBox = pxMailBox;
+    struct sys_mbox_ring * pxRing = ( pvxMailBox != NULL ) ? pvxMailBox->pxRing : NULL;
+    TickType_t xTicksToWait = ( ulTimeOut != 0UL ) ? ( ulTimeOut / portTICK_PERIOD_MS ) : portMAX_DELAY;
+    TimeOut_t xTimeOut;
+
+    if( NULL == ppvBuffer )
+    {
+        ppvBuffer = &pvDummy;
+    }
+
+    if( ( pxRing != NULL ) &&
+        ( prvRingFetch( pxRing, ppvBuffer ) == pdTRUE ) )
+    {
+        /* Fast path, no kernel call */
+        ulReturn = 1UL;
+    }
+    else if( pxRing != NULL )
+    {
+        TaskHandle_t xExpected = NULL;
+
+        configASSERT( xInsideISR == ( portBASE_TYPE ) 0 );
+
+        vTaskSetTimeOutState( &xTimeOut );
+
+        /* Register as the consumer, a second concurrent waiter is rejected as with the queue based mailbox */
+        if( atomic_compare_exchange_strong( &( pxRing->xTask ), &xExpected, xTaskGetCurrentTaskHandle() ) )
+        {
+            /* Pairs with the fence in prvRingPost, either the producer sees xTask or this fetch sees the message */
+            atomic_thread_fence( memory_order_seq_cst );
+
+            for( ; ; )
+            {
+                if( prvRingFetch( pxRing, ppvBuffer ) == pdTRUE )
+                {
+                    ulReturn = 1UL;
+                    break;
+                }
+
+                if( ( ulTimeOut != 0UL ) &&
+                    ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdTRUE ) )
+                {
+                    break;
+                }
+
+                ( void ) ulTaskNotifyTakeIndexed( MBOX_NOTIFY_IDX, pdTRUE, xTicksToWait );
+
+                if( pvxMailBox->pxRing != pxRing )
+                {
+                    /* Freed while waiting, the ring must not be touched anymore */
+                    pxRing = NULL;
+                    break;
+                }
+            }
+
+            if( pxRing != NULL )
+            {
+                atomic_store( &( pxRing->xTask ), NULL );
+            }
+        }
+    }
+
+    if( ulReturn == SYS_ARCH_TIMEOUT )
+    {
+        *ppvBuffer = NULL;
+    }
+
+    return ulReturn;
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  sys_arch_mbox_tryfetch
+*---------------------------------------------------------------------------*
+* Description:
+*      Similar to sys_arch_mbox_fetch, but if message is not ready
+*      immediately, we'll return with SYS_MBOX_EMPTY.  On success, 0 is
+*      returned.
+* Inputs:
+*      sys_mbox_t mbox         -- Handle of mailbox
+*      void **msg              -- Pointer to pointer to msg received
+* Outputs:
+*      u32_t                   -- SYS_MBOX_EMPTY if no messages.  Otherwise,
+*                                  return ERR_OK.
+*---------------------------------------------------------------------------*/
+u32_t sys_arch_mbox_tryfetch( sys_mbox_t * pxMailBox,
+                              void ** ppvBuffer )
+{
+    void * pvDummy;
+    unsigned long ulReturn = SYS_MBOX_EMPTY;
+
+    if( ppvBuffer == NULL )
+    {
+        ppvBuffer = &pvDummy;
+    }
+
+    if( prvRingFetch( pxMailBox->pxRing, ppvBuffer ) == pdTRUE )
+    {
+        ulReturn = ERR_OK;
+    }
+
+    return ulReturn;
+}
+
+#endif /* LWIP_FREERTOS_MBOX_RING == 0 */
+
 /*---------------------------------------------------------------------------*
 * Routine:  sys_sem_new
 *---------------------------------------------------------------------------*
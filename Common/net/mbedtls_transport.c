@@ -27,6 +27,7 @@
 #include "logging_levels.h"
 
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE   tls
 
 #include "logging.h"
 
@@ -56,21 +57,25 @@
 
 #define MBEDTLS_DEBUG_THRESHOLD    1
 
+/* Upper bound on the age of a session offered for resumption. Session tickets
+ * carrying a shorter lifetime hint expire earlier. */
+#ifndef MBEDTLS_TRANSPORT_SESSION_MAX_AGE_S
+    #define MBEDTLS_TRANSPORT_SESSION_MAX_AGE_S    ( 2 * 60 * 60 )
+#endif
+
+#define TLS_SESSION_BLOB_MAGIC                     0x544C5353UL /* "TLSS" */
+
+/* Size of the buffer used by mbedtls_transport_writev to gather small segments into a
+ * single TLS record. Larger segments are written in place. */
+#ifndef MBEDTLS_TRANSPORT_WRITEV_BUFFER_LEN
+    #define MBEDTLS_TRANSPORT_WRITEV_BUFFER_LEN    512
+#endif
+
 #ifdef MBEDTLS_TRANSPORT_PKCS11
     #include "core_pkcs11_config.h"
     #include "core_pkcs11.h"
 #endif
 
-typedef struct
-{
-    TaskHandle_t xTaskHandle;
-    void * pvRecvReadyCallbackCtx;
-    GenericCallback_t pxRecvReadyCallback;
-    StackType_t puxStackBuffer[ 128 ];
-    StaticTask_t xTaskBuffer;
-    SockHandle_t xSockHandle;
-} NotifyThreadCtx_t;
-
 /**
  * @brief Secured connection context.
  */
@@ -79,7 +84,12 @@ typedef struct TLSContext
     ConnectionState_t xConnectionState;
     SockHandle_t xSockHandle;
 
-    NotifyThreadCtx_t * pxNotifyThreadCtx;
+    /* Deadline for each call to mbedtls_ssl_send, 0 to wait indefinitely */
+    uint32_t ulSendTimeoutMs;
+
+    /* Called from the network stack when data is ready to be received */
+    GenericCallback_t pxRecvReadyCallback;
+    void * pvRecvReadyCallbackCtx;
 
     /* TLS connection */
     mbedtls_ssl_config xSslConfig;
@@ -102,8 +112,32 @@ typedef struct TLSContext
     #ifdef TRANSPORT_USE_CTR_DRBG
         mbedtls_ctr_drbg_context xCtrDrbgCtx;
     #endif /* TRANSPORT_USE_CTR_DRBG */
+
+    /* Session saved from the last successful handshake for resumption */
+    mbedtls_ssl_session xSavedSession;
+    BaseType_t xSessionValid;
+    TickType_t xSessionSavedAt;
+    uint32_t ulSessionLifetimeS;
+    uint32_t ulSessionEndpointHash;
+    KVStoreKey_t xSessionKvKey;
+
+    /* Gather buffer for mbedtls_transport_writev, allocated on first use */
+    uint8_t * pucWritevBuffer;
+    TlsTransportTxStats_t xTxStats;
 } TLSContext_t;
 
+/**
+ * @brief Header prepended to a serialized session persisted in the KVStore.
+ */
+typedef struct
+{
+    uint32_t ulMagic;
+    uint32_t ulEndpointHash;
+    uint32_t ulLifetimeS;
+} TlsSessionBlobHeader_t;
+
+static TlsHandshakeStats_t xHandshakeStats = { 0 };
+
 
 /*-----------------------------------------------------------*/
 
@@ -115,14 +149,11 @@ static TlsTransportStatus_t xConfigureCAChain( TLSContext_t * pxTLSCtx,
                                                const PkiObject_t * pxRootCaCerts,
                                                const size_t uxNumRootCA );
 
-static inline void vStopSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx );
+static void vAttachRecvCallback( TLSContext_t * pxTLSCtx );
 
-static void vCreateSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx,
-                                     SockHandle_t xSockHandle );
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx );
+static void vCloseSocket( TLSContext_t * pxTLSCtx );
 
-
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx );
+static void vInvalidateSession( TLSContext_t * pxTLSCtx );
 
 #ifdef MBEDTLS_DEBUG_C
 /* Used to print mbedTLS log output. */
@@ -135,64 +166,6 @@ static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx );
 
 /*-----------------------------------------------------------*/
 
-static void vSocketNotifyThread( void * pvParameters )
-{
-    NotifyThreadCtx_t * pxCtx = ( NotifyThreadCtx_t * ) pvParameters;
-    SockHandle_t xSockHandle = pxCtx->xSockHandle;
-    BaseType_t xExitFlag = pdFALSE;
-    fd_set xReadSet;
-    fd_set xErrorSet;
-    int lRslt;
-    uint32_t ulNotifyValue = 0;
-
-    ( void ) xTaskNotifyStateClear( NULL );
-
-    if( pxCtx->pxRecvReadyCallback == NULL )
-    {
-        xExitFlag = pdTRUE;
-    }
-
-    while( !xExitFlag )
-    {
-        FD_ZERO( &xReadSet );
-        FD_ZERO( &xErrorSet );
-        FD_SET( xSockHandle, &xReadSet );
-        FD_SET( xSockHandle, &xErrorSet );
-
-        lRslt = sock_select( xSockHandle + 1, &xReadSet, NULL, &xErrorSet, NULL );
-
-        xExitFlag |= ( lRslt == 0 );
-
-        if( ( lRslt == 0 ) ||
-            FD_ISSET( xSockHandle, &xErrorSet ) )
-        {
-            xExitFlag = pdTRUE;
-        }
-        else
-        {
-            if( FD_ISSET( xSockHandle, &xReadSet ) &&
-                pxCtx->pxRecvReadyCallback )
-            {
-                pxCtx->pxRecvReadyCallback( pxCtx->pvRecvReadyCallbackCtx );
-            }
-        }
-
-        if( xTaskNotifyWait( 0x0, 0xFFFFFFFF, &ulNotifyValue, portMAX_DELAY ) )
-        {
-            if( ulNotifyValue == 0xFFFFFFFF )
-            {
-                xExitFlag = pdTRUE;
-            }
-        }
-    }
-
-    /* Delete thread error */
-    pxCtx->xTaskHandle = NULL;
-    vTaskDelete( NULL );
-}
-
-/*-----------------------------------------------------------*/
-
 static int32_t lMbedtlsErrToTransportError( int32_t lError )
 {
     switch( lError )
@@ -341,73 +314,101 @@ static void vLogCertInfo( mbedtls_x509_crt * pxCert,
 }
 
 /*-----------------------------------------------------------*/
-/*TODO add proper timeout */
 static int mbedtls_ssl_send( void * pvCtx,
                              const unsigned char * pcBuf,
                              size_t uxLen )
 {
-    SockHandle_t * pxSockHandle = ( SockHandle_t * ) pvCtx;
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pvCtx;
     int lError = 0;
     size_t uxBytesSent = 0;
-    uint32_t ulBackofftimeMs = 1;
+    TimeOut_t xTimeOut;
+    TickType_t xTicksToWait = portMAX_DELAY;
 
-    if( ( pxSockHandle == NULL ) ||
-        ( *pxSockHandle < 0 ) )
+    if( ( pxTLSCtx == NULL ) ||
+        ( pxTLSCtx->xSockHandle < 0 ) )
     {
         lError = MBEDTLS_ERR_NET_SOCKET_FAILED;
     }
     else
     {
+        if( pxTLSCtx->ulSendTimeoutMs > 0 )
+        {
+            xTicksToWait = pdMS_TO_TICKS( pxTLSCtx->ulSendTimeoutMs );
+        }
+
+        vTaskSetTimeOutState( &xTimeOut );
+
         while( uxBytesSent < uxLen && lError == 0 )
         {
-            ssize_t xRslt = sock_send( *pxSockHandle,
-                                       ( void * const ) pcBuf,
-                                       uxLen,
-                                       0 );
+            ssize_t xRslt = sock_send( pxTLSCtx->xSockHandle,
+                                       ( const void * ) &( pcBuf[ uxBytesSent ] ),
+                                       uxLen - uxBytesSent,
+                                       MSG_DONTWAIT );
 
             if( xRslt > 0 )
             {
                 uxBytesSent += ( size_t ) xRslt;
+                continue;
             }
-            else
+
+            lError = *__errno();
+
+            switch( lError )
             {
-                lError = *__errno();
+                #if EAGAIN != EWOULDBLOCK
+                    case EAGAIN:
+                #endif
+                case EINTR:
+                case EWOULDBLOCK:
+                    lError = MBEDTLS_ERR_SSL_WANT_WRITE;
+                    break;
 
-                if( lError != EWOULDBLOCK )
-                {
+                case EPIPE:
+                case ECONNRESET:
                     LogError( "Got Error code: %ld", lError );
-                }
+                    lError = MBEDTLS_ERR_NET_CONN_RESET;
+                    break;
 
-                switch( lError )
-                {
-                    #if EAGAIN != EWOULDBLOCK
-                        case EAGAIN:
-                    #endif
-                    case EINTR:
-                    case EWOULDBLOCK:
-                        break;
+                default:
+                    LogError( "Got Error code: %ld", lError );
+                    lError = MBEDTLS_ERR_NET_SEND_FAILED;
+                    break;
+            }
 
-                    case EPIPE:
-                    case ECONNRESET:
-                        lError = MBEDTLS_ERR_NET_CONN_RESET;
-                        break;
+            /* Wait for space in the send buffer until the deadline expires */
+            if( ( lError == MBEDTLS_ERR_SSL_WANT_WRITE ) &&
+                ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE ) )
+            {
+                fd_set xWriteSet;
+                fd_set xErrorSet;
+                struct timeval xTimeVal;
+                struct timeval * pxTimeVal = NULL;
 
-                    default:
-                        lError = MBEDTLS_ERR_NET_SEND_FAILED;
-                        break;
-                }
+                FD_ZERO( &xWriteSet );
+                FD_ZERO( &xErrorSet );
+                FD_SET( pxTLSCtx->xSockHandle, &xWriteSet );
+                FD_SET( pxTLSCtx->xSockHandle, &xErrorSet );
 
-                if( lError == EWOULDBLOCK )
+                if( xTicksToWait != portMAX_DELAY )
                 {
-                    vTaskDelay( ulBackofftimeMs );
-                    ulBackofftimeMs = ulBackofftimeMs * 2;
-                    lError = 0;
+                    uint32_t ulWaitMs = ( uint32_t ) ( xTicksToWait * portTICK_PERIOD_MS );
+
+                    xTimeVal.tv_sec = ulWaitMs / 1000;
+                    xTimeVal.tv_usec = ( ulWaitMs % 1000 ) * 1000;
+                    pxTimeVal = &xTimeVal;
                 }
+
+                /* Errors are reported by the next call to sock_send */
+                ( void ) sock_select( pxTLSCtx->xSockHandle + 1, NULL, &xWriteSet, &xErrorSet, pxTimeVal );
+
+                lError = 0;
             }
         }
     }
 
-    return ( int ) lError < 0 ? lError : uxBytesSent;
+    /* Report a partial write so that mbedtls resumes from the right offset, and
+     * WANT_WRITE if the deadline passed before anything could be sent */
+    return ( uxBytesSent > 0 ) ? ( int ) uxBytesSent : lError;
 }
 
 /*-----------------------------------------------------------*/
@@ -416,13 +417,13 @@ static int mbedtls_ssl_recv( void * pvCtx,
                              unsigned char * pcBuf,
                              size_t xLen )
 {
-    SockHandle_t * pxSockHandle = ( SockHandle_t * ) pvCtx;
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pvCtx;
     int lError = -1;
 
-    if( ( pxSockHandle != NULL ) &&
-        ( *pxSockHandle >= 0 ) )
+    if( ( pxTLSCtx != NULL ) &&
+        ( pxTLSCtx->xSockHandle >= 0 ) )
     {
-        lError = sock_recv( *pxSockHandle,
+        lError = sock_recv( pxTLSCtx->xSockHandle,
                             ( void * ) pcBuf,
                             xLen,
                             0 );
@@ -481,6 +482,10 @@ NetworkContext_t * mbedtls_transport_allocate( void )
         mbedtls_x509_crt_init( &( pxTLSCtx->xRootCaChain ) );
         mbedtls_pk_init( &( pxTLSCtx->xPkCtx ) );
 
+        mbedtls_ssl_session_init( &( pxTLSCtx->xSavedSession ) );
+        pxTLSCtx->xSessionValid = pdFALSE;
+        pxTLSCtx->xSessionKvKey = CS_NUM_KEYS;
+
         #ifdef MBEDTLS_TRANSPORT_PKCS11
             pxTLSCtx->xP11SessionHandle = CK_INVALID_HANDLE;
         #endif /* MBEDTLS_TRANSPORT_PKCS11 */
@@ -507,18 +512,19 @@ void mbedtls_transport_free( NetworkContext_t * pxNetworkContext )
 
     if( pxNetworkContext != NULL )
     {
-        vFreeNotifyThreadCtx( pxTLSCtx->pxNotifyThreadCtx );
-
-        if( pxTLSCtx->xSockHandle >= 0 )
-        {
-            ( void ) sock_close( pxTLSCtx->xSockHandle );
-        }
+        vCloseSocket( pxTLSCtx );
 
         mbedtls_ssl_config_free( &( pxTLSCtx->xSslConfig ) );
         mbedtls_ssl_free( &( pxTLSCtx->xSslCtx ) );
         mbedtls_x509_crt_free( &( pxTLSCtx->xRootCaChain ) );
         mbedtls_x509_crt_free( &( pxTLSCtx->xClientCert ) );
         mbedtls_pk_free( &( pxTLSCtx->xPkCtx ) );
+        mbedtls_ssl_session_free( &( pxTLSCtx->xSavedSession ) );
+
+        if( pxTLSCtx->pucWritevBuffer != NULL )
+        {
+            vPortFree( pxTLSCtx->pucWritevBuffer );
+        }
 
         #ifdef MBEDTLS_TRANSPORT_PKCS11
             if( pxTLSCtx->xP11SessionHandle != CK_INVALID_HANDLE )
@@ -914,6 +920,9 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
         {
             mbedtls_ssl_config_free( pxSslConfig );
             mbedtls_ssl_config_init( pxSslConfig );
+
+            /* A session negotiated with the previous credentials must not be resumed */
+            vInvalidateSession( pxTLSCtx );
         }
 
         /* Initialize SSL Config from defaults */
@@ -1057,7 +1066,7 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
         else
         {
             /* Setup mbedtls IO callbacks */
-            mbedtls_ssl_set_bio( pxSslCtx, &( pxTLSCtx->xSockHandle ),
+            mbedtls_ssl_set_bio( pxSslCtx, pxTLSCtx,
                                  mbedtls_ssl_send, mbedtls_ssl_recv, NULL );
 
             pxTLSCtx->xConnectionState = STATE_CONFIGURED;
@@ -1080,11 +1089,7 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
     configASSERT( usPort > 0 );
 
     /* Close socket if already allocated */
-    if( pxTLSCtx->xSockHandle >= 0 )
-    {
-        ( void ) sock_close( pxTLSCtx->xSockHandle );
-        pxTLSCtx->xSockHandle = -1;
-    }
+    vCloseSocket( pxTLSCtx );
 
     /* Perform address (DNS) lookup */
     if( xStatus == TLS_TRANSPORT_SUCCESS )
@@ -1231,6 +1236,394 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
 
 /*-----------------------------------------------------------*/
 
+static uint32_t ulGetEndpointHash( const char * pcHostName,
+                                   uint16_t usPort )
+{
+    /* 32 bit FNV-1a over the host name followed by the port */
+    uint32_t ulHash = 2166136261UL;
+
+    for( const char * pcChar = pcHostName; *pcChar != '\0'; pcChar++ )
+    {
+        ulHash = ( ulHash ^ ( uint8_t ) *pcChar ) * 16777619UL;
+    }
+
+    ulHash = ( ulHash ^ ( usPort & 0xFF ) ) * 16777619UL;
+    ulHash = ( ulHash ^ ( usPort >> 8 ) ) * 16777619UL;
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vInvalidateSession( TLSContext_t * pxTLSCtx )
+{
+    if( pxTLSCtx->xSessionValid == pdTRUE )
+    {
+        mbedtls_ssl_session_free( &( pxTLSCtx->xSavedSession ) );
+        mbedtls_ssl_session_init( &( pxTLSCtx->xSavedSession ) );
+        pxTLSCtx->xSessionValid = pdFALSE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t ulGetSessionLifetime( const mbedtls_ssl_session * pxSession )
+{
+    uint32_t ulLifetimeS = MBEDTLS_TRANSPORT_SESSION_MAX_AGE_S;
+
+    #if defined( MBEDTLS_SSL_SESSION_TICKETS ) && defined( MBEDTLS_SSL_CLI_C )
+        if( ( pxSession->MBEDTLS_PRIVATE( ticket_len ) > 0 ) &&
+            ( pxSession->MBEDTLS_PRIVATE( ticket_lifetime ) > 0 ) &&
+            ( pxSession->MBEDTLS_PRIVATE( ticket_lifetime ) < ulLifetimeS ) )
+        {
+            ulLifetimeS = pxSession->MBEDTLS_PRIVATE( ticket_lifetime );
+        }
+    #else
+        ( void ) pxSession;
+    #endif
+
+    return ulLifetimeS;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t ulGetSessionRemainingLifetime( const TLSContext_t * pxTLSCtx )
+{
+    uint32_t ulAgeS = ( uint32_t ) ( ( xTaskGetTickCount() - pxTLSCtx->xSessionSavedAt ) / configTICK_RATE_HZ );
+
+    return ( ulAgeS < pxTLSCtx->ulSessionLifetimeS ) ? ( pxTLSCtx->ulSessionLifetimeS - ulAgeS ) : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xSessionTicketChanged( const mbedtls_ssl_session * pxOld,
+                                         const mbedtls_ssl_session * pxNew )
+{
+    BaseType_t xChanged = pdFALSE;
+
+    #if defined( MBEDTLS_SSL_SESSION_TICKETS ) && defined( MBEDTLS_SSL_CLI_C )
+        if( ( pxOld->MBEDTLS_PRIVATE( ticket_len ) != pxNew->MBEDTLS_PRIVATE( ticket_len ) ) ||
+            ( ( pxNew->MBEDTLS_PRIVATE( ticket_len ) > 0 ) &&
+              ( memcmp( pxOld->MBEDTLS_PRIVATE( ticket ),
+                        pxNew->MBEDTLS_PRIVATE( ticket ),
+                        pxNew->MBEDTLS_PRIVATE( ticket_len ) ) != 0 ) ) )
+        {
+            xChanged = pdTRUE;
+        }
+    #else
+        ( void ) pxOld;
+        ( void ) pxNew;
+    #endif
+
+    return xChanged;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xSessionIsResumable( const mbedtls_ssl_session * pxSession )
+{
+    BaseType_t xResumable = ( pxSession->MBEDTLS_PRIVATE( id_len ) > 0 );
+
+    #if defined( MBEDTLS_SSL_SESSION_TICKETS ) && defined( MBEDTLS_SSL_CLI_C )
+        xResumable |= ( pxSession->MBEDTLS_PRIVATE( ticket_len ) > 0 );
+    #endif
+
+    return xResumable;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vPersistSession( TLSContext_t * pxTLSCtx )
+{
+    uint8_t * pucBlob = NULL;
+    size_t uxSessionLen = 0;
+    int lError = 0;
+
+    /* The littlefs backend requires values strictly shorter than KVSTORE_VAL_MAX_LEN */
+    const size_t uxBlobMaxLen = KVSTORE_VAL_MAX_LEN - 1;
+
+    if( pxTLSCtx->xSessionKvKey < CS_NUM_KEYS )
+    {
+        pucBlob = pvPortMalloc( uxBlobMaxLen );
+    }
+
+    if( pucBlob != NULL )
+    {
+        TlsSessionBlobHeader_t xHeader =
+        {
+            .ulMagic        = TLS_SESSION_BLOB_MAGIC,
+            .ulEndpointHash = pxTLSCtx->ulSessionEndpointHash,
+            .ulLifetimeS    = ulGetSessionRemainingLifetime( pxTLSCtx ),
+        };
+
+        /* Leave the server certificate out of the stored session to keep it within the
+         * KVStore value size limit. It is not needed to resume the session. */
+        mbedtls_ssl_session xSessionNoCert = pxTLSCtx->xSavedSession;
+
+        #if defined( MBEDTLS_SSL_KEEP_PEER_CERTIFICATE )
+            xSessionNoCert.MBEDTLS_PRIVATE( peer_cert ) = NULL;
+        #endif
+
+        ( void ) memcpy( pucBlob, &xHeader, sizeof( TlsSessionBlobHeader_t ) );
+
+        lError = mbedtls_ssl_session_save( &xSessionNoCert,
+                                           &( pucBlob[ sizeof( TlsSessionBlobHeader_t ) ] ),
+                                           uxBlobMaxLen - sizeof( TlsSessionBlobHeader_t ),
+                                           &uxSessionLen );
+
+        if( lError != 0 )
+        {
+            LogWarn( "Failed to serialize TLS session (%lu bytes): Error: %s : %s.",
+                     uxSessionLen,
+                     mbedtlsHighLevelCodeOrDefault( lError ),
+                     mbedtlsLowLevelCodeOrDefault( lError ) );
+        }
+        else if( ( KVStore_setBlob( pxTLSCtx->xSessionKvKey,
+                                    sizeof( TlsSessionBlobHeader_t ) + uxSessionLen,
+                                    pucBlob ) != pdTRUE ) ||
+                 ( KVStore_xCommitKey( pxTLSCtx->xSessionKvKey ) != pdTRUE ) )
+        {
+            LogWarn( "Failed to store TLS session in key: %s.",
+                     kvKeyToString( pxTLSCtx->xSessionKvKey ) );
+        }
+        else
+        {
+            LogDebug( "Stored %lu byte TLS session valid for %lu s.",
+                      sizeof( TlsSessionBlobHeader_t ) + uxSessionLen,
+                      xHeader.ulLifetimeS );
+        }
+
+        vPortFree( pucBlob );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vLoadPersistedSession( TLSContext_t * pxTLSCtx )
+{
+    size_t uxBlobLen = 0;
+    uint8_t * pucBlob = NULL;
+    TlsSessionBlobHeader_t xHeader = { 0 };
+
+    if( KVStore_getSize( pxTLSCtx->xSessionKvKey ) > sizeof( TlsSessionBlobHeader_t ) )
+    {
+        pucBlob = KVStore_getBlobHeap( pxTLSCtx->xSessionKvKey, &uxBlobLen );
+    }
+
+    if( ( pucBlob != NULL ) &&
+        ( uxBlobLen > sizeof( TlsSessionBlobHeader_t ) ) )
+    {
+        ( void ) memcpy( &xHeader, pucBlob, sizeof( TlsSessionBlobHeader_t ) );
+
+        vInvalidateSession( pxTLSCtx );
+
+        if( ( xHeader.ulMagic == TLS_SESSION_BLOB_MAGIC ) &&
+            ( xHeader.ulLifetimeS > 0 ) &&
+            ( mbedtls_ssl_session_load( &( pxTLSCtx->xSavedSession ),
+                                        &( pucBlob[ sizeof( TlsSessionBlobHeader_t ) ] ),
+                                        uxBlobLen - sizeof( TlsSessionBlobHeader_t ) ) == 0 ) )
+        {
+            /* There is no wall clock, so the time spent powered off is unknown. A stale
+             * session is simply rejected by the server, costing one full handshake. */
+            pxTLSCtx->xSessionValid = pdTRUE;
+            pxTLSCtx->xSessionSavedAt = xTaskGetTickCount();
+            pxTLSCtx->ulSessionLifetimeS = xHeader.ulLifetimeS;
+            pxTLSCtx->ulSessionEndpointHash = xHeader.ulEndpointHash;
+
+            LogInfo( "Loaded persisted TLS session from key: %s.",
+                     kvKeyToString( pxTLSCtx->xSessionKvKey ) );
+        }
+        else
+        {
+            mbedtls_ssl_session_free( &( pxTLSCtx->xSavedSession ) );
+            mbedtls_ssl_session_init( &( pxTLSCtx->xSavedSession ) );
+
+            LogWarn( "Ignoring invalid TLS session stored in key: %s.",
+                     kvKeyToString( pxTLSCtx->xSessionKvKey ) );
+        }
+    }
+
+    if( pucBlob != NULL )
+    {
+        vPortFree( pucBlob );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xOfferSavedSession( TLSContext_t * pxTLSCtx,
+                                      uint32_t ulEndpointHash )
+{
+    BaseType_t xOffered = pdFALSE;
+    int lError = 0;
+
+    if( pxTLSCtx->xSessionValid != pdTRUE )
+    {
+        /* Nothing to offer */
+    }
+    else if( ( pxTLSCtx->ulSessionEndpointHash != ulEndpointHash ) ||
+             ( ulGetSessionRemainingLifetime( pxTLSCtx ) == 0 ) )
+    {
+        LogDebug( "Discarding TLS session saved for another endpoint or expired." );
+        vInvalidateSession( pxTLSCtx );
+    }
+    else
+    {
+        lError = mbedtls_ssl_set_session( &( pxTLSCtx->xSslCtx ), &( pxTLSCtx->xSavedSession ) );
+
+        if( lError == 0 )
+        {
+            xOffered = pdTRUE;
+        }
+        else
+        {
+            LogWarn( "Failed to offer saved TLS session: Error: %s : %s.",
+                     mbedtlsHighLevelCodeOrDefault( lError ),
+                     mbedtlsLowLevelCodeOrDefault( lError ) );
+            vInvalidateSession( pxTLSCtx );
+        }
+    }
+
+    return xOffered;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vSaveSession( TLSContext_t * pxTLSCtx,
+                          uint32_t ulEndpointHash,
+                          BaseType_t xResumed )
+{
+    const mbedtls_ssl_session * pxNegotiated = pxTLSCtx->xSslCtx.MBEDTLS_PRIVATE( session );
+    BaseType_t xRestartLifetime = !xResumed;
+    int lError = 0;
+
+    if( ( pxNegotiated == NULL ) ||
+        ( xSessionIsResumable( pxNegotiated ) != pdTRUE ) )
+    {
+        vInvalidateSession( pxTLSCtx );
+    }
+    else
+    {
+        /* A resumed session keeps its original lifetime unless the server issued a new ticket */
+        if( xResumed &&
+            xSessionTicketChanged( &( pxTLSCtx->xSavedSession ), pxNegotiated ) )
+        {
+            xRestartLifetime = pdTRUE;
+        }
+
+        lError = mbedtls_ssl_get_session( &( pxTLSCtx->xSslCtx ), &( pxTLSCtx->xSavedSession ) );
+
+        if( lError != 0 )
+        {
+            LogDebug( "TLS session is not resumable: Error: %s : %s.",
+                      mbedtlsHighLevelCodeOrDefault( lError ),
+                      mbedtlsLowLevelCodeOrDefault( lError ) );
+
+            /* mbedtls_ssl_get_session may have left a partial copy behind */
+            mbedtls_ssl_session_free( &( pxTLSCtx->xSavedSession ) );
+            mbedtls_ssl_session_init( &( pxTLSCtx->xSavedSession ) );
+            pxTLSCtx->xSessionValid = pdFALSE;
+        }
+        else
+        {
+            pxTLSCtx->xSessionValid = pdTRUE;
+            pxTLSCtx->ulSessionEndpointHash = ulEndpointHash;
+
+            if( xRestartLifetime )
+            {
+                pxTLSCtx->xSessionSavedAt = xTaskGetTickCount();
+                pxTLSCtx->ulSessionLifetimeS = ulGetSessionLifetime( &( pxTLSCtx->xSavedSession ) );
+
+                vPersistSession( pxTLSCtx );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vRecordHandshake( BaseType_t xOffered,
+                              BaseType_t xResumed,
+                              TickType_t xElapsed )
+{
+    uint32_t ulElapsedMs = ( uint32_t ) ( xElapsed * portTICK_PERIOD_MS );
+
+    taskENTER_CRITICAL();
+
+    if( xResumed )
+    {
+        xHandshakeStats.ulResumedCount++;
+        xHandshakeStats.ulResumedTotalMs += ulElapsedMs;
+
+        if( ulElapsedMs > xHandshakeStats.ulResumedMaxMs )
+        {
+            xHandshakeStats.ulResumedMaxMs = ulElapsedMs;
+        }
+    }
+    else
+    {
+        xHandshakeStats.ulFullCount++;
+        xHandshakeStats.ulFullTotalMs += ulElapsedMs;
+
+        if( ulElapsedMs > xHandshakeStats.ulFullMaxMs )
+        {
+            xHandshakeStats.ulFullMaxMs = ulElapsedMs;
+        }
+
+        if( xOffered )
+        {
+            xHandshakeStats.ulResumeRejected++;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_transport_gethandshakestats( TlsHandshakeStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    *pxStats = xHandshakeStats;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t mbedtls_transport_setsessionstore( NetworkContext_t * pxNetworkContext,
+                                                        KVStoreKey_t xKey )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+
+    if( pxNetworkContext == NULL )
+    {
+        LogError( "Provided pxNetworkContext cannot be NULL." );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else if( ( xKey < CS_NUM_KEYS ) &&
+             ( KVStore_getType( xKey ) != KV_TYPE_BLOB ) )
+    {
+        LogError( "KVStore key: %s is not of type KV_TYPE_BLOB.", kvKeyToString( xKey ) );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else
+    {
+        pxTLSCtx->xSessionKvKey = xKey;
+
+        if( xKey < CS_NUM_KEYS )
+        {
+            vLoadPersistedSession( pxTLSCtx );
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
 TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkContext,
                                                 const char * pcHostName,
                                                 uint16_t usPort,
@@ -1294,6 +1687,8 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
     /* Set send and receive timeout parameters */
     if( xStatus == TLS_TRANSPORT_SUCCESS )
     {
+        pxTLSCtx->ulSendTimeoutMs = ulSendTimeoutMs;
+
         lError = sock_setsockopt( pxTLSCtx->xSockHandle,
                                   SOL_SOCKET,
                                   SO_RCVTIMEO,
@@ -1347,6 +1742,10 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
     /* Perform TLS handshake. */
     if( xStatus == TLS_TRANSPORT_SUCCESS )
     {
+        uint32_t ulEndpointHash = ulGetEndpointHash( pcHostName, usPort );
+        BaseType_t xSessionOffered = xOfferSavedSession( pxTLSCtx, ulEndpointHash );
+        TickType_t xHandshakeStart = xTaskGetTickCount();
+
         /* Perform the TLS handshake. */
         do
         {
@@ -1361,12 +1760,32 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
                       mbedtlsHighLevelCodeOrDefault( lError ),
                       mbedtlsLowLevelCodeOrDefault( lError ) );
 
+            /* Do not offer the same session again in case it caused the failure */
+            if( xSessionOffered )
+            {
+                vInvalidateSession( pxTLSCtx );
+            }
+
             xStatus = TLS_TRANSPORT_HANDSHAKE_FAILED;
         }
         else
         {
-            LogInfo( "Network connection %p: TLS handshake successful.",
-                     pxTLSCtx );
+            TickType_t xElapsed = xTaskGetTickCount() - xHandshakeStart;
+
+            /* A resumed session reuses the master secret of the session that was offered */
+            BaseType_t xResumed = xSessionOffered &&
+                                  ( pxSslCtx->MBEDTLS_PRIVATE( session ) != NULL ) &&
+                                  ( memcmp( pxSslCtx->MBEDTLS_PRIVATE( session )->MBEDTLS_PRIVATE( master ),
+                                            pxTLSCtx->xSavedSession.MBEDTLS_PRIVATE( master ),
+                                            sizeof( pxTLSCtx->xSavedSession.MBEDTLS_PRIVATE( master ) ) ) == 0 );
+
+            vRecordHandshake( xSessionOffered, xResumed, xElapsed );
+
+            LogInfo( "Network connection %p: TLS handshake successful (%s, %lu ms).",
+                     pxTLSCtx, xResumed ? "resumed" : "full",
+                     ( uint32_t ) ( xElapsed * portTICK_PERIOD_MS ) );
+
+            vSaveSession( pxTLSCtx, ulEndpointHash, xResumed );
         }
     }
 
@@ -1375,23 +1794,17 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
         LogInfo( "Network connection %p: Connection to %s:%u established.",
                  pxNetworkContext, pcHostName, usPort );
 
-        if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
-            pxTLSCtx->pxNotifyThreadCtx )
-        {
-            vCreateSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx, pxTLSCtx->xSockHandle );
-        }
-
         pxTLSCtx->xConnectionState = STATE_CONNECTED;
+
+        vAttachRecvCallback( pxTLSCtx );
     }
     else
     {
         /* Clean up on failure. */
-        if( ( pxNetworkContext != NULL ) &&
-            ( pxTLSCtx->xSockHandle >= 0 ) )
+        if( pxNetworkContext != NULL )
         {
             /* Deallocate the open socket. */
-            sock_close( pxTLSCtx->xSockHandle );
-            pxTLSCtx->xSockHandle = -1;
+            vCloseSocket( pxTLSCtx );
         }
 
         /* Reset SSL session context for reconnect attempt */
@@ -1407,54 +1820,39 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
 
 /*-----------------------------------------------------------*/
 
-static inline void vStopSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx )
-{
-    configASSERT( pxNotifyThreadCtx );
-
-    while( ( pxNotifyThreadCtx->xTaskHandle != NULL ) &&
-           ( eTaskGetState( pxNotifyThreadCtx->xTaskHandle ) != eDeleted ) )
-    {
-        ( void ) xTaskNotify( pxNotifyThreadCtx->xTaskHandle, 0xFFFFFFFF, eSetValueWithOverwrite );
-        vTaskDelay( 1 );
-    }
-}
-
-/*-----------------------------------------------------------*/
-
-static void vCreateSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx,
-                                     SockHandle_t xSockHandle )
+static void vAttachRecvCallback( TLSContext_t * pxTLSCtx )
 {
-    TaskHandle_t xTaskHandle = NULL;
-
-    configASSERT_CONTINUE( pxNotifyThreadCtx );
-
-    vStopSocketNotifyTask( pxNotifyThreadCtx );
-
-    if( pxNotifyThreadCtx &&
-        pxNotifyThreadCtx->pxRecvReadyCallback )
+    if( ( pxTLSCtx->pxRecvReadyCallback != NULL ) &&
+        ( pxTLSCtx->xSockHandle >= 0 ) )
     {
-        pxNotifyThreadCtx->xSockHandle = xSockHandle;
-
-        xTaskHandle = xTaskCreateStatic( vSocketNotifyThread,
-                                         "SockNotify",
-                                         128,
-                                         ( void * ) pxNotifyThreadCtx,
-                                         tskIDLE_PRIORITY,
-                                         pxNotifyThreadCtx->puxStackBuffer,
-                                         &( pxNotifyThreadCtx->xTaskBuffer ) );
+        if( sock_set_recv_callback( pxTLSCtx->xSockHandle,
+                                    pxTLSCtx->pxRecvReadyCallback,
+                                    pxTLSCtx->pvRecvReadyCallbackCtx ) != 0 )
+        {
+            LogError( "Failed to register a receive callback for socket %d.",
+                      pxTLSCtx->xSockHandle );
+        }
 
-        pxNotifyThreadCtx->xTaskHandle = xTaskHandle;
+        /* Data may have arrived before the callback was in place */
+        if( ( mbedtls_ssl_get_bytes_avail( &( pxTLSCtx->xSslCtx ) ) > 0 ) ||
+            sock_recv_pending( pxTLSCtx->xSockHandle ) )
+        {
+            pxTLSCtx->pxRecvReadyCallback( pxTLSCtx->pvRecvReadyCallbackCtx );
+        }
     }
 }
+
 /*-----------------------------------------------------------*/
 
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx )
+static void vCloseSocket( TLSContext_t * pxTLSCtx )
 {
-    if( pxNotifyThreadCtx )
+    if( pxTLSCtx->xSockHandle >= 0 )
     {
-        vStopSocketNotifyTask( pxNotifyThreadCtx );
+        /* The callback must not outlive the socket, whose number may be reused */
+        ( void ) sock_set_recv_callback( pxTLSCtx->xSockHandle, NULL, NULL );
 
-        vPortFree( pxNotifyThreadCtx );
+        ( void ) sock_close( pxTLSCtx->xSockHandle );
+        pxTLSCtx->xSockHandle = -1;
     }
 }
 
@@ -1465,7 +1863,6 @@ int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
                                            void * pvCtx )
 {
     TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
-    NotifyThreadCtx_t * pxNotifyThreadCtx = NULL;
     int32_t lError = 0;
 
     if( ( pxTLSCtx == NULL ) ||
@@ -1475,44 +1872,12 @@ int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
     }
     else
     {
-        pxNotifyThreadCtx = pxTLSCtx->pxNotifyThreadCtx;
-    }
-
-    if( pxNotifyThreadCtx == NULL )
-    {
-        pxNotifyThreadCtx = pvPortMalloc( sizeof( NotifyThreadCtx_t ) );
-
-        if( pxNotifyThreadCtx == NULL )
-        {
-            LogError( "Failed to allocate memory for a NotifyThreadCtx_t." );
-            lError = -1;
-        }
-        else
-        {
-            pxTLSCtx->pxNotifyThreadCtx = pxNotifyThreadCtx;
-            pxNotifyThreadCtx->xSockHandle = -1;
-            pxNotifyThreadCtx->xTaskHandle = 0;
-        }
-    }
-    /* Connected and pxNotifyThreadCtx already exists */
-    else if( ( pxTLSCtx->xConnectionState == STATE_CONNECTED ) &&
-             pxNotifyThreadCtx->xTaskHandle )
-    {
-        vStopSocketNotifyTask( pxNotifyThreadCtx );
-    }
-    else
-    {
-        /* Empty */
-    }
-
-    if( lError == 0 )
-    {
-        pxNotifyThreadCtx->pxRecvReadyCallback = pxCallback;
-        pxNotifyThreadCtx->pvRecvReadyCallbackCtx = pvCtx;
+        pxTLSCtx->pxRecvReadyCallback = pxCallback;
+        pxTLSCtx->pvRecvReadyCallbackCtx = pvCtx;
 
         if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
         {
-            vCreateSocketNotifyTask( pxNotifyThreadCtx, pxTLSCtx->xSockHandle );
+            vAttachRecvCallback( pxTLSCtx );
         }
     }
 
@@ -1578,20 +1943,17 @@ void mbedtls_transport_disconnect( NetworkContext_t * pxNetworkContext )
                 }
             }
 
+            LogInfo( "Network connection %p: TLS records sent %lu, plaintext bytes %lu, wire bytes %lu.",
+                     pxNetworkContext,
+                     ( unsigned long ) pxTLSCtx->xTxStats.ulRecords,
+                     ( unsigned long ) pxTLSCtx->xTxStats.ulPlaintextBytes,
+                     ( unsigned long ) pxTLSCtx->xTxStats.ulWireBytes );
+
             pxTLSCtx->xConnectionState = STATE_CONFIGURED;
         }
 
-        if( pxTLSCtx->pxNotifyThreadCtx )
-        {
-            vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
-        }
-
-        if( pxTLSCtx->xSockHandle >= 0 )
-        {
-            /* Call socket close function to deallocate the socket. */
-            sock_close( pxTLSCtx->xSockHandle );
-            pxTLSCtx->xSockHandle = -1;
-        }
+        /* Call socket close function to deallocate the socket. */
+        vCloseSocket( pxTLSCtx );
 
         /* Clear SSL connection context for re-use */
         if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
@@ -1653,16 +2015,7 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
             tlsStatus = -1;
             pxTLSCtx->xConnectionState = STATE_CONFIGURED;
 
-            if( pxTLSCtx->xSockHandle >= 0 )
-            {
-                if( pxTLSCtx->pxNotifyThreadCtx )
-                {
-                    vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
-                }
-
-                sock_close( pxTLSCtx->xSockHandle );
-                pxTLSCtx->xSockHandle = -1;
-            }
+            vCloseSocket( pxTLSCtx );
         }
         else if( tlsStatus < 0 )
         {
@@ -1672,10 +2025,13 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
         }
         else
         {
-            if( pxTLSCtx->pxNotifyThreadCtx &&
-                pxTLSCtx->pxNotifyThreadCtx->xTaskHandle )
+            /* Receive events are edge triggered, so signal again if data remains
+             * buffered in the TLS layer or the socket after this read */
+            if( ( pxTLSCtx->pxRecvReadyCallback != NULL ) &&
+                ( ( mbedtls_ssl_get_bytes_avail( &( pxTLSCtx->xSslCtx ) ) > 0 ) ||
+                  sock_recv_pending( pxTLSCtx->xSockHandle ) ) )
             {
-                ( void ) xTaskNotify( pxTLSCtx->pxNotifyThreadCtx->xTaskHandle, 0x0, eSetValueWithOverwrite );
+                pxTLSCtx->pxRecvReadyCallback( pxTLSCtx->pvRecvReadyCallbackCtx );
             }
         }
     }
@@ -1684,6 +2040,61 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
 }
 /*-----------------------------------------------------------*/
 
+static int32_t lTlsWrite( TLSContext_t * pxTLSCtx,
+                          const void * pvBuffer,
+                          size_t uxBytesToSend )
+{
+    int32_t tlsStatus = 0;
+
+    if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
+    {
+        tlsStatus = ( int32_t ) mbedtls_ssl_write( &( pxTLSCtx->xSslCtx ),
+                                                   pvBuffer,
+                                                   uxBytesToSend );
+    }
+    else
+    {
+        tlsStatus = 0;
+    }
+
+    if( ( tlsStatus == MBEDTLS_ERR_SSL_TIMEOUT ) ||
+        ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ||
+        ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
+    {
+        /* Mark these set of errors as a timeout. The libraries may retry send
+         * on these errors. */
+        tlsStatus = 0;
+    }
+    /* Close the Socket if needed. */
+    else if( ( tlsStatus == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ) ||
+             ( tlsStatus == MBEDTLS_ERR_NET_CONN_RESET ) )
+    {
+        tlsStatus = -1;
+        pxTLSCtx->xConnectionState = STATE_CONFIGURED;
+
+        vCloseSocket( pxTLSCtx );
+    }
+    else if( tlsStatus < 0 )
+    {
+        LogError( "Failed to send data:  Error: %s : %s.",
+                  mbedtlsHighLevelCodeOrDefault( tlsStatus ),
+                  mbedtlsLowLevelCodeOrDefault( tlsStatus ) );
+    }
+    else
+    {
+        /* mbedtls_ssl_write emits at most one record per call */
+        int lExpansion = mbedtls_ssl_get_record_expansion( &( pxTLSCtx->xSslCtx ) );
+
+        pxTLSCtx->xTxStats.ulRecords++;
+        pxTLSCtx->xTxStats.ulPlaintextBytes += ( uint32_t ) tlsStatus;
+        pxTLSCtx->xTxStats.ulWireBytes += ( uint32_t ) tlsStatus + ( uint32_t ) ( ( lExpansion > 0 ) ? lExpansion : 0 );
+    }
+
+    return tlsStatus;
+}
+
+/*-----------------------------------------------------------*/
+
 int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
                                 const void * pBuffer,
                                 size_t uxBytesToSend )
@@ -1708,52 +2119,86 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
     }
     else
     {
-        if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
+        tlsStatus = lTlsWrite( pxTLSCtx, pBuffer, uxBytesToSend );
+    }
+
+    return tlsStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t mbedtls_transport_writev( NetworkContext_t * pxNetworkContext,
+                                  TransportOutVector_t * pxIoVec,
+                                  size_t uxIoVecCount )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    int32_t tlsStatus = 0;
+    size_t uxGatherLen = 0;
+    int lMaxPayload = 0;
+
+    if( pxTLSCtx == NULL )
+    {
+        LogWarn( "mbedtls_transport_writev: pxTLSCtx is NULL" );
+        tlsStatus = -1;
+    }
+    else if( ( pxIoVec == NULL ) || ( uxIoVecCount == 0 ) )
+    {
+        LogWarn( "mbedtls_transport_writev: pxIoVec is NULL or empty" );
+        tlsStatus = -1;
+    }
+    else
+    {
+        lMaxPayload = mbedtls_ssl_get_max_out_record_payload( &( pxTLSCtx->xSslCtx ) );
+
+        /* Limit each record to the negotiated fragment size and the gather buffer */
+        uxGatherLen = MBEDTLS_TRANSPORT_WRITEV_BUFFER_LEN;
+
+        if( ( lMaxPayload > 0 ) && ( ( size_t ) lMaxPayload < uxGatherLen ) )
         {
-            tlsStatus = ( int32_t ) mbedtls_ssl_write( &( pxTLSCtx->xSslCtx ),
-                                                       pBuffer,
-                                                       uxBytesToSend );
+            uxGatherLen = ( size_t ) lMaxPayload;
         }
-        else
+
+        /* Gathering only pays off when the first segment leaves room in the record */
+        if( ( uxIoVecCount > 1 ) &&
+            ( pxIoVec[ 0 ].iov_len < uxGatherLen ) &&
+            ( pxTLSCtx->pucWritevBuffer == NULL ) )
         {
-            tlsStatus = 0;
+            pxTLSCtx->pucWritevBuffer = pvPortMalloc( MBEDTLS_TRANSPORT_WRITEV_BUFFER_LEN );
         }
 
-        if( ( tlsStatus == MBEDTLS_ERR_SSL_TIMEOUT ) ||
-            ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ||
-            ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
+        if( ( uxIoVecCount == 1 ) ||
+            ( pxIoVec[ 0 ].iov_len >= uxGatherLen ) ||
+            ( pxTLSCtx->pucWritevBuffer == NULL ) )
         {
-            /* Mark these set of errors as a timeout. The libraries may retry send
-             * on these errors. */
-            tlsStatus = 0;
+            tlsStatus = mbedtls_transport_send( pxNetworkContext,
+                                                pxIoVec[ 0 ].iov_base,
+                                                pxIoVec[ 0 ].iov_len );
         }
-        /* Close the Socket if needed. */
-        else if( ( tlsStatus == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ) ||
-                 ( tlsStatus == MBEDTLS_ERR_NET_CONN_RESET ) )
+        else
         {
-            tlsStatus = -1;
-            pxTLSCtx->xConnectionState = STATE_CONFIGURED;
+            size_t uxOffset = 0;
 
-            if( pxTLSCtx->xSockHandle >= 0 )
+            /* Copy as many segments as fit, splitting the last one if necessary. Data
+             * not accepted now is passed again by the caller on the next call. */
+            for( size_t uxIdx = 0; ( uxIdx < uxIoVecCount ) && ( uxOffset < uxGatherLen ); uxIdx++ )
             {
-                if( pxTLSCtx->pxNotifyThreadCtx )
+                size_t uxCopyLen = pxIoVec[ uxIdx ].iov_len;
+
+                if( uxCopyLen > ( uxGatherLen - uxOffset ) )
                 {
-                    vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
+                    uxCopyLen = uxGatherLen - uxOffset;
                 }
 
-                sock_close( pxTLSCtx->xSockHandle );
-                pxTLSCtx->xSockHandle = -1;
+                if( uxCopyLen > 0 )
+                {
+                    ( void ) memcpy( &( pxTLSCtx->pucWritevBuffer[ uxOffset ] ),
+                                     pxIoVec[ uxIdx ].iov_base,
+                                     uxCopyLen );
+                    uxOffset += uxCopyLen;
+                }
             }
-        }
-        else if( tlsStatus < 0 )
-        {
-            LogError( "Failed to send data:  Error: %s : %s.",
-                      mbedtlsHighLevelCodeOrDefault( tlsStatus ),
-                      mbedtlsLowLevelCodeOrDefault( tlsStatus ) );
-        }
-        else
-        {
-            /* Empty else marker. */
+
+            tlsStatus = lTlsWrite( pxTLSCtx, pxTLSCtx->pucWritevBuffer, uxOffset );
         }
     }
 
@@ -1762,6 +2207,19 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
 
 /*-----------------------------------------------------------*/
 
+void mbedtls_transport_gettxstats( NetworkContext_t * pxNetworkContext,
+                                   TlsTransportTxStats_t * pxStats )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+
+    configASSERT( pxTLSCtx != NULL );
+    configASSERT( pxStats != NULL );
+
+    *pxStats = pxTLSCtx->xTxStats;
+}
+
+/*-----------------------------------------------------------*/
+
 #ifdef MBEDTLS_DEBUG_C
     static inline const char * pcMbedtlsLevelToFrLevel( int lLevel )
     {
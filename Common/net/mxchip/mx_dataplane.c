@@ -31,6 +31,7 @@
 #include "semphr.h"
 #include "event_groups.h"
 #include "stdbool.h"
+#include <string.h>
 #include "main.h"
 #include "message_buffer.h"
 #include "atomic.h"
@@ -48,6 +49,56 @@
 
 static MxDataplaneCtx_t * volatile pxSpiCtx = NULL;
 
+/* Packets dequeued for the next SPI transaction */
+typedef struct
+{
+    MxTxPacket_t xPackets[ MX_SPI_AGG_MAX_PACKETS ];
+    uint32_t ulNumPackets;
+    uint8_t * pucData;
+    uint16_t usLen;
+    uint8_t ucType;
+    BaseType_t xLatencyRecorded;
+} TxFrame_t;
+
+/* Packets taken from a send queue through the event set, waiting for a transaction */
+#define TX_FIFO_LEN    ( ( CONTROL_PLANE_QUEUE_LEN > DATA_PLANE_QUEUE_LEN ) ? CONTROL_PLANE_QUEUE_LEN : DATA_PLANE_QUEUE_LEN )
+
+typedef struct
+{
+    MxTxPacket_t xItems[ TX_FIFO_LEN ];
+    uint32_t ulHead;
+    uint32_t ulCount;
+} TxFifo_t;
+
+static TxFifo_t xControlPlaneFifo = { 0 };
+static TxFifo_t xDataPlaneFifo = { 0 };
+
+typedef enum
+{
+    DATAPLANE_STATE_IDLE,       /* Nothing to send and the notify pin is low, block on the event set */
+    DATAPLANE_STATE_TRANSACTION /* Packets to send, a retained frame or the notify pin is high */
+} DataplaneState_t;
+
+/* Max size RX buffers posted ahead of incoming frames, filled in [ulHead, ulHead + ulCount) */
+typedef struct
+{
+    PacketBuffer_t * pxBuffers[ MX_RX_RING_LEN ];
+    TickType_t xTakenAt[ MX_RX_RING_LEN ];
+    uint32_t ulHead;
+    uint32_t ulCount;
+} RxRing_t;
+
+static RxRing_t xRxRing = { 0 };
+
+/* Receives frames which could not be given a buffer so that they are dropped cleanly.
+ * Sized for the longest frame accepted by xDoSpiHeaderTransfer. */
+static uint8_t ucRxDiscardBuffer[ MX_MAX_MESSAGE_LEN ] __attribute__( ( aligned( 4 ) ) );
+
+#if MX_SPI_AGGREGATION
+    static uint8_t ucTxFrameBuffer[ MX_MAX_MESSAGE_LEN ] __attribute__( ( aligned( 4 ) ) );
+    static uint8_t ucRxFrameBuffer[ MX_MAX_MESSAGE_LEN ] __attribute__( ( aligned( 4 ) ) );
+#endif
+
 uint32_t prvGetNextRequestID( void )
 {
     uint32_t ulRequestId = 0;
@@ -113,9 +164,9 @@ static void spi_notify_callback( void * pvContext )
 
     if( pxSpiCtx != NULL )
     {
-        vTaskNotifyGiveIndexedFromISR( pxCtx->xDataPlaneTaskHandle,
-                                       DATA_WAITING_IDX,
-                                       &xHigherPriorityTaskWoken );
+        /* The semaphore is a member of the dataplane event set */
+        ( void ) xSemaphoreGiveFromISR( pxCtx->xNotifySemaphore,
+                                        &xHigherPriorityTaskWoken );
 
         portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
     }
@@ -163,8 +214,10 @@ static inline void vDoHardReset( MxDataplaneCtx_t * pxCtx )
 }
 
 /* SPI protocol definitions */
-#define MX_SPI_WRITE    ( 0x0A )
-#define MX_SPI_READ     ( 0x0B )
+#define MX_SPI_WRITE        ( 0x0A )
+#define MX_SPI_READ         ( 0x0B )
+#define MX_SPI_WRITE_AGG    ( 0x0C )
+#define MX_SPI_READ_AGG     ( 0x0D )
 
 static inline BaseType_t xWaitForSPIEvent( TickType_t xTimeout )
 {
@@ -204,15 +257,18 @@ static inline BaseType_t xWaitForSPIEvent( TickType_t xTimeout )
  * @brief Exchange SPIHeader_t headers with the wifi module.
  * */
 static inline BaseType_t xDoSpiHeaderTransfer( MxDataplaneCtx_t * pxCtx,
+                                               uint8_t ucTxType,
                                                uint16_t * psTxLen,
-                                               uint16_t * psRxLen )
+                                               uint16_t * psRxLen,
+                                               BaseType_t * pxRxAggregated )
 {
     HAL_StatusTypeDef xHalStatus = HAL_ERROR;
+    BaseType_t xRxTypeValid = pdFALSE;
 
     SPIHeader_t xRxHeader = { 0 };
     SPIHeader_t xTxHeader = { 0 };
 
-    xTxHeader.type = MX_SPI_WRITE;
+    xTxHeader.type = ucTxType;
     xTxHeader.len = *psTxLen;
     xTxHeader.lenx = ~( xTxHeader.len );
 
@@ -233,16 +289,25 @@ static inline BaseType_t xDoSpiHeaderTransfer( MxDataplaneCtx_t * pxCtx,
         xHalStatus = ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
     }
 
+    #if MX_SPI_AGGREGATION
+        xRxTypeValid = ( xRxHeader.type == MX_SPI_READ ) || ( xRxHeader.type == MX_SPI_READ_AGG );
+    #else
+        xRxTypeValid = ( xRxHeader.type == MX_SPI_READ );
+    #endif
+
+    *pxRxAggregated = pdFALSE;
+
     if( ( xHalStatus == HAL_OK ) &&
         ( xRxHeader.len < MX_MAX_MESSAGE_LEN ) &&
-        ( xRxHeader.type == MX_SPI_READ ) &&
+        ( xRxTypeValid == pdTRUE ) &&
         ( ( ( xRxHeader.len ) ^ ( xRxHeader.lenx ) ) == 0xFFFF ) )
     {
         *psRxLen = xRxHeader.len;
+        *pxRxAggregated = ( xRxHeader.type != MX_SPI_READ );
     }
     else
     {
-        if( ( xRxHeader.type == MX_SPI_READ ) &&
+        if( ( xRxTypeValid == pdTRUE ) &&
             ( xRxHeader.len != 0 ) )
         {
             LogError( "RX header validation failed. len: %d, lenx: %d, xord: %d, type: %d, xHalStatus: %d",
@@ -429,6 +494,316 @@ static void vProcessRxPacket( MessageBufferHandle_t * xControlPlaneResponseBuff,
 }
 
 
+#if MX_SPI_AGGREGATION
+
+/* Split an aggregated frame into one packet buffer per record */
+    static void vProcessRxFrame( MxDataplaneCtx_t * pxCtx,
+                                 const uint8_t * pucFrame,
+                                 uint16_t usFrameLen )
+    {
+        size_t uxOffset = 0;
+
+        while( ( uxOffset + sizeof( SPIAggRecordHeader_t ) ) <= usFrameLen )
+        {
+            SPIAggRecordHeader_t xRecord;
+            PacketBuffer_t * pxRxBuff = NULL;
+
+            ( void ) memcpy( &xRecord, &( pucFrame[ uxOffset ] ), sizeof( SPIAggRecordHeader_t ) );
+
+            if( ( xRecord.usLen < sizeof( IPCHeader_t ) ) ||
+                ( ( uxOffset + MX_SPI_AGG_RECORD_LEN( xRecord.usLen ) ) > usFrameLen ) )
+            {
+                LogError( "Dropping remainder of aggregated frame. Invalid record length: %d at offset: %d",
+                          xRecord.usLen, ( int ) uxOffset );
+                break;
+            }
+
+            pxRxBuff = PBUF_ALLOC_RX( xRecord.usLen );
+
+            if( pxRxBuff == NULL )
+            {
+                LogError( "Failed to allocate a buffer for a packet of %d bytes.", xRecord.usLen );
+            }
+            else
+            {
+                ( void ) pbuf_take( pxRxBuff, &( pucFrame[ uxOffset + sizeof( SPIAggRecordHeader_t ) ] ), xRecord.usLen );
+
+                pxCtx->ulRxPackets++;
+                vProcessRxPacket( pxCtx->xControlPlaneResponseBuff, pxCtx->pxNetif, &pxRxBuff );
+            }
+
+            uxOffset += MX_SPI_AGG_RECORD_LEN( xRecord.usLen );
+        }
+    }
+
+#endif /* MX_SPI_AGGREGATION */
+
+static inline void vTxFifoPush( TxFifo_t * pxFifo,
+                                const MxTxPacket_t * pxPacket )
+{
+    configASSERT( pxFifo->ulCount < TX_FIFO_LEN );
+
+    pxFifo->xItems[ ( pxFifo->ulHead + pxFifo->ulCount ) % TX_FIFO_LEN ] = *pxPacket;
+    pxFifo->ulCount++;
+}
+
+static inline MxTxPacket_t * pxTxFifoPeek( TxFifo_t * pxFifo )
+{
+    return( ( pxFifo->ulCount > 0 ) ? &( pxFifo->xItems[ pxFifo->ulHead ] ) : NULL );
+}
+
+static inline void vTxFifoPop( TxFifo_t * pxFifo )
+{
+    configASSERT( pxFifo->ulCount > 0 );
+
+    pxFifo->ulHead = ( pxFifo->ulHead + 1 ) % TX_FIFO_LEN;
+    pxFifo->ulCount--;
+}
+
+/*
+ * Handle the events pending on the event set, blocking for up to xBlockTime for
+ * the first one. Queued packets are moved to the local fifos. An event is only
+ * selected while both fifos have room so that the member it names can always
+ * be read, as the queue set API requires.
+ */
+static void vHandleEvents( MxDataplaneCtx_t * pxCtx,
+                           TickType_t xBlockTime )
+{
+    QueueSetMemberHandle_t xMember = NULL;
+
+    while( ( xControlPlaneFifo.ulCount < TX_FIFO_LEN ) &&
+           ( xDataPlaneFifo.ulCount < TX_FIFO_LEN ) &&
+           ( ( xMember = xQueueSelectFromSet( pxCtx->xEventSet, xBlockTime ) ) != NULL ) )
+    {
+        MxTxPacket_t xTxPacket = { 0 };
+
+        if( xMember == pxCtx->xNotifySemaphore )
+        {
+            /* The notify pin level is sampled before going idle */
+            ( void ) xSemaphoreTake( pxCtx->xNotifySemaphore, 0 );
+        }
+        else if( xQueueReceive( xMember, &xTxPacket, 0 ) == pdTRUE )
+        {
+            configASSERT( xTxPacket.pxPbuf != NULL );
+            configASSERT( xTxPacket.pxPbuf->ref > 0 );
+
+            if( xMember == pxCtx->xControlPlaneSendQueue )
+            {
+                vTxFifoPush( &xControlPlaneFifo, &xTxPacket );
+            }
+            else
+            {
+                vTxFifoPush( &xDataPlaneFifo, &xTxPacket );
+            }
+        }
+        else
+        {
+            LogError( "Event set member %p was selected while empty.", xMember );
+        }
+
+        xBlockTime = 0;
+    }
+}
+
+/*
+ * Take the packets to send in the next transaction, control plane first.
+ * With MX_SPI_AGGREGATION, packets are added until the frame would exceed
+ * MX_MAX_MESSAGE_LEN and are copied into a single aggregated frame.
+ */
+static void vPrepareTxFrame( TxFrame_t * pxFrame )
+{
+    TxFifo_t * pxFifos[] = { &xControlPlaneFifo, &xDataPlaneFifo };
+    size_t uxAggLen = 0;
+
+    pxFrame->ulNumPackets = 0;
+    pxFrame->pucData = NULL;
+    pxFrame->usLen = 0;
+    pxFrame->ucType = MX_SPI_WRITE;
+    pxFrame->xLatencyRecorded = pdFALSE;
+
+    for( uint32_t ulFifoIdx = 0; ulFifoIdx < ( sizeof( pxFifos ) / sizeof( pxFifos[ 0 ] ) ); ulFifoIdx++ )
+    {
+        MxTxPacket_t * pxTxPacket = NULL;
+
+        while( ( pxFrame->ulNumPackets < MX_SPI_AGG_MAX_PACKETS ) &&
+               ( ( pxTxPacket = pxTxFifoPeek( pxFifos[ ulFifoIdx ] ) ) != NULL ) )
+        {
+            if( ( pxFrame->ulNumPackets > 0 ) &&
+                ( ( uxAggLen + MX_SPI_AGG_RECORD_LEN( pxTxPacket->pxPbuf->tot_len ) ) > MX_MAX_MESSAGE_LEN ) )
+            {
+                break;
+            }
+
+            pxFrame->xPackets[ pxFrame->ulNumPackets ] = *pxTxPacket;
+            pxFrame->ulNumPackets++;
+
+            uxAggLen += MX_SPI_AGG_RECORD_LEN( pxTxPacket->pxPbuf->tot_len );
+
+            vTxFifoPop( pxFifos[ ulFifoIdx ] );
+        }
+    }
+
+    if( pxFrame->ulNumPackets == 1 )
+    {
+        pxFrame->pucData = pxFrame->xPackets[ 0 ].pxPbuf->payload;
+        pxFrame->usLen = pxFrame->xPackets[ 0 ].pxPbuf->tot_len;
+    }
+
+    #if MX_SPI_AGGREGATION
+        else if( pxFrame->ulNumPackets > 1 )
+        {
+            size_t uxOffset = 0;
+
+            for( uint32_t ulIdx = 0; ulIdx < pxFrame->ulNumPackets; ulIdx++ )
+            {
+                PacketBuffer_t * pxTxBuff = pxFrame->xPackets[ ulIdx ].pxPbuf;
+                SPIAggRecordHeader_t xRecord = { 0 };
+                size_t uxRecordLen = MX_SPI_AGG_RECORD_LEN( pxTxBuff->tot_len );
+
+                xRecord.usLen = pxTxBuff->tot_len;
+
+                ( void ) memcpy( &( ucTxFrameBuffer[ uxOffset ] ), &xRecord, sizeof( SPIAggRecordHeader_t ) );
+                ( void ) pbuf_copy_partial( pxTxBuff, &( ucTxFrameBuffer[ uxOffset + sizeof( SPIAggRecordHeader_t ) ] ),
+                                            pxTxBuff->tot_len, 0 );
+
+                /* Zero the padding */
+                ( void ) memset( &( ucTxFrameBuffer[ uxOffset + sizeof( SPIAggRecordHeader_t ) + pxTxBuff->tot_len ] ), 0,
+                                 uxRecordLen - sizeof( SPIAggRecordHeader_t ) - pxTxBuff->tot_len );
+
+                uxOffset += uxRecordLen;
+            }
+
+            configASSERT( uxOffset == uxAggLen );
+
+            pxFrame->pucData = ucTxFrameBuffer;
+            pxFrame->usLen = ( uint16_t ) uxAggLen;
+            pxFrame->ucType = MX_SPI_WRITE_AGG;
+        }
+    #endif /* MX_SPI_AGGREGATION */
+}
+
+/* Account for the time the packets of a frame were queued before their first transaction started */
+static void vRecordTxLatency( MxDataplaneCtx_t * pxCtx,
+                              TxFrame_t * pxFrame )
+{
+    if( pxFrame->xLatencyRecorded == pdFALSE )
+    {
+        uint32_t ulNow = ulGetRunTimeCounter();
+
+        for( uint32_t ulIdx = 0; ulIdx < pxFrame->ulNumPackets; ulIdx++ )
+        {
+            uint32_t ulLatency = ulNow - pxFrame->xPackets[ ulIdx ].ulEnqueuedAt;
+
+            pxCtx->ulTxLatencyCount++;
+            pxCtx->ulTxLatencyTotal += ulLatency;
+
+            if( ulLatency > pxCtx->ulTxLatencyMax )
+            {
+                pxCtx->ulTxLatencyMax = ulLatency;
+            }
+        }
+
+        pxFrame->xLatencyRecorded = pdTRUE;
+    }
+}
+
+/* Release the packets of a frame once it has been handed to the module */
+static void vReleaseTxFrame( TxFrame_t * pxFrame )
+{
+    for( uint32_t ulIdx = 0; ulIdx < pxFrame->ulNumPackets; ulIdx++ )
+    {
+        PacketBuffer_t * pxTxBuff = pxFrame->xPackets[ ulIdx ].pxPbuf;
+
+        /* Free the TX buffer */
+        LogDebug( "Decreasing reference count of pxTxBuff %p from %d to %d", pxTxBuff, pxTxBuff->ref, ( pxTxBuff->ref - 1 ) );
+        PBUF_FREE( pxTxBuff );
+        pxFrame->xPackets[ ulIdx ].pxPbuf = NULL;
+    }
+
+    pxFrame->ulNumPackets = 0;
+    pxFrame->pucData = NULL;
+    pxFrame->usLen = 0;
+}
+
+/* Post new RX buffers in place of the ones handed to the stack. Runs outside of SPI transactions. */
+static void vRxRingRefill( MxDataplaneCtx_t * pxCtx )
+{
+    while( xRxRing.ulCount < MX_RX_RING_LEN )
+    {
+        uint32_t ulSlot = ( xRxRing.ulHead + xRxRing.ulCount ) % MX_RX_RING_LEN;
+        PacketBuffer_t * pxRxBuff = PBUF_ALLOC_RX( MX_RX_BUFF_SZ );
+
+        if( pxRxBuff == NULL )
+        {
+            break;
+        }
+
+        /* Each slot is refilled once after being taken, except during the initial fill */
+        if( xRxRing.xTakenAt[ ulSlot ] != 0 )
+        {
+            uint32_t ulRefillTicks = ( uint32_t ) ( xTaskGetTickCount() - xRxRing.xTakenAt[ ulSlot ] );
+
+            pxCtx->ulRxRingRefills++;
+            pxCtx->ulRxRingRefillTotalTicks += ulRefillTicks;
+
+            if( ulRefillTicks > pxCtx->ulRxRingRefillMaxTicks )
+            {
+                pxCtx->ulRxRingRefillMaxTicks = ulRefillTicks;
+            }
+
+            xRxRing.xTakenAt[ ulSlot ] = 0;
+        }
+
+        xRxRing.pxBuffers[ ulSlot ] = pxRxBuff;
+        xRxRing.ulCount++;
+    }
+
+    pxCtx->ulRxRingDepth = xRxRing.ulCount;
+}
+
+/* Get a buffer for an incoming frame of usRxLen bytes without allocating when possible */
+static PacketBuffer_t * pxRxRingTake( MxDataplaneCtx_t * pxCtx,
+                                      uint16_t usRxLen )
+{
+    PacketBuffer_t * pxRxBuff = NULL;
+
+    if( ( usRxLen <= MX_RX_BUFF_SZ ) &&
+        ( xRxRing.ulCount > 0 ) )
+    {
+        uint32_t ulSlot = xRxRing.ulHead;
+
+        pxRxBuff = xRxRing.pxBuffers[ ulSlot ];
+        xRxRing.pxBuffers[ ulSlot ] = NULL;
+        xRxRing.xTakenAt[ ulSlot ] = xTaskGetTickCount();
+
+        /* A tick count of 0 marks a slot which was never taken */
+        if( xRxRing.xTakenAt[ ulSlot ] == 0 )
+        {
+            xRxRing.xTakenAt[ ulSlot ] = 1;
+        }
+
+        xRxRing.ulHead = ( ulSlot + 1 ) % MX_RX_RING_LEN;
+        xRxRing.ulCount--;
+
+        /* Trim the buffer to the frame length. A pool pbuf keeps its payload in place. */
+        pbuf_realloc( pxRxBuff, usRxLen );
+    }
+    else
+    {
+        pxCtx->ulRxRingMisses++;
+        pxRxBuff = PBUF_ALLOC_RX( usRxLen );
+    }
+
+    pxCtx->ulRxRingDepth = xRxRing.ulCount;
+
+    if( xRxRing.ulCount < pxCtx->ulRxRingMinDepth )
+    {
+        pxCtx->ulRxRingMinDepth = xRxRing.ulCount;
+    }
+
+    return pxRxBuff;
+}
+
 void vInitCallbacks( MxDataplaneCtx_t * pxCtx )
 {
     HAL_StatusTypeDef xHalResult = HAL_ERROR;
@@ -486,183 +861,223 @@ static inline BaseType_t xWaitForFlow( MxDataplaneCtx_t * pxCtx )
     return( ( BaseType_t ) ( ulFlowValue != 0 ) );
 }
 
-void vDataplaneThread( void * pvParameters )
+/*
+ * Run a single SPI transaction: announce the pending TX frame if any, then
+ * exchange data with the module. A frame which could not be announced is kept
+ * in pxTxFrame to be retried by the next transaction.
+ */
+static void vDoTransaction( MxDataplaneCtx_t * pxCtx,
+                            TxFrame_t * pxTxFrame )
 {
-    /* Get context struct (contains instance parameters) */
-    MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvParameters;
-
-    BaseType_t exitFlag = pdFALSE;
-
-    /* Export context for callbacks */
-    pxSpiCtx = pxCtx;
+    PacketBuffer_t * pxRxBuff = NULL;
+    uint8_t * pucRxData = NULL;
+    uint16_t usRxLen = 0;
+    BaseType_t xRxAggregated = pdFALSE;
 
-    vInitCallbacks( pxCtx );
+    /* Clear flow state */
+    xTaskNotifyStateClearIndexed( NULL, SPI_EVT_FLOW_IDX );
 
-    /* set CS/NSS high */
-    vGpioSet( pxCtx->gpio_nss );
+    /* Set CS low to initiate transaction */
+    vGpioClear( pxCtx->gpio_nss );
 
-    /* Do hardware reset */
-    vDoHardReset( pxCtx );
+    BaseType_t xResult = pdTRUE;
 
-    while( exitFlag == pdFALSE )
+    /* Wait for the module to be ready */
+    if( xWaitForFlow( pxCtx ) == pdTRUE )
     {
-        PacketBuffer_t * pxTxBuff = NULL;
-        PacketBuffer_t * pxRxBuff = NULL;
+        uint16_t usTxLen = 0;
 
-        if( pxCtx->ulTxPacketsWaiting == 0 )
+        /* Prepare control plane and data plane messages for TX */
+        if( pxTxFrame->ulNumPackets == 0 )
         {
-            LogDebug( "Starting wait for DATA_WAITING_IDX event" );
-            ulTaskNotifyTakeIndexed( DATA_WAITING_IDX,
-                                     pdFALSE,
-                                     500 );
+            vPrepareTxFrame( pxTxFrame );
         }
 
-        /* Skip this transaction if IRQ pin is low and there are no pending tx packets */
-        if( ( xGpioGet( pxCtx->gpio_notify ) == pdFALSE ) &&
-            ( pxCtx->ulTxPacketsWaiting == 0 ) )
-        {
-            continue;
-        }
+        vRecordTxLatency( pxCtx, pxTxFrame );
 
-        /* Clear flow state */
-        xTaskNotifyStateClearIndexed( NULL, SPI_EVT_FLOW_IDX );
+        usTxLen = pxTxFrame->usLen;
 
-        /* Set CS low to initiate transaction */
-        vGpioClear( pxCtx->gpio_nss );
+        /* Transfer the header */
+        xResult = xDoSpiHeaderTransfer( pxCtx, pxTxFrame->ucType, &usTxLen, &usRxLen, &xRxAggregated );
 
-        BaseType_t xResult = pdTRUE;
-
-        /* Wait for the module to be ready */
-        if( xWaitForFlow( pxCtx ) == pdTRUE )
+        if( xResult == pdTRUE )
         {
-            uint16_t usTxLen = 0;
-            uint16_t usRxLen = 0;
-
-            QueueHandle_t xSourceQueue = NULL;
+            pxCtx->ulSpiTransactions++;
 
-            /* Prepare a control plane messages for TX */
-            if( xQueuePeek( pxCtx->xControlPlaneSendQueue, &pxTxBuff, 0 ) == pdTRUE )
+            /* Allocate RX buffer */
+            if( usRxLen > 0 )
             {
-                configASSERT( pxTxBuff != NULL );
-                configASSERT( pxTxBuff->ref > 0 );
-                usTxLen = pxTxBuff->tot_len;
-                xSourceQueue = pxCtx->xControlPlaneSendQueue;
-                LogDebug( "Preparing controlplane message for transmission" );
+                #if MX_SPI_AGGREGATION
+                    if( xRxAggregated == pdTRUE )
+                    {
+                        pucRxData = ucRxFrameBuffer;
+                    }
+                    else
+                #endif
+                {
+                    pxRxBuff = pxRxRingTake( pxCtx, usRxLen );
+
+                    if( pxRxBuff != NULL )
+                    {
+                        pucRxData = pxRxBuff->payload;
+                    }
+                    else
+                    {
+                        pucRxData = ucRxDiscardBuffer;
+                    }
+                }
             }
-            else if( xQueuePeek( pxCtx->xDataPlaneSendQueue, &pxTxBuff, 0 ) == pdTRUE )
+
+            /* Wait for flow pin to go high */
+            xResult = xWaitForFlow( pxCtx );
+        }
+
+        /* The frame has been committed once the module is ready for the data */
+        if( ( xResult == pdTRUE ) &&
+            ( pxTxFrame->ulNumPackets > 0 ) )
+        {
+            uint8_t * pucTxData = pxTxFrame->pucData;
+            uint32_t ulTxPackets = pxTxFrame->ulNumPackets;
+
+            /* Transmit / receive packet data */
+            if( ( usTxLen > 0 ) &&
+                ( usRxLen == 0 ) )
             {
-                configASSERT( pxTxBuff != NULL );
-                configASSERT( pxTxBuff->ref > 0 );
-                usTxLen = pxTxBuff->tot_len;
-                xSourceQueue = pxCtx->xDataPlaneSendQueue;
-                LogDebug( "Preparing dataplane message for transmission" );
+                xResult = xTransmitMessage( pxCtx, pucTxData, usTxLen );
             }
-            else
+            else if( ( usRxLen > 0 ) &&
+                     ( usTxLen > 0 ) )
             {
-                /* Empty, no TX packets */
-            }
+                configASSERT( pucRxData );
 
-            if( ( pxTxBuff == NULL ) &&
-                ( pxCtx->ulTxPacketsWaiting != 0 ) )
+                xResult = xTransmitReceiveMessage( pxCtx,
+                                                   pucTxData,
+                                                   usTxLen,
+                                                   pucRxData,
+                                                   usRxLen );
+            }
+            else if( usRxLen > 0 )
             {
-                LogWarn( "Mismatch between ulTxPacketsWaiting and queue contents. Resetting ulTxPacketsWaiting" );
-                pxSpiCtx->ulTxPacketsWaiting = 0;
+                configASSERT( pucRxData );
+                xResult = xReceiveMessage( pxCtx, pucRxData, usRxLen );
             }
 
-            if( xResult == pdTRUE )
+            if( usTxLen > 0 )
             {
-                /* Transfer the header */
-                xResult = xDoSpiHeaderTransfer( pxCtx, &usTxLen, &usRxLen );
+                pxCtx->ulTxPackets += ulTxPackets;
+                pxCtx->ulTxBytes += usTxLen;
             }
 
-            if( xResult == pdTRUE )
-            {
-                /* Allocate RX buffer */
-                if( usRxLen > 0 )
-                {
-                    pxRxBuff = PBUF_ALLOC_RX( usRxLen );
-                }
+            vReleaseTxFrame( pxTxFrame );
+        }
+        else if( ( xResult == pdTRUE ) &&
+                 ( usRxLen > 0 ) )
+        {
+            configASSERT( pucRxData );
+            xResult = xReceiveMessage( pxCtx, pucRxData, usRxLen );
+        }
+    }
+    else
+    {
+        LogDebug( "Timed out while waiting for flow event." );
+        xResult = pdFALSE;
+    }
 
-                /* Wait for flow pin to go high */
-                xResult = xWaitForFlow( pxCtx );
-            }
+    /* Set CS / NSS high (idle) */
+    vGpioSet( pxCtx->gpio_nss );
 
-            /* Read from the queue */
-            if( ( xResult == pdTRUE ) &&
-                ( xSourceQueue != NULL ) )
-            {
-                xResult = xQueueReceive( xSourceQueue, &pxTxBuff, 0 );
-                configASSERT( pxTxBuff != NULL );
-                configASSERT( xResult == pdTRUE );
-            }
-            else if( pxTxBuff != NULL )
-            {
-                pxTxBuff = NULL;
-            }
+    if( ( xResult == pdTRUE ) &&
+        ( pucRxData == ucRxDiscardBuffer ) )
+    {
+        pxCtx->ulRxDrops++;
+        LogWarn( "Dropped a received frame of %d bytes. No RX buffer available.", usRxLen );
+    }
+    else if( ( xResult == pdTRUE ) &&
+             ( usRxLen > 0 ) )
+    {
+        pxCtx->ulRxBytes += usRxLen;
 
-            /* Transmit / receive packet data */
-            if( xResult == pdTRUE )
+        #if MX_SPI_AGGREGATION
+            if( xRxAggregated == pdTRUE )
             {
-                /* Transmit case */
-                if( ( usTxLen > 0 ) &&
-                    ( usRxLen == 0 ) )
-                {
-                    configASSERT( pxTxBuff );
-                    xResult = xTransmitMessage( pxCtx, pxTxBuff->payload, usTxLen );
-                }
-                else if( ( usRxLen > 0 ) &&
-                         ( usTxLen == 0 ) )
-                {
-                    configASSERT( pxRxBuff );
-                    xResult = xReceiveMessage( pxCtx, pxRxBuff->payload, usRxLen );
-                }
-                else if( ( usRxLen > 0 ) &&
-                         ( usTxLen > 0 ) )
-                {
-                    configASSERT( pxRxBuff );
-                    configASSERT( pxTxBuff );
-
-                    xResult = xTransmitReceiveMessage( pxCtx,
-                                                       pxTxBuff->payload,
-                                                       usTxLen,
-                                                       pxRxBuff->payload,
-                                                       usRxLen );
-                }
+                vProcessRxFrame( pxCtx, ucRxFrameBuffer, usRxLen );
             }
-        }
-        else
+            else
+        #endif
         {
-            LogDebug( "Timed out while waiting for flow event." );
-            xResult = pdFALSE;
+            pxCtx->ulRxPackets++;
+            vProcessRxPacket( pxCtx->xControlPlaneResponseBuff, pxCtx->pxNetif, &pxRxBuff );
         }
+    }
+
+    if( pxRxBuff != NULL )
+    {
+        LogDebug( "Decreasing reference count of pxRxBuff %p from %d to %d", pxRxBuff, pxRxBuff->ref, ( pxRxBuff->ref - 1 ) );
+        PBUF_FREE( pxRxBuff );
+        pxRxBuff = NULL;
+    }
+
+    configASSERT( pxRxBuff == NULL );
+}
+
+void vDataplaneThread( void * pvParameters )
+{
+    /* Get context struct (contains instance parameters) */
+    MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvParameters;
+
+    BaseType_t exitFlag = pdFALSE;
+
+    /* Export context for callbacks */
+    pxSpiCtx = pxCtx;
+
+    vInitCallbacks( pxCtx );
 
-        /* Set CS / NSS high (idle) */
-        vGpioSet( pxCtx->gpio_nss );
+    /* set CS/NSS high */
+    vGpioSet( pxCtx->gpio_nss );
+
+    /* Do hardware reset */
+    vDoHardReset( pxCtx );
+
+    vRxRingRefill( pxCtx );
+    pxCtx->ulRxRingMinDepth = xRxRing.ulCount;
+
+    /* A frame which could not be announced to the module is retried in the next transaction */
+    TxFrame_t xTxFrame = { 0 };
+
+    DataplaneState_t xState = DATAPLANE_STATE_TRANSACTION;
 
-        if( pxTxBuff != NULL )
+    while( exitFlag == pdFALSE )
+    {
+        switch( xState )
         {
-            /* Decrement TX packets waiting counter */
-            ( void ) Atomic_Decrement_u32( &( pxSpiCtx->ulTxPacketsWaiting ) );
+            case DATAPLANE_STATE_IDLE:
+                /* Block until a packet is queued or the notify pin rises */
+                LogDebug( "Waiting for dataplane events." );
+                vHandleEvents( pxCtx, portMAX_DELAY );
+                break;
+
+            case DATAPLANE_STATE_TRANSACTION:
+            default:
+                /* Collect the packets queued in the meantime so that they can share this transaction */
+                vHandleEvents( pxCtx, 0 );
+
+                vDoTransaction( pxCtx, &xTxFrame );
 
-            /* Free the TX buffer */
-            LogDebug( "Decreasing reference count of pxTxBuff %p from %d to %d", pxTxBuff, pxTxBuff->ref, ( pxTxBuff->ref - 1 ) );
-            PBUF_FREE( pxTxBuff );
-            pxTxBuff = NULL;
+                vRxRingRefill( pxCtx );
+                break;
         }
 
-        if( ( xResult == pdTRUE ) &&
-            ( pxRxBuff != NULL ) )
+        /* Stay in the transaction state while there is data to move in either direction */
+        if( ( xTxFrame.ulNumPackets > 0 ) ||
+            ( xControlPlaneFifo.ulCount > 0 ) ||
+            ( xDataPlaneFifo.ulCount > 0 ) ||
+            ( xGpioGet( pxCtx->gpio_notify ) == pdTRUE ) )
         {
-            vProcessRxPacket( pxCtx->xControlPlaneResponseBuff, pxCtx->pxNetif, &pxRxBuff );
+            xState = DATAPLANE_STATE_TRANSACTION;
         }
-        else if( pxRxBuff != NULL )
+        else
         {
-            LogDebug( "Decreasing reference count of pxRxBuff %p from %d to %d", pxRxBuff, pxRxBuff->ref, ( pxRxBuff->ref - 1 ) );
-            PBUF_FREE( pxRxBuff );
-            pxRxBuff = NULL;
+            xState = DATAPLANE_STATE_IDLE;
         }
-
-        configASSERT( pxTxBuff == NULL );
-        configASSERT( pxRxBuff == NULL );
     }
 }
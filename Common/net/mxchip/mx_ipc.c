@@ -32,7 +32,6 @@
 #include "message_buffer.h"
 #include "netif/ethernet.h"
 #include "string.h"
-#include "atomic.h"
 #include "lwip/pbuf.h"
 #include "mx_prv.h"
 
@@ -96,6 +95,35 @@ static void vClearCtx( IPCRequestCtx_t * pxRequestCtx )
     }
 }
 
+/*
+ * Request IDs carry the index of their context in the low bits so that a
+ * response can be matched to its context without searching.
+ */
+static inline uint32_t ulMakeRequestID( uint32_t ulCtxIdx )
+{
+    uint32_t ulRequestId = ( prvGetNextRequestID() * NUM_IPC_REQUEST_CTX ) + ulCtxIdx;
+
+    /* Request ID 0 is reserved for events */
+    if( ulRequestId == 0 )
+    {
+        ulRequestId = NUM_IPC_REQUEST_CTX;
+    }
+
+    return ulRequestId;
+}
+
+static inline IPCRequestCtx_t * pxLookupCtx( uint32_t ulRequestId )
+{
+    IPCRequestCtx_t * pxRequestCtx = &( xIPCRequestCtxArray[ ulRequestId % NUM_IPC_REQUEST_CTX ] );
+
+    if( pxRequestCtx->ulRequestID != ulRequestId )
+    {
+        pxRequestCtx = NULL;
+    }
+
+    return pxRequestCtx;
+}
+
 static IPCRequestCtx_t * pxFindAvailableCtx( TickType_t xTimeout,
                                              BaseType_t xPbufLen )
 {
@@ -107,54 +135,64 @@ static IPCRequestCtx_t * pxFindAvailableCtx( TickType_t xTimeout,
     /* Wait for a context to become available, then take a token from xContextCountSemaphore */
     xResult = xSemaphoreTake( xContextCountSemaphore, xTimeout );
 
-    configASSERT( xResult == pdTRUE );
-
-    configASSERT( xContextArrayMutex != NULL );
+    if( xResult != pdTRUE )
+    {
+        LogError( "Timed out while waiting for an available IPCRequestCtx." );
+    }
+    else
+    {
+        configASSERT( xContextArrayMutex != NULL );
 
-    xResult = xSemaphoreTake( xContextArrayMutex, xTimeout );
+        xResult = xSemaphoreTake( xContextArrayMutex, xTimeout );
 
-    if( xResult == pdTRUE )
-    {
-        for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
+        if( xResult == pdTRUE )
         {
-            if( xIPCRequestCtxArray[ i ].ulRequestID == 0 )
+            for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
             {
-                xIPCRequestCtxArray[ i ].ulRequestID = prvGetNextRequestID();
+                if( xIPCRequestCtxArray[ i ].ulRequestID == 0 )
+                {
+                    xIPCRequestCtxArray[ i ].ulRequestID = ulMakeRequestID( i );
 
-                pxRequestCtx = &( xIPCRequestCtxArray[ i ] );
+                    pxRequestCtx = &( xIPCRequestCtxArray[ i ] );
 
-                if( pxRequestCtx->pxRxPbuf != NULL )
-                {
-                    PBUF_FREE( pxRequestCtx->pxRxPbuf );
-                    LogWarn( "pxRxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
-                }
+                    if( pxRequestCtx->pxRxPbuf != NULL )
+                    {
+                        PBUF_FREE( pxRequestCtx->pxRxPbuf );
+                        LogWarn( "pxRxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
+                    }
 
-                if( pxRequestCtx->pxTxPbuf != NULL )
-                {
-                    PBUF_FREE( pxRequestCtx->pxTxPbuf );
-                    LogWarn( "pxTxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
-                }
+                    if( pxRequestCtx->pxTxPbuf != NULL )
+                    {
+                        PBUF_FREE( pxRequestCtx->pxTxPbuf );
+                        LogWarn( "pxTxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
+                    }
 
-                if( pxRequestCtx->xWaitingTask != NULL )
-                {
-                    pxRequestCtx->xWaitingTask = NULL;
-                    LogWarn( "xWaitingTask for IPCRequestCtx %d was non-null upon re-use.", i );
-                }
+                    if( pxRequestCtx->xWaitingTask != NULL )
+                    {
+                        pxRequestCtx->xWaitingTask = NULL;
+                        LogWarn( "xWaitingTask for IPCRequestCtx %d was non-null upon re-use.", i );
+                    }
 
-                /* Allocate a tx pbuf */
-                pxRequestCtx->pxTxPbuf = PBUF_ALLOC_TX( xPbufLen );
-/*                LogDebug( "Allocated pbuf: %p length: %d ref: %d",  pxRequestCtx->pxTxPbuf, pxRequestCtx->pxRxPbuf->tot_len, pxRequestCtx->pxRxPbuf->ref ); */
-                break;
+                    /* Allocate a tx pbuf */
+                    pxRequestCtx->pxTxPbuf = PBUF_ALLOC_TX( xPbufLen );
+                    break;
+                }
             }
-        }
 
-        xResult = xSemaphoreGive( xContextArrayMutex );
+            xResult = xSemaphoreGive( xContextArrayMutex );
 
-        configASSERT( xResult == pdTRUE );
-    }
-    else
-    {
-        LogError( "Timed out while acquiring xContextArrayMutex." );
+            configASSERT( xResult == pdTRUE );
+        }
+        else
+        {
+            LogError( "Timed out while acquiring xContextArrayMutex." );
+        }
+
+        /* Return the token if no context could be claimed */
+        if( pxRequestCtx == NULL )
+        {
+            ( void ) xSemaphoreGive( xContextCountSemaphore );
+        }
     }
 
     return pxRequestCtx;
@@ -167,6 +205,7 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
                                    TickType_t xTimeout )
 {
     IPCError_t xReturnValue = IPC_SUCCESS;
+    TimeOut_t xTimeOut;
 
     /* Validate inputs */
     configASSERT( pxTxPkt != NULL );
@@ -179,22 +218,33 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
     BaseType_t ulTxPacketLen = sizeof( IPCHeader_t ) + ulTxPacketDataLen;
     BaseType_t xResult = pdFALSE;
 
+    /* xTimeout covers the whole request, including the wait for a free context */
+    vTaskSetTimeOutState( &xTimeOut );
+
     /* Allocate a request context */
     IPCRequestCtx_t * pxRequestCtx = pxFindAvailableCtx( xTimeout, ulTxPacketLen );
 
-    LogDebug( "Sending IPC packet with request_id: %d, api_id: %d, pktdatalen: %d, total_len: %d",
-              pxRequestCtx->ulRequestID, pxTxPkt->xHeader.usIPCApiId, ulTxPacketDataLen, ulTxPacketLen );
-
     if( pxRequestCtx == NULL )
     {
         LogError( "Timed out while finding a request context." );
         xReturnValue = IPC_ERROR_INTERNAL;
     }
+    else if( pxRequestCtx->pxTxPbuf == NULL )
+    {
+        LogError( "Failed to allocate a buffer for request id=%d", pxRequestCtx->ulRequestID );
+        xReturnValue = IPC_ERROR_INTERNAL;
+    }
     else
     {
+        LogDebug( "Sending IPC packet with request_id: %d, api_id: %d, pktdatalen: %d, total_len: %d",
+                  pxRequestCtx->ulRequestID, pxTxPkt->xHeader.usIPCApiId, ulTxPacketDataLen, ulTxPacketLen );
+
         /* Set request ID */
         pxTxPkt->xHeader.ulIPCRequestId = pxRequestCtx->ulRequestID;
 
+        /* Discard any response notification left over from an earlier request which timed out */
+        ( void ) xTaskNotifyStateClearIndexed( NULL, IPC_RESPONSE_IDX );
+
         /* Set task handle */
         pxRequestCtx->xWaitingTask = xTaskGetCurrentTaskHandle();
 
@@ -203,13 +253,18 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
 
         configASSERT( pxControlPlaneCtx->xControlPlaneSendQueue != NULL );
 
-        /* Send to dataplane thread for transmission */
+        MxTxPacket_t xTxPacket = { 0 };
+
+        xTxPacket.pxPbuf = pxRequestCtx->pxTxPbuf;
+        xTxPacket.ulEnqueuedAt = ulGetRunTimeCounter();
+
+        ( void ) xTaskCheckForTimeOut( &xTimeOut, &xTimeout );
+
+        /* Send to dataplane thread for transmission, which is woken through its queue set */
         xResult = xQueueSend( pxControlPlaneCtx->xControlPlaneSendQueue,
-                              &( pxRequestCtx->pxTxPbuf ),
+                              &xTxPacket,
                               xTimeout );
 
-        Atomic_Increment_u32( pxControlPlaneCtx->pulTxPacketsWaiting );
-
         if( xResult != pdTRUE )
         {
             LogError( "Error when sending message with request id=%d", pxRequestCtx->ulRequestID );
@@ -219,11 +274,6 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
         {
             /* Clear the pointer. Reference is now owned by the queue. */
             pxRequestCtx->pxTxPbuf = NULL;
-
-            configASSERT( pxControlPlaneCtx->xDataPlaneTaskHandle != NULL );
-
-            /* Notify dataplane thread of a waiting message */
-            xTaskNotifyGiveIndexed( pxControlPlaneCtx->xDataPlaneTaskHandle, DATA_WAITING_IDX );
         }
     }
 
@@ -232,19 +282,28 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
     /* If the message was sent successfully, wait for a task notification */
     if( xResult == pdTRUE )
     {
+        ( void ) xTaskCheckForTimeOut( &xTimeOut, &xTimeout );
+
         /* Wait for notification */
-        xResult = xTaskNotifyWait( 0, 0, NULL, xTimeout );
+        xResult = xTaskNotifyWaitIndexed( IPC_RESPONSE_IDX, 0, 0, NULL, xTimeout );
 
-        if( xResult == pdTRUE )
+        /* Hold the mutex so that the router cannot deliver a response concurrently */
+        ( void ) xSemaphoreTake( xContextArrayMutex, portMAX_DELAY );
+
+        if( ( xResult == pdTRUE ) &&
+            ( pxRequestCtx->pxRxPbuf != NULL ) )
         {
             pxResponsePacket = ( IPCPacket_t * ) pxRequestCtx->pxRxPbuf->payload;
         }
         else
         {
+            LogError( "Timed out while waiting for a response to request id=%d", pxRequestCtx->ulRequestID );
             xReturnValue = IPC_TIMEOUT;
         }
 
         pxRequestCtx->xWaitingTask = NULL;
+
+        ( void ) xSemaphoreGive( xContextArrayMutex );
     }
 
     if( ( pxResponsePacket != NULL ) &&
@@ -561,16 +620,7 @@ void prvControlPlaneRouter( void * pvParameters )
 
                 configASSERT( xResult == pdTRUE );
 
-                IPCRequestCtx_t * pxTargetCtx = NULL;
-
-                for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
-                {
-                    if( xIPCRequestCtxArray[ i ].ulRequestID == pxRxPacket->xHeader.ulIPCRequestId )
-                    {
-                        pxTargetCtx = &xIPCRequestCtxArray[ i ];
-                        break;
-                    }
-                }
+                IPCRequestCtx_t * pxTargetCtx = pxLookupCtx( pxRxPacket->xHeader.ulIPCRequestId );
 
                 /* Send packet to waiting thread */
                 if( ( pxTargetCtx != NULL ) &&
@@ -579,7 +629,7 @@ void prvControlPlaneRouter( void * pvParameters )
                 {
                     LogDebug( "Notifying waiting task %d of RX packet.", pxTargetCtx->xWaitingTask );
                     pxTargetCtx->pxRxPbuf = pxRxPbuf;
-                    xResult = xTaskNotify( pxTargetCtx->xWaitingTask, 0, eNoAction );
+                    xResult = xTaskNotifyIndexed( pxTargetCtx->xWaitingTask, IPC_RESPONSE_IDX, 0, eNoAction );
 
                     if( xResult == pdTRUE )
                     {
@@ -28,7 +28,6 @@
 #include "mx_lwip.h"
 
 #include "FreeRTOS.h"
-#include "atomic.h"
 #include "mx_prv.h"
 
 static void vAddMXHeaderToEthernetFrame( PacketBuffer_t * pxTxPacket )
@@ -158,14 +157,19 @@ err_t prvxLinkOutput( NetInterface_t * pxNetif,
     }
 
     configASSERT( pxCtx->xDataPlaneSendQueue != NULL );
-    configASSERT( pxCtx->pulTxPacketsWaiting != NULL );
-    configASSERT( pxCtx->xDataPlaneTaskHandle != NULL );
 
     if( xError == ERR_OK )
     {
+        MxTxPacket_t xTxPacket = { 0 };
+
         configASSERT( pxPbufToSend != NULL );
+
+        xTxPacket.pxPbuf = pxPbufToSend;
+        xTxPacket.ulEnqueuedAt = ulGetRunTimeCounter();
+
+        /* The dataplane thread is woken through its queue set */
         xReturn = xQueueSend( pxCtx->xDataPlaneSendQueue,
-                              &pxPbufToSend,
+                              &xTxPacket,
                               MX_ETH_PACKET_ENQUEUE_TIMEOUT );
 
         if( xReturn == pdTRUE )
@@ -173,10 +177,6 @@ err_t prvxLinkOutput( NetInterface_t * pxNetif,
             xError = ERR_OK;
             LogDebug( "Packet enqueued into xDataPlaneSendQueue addr: %p, len: %d, refs: %d, remaining space: %d",
                       pxPbufToSend, pxPbufToSend->tot_len, pxPbufToSend->ref, uxQueueSpacesAvailable( pxCtx->xDataPlaneSendQueue ) );
-
-            ( void ) Atomic_Increment_u32( pxCtx->pulTxPacketsWaiting );
-
-            ( void ) xTaskNotifyGiveIndexed( pxCtx->xDataPlaneTaskHandle, DATA_WAITING_IDX );
         }
         else
         {
@@ -29,6 +29,7 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_DEBUG
+#define LOG_MODULE   mx_netconn
 #include "logging.h"
 
 #include "main.h"
@@ -238,6 +239,28 @@ BaseType_t net_request_reconnect( void )
     return xReturn;
 }
 
+void net_get_dataplane_stats( MxDataplaneStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    /* Counters are updated by the dataplane task, each one is read atomically */
+    pxStats->ulRxRingDepth = xDataPlaneCtx.ulRxRingDepth;
+    pxStats->ulRxRingMinDepth = xDataPlaneCtx.ulRxRingMinDepth;
+    pxStats->ulRxRingMisses = xDataPlaneCtx.ulRxRingMisses;
+    pxStats->ulRxRingRefills = xDataPlaneCtx.ulRxRingRefills;
+    pxStats->ulRxRingRefillMaxTicks = xDataPlaneCtx.ulRxRingRefillMaxTicks;
+    pxStats->ulRxRingRefillTotalTicks = xDataPlaneCtx.ulRxRingRefillTotalTicks;
+    pxStats->ulRxDrops = xDataPlaneCtx.ulRxDrops;
+    pxStats->ulTxLatencyCount = xDataPlaneCtx.ulTxLatencyCount;
+    pxStats->ulTxLatencyTotal = xDataPlaneCtx.ulTxLatencyTotal;
+    pxStats->ulTxLatencyMax = xDataPlaneCtx.ulTxLatencyMax;
+    pxStats->ulSpiTransactions = xDataPlaneCtx.ulSpiTransactions;
+    pxStats->ulTxPackets = xDataPlaneCtx.ulTxPackets;
+    pxStats->ulTxBytes = xDataPlaneCtx.ulTxBytes;
+    pxStats->ulRxPackets = xDataPlaneCtx.ulRxPackets;
+    pxStats->ulRxBytes = xDataPlaneCtx.ulRxBytes;
+}
+
 /*
  * Handles network interface state change notifications from the control plane.
  */
@@ -362,15 +385,26 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
     QueueHandle_t xDataPlaneSendQueue;
 
     /* Construct queues */
-    xDataPlaneSendQueue = xQueueCreate( DATA_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
+    xDataPlaneSendQueue = xQueueCreate( DATA_PLANE_QUEUE_LEN, sizeof( MxTxPacket_t ) );
     configASSERT( xDataPlaneSendQueue != NULL );
 
     xControlPlaneResponseBuff = xMessageBufferCreate( CONTROL_PLANE_BUFFER_SZ );
     configASSERT( xControlPlaneResponseBuff != NULL );
 
-    xControlPlaneSendQueue = xQueueCreate( CONTROL_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
+    xControlPlaneSendQueue = xQueueCreate( CONTROL_PLANE_QUEUE_LEN, sizeof( MxTxPacket_t ) );
     configASSERT( xControlPlaneSendQueue != NULL );
 
+    /* Queues must be added to the set while they are still empty */
+    xDataPlaneCtx.xNotifySemaphore = xSemaphoreCreateBinary();
+    configASSERT( xDataPlaneCtx.xNotifySemaphore != NULL );
+
+    xDataPlaneCtx.xEventSet = xQueueCreateSet( DATAPLANE_EVENT_SET_LEN );
+    configASSERT( xDataPlaneCtx.xEventSet != NULL );
+
+    ( void ) xQueueAddToSet( xControlPlaneSendQueue, xDataPlaneCtx.xEventSet );
+    ( void ) xQueueAddToSet( xDataPlaneSendQueue, xDataPlaneCtx.xEventSet );
+    ( void ) xQueueAddToSet( xDataPlaneCtx.xNotifySemaphore, xDataPlaneCtx.xEventSet );
+
 
     /* Initialize wifi connect context */
     pxCtx->xStatus = MX_STATUS_NONE;
@@ -379,7 +413,6 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
     ( void ) memset( &( pxCtx->xMacAddress ), 0, sizeof( MacAddress_t ) );
 
     pxCtx->xDataPlaneSendQueue = xDataPlaneSendQueue;
-    pxCtx->pulTxPacketsWaiting = &( xDataPlaneCtx.ulTxPacketsWaiting );
     pxCtx->xNetTaskHandle = xTaskGetCurrentTaskHandle();
 
     /* Construct dataplane context */
@@ -392,9 +425,6 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
 
     xDataPlaneCtx.pxSpiHandle = pxHndlSpi2;
 
-    /* Initialize waiting packet counters */
-    xDataPlaneCtx.ulTxPacketsWaiting = 0;
-
     /* Set queue handles */
     xDataPlaneCtx.xControlPlaneSendQueue = xControlPlaneSendQueue;
     xDataPlaneCtx.xControlPlaneResponseBuff = xControlPlaneResponseBuff;
@@ -405,9 +435,7 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
     xControlPlaneCtx.pxEventCallbackCtx = pxCtx;
     xControlPlaneCtx.xEventCallback = vMxStatusNotify;
     xControlPlaneCtx.xControlPlaneResponseBuff = xControlPlaneResponseBuff;
-    xControlPlaneCtx.xDataPlaneTaskHandle = NULL;
     xControlPlaneCtx.xControlPlaneSendQueue = xControlPlaneSendQueue;
-    xControlPlaneCtx.pulTxPacketsWaiting = &( xDataPlaneCtx.ulTxPacketsWaiting );
 }
 
 /*
@@ -443,8 +471,6 @@ void net_main( void * pvParameters )
                            &xDataPlaneCtx.xDataPlaneTaskHandle );
 
     configASSERT( xResult == pdTRUE );
-    xControlPlaneCtx.xDataPlaneTaskHandle = xDataPlaneCtx.xDataPlaneTaskHandle;
-    xCtx.xDataPlaneTaskHandle = xDataPlaneCtx.xDataPlaneTaskHandle;
 
     /* Start control plane thread */
     xResult = xTaskCreate( &prvControlPlaneRouter,
@@ -30,7 +30,28 @@
 
 #include "FreeRTOS.h"
 
+/* Snapshot of the SPI dataplane counters */
+typedef struct
+{
+    uint32_t ulRxRingDepth;            /* RX buffers currently posted */
+    uint32_t ulRxRingMinDepth;         /* Lowest ulRxRingDepth seen since start */
+    uint32_t ulRxRingMisses;           /* Frames which needed an allocation on the critical path */
+    uint32_t ulRxRingRefills;          /* RX buffers posted again after being taken */
+    uint32_t ulRxRingRefillMaxTicks;   /* Longest time a slot stayed empty */
+    uint32_t ulRxRingRefillTotalTicks;
+    uint32_t ulRxDrops;                /* Frames discarded for lack of a buffer */
+    uint32_t ulTxLatencyCount;         /* Packets for which the latency below was measured */
+    uint32_t ulTxLatencyTotal;         /* Run time counter ticks from enqueue to SPI start */
+    uint32_t ulTxLatencyMax;
+    uint32_t ulSpiTransactions;
+    uint32_t ulTxPackets;
+    uint32_t ulTxBytes;
+    uint32_t ulRxPackets;
+    uint32_t ulRxBytes;
+} MxDataplaneStats_t;
+
 void net_main( void * pvParameters );
 BaseType_t net_request_reconnect( void );
+void net_get_dataplane_stats( MxDataplaneStats_t * pxStats );
 
 #endif /* MX_NETCONN_H */
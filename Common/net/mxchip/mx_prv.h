@@ -37,6 +37,7 @@ extern "C"
 #include "task.h"
 #include "mx_ipc.h"
 #include "semphr.h"
+#include "run_time_counter.h"
 
 #define LWIP_STACK
 
@@ -44,11 +45,6 @@ extern "C"
     #include "mx_lwip.h"
 #endif
 
-#define DATA_WAITING_IDX                 3
-#define DATA_WAITING_SNOTIFY             0x20
-#define DATA_WAITING_CONTROL             0x10
-#define DATA_WAITING_DATA                0x8
-
 #define NET_EVT_IDX                      0x1
 #define NET_LWIP_READY_BIT               0x1
 #define NET_LWIP_IP_CHANGE_BIT           0x2
@@ -60,7 +56,8 @@ extern "C"
 #define ASYNC_REQUEST_RECONNECT_BIT      0x80
 
 /* Constants */
-#define NUM_IPC_REQUEST_CTX              1
+#define NUM_IPC_REQUEST_CTX              4 /* Concurrent control plane requests, must be a power of two */
+#define IPC_RESPONSE_IDX                 4 /* Task notification index used to wait for an IPC response */
 #define MX_DEFAULT_TIMEOUT_MS            100
 #define MX_DEFAULT_TIMEOUT_TICK          pdMS_TO_TICKS( MX_DEFAULT_TIMEOUT_MS )
 #define MX_TIMEOUT_CONNECT               pdMS_TO_TICKS( 120 * 1000 )
@@ -76,10 +73,44 @@ extern "C"
 #define MX_SPI_EVENT_TIMEOUT             pdMS_TO_TICKS( 10000 )
 #define MX_SPI_FLOW_TIMEOUT              pdMS_TO_TICKS( 10 )
 
+/*
+ * Set MX_SPI_AGGREGATION to 1 to pack several queued packets into a single SPI
+ * transaction. This requires module firmware which understands the aggregated
+ * frame format described by SPIAggRecordHeader_t and the SPI header types 0x0C
+ * (aggregated write) and 0x0D (aggregated read). Leave it at 0 for module
+ * firmware which only handles the single packet types.
+ */
+#ifndef MX_SPI_AGGREGATION
+    #define MX_SPI_AGGREGATION           0
+#endif
+
+#if MX_SPI_AGGREGATION
+    #define MX_SPI_AGG_MAX_PACKETS       8
+#else
+    #define MX_SPI_AGG_MAX_PACKETS       1
+#endif
+
+/* Number of max size RX buffers kept allocated ahead of incoming frames */
+#define MX_RX_RING_LEN                   4
+
+#if ( NUM_IPC_REQUEST_CTX & ( NUM_IPC_REQUEST_CTX - 1 ) ) != 0
+    #error "NUM_IPC_REQUEST_CTX must be a power of two"
+#endif
+
 #define CONTROL_PLANE_QUEUE_LEN          10
 #define DATA_PLANE_QUEUE_LEN             10
 #define CONTROL_PLANE_BUFFER_SZ          ( 25 * sizeof( void * ) + sizeof( size_t ) )
 
+/* The dataplane event set holds one event per queued packet plus the notify semaphore */
+#define DATAPLANE_EVENT_SET_LEN          ( CONTROL_PLANE_QUEUE_LEN + DATA_PLANE_QUEUE_LEN + 1 )
+
+/* Item of the control plane and data plane send queues */
+typedef struct
+{
+    PacketBuffer_t * pxPbuf;
+    uint32_t ulEnqueuedAt; /* ulGetRunTimeCounter() when the packet was queued */
+} MxTxPacket_t;
+
 typedef struct
 {
     const IotMappedPin_t * gpio_flow;
@@ -88,22 +119,36 @@ typedef struct
     const IotMappedPin_t * gpio_notify;
     SPI_HandleTypeDef * pxSpiHandle;
     TaskHandle_t xDataPlaneTaskHandle;
-    volatile uint32_t ulTxPacketsWaiting;
     volatile uint32_t ulLastRequestId;
     NetInterface_t * pxNetif;
     MessageBufferHandle_t xControlPlaneResponseBuff;
     QueueHandle_t xDataPlaneSendQueue;
     QueueHandle_t xControlPlaneSendQueue;
+    SemaphoreHandle_t xNotifySemaphore; /* Given by the notify pin interrupt */
+    QueueSetHandle_t xEventSet;         /* Send queues and xNotifySemaphore */
+    uint32_t ulTxLatencyCount;          /* Packets for which the latency below was measured */
+    uint32_t ulTxLatencyTotal;          /* Run time counter ticks from enqueue to SPI start */
+    uint32_t ulTxLatencyMax;
+    uint32_t ulSpiTransactions;
+    uint32_t ulTxPackets;
+    uint32_t ulTxBytes;
+    uint32_t ulRxPackets;
+    uint32_t ulRxBytes;
+    uint32_t ulRxRingDepth;        /* RX buffers currently posted */
+    uint32_t ulRxRingMinDepth;     /* Lowest ulRxRingDepth seen since start */
+    uint32_t ulRxRingMisses;       /* Frames which needed an allocation on the critical path */
+    uint32_t ulRxRingRefills;
+    uint32_t ulRxRingRefillMaxTicks;
+    uint32_t ulRxRingRefillTotalTicks;
+    uint32_t ulRxDrops;            /* Frames read into the void for lack of a buffer */
 } MxDataplaneCtx_t;
 
 typedef struct
 {
     QueueHandle_t xControlPlaneSendQueue;
     MessageBufferHandle_t xControlPlaneResponseBuff; /* Message buffer for IPC message responses */
-    TaskHandle_t xDataPlaneTaskHandle;
     MxEventCallback_t xEventCallback;
     void * pxEventCallbackCtx;
-    volatile uint32_t * pulTxPacketsWaiting;
 } ControlPlaneCtx_t;
 
 typedef struct
@@ -114,9 +159,7 @@ typedef struct
     volatile MxStatus_t xStatus;
     volatile MxStatus_t xStatusPrevious;
     QueueHandle_t xDataPlaneSendQueue;
-    volatile uint32_t * pulTxPacketsWaiting;
     TaskHandle_t xNetTaskHandle;
-    TaskHandle_t xDataPlaneTaskHandle;
 } MxNetConnectCtx_t;
 
 typedef enum
@@ -273,8 +316,21 @@ typedef struct
     uint16_t lenx;
     uint8_t pad[ 3 ];
 } SPIHeader_t;
+
+/*
+ * Aggregated frames (SPIHeader_t type MX_SPI_WRITE_AGG or MX_SPI_READ_AGG)
+ * carry a sequence of records, each made of this header followed by one IPC
+ * packet padded to a multiple of 4 bytes.
+ */
+typedef struct
+{
+    uint16_t usLen; /* Length of the IPC packet, excluding padding */
+    uint16_t usReserved;
+} SPIAggRecordHeader_t;
 #pragma pack()
 
+#define MX_SPI_AGG_RECORD_LEN( len )    ( sizeof( SPIAggRecordHeader_t ) + ( ( ( len ) + 3U ) & ~3U ) )
+
 #define MX_MAX_MTU       1500
 #define MX_RX_BUFF_SZ    ( MX_MAX_MTU + sizeof( BypassInOut_t ) + PBUF_LINK_HLEN )
 
@@ -304,7 +360,6 @@ typedef struct
  *
  */
 
-
 BaseType_t prvxLinkInput( NetInterface_t * pxNetif, PacketBuffer_t * pxPbufIn );
 void prvControlPlaneRouter( void * pvParameters );
 uint32_t prvGetNextRequestID( void );
@@ -0,0 +1,470 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+
+/**
+ * @file crash_log.c
+ * @brief Crash surviving log ring in retained SRAM.
+ *
+ * The region lives in SRAM4, which is neither initialized by the startup code
+ * nor cleared by a system or watchdog reset. Record n is stored in slot
+ * n % CRASH_LOG_SLOTS, so the write position is recovered at boot by scanning
+ * for the highest valid sequence number and appending never touches the header.
+ */
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "main.h"
+#include "lfs.h"
+
+#include "crash_log.h"
+
+#define CRASH_LOG_MAGIC    0x474F4C43UL /* "CLOG" */
+
+typedef struct
+{
+    uint32_t ulMagic;
+    uint32_t ulBootCount;
+    uint32_t ulPinnedSeq;
+    uint32_t ulCrc;
+} CrashLogHeader_t;
+
+typedef struct
+{
+    CrashLogHeader_t xHeader;
+    CrashLogRecord_t xSlots[ CRASH_LOG_SLOTS ];
+} CrashLogRegion_t;
+
+_Static_assert( sizeof( CrashLogRecord_t ) == CRASH_LOG_RECORD_SIZE, "Unexpected padding in CrashLogRecord_t" );
+_Static_assert( sizeof( CrashLogRegion_t ) <= ( 16 * 1024 ), "The crash log must fit in SRAM4" );
+
+/* Placed in the NOLOAD .crash_log output section by the linker script */
+static CrashLogRegion_t xCrashLogRegion __attribute__( ( section( ".crash_log" ) ) );
+
+/* Rebuilt from the region at boot */
+static BaseType_t xCrashLogInitialized = pdFALSE;
+static uint32_t ulCrashLogNextSeq = 0;
+static uint32_t ulCrashLogFirstSeq = 0;
+static uint32_t ulCrashLogBootFirstSeq = 0;
+static uint32_t ulCrashLogResetFlags = 0;
+static uint32_t ulCrashLogDropped = 0;
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t prvHeaderCrc( const CrashLogHeader_t * pxHeader )
+{
+    return lfs_crc( 0xFFFFFFFFUL, pxHeader, offsetof( CrashLogHeader_t, ulCrc ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static inline void prvUpdateHeader( void )
+{
+    xCrashLogRegion.xHeader.ulCrc = prvHeaderCrc( &( xCrashLogRegion.xHeader ) );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Covers the fixed fields and the used part of pcData only, to keep appends cheap */
+static inline uint32_t prvRecordCrc( const CrashLogRecord_t * pxRecord )
+{
+    uint32_t ulCrc = 0xFFFFFFFFUL;
+
+    ulCrc = lfs_crc( ulCrc, pxRecord, offsetof( CrashLogRecord_t, pcData ) );
+    ulCrc = lfs_crc( ulCrc, pxRecord->pcData, pxRecord->ucLen );
+
+    return ulCrc;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline BaseType_t prvRecordValid( const CrashLogRecord_t * pxRecord,
+                                         uint32_t ulSlot )
+{
+    return( ( ( pxRecord->ulSeq % CRASH_LOG_SLOTS ) == ulSlot ) &&
+            ( pxRecord->ucLen <= CRASH_LOG_DATA_LEN ) &&
+            ( pxRecord->ulCrc == prvRecordCrc( pxRecord ) ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvResetRegion( void )
+{
+    ( void ) memset( &xCrashLogRegion, 0, sizeof( xCrashLogRegion ) );
+
+    for( uint32_t ulSlot = 0; ulSlot < CRASH_LOG_SLOTS; ulSlot++ )
+    {
+        xCrashLogRegion.xSlots[ ulSlot ].ulSeq = CRASH_LOG_SEQ_NONE;
+    }
+
+    xCrashLogRegion.xHeader.ulMagic = CRASH_LOG_MAGIC;
+    xCrashLogRegion.xHeader.ulPinnedSeq = CRASH_LOG_SEQ_NONE;
+}
+
+/*-----------------------------------------------------------*/
+
+static char * prvAppendStr( char * pcOut,
+                            const char * pcEnd,
+                            const char * pcStr )
+{
+    while( ( pcOut < pcEnd ) && ( *pcStr != '\0' ) )
+    {
+        *pcOut++ = *pcStr++;
+    }
+
+    return pcOut;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Formatting without the C library, which may be what faulted */
+static char * prvAppendHex( char * pcOut,
+                            const char * pcEnd,
+                            const char * pcLabel,
+                            uint32_t ulValue )
+{
+    static const char cHexDigits[] = "0123456789abcdef";
+
+    pcOut = prvAppendStr( pcOut, pcEnd, pcLabel );
+
+    for( int32_t lShift = 28; ( lShift >= 0 ) && ( pcOut < pcEnd ); lShift -= 4 )
+    {
+        *pcOut++ = cHexDigits[ ( ulValue >> lShift ) & 0xF ];
+    }
+
+    return pcOut;
+}
+
+/*-----------------------------------------------------------*/
+
+static TickType_t prvGetTickCount( void )
+{
+    TickType_t xTicks = 0;
+
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        xTicks = xTaskGetTickCountFromISR();
+    }
+
+    return xTicks;
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashLog_Init( uint32_t ulResetFlags )
+{
+    uint32_t ulBoot = 0;
+    uint16_t usPrevBoot = 0;
+    BaseType_t xFoundRecord = pdFALSE;
+    BaseType_t xPrevBootCrashed = pdFALSE;
+    uint32_t ulPrevBootFirstSeq = CRASH_LOG_SEQ_NONE;
+    char pcBootMsg[ 48 ];
+    char * pcOut = pcBootMsg;
+    const char * pcEnd = &pcBootMsg[ sizeof( pcBootMsg ) ];
+
+    __HAL_RCC_SRAM4_CLK_ENABLE();
+
+    if( ( xCrashLogRegion.xHeader.ulMagic != CRASH_LOG_MAGIC ) ||
+        ( xCrashLogRegion.xHeader.ulCrc != prvHeaderCrc( &( xCrashLogRegion.xHeader ) ) ) )
+    {
+        /* Power on, or the region was never initialized */
+        prvResetRegion();
+    }
+
+    ulBoot = ++xCrashLogRegion.xHeader.ulBootCount;
+    usPrevBoot = ( uint16_t ) ( ulBoot - 1 );
+
+    ulCrashLogNextSeq = 0;
+    ulCrashLogFirstSeq = 0;
+
+    for( uint32_t ulSlot = 0; ulSlot < CRASH_LOG_SLOTS; ulSlot++ )
+    {
+        const CrashLogRecord_t * pxRecord = &( xCrashLogRegion.xSlots[ ulSlot ] );
+
+        if( prvRecordValid( pxRecord, ulSlot ) == pdTRUE )
+        {
+            if( ( xFoundRecord == pdFALSE ) || ( pxRecord->ulSeq >= ulCrashLogNextSeq ) )
+            {
+                ulCrashLogNextSeq = pxRecord->ulSeq + 1;
+            }
+
+            if( ( xFoundRecord == pdFALSE ) || ( pxRecord->ulSeq < ulCrashLogFirstSeq ) )
+            {
+                ulCrashLogFirstSeq = pxRecord->ulSeq;
+            }
+
+            xFoundRecord = pdTRUE;
+
+            if( pxRecord->usBoot == usPrevBoot )
+            {
+                if( ( pxRecord->ucType == CRASH_LOG_TYPE_ASSERT ) ||
+                    ( pxRecord->ucType == CRASH_LOG_TYPE_FAULT ) )
+                {
+                    xPrevBootCrashed = pdTRUE;
+                }
+
+                if( ( ulPrevBootFirstSeq == CRASH_LOG_SEQ_NONE ) || ( pxRecord->ulSeq < ulPrevBootFirstSeq ) )
+                {
+                    ulPrevBootFirstSeq = pxRecord->ulSeq;
+                }
+            }
+        }
+    }
+
+    if( ( ulResetFlags & ( RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF ) ) != 0 )
+    {
+        xPrevBootCrashed = pdTRUE;
+    }
+
+    /* Keep the first crash until it has been reported */
+    if( ( xPrevBootCrashed == pdTRUE ) &&
+        ( ulPrevBootFirstSeq != CRASH_LOG_SEQ_NONE ) &&
+        ( xCrashLogRegion.xHeader.ulPinnedSeq == CRASH_LOG_SEQ_NONE ) )
+    {
+        xCrashLogRegion.xHeader.ulPinnedSeq = ulPrevBootFirstSeq;
+    }
+
+    prvUpdateHeader();
+
+    ulCrashLogBootFirstSeq = ulCrashLogNextSeq;
+    ulCrashLogResetFlags = ulResetFlags;
+    ulCrashLogDropped = 0;
+    xCrashLogInitialized = pdTRUE;
+
+    pcOut = prvAppendHex( pcOut, pcEnd, "boot ", ulBoot );
+    pcOut = prvAppendHex( pcOut, pcEnd, " reset flags ", ulResetFlags );
+    CrashLog_Append( CRASH_LOG_TYPE_BOOT, pcBootMsg, ( size_t ) ( pcOut - pcBootMsg ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashLog_Append( CrashLogType_t xType,
+                      const char * pcData,
+                      size_t uxLen )
+{
+    UBaseType_t uxSavedInterruptStatus;
+
+    if( xCrashLogInitialized == pdFALSE )
+    {
+        return;
+    }
+
+    if( uxLen > CRASH_LOG_DATA_LEN )
+    {
+        uxLen = CRASH_LOG_DATA_LEN;
+    }
+
+    /* Usable from tasks, ISRs and fault handlers alike */
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    if( ( xCrashLogRegion.xHeader.ulPinnedSeq != CRASH_LOG_SEQ_NONE ) &&
+        ( ( ulCrashLogNextSeq - xCrashLogRegion.xHeader.ulPinnedSeq ) >= CRASH_LOG_SLOTS ) )
+    {
+        ulCrashLogDropped++;
+    }
+    else
+    {
+        CrashLogRecord_t * pxRecord = &( xCrashLogRegion.xSlots[ ulCrashLogNextSeq % CRASH_LOG_SLOTS ] );
+
+        pxRecord->ulSeq = ulCrashLogNextSeq;
+        pxRecord->ulTick = prvGetTickCount();
+        pxRecord->usBoot = ( uint16_t ) xCrashLogRegion.xHeader.ulBootCount;
+        pxRecord->ucType = ( uint8_t ) xType;
+        pxRecord->ucLen = ( uint8_t ) uxLen;
+        ( void ) memcpy( pxRecord->pcData, pcData, uxLen );
+        pxRecord->ulCrc = prvRecordCrc( pxRecord );
+
+        ulCrashLogNextSeq++;
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashLog_RecordAssert( const char * pcFileName,
+                            uint32_t ulLineNumber )
+{
+    char pcMsg[ CRASH_LOG_DATA_LEN ];
+    int lLen = 0;
+
+    lLen = snprintf( pcMsg, sizeof( pcMsg ), "assert %s:%lu",
+                     ( pcFileName != NULL ) ? pcFileName : "?",
+                     ( unsigned long ) ulLineNumber );
+
+    if( lLen > 0 )
+    {
+        CrashLog_Append( CRASH_LOG_TYPE_ASSERT, pcMsg, ( size_t ) lLen );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashLog_RecordFault( const uint32_t * pulStackFrame )
+{
+    char pcMsg[ CRASH_LOG_DATA_LEN ];
+    char * pcOut = pcMsg;
+    const char * pcEnd = &pcMsg[ sizeof( pcMsg ) ];
+
+    pcOut = prvAppendHex( pcOut, pcEnd, "fault pc ", pulStackFrame[ 6 ] );
+    pcOut = prvAppendHex( pcOut, pcEnd, " lr ", pulStackFrame[ 5 ] );
+    pcOut = prvAppendHex( pcOut, pcEnd, " psr ", pulStackFrame[ 7 ] );
+    pcOut = prvAppendHex( pcOut, pcEnd, " cfsr ", SCB->CFSR );
+    pcOut = prvAppendHex( pcOut, pcEnd, " hfsr ", SCB->HFSR );
+    pcOut = prvAppendHex( pcOut, pcEnd, " mmfar ", SCB->MMFAR );
+    pcOut = prvAppendHex( pcOut, pcEnd, " bfar ", SCB->BFAR );
+
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        pcOut = prvAppendStr( pcOut, pcEnd, " task " );
+        pcOut = prvAppendStr( pcOut, pcEnd, pcTaskGetName( NULL ) );
+    }
+
+    CrashLog_Append( CRASH_LOG_TYPE_FAULT, pcMsg, ( size_t ) ( pcOut - pcMsg ) );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t CrashLog_ReadRecord( uint32_t ulSeq,
+                                CrashLogRecord_t * pxRecord )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t ulSlot = ulSeq % CRASH_LOG_SLOTS;
+
+    configASSERT( pxRecord != NULL );
+
+    if( xCrashLogInitialized == pdTRUE )
+    {
+        UBaseType_t uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+        ( void ) memcpy( pxRecord, &( xCrashLogRegion.xSlots[ ulSlot ] ), sizeof( CrashLogRecord_t ) );
+
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+
+        xResult = ( ( pxRecord->ulSeq == ulSeq ) && ( prvRecordValid( pxRecord, ulSlot ) == pdTRUE ) ) ? pdTRUE : pdFALSE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashLog_GetInfo( CrashLogInfo_t * pxInfo )
+{
+    UBaseType_t uxSavedInterruptStatus;
+
+    configASSERT( pxInfo != NULL );
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    pxInfo->ulBootCount = xCrashLogRegion.xHeader.ulBootCount;
+    pxInfo->ulResetFlags = ulCrashLogResetFlags;
+    pxInfo->ulNextSeq = ulCrashLogNextSeq;
+    pxInfo->ulBootFirstSeq = ulCrashLogBootFirstSeq;
+    pxInfo->ulPinnedSeq = xCrashLogRegion.xHeader.ulPinnedSeq;
+    pxInfo->ulDropped = ulCrashLogDropped;
+
+    /* Older records have been overwritten once the ring has wrapped */
+    if( ( ulCrashLogNextSeq - ulCrashLogFirstSeq ) > CRASH_LOG_SLOTS )
+    {
+        pxInfo->ulFirstSeq = ulCrashLogNextSeq - CRASH_LOG_SLOTS;
+    }
+    else
+    {
+        pxInfo->ulFirstSeq = ulCrashLogFirstSeq;
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashLog_Release( void )
+{
+    UBaseType_t uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    xCrashLogRegion.xHeader.ulPinnedSeq = CRASH_LOG_SEQ_NONE;
+    prvUpdateHeader();
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+void CrashLog_Clear( void )
+{
+    UBaseType_t uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t ulBootCount = xCrashLogRegion.xHeader.ulBootCount;
+
+    prvResetRegion();
+    xCrashLogRegion.xHeader.ulBootCount = ulBootCount;
+    prvUpdateHeader();
+
+    /* Sequence numbers keep counting so that readers can tell the ring was cleared */
+    ulCrashLogFirstSeq = ulCrashLogNextSeq;
+    ulCrashLogBootFirstSeq = ulCrashLogNextSeq;
+    ulCrashLogDropped = 0;
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+const char * CrashLog_TypeToString( uint8_t ucType )
+{
+    const char * pcType = "???";
+
+    switch( ucType )
+    {
+        case CRASH_LOG_TYPE_BOOT:
+            pcType = "BOOT";
+            break;
+
+        case CRASH_LOG_TYPE_LOG:
+            pcType = "LOG";
+            break;
+
+        case CRASH_LOG_TYPE_ASSERT:
+            pcType = "ASRT";
+            break;
+
+        case CRASH_LOG_TYPE_FAULT:
+            pcType = "FLT";
+            break;
+
+        default:
+            break;
+    }
+
+    return pcType;
+}
@@ -32,6 +32,7 @@
 
 #include "task.h"
 #include "logging.h"
+#include "crash_log.h"
 #include <string.h>
 
 /* Global peripheral handles */
@@ -47,11 +48,11 @@ void hw_init(void)
 
 #if !defined(STM32H5)
   ulCsrFlags = RCC->CSR;
-
-  /* To make the compiler happy */
-  ulCsrFlags = ulCsrFlags;
 #endif
 
+  /* Start a new boot in the crash log before the reset cause is cleared */
+  CrashLog_Init(ulCsrFlags);
+
   __HAL_RCC_CLEAR_RESET_FLAGS();
 }
 
@@ -30,6 +30,7 @@
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 
 /* mbed TLS includes. */
@@ -41,12 +42,329 @@
 #include "mbedtls/entropy.h"
 
 #include "threading_alt.h"
+#include "mbedtls_freertos_port.h"
+
+/*-----------------------------------------------------------*/
+
+/* Size classes served from the arena range from 16 to 1024 bytes in powers of two */
+#define ARENA_MIN_CLASS_SHIFT    4U
+#define ARENA_NUM_CLASSES        7U
+#define ARENA_MAX_BLOCK_LEN      ( 1U << ( ARENA_MIN_CLASS_SHIFT + ARENA_NUM_CLASSES - 1U ) )
+#define ARENA_PAGE_LEN           ( 2U * ARENA_MAX_BLOCK_LEN )
+
+#if defined( MBEDTLS_FREERTOS_ARENA_SIZE ) && ( MBEDTLS_FREERTOS_ARENA_SIZE > 0 )
+    #define ARENA_NUM_PAGES    ( MBEDTLS_FREERTOS_ARENA_SIZE / ARENA_PAGE_LEN )
+#else
+    #define ARENA_NUM_PAGES    0U
+#endif
+
+#if ARENA_NUM_PAGES > 0
+
+/*
+ * The arena is split into fixed size pages. A free page is assigned to a size
+ * class on demand and carved into blocks of that size, so a page only ever
+ * holds blocks of one size and frees never leave holes that a larger request
+ * cannot use once the whole page is released. The size of a block is known
+ * from its page, which avoids a per-block header.
+ *
+ * Free blocks are kept zeroed apart from the free list link in their first word,
+ * so calloc only has to clear that word.
+ */
+    typedef struct ArenaPage
+    {
+        struct ArenaPage * pxNext;
+        struct ArenaPage * pxPrev;
+        void * pvFreeList;
+        uint16_t usInUse;
+        uint16_t usCarved;
+        uint8_t ucClass;
+    } ArenaPage_t;
+
+    typedef struct
+    {
+        ArenaPage_t * pxPartial; /* Assigned pages with at least one free block */
+        size_t uxPages;
+    } ArenaClass_t;
+
+    static uint8_t ucArena[ ARENA_NUM_PAGES * ARENA_PAGE_LEN ] __attribute__( ( aligned( portBYTE_ALIGNMENT ) ) );
+    static ArenaPage_t xArenaPages[ ARENA_NUM_PAGES ];
+    static ArenaClass_t xArenaClasses[ ARENA_NUM_CLASSES ];
+    static ArenaPage_t * pxArenaFreePages = NULL;
+    static BaseType_t xArenaInitialized = pdFALSE;
+#endif /* ARENA_NUM_PAGES > 0 */
+
+static MbedtlsMemStats_t xMemStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static inline void vUpdatePeak( void )
+{
+    size_t uxTotal = xMemStats.uxArenaUsed + xMemStats.uxHeapUsed;
+
+    if( xMemStats.uxArenaUsed > xMemStats.uxArenaPeak )
+    {
+        xMemStats.uxArenaPeak = xMemStats.uxArenaUsed;
+    }
+
+    if( xMemStats.uxHeapUsed > xMemStats.uxHeapPeak )
+    {
+        xMemStats.uxHeapPeak = xMemStats.uxHeapUsed;
+    }
+
+    if( uxTotal > xMemStats.uxTotalPeak )
+    {
+        xMemStats.uxTotalPeak = uxTotal;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if ARENA_NUM_PAGES > 0
+
+    static inline size_t uxArenaClassLen( uint8_t ucClass )
+    {
+        return ( size_t ) 1U << ( ARENA_MIN_CLASS_SHIFT + ucClass );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static inline uint8_t ucArenaSizeToClass( size_t uxLen )
+    {
+        uint8_t ucClass = 0;
+
+        if( uxLen > ( 1U << ARENA_MIN_CLASS_SHIFT ) )
+        {
+            ucClass = ( uint8_t ) ( ( 32U - __builtin_clz( ( uint32_t ) uxLen - 1U ) ) - ARENA_MIN_CLASS_SHIFT );
+        }
+
+        return ucClass;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static inline BaseType_t xIsArenaBlock( const void * pvPtr )
+    {
+        return( ( ( const uint8_t * ) pvPtr >= ucArena ) &&
+                ( ( const uint8_t * ) pvPtr < &( ucArena[ sizeof( ucArena ) ] ) ) );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static inline uint8_t * pucArenaPageBase( const ArenaPage_t * pxPage )
+    {
+        return &( ucArena[ ( size_t ) ( pxPage - xArenaPages ) * ARENA_PAGE_LEN ] );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vArenaInit( void )
+    {
+        for( size_t uxIdx = ARENA_NUM_PAGES; uxIdx > 0; uxIdx-- )
+        {
+            xArenaPages[ uxIdx - 1 ].pxNext = pxArenaFreePages;
+            pxArenaFreePages = &( xArenaPages[ uxIdx - 1 ] );
+        }
+
+        xMemStats.uxArenaSize = sizeof( ucArena );
+        xArenaInitialized = pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vArenaUnlinkPartial( ArenaPage_t * pxPage )
+    {
+        ArenaClass_t * pxClass = &( xArenaClasses[ pxPage->ucClass ] );
+
+        if( pxPage->pxPrev != NULL )
+        {
+            pxPage->pxPrev->pxNext = pxPage->pxNext;
+        }
+        else
+        {
+            pxClass->pxPartial = pxPage->pxNext;
+        }
+
+        if( pxPage->pxNext != NULL )
+        {
+            pxPage->pxNext->pxPrev = pxPage->pxPrev;
+        }
+
+        pxPage->pxNext = NULL;
+        pxPage->pxPrev = NULL;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vArenaLinkPartial( ArenaPage_t * pxPage )
+    {
+        ArenaClass_t * pxClass = &( xArenaClasses[ pxPage->ucClass ] );
+
+        pxPage->pxPrev = NULL;
+        pxPage->pxNext = pxClass->pxPartial;
+
+        if( pxClass->pxPartial != NULL )
+        {
+            pxClass->pxPartial->pxPrev = pxPage;
+        }
+
+        pxClass->pxPartial = pxPage;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Return an empty page to the free page list, clearing the free list links */
+    static void vArenaReleasePage( ArenaPage_t * pxPage )
+    {
+        void * pvBlock = pxPage->pvFreeList;
+
+        configASSERT( pxPage->usInUse == 0 );
+
+        while( pvBlock != NULL )
+        {
+            void * pvNext = *( ( void ** ) pvBlock );
+
+            *( ( void ** ) pvBlock ) = NULL;
+            pvBlock = pvNext;
+        }
+
+        vArenaUnlinkPartial( pxPage );
+        xArenaClasses[ pxPage->ucClass ].uxPages--;
+        xMemStats.uxArenaPagesUsed--;
+
+        pxPage->pvFreeList = NULL;
+        pxPage->usCarved = 0;
+        pxPage->pxNext = pxArenaFreePages;
+        pxArenaFreePages = pxPage;
+    }
+
+/*-----------------------------------------------------------*/
+
+/* Reclaim an empty page held back by another size class */
+    static BaseType_t xArenaReclaimPage( void )
+    {
+        BaseType_t xReclaimed = pdFALSE;
+
+        for( uint8_t ucClass = 0; ucClass < ARENA_NUM_CLASSES && xReclaimed == pdFALSE; ucClass++ )
+        {
+            ArenaPage_t * pxPage = xArenaClasses[ ucClass ].pxPartial;
+
+            if( ( pxPage != NULL ) &&
+                ( pxPage->usInUse == 0 ) )
+            {
+                vArenaReleasePage( pxPage );
+                xReclaimed = pdTRUE;
+            }
+        }
+
+        return xReclaimed;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void * pvArenaAlloc( size_t uxLen )
+    {
+        uint8_t ucClass = ucArenaSizeToClass( uxLen );
+        size_t uxBlockLen = uxArenaClassLen( ucClass );
+        ArenaClass_t * pxClass = &( xArenaClasses[ ucClass ] );
+        ArenaPage_t * pxPage = NULL;
+        void * pvBlock = NULL;
+
+        if( xArenaInitialized == pdFALSE )
+        {
+            vArenaInit();
+        }
+
+        pxPage = pxClass->pxPartial;
+
+        if( ( pxPage == NULL ) &&
+            ( ( pxArenaFreePages != NULL ) || ( xArenaReclaimPage() == pdTRUE ) ) )
+        {
+            pxPage = pxArenaFreePages;
+            pxArenaFreePages = pxPage->pxNext;
+
+            pxPage->ucClass = ucClass;
+            pxPage->usInUse = 0;
+            pxPage->usCarved = 0;
+            pxPage->pvFreeList = NULL;
+
+            vArenaLinkPartial( pxPage );
+            pxClass->uxPages++;
+            xMemStats.uxArenaPagesUsed++;
+        }
+
+        if( pxPage != NULL )
+        {
+            if( pxPage->pvFreeList != NULL )
+            {
+                pvBlock = pxPage->pvFreeList;
+                pxPage->pvFreeList = *( ( void ** ) pvBlock );
+                *( ( void ** ) pvBlock ) = NULL;
+            }
+            else
+            {
+                pvBlock = &( pucArenaPageBase( pxPage )[ pxPage->usCarved * uxBlockLen ] );
+                pxPage->usCarved++;
+            }
+
+            pxPage->usInUse++;
+
+            if( ( pxPage->pvFreeList == NULL ) &&
+                ( ( pxPage->usCarved * uxBlockLen ) >= ARENA_PAGE_LEN ) )
+            {
+                vArenaUnlinkPartial( pxPage );
+            }
+
+            xMemStats.uxArenaUsed += uxBlockLen;
+        }
+
+        return pvBlock;
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void vArenaFree( void * pvBlock )
+    {
+        ArenaPage_t * pxPage = &( xArenaPages[ ( ( uint8_t * ) pvBlock - ucArena ) / ARENA_PAGE_LEN ] );
+        size_t uxBlockLen = uxArenaClassLen( pxPage->ucClass );
+        BaseType_t xWasFull;
+
+        configASSERT( ( ( ( uint8_t * ) pvBlock - pucArenaPageBase( pxPage ) ) % uxBlockLen ) == 0 );
+        configASSERT( pxPage->usInUse > 0 );
+
+        /* The block was zeroed by the caller, outside of the critical section */
+        xWasFull = ( pxPage->pvFreeList == NULL ) &&
+                   ( ( pxPage->usCarved * uxBlockLen ) >= ARENA_PAGE_LEN );
+
+        *( ( void ** ) pvBlock ) = pxPage->pvFreeList;
+        pxPage->pvFreeList = pvBlock;
+        pxPage->usInUse--;
+
+        xMemStats.uxArenaUsed -= uxBlockLen;
+
+        if( xWasFull == pdTRUE )
+        {
+            vArenaLinkPartial( pxPage );
+        }
+
+        /* Keep the last page of a class to avoid thrashing between alloc and free */
+        if( ( pxPage->usInUse == 0 ) &&
+            ( xArenaClasses[ pxPage->ucClass ].uxPages > 1 ) )
+        {
+            vArenaReleasePage( pxPage );
+        }
+    }
+
+#endif /* ARENA_NUM_PAGES > 0 */
 
 /*-----------------------------------------------------------*/
 
 /**
  * @brief Allocates memory for an array of members.
  *
+ * Requests of up to ARENA_MAX_BLOCK_LEN bytes are served from the dedicated
+ * arena when MBEDTLS_FREERTOS_ARENA_SIZE is defined. Larger requests, and
+ * requests made while the arena is exhausted, use the FreeRTOS heap.
+ *
  * @param[in] nmemb Number of members that need to be allocated.
  * @param[in] size Size of each member.
  *
@@ -64,15 +382,56 @@ void * mbedtls_platform_calloc( size_t nmemb,
         /* Overflow check. */
         if( ( totalSize / size ) == nmemb )
         {
-            pBuffer = pvPortMalloc( totalSize );
-
-            if( pBuffer != NULL )
+            #if ARENA_NUM_PAGES > 0
+                if( totalSize <= ARENA_MAX_BLOCK_LEN )
+                {
+                    taskENTER_CRITICAL();
+                    {
+                        pBuffer = pvArenaAlloc( totalSize );
+
+                        if( pBuffer != NULL )
+                        {
+                            xMemStats.ulAllocCount++;
+                            vUpdatePeak();
+                        }
+                    }
+                    taskEXIT_CRITICAL();
+                }
+            #endif /* ARENA_NUM_PAGES > 0 */
+
+            if( pBuffer == NULL )
             {
-                explicit_bzero( pBuffer, totalSize );
+                pBuffer = pvPortMalloc( totalSize );
+
+                if( pBuffer != NULL )
+                {
+                    size_t xBlockLen = malloc_usable_size( pBuffer );
+
+                    explicit_bzero( pBuffer, totalSize );
+
+                    taskENTER_CRITICAL();
+                    {
+                        xMemStats.uxHeapUsed += xBlockLen;
+                        xMemStats.ulAllocCount++;
+                        xMemStats.ulHeapAllocCount++;
+                        vUpdatePeak();
+                    }
+                    taskEXIT_CRITICAL();
+                }
             }
         }
     }
 
+    if( ( pBuffer == NULL ) &&
+        ( totalSize > 0 ) )
+    {
+        taskENTER_CRITICAL();
+        {
+            xMemStats.ulFailCount++;
+        }
+        taskEXIT_CRITICAL();
+    }
+
     return pBuffer;
 }
 
@@ -81,17 +440,86 @@ void * mbedtls_platform_calloc( size_t nmemb,
 /**
  * @brief Frees the space previously allocated by calloc.
  *
+ * The whole block is zeroed before it is returned to the arena or heap.
+ *
  * @param[in] ptr Pointer to the memory to be freed.
  */
 void mbedtls_platform_free( void * ptr )
 {
-    size_t xBlockLen = malloc_usable_size( ptr );
+    if( ptr == NULL )
+    {
+        /* Nothing to free */
+    }
+
+    #if ARENA_NUM_PAGES > 0
+        else if( xIsArenaBlock( ptr ) )
+        {
+            const ArenaPage_t * pxPage = &( xArenaPages[ ( ( uint8_t * ) ptr - ucArena ) / ARENA_PAGE_LEN ] );
+
+            explicit_bzero( ptr, uxArenaClassLen( pxPage->ucClass ) );
+
+            taskENTER_CRITICAL();
+            {
+                vArenaFree( ptr );
+                xMemStats.ulFreeCount++;
+            }
+            taskEXIT_CRITICAL();
+        }
+    #endif /* ARENA_NUM_PAGES > 0 */
+    else
+    {
+        size_t xBlockLen = malloc_usable_size( ptr );
+
+        if( xBlockLen > 0 )
+        {
+            explicit_bzero( ptr, xBlockLen );
+            vPortFree( ptr );
+
+            taskENTER_CRITICAL();
+            {
+                xMemStats.uxHeapUsed -= xBlockLen;
+                xMemStats.ulFreeCount++;
+            }
+            taskEXIT_CRITICAL();
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_platform_get_memory_stats( MbedtlsMemStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
 
-    if( xBlockLen > 0 )
+    taskENTER_CRITICAL();
+    {
+        *pxStats = xMemStats;
+    }
+    taskEXIT_CRITICAL();
+
+    #if ARENA_NUM_PAGES > 0
+        pxStats->uxArenaSize = sizeof( ucArena );
+
+        if( pxStats->uxArenaPagesUsed > 0 )
+        {
+            size_t uxAssigned = pxStats->uxArenaPagesUsed * ARENA_PAGE_LEN;
+
+            pxStats->ulFragmentationPct = ( uint32_t ) ( ( 100U * ( uxAssigned - pxStats->uxArenaUsed ) ) / uxAssigned );
+        }
+    #endif /* ARENA_NUM_PAGES > 0 */
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_platform_reset_memory_peak( void )
+{
+    taskENTER_CRITICAL();
     {
-        explicit_bzero( ptr, xBlockLen );
-        vPortFree( ptr );
+        xMemStats.uxArenaPeak = xMemStats.uxArenaUsed;
+        xMemStats.uxHeapPeak = xMemStats.uxHeapUsed;
+        xMemStats.uxTotalPeak = xMemStats.uxArenaUsed + xMemStats.uxHeapUsed;
     }
+    taskEXIT_CRITICAL();
 }
 
 /*-----------------------------------------------------------*/
@@ -0,0 +1,55 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file run_time_counter.c
+ * @brief Timestamps for measuring short intervals such as callback run times
+ * or queueing delays.
+ */
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "run_time_counter.h"
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulGetRunTimeCounter( void )
+{
+    uint32_t ulCounter = 0;
+
+    #if ( configGENERATE_RUN_TIME_STATS == 1 )
+        /* The counter implementation is not reentrant, serialize with the scheduler */
+        taskENTER_CRITICAL();
+        ulCounter = ( uint32_t ) portGET_RUN_TIME_COUNTER_VALUE();
+        taskEXIT_CRITICAL();
+    #else
+        ulCounter = ( uint32_t ) xTaskGetTickCount();
+    #endif
+
+    return ulCounter;
+}
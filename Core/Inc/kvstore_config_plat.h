@@ -30,21 +30,32 @@
 /* Define KV_STORE_CACHE_ENABLE to 1 to enable an in-memory cache of all Key / Value pairs */
 #define KV_STORE_CACHE_ENABLE       1
 
+/* Define KV_STORE_CACHE_LAZY to 1 to read each value into the cache on first use instead of at boot.
+ * Values larger than a pointer are then kept on the heap up to KV_STORE_CACHE_BUDGET bytes, least recently used
+ * first out. Smaller values are stored in the cache entry itself and stay cached. */
+#define KV_STORE_CACHE_LAZY         0
+#define KV_STORE_CACHE_BUDGET       512
+
 /* Define KV_STORE_NVIMPL_ENABLE to 1 to enable storage of all key / value pairs in non-volatile storage */
 #define KV_STORE_NVIMPL_ENABLE      1
 
-/* Select where the KV_STORE is located */
+/* Select where the KV_STORE is located.
+ * KV_STORE_NVIMPL_LITTLEFS keeps one file per key under /cfg/.
+ * KV_STORE_NVIMPL_LFS_LOG appends each commit to a single littlefs file, see kvstore_nv_lfs_log.c.
+ */
 #if defined(__USE_STSAFE__)
 #define KV_STORE_NVIMPL_LITTLEFS    0
+#define KV_STORE_NVIMPL_LFS_LOG     0
 #define KV_STORE_NVIMPL_STSAFE      1
 #define KV_STORE_NVIMPL_ARM_PSA     0
 #else
 #define KV_STORE_NVIMPL_LITTLEFS    1
+#define KV_STORE_NVIMPL_LFS_LOG     0
 #define KV_STORE_NVIMPL_STSAFE      0
 #define KV_STORE_NVIMPL_ARM_PSA     0
 #endif
 
-#if (KV_STORE_NVIMPL_LITTLEFS + KV_STORE_NVIMPL_STSAFE + KV_STORE_NVIMPL_ARM_PSA != 1)
+#if (KV_STORE_NVIMPL_LITTLEFS + KV_STORE_NVIMPL_LFS_LOG + KV_STORE_NVIMPL_STSAFE + KV_STORE_NVIMPL_ARM_PSA != 1)
 #error "Exactly one KV_STORE_NVIMPL flag must be set to 1."
 #endif
 
@@ -52,14 +63,24 @@
 #error "STSAFE not present"
 #endif
 
+/* Define KV_STORE_PERSIST_TLS_SESSION to 1 to save the resumable TLS session of the MQTT connection in the
+ * tls_session key so that it survives a reset. The session includes the master secret, which the littlefs backends
+ * store in plaintext. Leave it at 0 to keep the session in RAM only, where it still allows resumption on reconnect.
+ * Not available with the STSAFE backend. */
+#define KV_STORE_PERSIST_TLS_SESSION    0
+
 #define KVSTORE_KEY_MAX_LEN         16
 
-#if (KV_STORE_NVIMPL_LITTLEFS || KV_STORE_NVIMPL_ARM_PSA)
+#if (KV_STORE_NVIMPL_LITTLEFS || KV_STORE_NVIMPL_LFS_LOG || KV_STORE_NVIMPL_ARM_PSA)
 #define KVSTORE_VAL_MAX_LEN         256
 #endif
 
 #if KV_STORE_NVIMPL_STSAFE
 #define KVSTORE_VAL_MAX_LEN         STSAFE_KVSTORE_VAL_MAX_LEN
+
+/* Define KV_STORE_STSAFE_WRITE_BACK to 1 to keep changed keys in RAM until KVStore_xCommitChanges and then write
+ * only the changed parts of the STSAFE zone. Set to 0 to write each key as soon as it is stored. */
+#define KV_STORE_STSAFE_WRITE_BACK  1
 #endif
 
 #endif /* _KVSTORE_CONFIG_PLAT_H */
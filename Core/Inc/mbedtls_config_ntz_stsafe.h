@@ -3070,6 +3070,10 @@ void mbedtls_platform_free( void * ptr );
 /* MBEDTLS_PLATFORM_XXX_MACRO and MBEDTLS_PLATFORM_XXX_ALT cannot both be defined */
 #define MBEDTLS_PLATFORM_CALLOC_MACRO    mbedtls_platform_calloc /**< Default allocator macro to use, can be undefined */
 #define MBEDTLS_PLATFORM_FREE_MACRO      mbedtls_platform_free   /**< Default free macro to use, can be undefined */
+
+/* Serve allocations of up to 1 KB from a dedicated arena of this size rather than the FreeRTOS heap.
+ * Comment out to allocate everything from the FreeRTOS heap. See Common/sys/mbedtls_freertos_port.c */
+#define MBEDTLS_FREERTOS_ARENA_SIZE      ( 32 * 1024 )
 /*#define MBEDTLS_PLATFORM_EXIT_MACRO            exit / **< Default exit macro to use, can be undefined * / */
 /*#define MBEDTLS_PLATFORM_TIME_MACRO            time / **< Default time macro to use, can be undefined. MBEDTLS_HAVE_TIME must be enabled * / */
 /*#define MBEDTLS_PLATFORM_TIME_TYPE_MACRO       time_t / **< Default time macro to use, can be undefined. MBEDTLS_HAVE_TIME must be enabled * / */
@@ -48,6 +48,7 @@
 #include "mx_netconn.h"
 
 #include "mqtt_agent_task.h"
+#include "mqtt_publish_spool.h"
 
 #if defined(__USE_STSAFE__)
 #include "stsafe.h"
@@ -100,6 +101,7 @@ extern void vEnvironmentSensorPublishTask(void *pvParameters);
 extern void vMotionSensorsPublish(void *pvParameters);
 extern void vEchoServerTask(void *pvParameters);
 extern void prvFleetProvisioningTask(void *pvParameters);
+extern void vCrashLogUploadTask(void *pvParameters);
 /* USER CODE END FunctionPrototypes */
 
 /* USER CODE BEGIN 5 */
@@ -234,6 +236,8 @@ void StartDefaultTask(void *argument)
     (void) xEventGroupSetBits(xSystemEvents, EVT_MASK_FS_READY);
 
     KVStore_init();
+
+    vLoggingLoadModuleLevels();
   }
   else
   {
@@ -288,6 +292,16 @@ void StartDefaultTask(void *argument)
   xResult = xTaskCreate(vMQTTAgentTask, "MQTTAgent", 2048, NULL, 10, NULL);
   configASSERT(xResult == pdTRUE);
 
+#if DEMO_PUBLISH_SPOOL
+  xResult = xTaskCreate(vMqttSpoolDrainTask, "MQTTSpool", 1024, NULL, 6, NULL);
+  configASSERT(xResult == pdTRUE);
+#endif
+
+#if DEMO_CRASH_LOG_UPLOAD
+  xResult = xTaskCreate(vCrashLogUploadTask, "CrashLogUp", 1024, NULL, tskIDLE_PRIORITY + 1, NULL);
+  configASSERT(xResult == pdTRUE);
+#endif
+
 #if !defined(__USE_STSAFE__) && defined(FLEET_PROVISION_DEMO)
   if(provisioned == 0)
   {
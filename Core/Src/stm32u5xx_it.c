@@ -24,6 +24,7 @@
 #include "task.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "crash_log.h"
 
 /* USER CODE END Includes */
 
@@ -83,6 +84,9 @@ __attribute__( ( optimize( "O0" ) ) ) void prvGetRegistersFromStack( uint32_t *
     psr = pulFaultStackAddress[ 7 ];
     #pragma GCC diagnostic pop
 
+    /* Keep the fault context for the next boot, the watchdog resets the system */
+    CrashLog_RecordFault( pulFaultStackAddress );
+
     /* When the following line is hit, the variables contain the register values. */
     for( ; ; )
     {
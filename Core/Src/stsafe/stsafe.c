@@ -511,6 +511,48 @@ bool STSAFE1_Write(CK_BYTE_PTR pucData, CK_ULONG ulDataSize, uint8_t InZoneIndex
   return status;
 }
 
+/* Update ulLength bytes at ulOffset of the data previously stored with STSAFE1_Write, leaving the zone header and the
+ * other bytes untouched. */
+bool STSAFE1_WriteRange(const uint8_t *pucData, uint32_t ulOffset, uint32_t ulLength, uint8_t InZoneIndex)
+{
+  StSafeA_ResponseCode_t stsafe_status = STSAFEA_OK;
+  uint32_t zone_offset = STSAFE_ZONE_HEADER_SIZE + ulOffset;
+  uint32_t amount_written = 0;
+  uint32_t amount_to_write = 0;
+  StSafeA_LVBuffer_t buf;
+
+  if ((pucData == NULL) || (ulLength == 0) || (zone_offset + ulLength > zone_size[InZoneIndex]))
+  {
+    return false;
+  }
+
+  xSemaphoreTake(xSTSAFEMutex, portMAX_DELAY);
+
+  while ((amount_written < ulLength) && (stsafe_status == STSAFEA_OK))
+  {
+    /* Do not let a single update cross a STSAFEA_BUFFER_DATA_CONTENT_SIZE boundary of the zone */
+    amount_to_write = STSAFEA_BUFFER_DATA_CONTENT_SIZE - ((zone_offset + amount_written) % STSAFEA_BUFFER_DATA_CONTENT_SIZE);
+
+    if (amount_to_write > ulLength - amount_written)
+    {
+      amount_to_write = ulLength - amount_written;
+    }
+
+    buf.Length = amount_to_write;
+    buf.Data = (uint8_t *) &pucData[amount_written];
+
+    vTaskDelay(50);
+
+    stsafe_status = StSafeA_Update(&stsafea_handle, STSAFEA_FLAG_TRUE, STSAFEA_FLAG_FALSE, STSAFEA_FLAG_FALSE, STSAFEA_AC_ALWAYS, InZoneIndex, zone_offset + amount_written, &buf, STSAFEA_MAC_NONE);
+
+    amount_written += amount_to_write;
+  }
+
+  xSemaphoreGive(xSTSAFEMutex);
+
+  return stsafe_status == STSAFEA_OK;
+}
+
 bool STSAFE1_Erase(uint8_t InZoneIndex)
 {
   bool status = false;
@@ -28,6 +28,7 @@ CK_RV SAFEA1_getDeviceCertificate(CK_BYTE_PTR * ppucData,CK_ULONG_PTR pulDataSiz
 CK_RV SAFEA1_getDeviceCommonName (CK_BYTE_PTR * ppucData,CK_ULONG_PTR pulDataSize);
 bool STSAFE1_Read (CK_BYTE_PTR *ppucData, CK_ULONG_PTR pulDataSize, uint8_t InZoneIndex);
 bool STSAFE1_Write(CK_BYTE_PTR pucData, CK_ULONG ulDataSize, uint8_t InZoneIndex);
+bool STSAFE1_WriteRange(const uint8_t *pucData, uint32_t ulOffset, uint32_t ulLength, uint8_t InZoneIndex);
 bool STSAFE1_Erase(uint8_t InZoneIndex);
 
 StSafeA_ResponseCode_t SAFEA1_ECDSA_Sign( uint8_t stsafe_prv_key_slot,
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stddef.h>
 #include <stdbool.h>
 
 #include <logging_levels.h>
@@ -7,6 +8,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
+#include "logging.h"
 
 #include "kvstore.h"
 #if defined(__USE_STSAFE__)
@@ -41,6 +43,12 @@ typedef struct
 
 static STSAFE_KVStoreTLV_t * pxSTSAFE_KVStoreTLV = NULL;
 
+/* Keys changed in RAM and not yet written to the zone, one bit per key */
+static uint32_t ulDirtyKeys = 0;
+
+/* Bytes sent to the zone since boot */
+static uint32_t ulBytesWritten = 0;
+
 static const uint8_t endpoint[]   = DEFAULT_AWS_IOT_ENDPOINT;
 static const uint8_t ssid[]       = DEFAULT_WIFI_SSID;
 static const uint8_t password[]   = DEFAULT_WIFI_PASSWORD;
@@ -48,8 +56,11 @@ static const uint8_t password[]   = DEFAULT_WIFI_PASSWORD;
 static bool pfKvs_read(void);
 static bool pfKvs_write (void);
 static bool pfKvs_setDefault(void);
+static uint32_t pfKvs_crc(void);
 
 _Static_assert(sizeof(STSAFE_KVStoreTLV_t) <= STSAFE_MAX_KVSTORE_SIZE, "STSAFE_KVStoreTLV_t size exceeds STSAFE_MAX_KVSTORE_SIZE");
+_Static_assert(CS_NUM_KEYS <= 32, "ulDirtyKeys holds one bit per key");
+_Static_assert((offsetof(STSAFE_KVStoreTLV_t, crc) % 4) == 0, "The CRC is computed over whole words");
 
 /* Function to initialize the KV store */
 bool pfKvs_init(void)
@@ -111,27 +122,115 @@ bool pfKvs_writeKeyValue(KVStoreKey_t xKey, const uint8_t *value, KVStoreTLVHead
     return false;
   }
 
+  if (xTlvHeader.length > STSAFE_KVSTORE_VAL_MAX_LEN)
+  {
+    return false;
+  }
+
   pxSTSAFE_KVStoreTLV->KVStore[xKey].xTlvHeader.type = xTlvHeader.type; /* Assuming type is the same as the key */
   pxSTSAFE_KVStoreTLV->KVStore[xKey].xTlvHeader.length = xTlvHeader.length;
   memcpy(pxSTSAFE_KVStoreTLV->KVStore[xKey].data, value, pxSTSAFE_KVStoreTLV->KVStore[xKey].xTlvHeader.length);
 
-  /* Update the CRC */
-  __HAL_CRC_DR_RESET(&hcrc);
-  pxSTSAFE_KVStoreTLV->crc = HAL_CRC_Calculate(&hcrc, (uint32_t*) pxSTSAFE_KVStoreTLV, sizeof(STSAFE_KVStoreTLV_t) / 4);
+  ulDirtyKeys |= (1UL << xKey);
 
-  return pfKvs_write();
+#if KV_STORE_STSAFE_WRITE_BACK
+  /* Written to the zone by pfKvs_commit */
+  return true;
+#else
+  return pfKvs_commit();
+#endif
 }
 
-/* Function to write to NVM */
+/* Function to write the changed keys to NVM.
+ * Each run of consecutive changed keys is sent as one range covering the headers and the used part of the values,
+ * the CRC is sent last so that an interrupted commit is detected by pfKvs_read. */
+bool pfKvs_commit(void)
+{
+  bool status = true;
+  uint32_t ulKey = 0;
+
+  if (ulDirtyKeys == 0)
+  {
+    return true;
+  }
+
+  pxSTSAFE_KVStoreTLV->crc = pfKvs_crc();
+
+  while ((ulKey < CS_NUM_KEYS) && (status == true))
+  {
+    if ((ulDirtyKeys & (1UL << ulKey)) == 0)
+    {
+      ulKey++;
+      continue;
+    }
+
+    uint32_t ulStart = offsetof(STSAFE_KVStoreTLV_t, KVStore) + (ulKey * sizeof(KVStoreTLV_t));
+    uint32_t ulEnd = 0;
+
+    while ((ulKey < CS_NUM_KEYS) && ((ulDirtyKeys & (1UL << ulKey)) != 0))
+    {
+      ulEnd = offsetof(STSAFE_KVStoreTLV_t, KVStore) + (ulKey * sizeof(KVStoreTLV_t)) +
+              offsetof(KVStoreTLV_t, data) + pxSTSAFE_KVStoreTLV->KVStore[ulKey].xTlvHeader.length;
+      ulKey++;
+    }
+
+    status = STSAFE1_WriteRange((uint8_t *) pxSTSAFE_KVStoreTLV + ulStart, ulStart, ulEnd - ulStart, STSAFE_KVSTORE_ZONE);
+
+    if (status == true)
+    {
+      ulBytesWritten += ulEnd - ulStart;
+    }
+  }
+
+  if (status == true)
+  {
+    status = STSAFE1_WriteRange((uint8_t *) &pxSTSAFE_KVStoreTLV->crc, offsetof(STSAFE_KVStoreTLV_t, crc), sizeof(uint32_t), STSAFE_KVSTORE_ZONE);
+  }
+
+  if (status == true)
+  {
+    ulBytesWritten += sizeof(uint32_t);
+    ulDirtyKeys = 0;
+  }
+  else
+  {
+    LogError("Failed to write the KVStore to STSAFE zone %d", STSAFE_KVSTORE_ZONE);
+  }
+
+  return status;
+}
+
+uint32_t pfKvs_getBytesWritten(void)
+{
+  return ulBytesWritten;
+}
+
+/* Function to write the whole store to NVM */
 static bool pfKvs_write(void)
 {
   bool status = false;
 
+  pxSTSAFE_KVStoreTLV->crc = pfKvs_crc();
+
   status = STSAFE1_Write((uint8_t *) pxSTSAFE_KVStoreTLV, sizeof(STSAFE_KVStoreTLV_t), STSAFE_KVSTORE_ZONE);
 
+  if (status == true)
+  {
+    ulBytesWritten += sizeof(STSAFE_KVStoreTLV_t);
+    ulDirtyKeys = 0;
+  }
+
   return status;
 }
 
+/* CRC of everything stored before the crc field */
+static uint32_t pfKvs_crc(void)
+{
+  __HAL_CRC_DR_RESET(&hcrc);
+
+  return HAL_CRC_Calculate(&hcrc, (uint32_t*) pxSTSAFE_KVStoreTLV, offsetof(STSAFE_KVStoreTLV_t, crc) / 4);
+}
+
 /* Function to read from VNM */
 static bool pfKvs_read(void)
 {
@@ -140,11 +239,18 @@ static bool pfKvs_read(void)
 
   status = STSAFE1_Read((CK_BYTE_PTR *)&pxSTSAFE_KVStoreTLV, (CK_ULONG_PTR)&data_size, STSAFE_KVSTORE_ZONE);
 
+  if (status && (data_size < sizeof(STSAFE_KVStoreTLV_t)))
+  {
+    /* Written by an older layout, too small to hold the store */
+    vPortFree(pxSTSAFE_KVStoreTLV);
+    pxSTSAFE_KVStoreTLV = NULL;
+    status = false;
+  }
+
   if (status)
   {
     /* Check CRC and Magic number */
-    __HAL_CRC_DR_RESET(&hcrc);
-    uint32_t uwCRCValue = HAL_CRC_Calculate(&hcrc, (uint32_t*) pxSTSAFE_KVStoreTLV, sizeof(STSAFE_KVStoreTLV_t) / 4);
+    uint32_t uwCRCValue = pfKvs_crc();
 
     status = ((pxSTSAFE_KVStoreTLV->magic_number == MAGIC_NUMBER) && (uwCRCValue == pxSTSAFE_KVStoreTLV->crc));
   }
@@ -208,13 +314,13 @@ static bool pfKvs_setDefault(void)
   pxSTSAFE_KVStoreTLV->KVStore[CS_TIME_HWM_S_1970].data[2] = 0;
   pxSTSAFE_KVStoreTLV->KVStore[CS_TIME_HWM_S_1970].data[3] = 0;
 
+  pxSTSAFE_KVStoreTLV->KVStore[CS_LOG_LEVELS].xTlvHeader.type = KV_TYPE_STRING;
+  pxSTSAFE_KVStoreTLV->KVStore[CS_LOG_LEVELS].xTlvHeader.length = 1;
+  pxSTSAFE_KVStoreTLV->KVStore[CS_LOG_LEVELS].data[0] = '\0';
+
   /* Set the magic number */
    pxSTSAFE_KVStoreTLV->magic_number = MAGIC_NUMBER;
 
-  /* Update CRC */
-  __HAL_CRC_DR_RESET(&hcrc);
-  pxSTSAFE_KVStoreTLV->crc = HAL_CRC_Calculate(&hcrc, (uint32_t*) &pxSTSAFE_KVStoreTLV, sizeof(STSAFE_KVStoreTLV_t) / 4);
-
   return pfKvs_write();
 }
 
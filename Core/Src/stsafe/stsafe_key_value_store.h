@@ -35,4 +35,6 @@ bool pfKvs_writeKeyValue(KVStoreKey_t xKey, const uint8_t *value, KVStoreTLVHead
 bool pfKvs_getKeyValue  (KVStoreKey_t xKey,       uint8_t *value, KVStoreTLVHeader_t *pxTlvHeader);
 bool pfKvs_getKeyLength (KVStoreKey_t xKey, KVStoreTLVHeader_t *pxTlvHeader);
 bool pfKvs_init(void);
+bool pfKvs_commit(void);
+uint32_t pfKvs_getBytesWritten(void);
 #endif /* PLATFORM_KVS */
@@ -211,7 +211,11 @@ static inline uint32_t lfs_tobe32( uint32_t a )
     return lfs_frombe32( a );
 }
 
-/* Calculate CRC-32 with polynomial = 0x04c11db7 */
+/* Calculate CRC-32 with polynomial = 0x04c11db7, see lfs_crc.c.
+ * Define LFS_CRC_HW to 1 to use the CRC peripheral for buffers of LFS_CRC_HW_MIN_SIZE bytes or more. */
+#define LFS_CRC_HW             0
+#define LFS_CRC_HW_MIN_SIZE    64
+
 uint32_t lfs_crc( uint32_t crc,
                   const void * buffer,
                   size_t size );
@@ -38,3 +38,15 @@
 
 /* Provided outside of the lfs port */
 lfs_t * pxGetDefaultFsCtx( void );
+
+/* Block device activity since boot, counted by the port read, prog and erase callbacks */
+typedef struct
+{
+    uint32_t ulReads;
+    uint32_t ulReadBytes;
+    uint32_t ulProgs;
+    uint32_t ulProgBytes;
+    uint32_t ulErases;
+} LfsPortStats_t;
+
+void vLfsPortGetStats( LfsPortStats_t * pxStats );
@@ -61,6 +61,9 @@ static int lfs_port_read( const struct lfs_config * c,
                           void * buffer,
                           lfs_size_t size )
 {
+    xLfsPortStats.ulReads++;
+    xLfsPortStats.ulReadBytes += size;
+
     HAL_FLASH_Unlock();
     __HAL_FLASH_CLEAR_FLAG( FLASH_FLAG_ALL_ERRORS );
 
@@ -89,6 +92,9 @@ static int lfs_port_prog( const struct lfs_config * c,
 
     configASSERT( xQueueGetMutexHolder( pxCtx->xMutex ) == xTaskGetCurrentTaskHandle() );
 
+    xLfsPortStats.ulProgs++;
+    xLfsPortStats.ulProgBytes += size;
+
     HAL_FLASH_Unlock();
     __HAL_FLASH_CLEAR_FLAG( FLASH_FLAG_ALL_ERRORS );
 
@@ -119,6 +125,8 @@ static int lfs_port_erase( const struct lfs_config * c,
 
     configASSERT( xQueueGetMutexHolder( pxCtx->xMutex ) == xTaskGetCurrentTaskHandle() );
 
+    xLfsPortStats.ulErases++;
+
 #if defined(STM32H5)
     xErase_Config.TypeErase = FLASH_TYPEERASE_SECTORS;
     xErase_Config.Banks = FLASH_BANK_2;
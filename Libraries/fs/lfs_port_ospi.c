@@ -203,6 +203,9 @@ static int lfs_port_read( const struct lfs_config * c,
 
     int32_t lReturnValue = 0;
 
+    xLfsPortStats.ulReads++;
+    xLfsPortStats.ulReadBytes += size;
+
     uint32_t ulReadAddr = OPI_START_ADDRESS + ( block * c->block_size ) + off;
 
     if( ospi_ReadAddr( pxCtx->xpOSPIHandle,
@@ -238,6 +241,9 @@ static int lfs_port_prog( const struct lfs_config * pxCfg,
 
     configASSERT( ( size % MX25LM_PROGRAM_FIFO_LEN ) == 0 );
 
+    xLfsPortStats.ulProgs++;
+    xLfsPortStats.ulProgBytes += size;
+
     /* Determine the 4-byte write address */
     uint32_t ulStartAddr = OPI_START_ADDRESS + ( block * pxCfg->block_size ) + off;
 
@@ -273,6 +279,8 @@ static int lfs_port_erase( const struct lfs_config * pxCfg,
     int32_t lReturnValue = 0;
     struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) pxCfg->context;
 
+    xLfsPortStats.ulErases++;
+
     /* Determine the 4-byte erase address */
     uint32_t ulEraseAddr = OPI_START_ADDRESS + ( block * pxCfg->block_size );
 
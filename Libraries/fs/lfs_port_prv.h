@@ -29,6 +29,7 @@
 #include "semphr.h"
 
 #include "lfs.h"
+#include "lfs_port.h"
 
 #include "main.h"
 
@@ -41,6 +42,8 @@ struct LfsPortCtx
 #endif
 };
 
+extern LfsPortStats_t xLfsPortStats;
+
 int lfs_port_lock( const struct lfs_config * c );
 
 int lfs_port_unlock( const struct lfs_config * c );
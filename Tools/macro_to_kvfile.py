@@ -26,8 +26,12 @@
 
 import ast
 import operator as op
+import re
 from argparse import ArgumentParser
 
+FNV_PRIME = 16777619
+FNV_OFFSET_BASIS = 2166136261
+
 
 class MacroParser(object):
     # supported operators for our safe parser
@@ -94,11 +98,75 @@ def cleanup_lines(lines, prefix):
     return lines_out
 
 
+def key_names(text):
+    """Return the names in every KV_STORE_*STRING* macro, so that the hash covers all build variants"""
+    text = re.sub(r"\\\s*\n", " ", text)
+    names = []
+    for match in re.finditer(r"^\s*#\s*define\s+KV_STORE_\w*STRING\w*\b(.*)$", text, re.M):
+        for name in re.findall(r'"([^"]*)"', match.group(1)):
+            if name not in names:
+                names.append(name)
+    return names
+
+
+def key_hash(name, seed, slots):
+    """FNV-1a seeded with the given value, must match prvKeyHash in kvstore.c.
+    The slot comes from the high bits, the low bits of FNV-1a only depend on the parity of the bytes."""
+    value = seed
+    for byte in name.encode():
+        value = ((value ^ byte) * FNV_PRIME) & 0xFFFFFFFF
+    return (value * slots) >> 32
+
+
+def find_seed(names):
+    """Search for a seed that maps each name to its own slot, with one slot per name"""
+    slots = len(names)
+    for seed in range(FNV_OFFSET_BASIS, FNV_OFFSET_BASIS + 0x1000000):
+        if len({key_hash(name, seed, slots) for name in names}) == slots:
+            return seed
+    raise ValueError("No perfect hash seed found for {} keys".format(slots))
+
+
+def write_key_hash(output_file, input_files):
+    names = []
+    for file_name in input_files:
+        with open(file_name, "r") as f:
+            for name in key_names(f.read()):
+                if name not in names:
+                    names.append(name)
+
+    if not names:
+        raise ValueError("No KV_STORE_STRINGS found in the input files")
+
+    seed = find_seed(names)
+
+    with open(output_file, "w", newline="\r\n") as f:
+        f.write("/* Generated by Tools/macro_to_kvfile.py --key-hash from kvstore_config.h, do not edit. */\n")
+        f.write("\n")
+        f.write("#ifndef _KVSTORE_KEY_HASH_H\n")
+        f.write("#define _KVSTORE_KEY_HASH_H\n")
+        f.write("\n")
+        f.write("/* Minimal perfect hash of the key names:\n")
+        for name in names:
+            f.write(" *   {:<20} slot {}\n".format(name, key_hash(name, seed, len(names))))
+        f.write(" */\n")
+        f.write("#define KV_STORE_HASH_SEED     0x{:08X}UL\n".format(seed))
+        f.write("#define KV_STORE_HASH_SLOTS    {}\n".format(len(names)))
+        f.write("\n")
+        f.write("#endif /* _KVSTORE_KEY_HASH_H */\n")
+
+
 def main():
     argparser = ArgumentParser()
     argparser.add_argument(
         "--prefix", "-p", help="Prefix for each valid macro.", default="RE_"
     )
+    argparser.add_argument(
+        "--key-hash",
+        action="store_true",
+        help="Write a C header with a perfect hash of the KV_STORE_STRINGS key names "
+        "found in the input files instead of key=value pairs.",
+    )
     argparser.add_argument(
         "output_file", help="Output file to store key=value pairs in."
     )
@@ -111,6 +179,10 @@ def main():
     output_file = args.output_file
     prefix = args.prefix
 
+    if args.key_hash:
+        write_key_hash(output_file, input_files)
+        return
+
     output_dict = dict()
 
     for file_name in input_files: